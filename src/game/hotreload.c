@@ -5,72 +5,223 @@
 
 #include "hotreload.h"
 #include "plugin-interface.h"
+#include "resources.h"
+
+#include "util/clock.h"
+#include "util/watch.h"
 
 #ifdef linux
 
 #include <dlfcn.h>
-#define PLUG_PATH "bin/libplug.so"
+#include <unistd.h>
+#define PLUG_DIR "bin"
+#define PLUG_NAME "libplug.so"
+#define PLUG_COPY_FMT "/tmp/libplug-%d-%u.so"
 
 #elif (defined(_WIN32) || defined(WIN32))
 
 #include <windows.h>
-#define PLUG_PATH "bin/libplug.dll"
+#include <process.h>
+#define PLUG_DIR "bin"
+#define PLUG_NAME "libplug.dll"
+#define PLUG_COPY_FMT "bin/libplug-%d-%u.dll"
 
 #define dlopen(filename, flags) (void *)LoadLibrary(filename)
 #define dlclose(handle) !FreeLibrary(handle)
 #define dlerror() "Failed to load DLL. Path: " PLUG_PATH
 #define dlsym(handle, symbol) (void *)GetProcAddress(handle, symbol)
+#define getpid _getpid
 
 #endif
 
+#define PLUG_PATH PLUG_DIR "/" PLUG_NAME
+#define PLUG_COPY_MAX 256
+
+// A new build is loaded once it has not changed for this long, so the
+// linker is done with it
+#define HOTRELOAD_SETTLE_MS 100
+
 #ifdef HOT_RELOAD
 
 #define X(name, ret, ...) ret (*name)(__VA_ARGS__) = nullptr;
 PLUGIN_FUNCTIONS();
+#undef X
 
-#endif
+struct hotreload_Functions {
+#define X(name, ret, ...) ret (*name)(__VA_ARGS__);
+  PLUGIN_FUNCTIONS()
+#undef X
+};
 
 static void *plug = nullptr;
 
-void hotreload_load_plug(void) {
-#ifdef HOT_RELOAD
-  if (plug) {
-    if (dlclose(plug) != 0) {
-      fprintf(stderr, "%s\n", dlerror());
-      exit(EXIT_FAILURE);
-    }
+// The copy of PLUG_PATH plug was loaded from
+static char plug_copy[PLUG_COPY_MAX];
+static uint32_t plug_generation = 0;
+
+static struct watch_Watcher plug_watcher;
+
+// When PLUG_PATH last changed, 0 if it has not since the last load
+static uint64_t plug_changed_at = 0;
+
+// Copies PLUG_PATH to a new path and loads that, so the build can replace
+// PLUG_PATH while it is loaded, and dlopen never hands back the old one.
+static void *hotreload_open(char *copy, size_t size) {
+  snprintf(copy, size, PLUG_COPY_FMT, (int)getpid(), plug_generation++);
+
+  FILE *src = fopen(PLUG_PATH, "rb");
+  FILE *dst = src != NULL ? fopen(copy, "wb") : NULL;
+
+  bool copied = dst != NULL;
+  char buffer[1 << 16];
+  size_t n;
+
+  while (copied && (n = fread(buffer, 1, sizeof(buffer), src)) > 0) {
+    copied = fwrite(buffer, 1, n, dst) == n;
   }
+  copied = copied && !ferror(src);
 
-  plug = dlopen(PLUG_PATH, RTLD_NOW);
-  if (!plug) {
-    fprintf(stderr, "%s\n", dlerror());
-    exit(EXIT_FAILURE);
+  if (src != NULL) {
+    fclose(src);
+  }
+  if (dst != NULL && fclose(dst) != 0) {
+    copied = false;
   }
 
-  plug_init = dlsym(plug, "plug_init");
-  if (!plug_init) {
-    fprintf(stderr, "%s\n", dlerror());
-    exit(EXIT_FAILURE);
+  if (!copied) {
+    fprintf(stderr, "[ERROR]: Failed to copy %s to %s\n", PLUG_PATH, copy);
+    remove(copy);
+    return nullptr;
   }
 
-  plug_pre_reload = dlsym(plug, "plug_pre_reload");
-  if (!plug_pre_reload) {
+  void *handle = dlopen(copy, RTLD_NOW);
+  if (handle == nullptr) {
     fprintf(stderr, "%s\n", dlerror());
+    remove(copy);
+  }
+
+  return handle;
+}
+
+static bool hotreload_bind(void *handle, struct hotreload_Functions *fns) {
+#define X(name, ret, ...)                      \
+  fns->name = dlsym(handle, #name);            \
+  if (fns->name == nullptr) {                  \
+    fprintf(stderr, "%s\n", dlerror());        \
+    return false;                              \
+  }
+  PLUGIN_FUNCTIONS()
+#undef X
+
+  return true;
+}
+
+static void hotreload_use(void *handle, const char *copy,
+                          const struct hotreload_Functions *fns) {
+  plug = handle;
+  snprintf(plug_copy, sizeof(plug_copy), "%s", copy);
+
+#define X(name, ret, ...) name = fns->name;
+  PLUGIN_FUNCTIONS()
+#undef X
+}
+
+#endif
+
+void hotreload_load_plug(void) {
+#ifdef HOT_RELOAD
+  assert(plug == nullptr && "Plugin already loaded");
+
+  char copy[PLUG_COPY_MAX];
+  void *handle = hotreload_open(copy, sizeof(copy));
+  if (handle == nullptr) {
     exit(EXIT_FAILURE);
   }
 
-  plug_post_reload = dlsym(plug, "plug_post_reload");
-  if (!plug_post_reload) {
-    fprintf(stderr, "%s\n", dlerror());
+  struct hotreload_Functions fns;
+  if (!hotreload_bind(handle, &fns)) {
     exit(EXIT_FAILURE);
   }
 
-  plug_update = dlsym(plug, "plug_update");
-  if (!plug_update) {
+  hotreload_use(handle, copy, &fns);
+
+  if (!watch_init(&plug_watcher) || !watch_add_dir(&plug_watcher, PLUG_DIR)) {
+    fprintf(stderr, "[WARNING]: Not watching %s, reload with Ctrl+R\n",
+            PLUG_PATH);
+  }
+#endif
+}
+
+bool hotreload_poll(void) {
+#ifdef HOT_RELOAD
+  char path[WATCH_PATH_MAX];
+  uint64_t now = clk_now_ns();
+
+  while (watch_next(&plug_watcher, path, sizeof(path))) {
+    if (strcmp(path, PLUG_PATH) == 0) {
+      plug_changed_at = now;
+    }
+  }
+
+  return plug_changed_at != 0 &&
+         clk_ns_to_ms(now - plug_changed_at) >= HOTRELOAD_SETTLE_MS;
+#else
+  return false;
+#endif
+}
+
+void hotreload_reload(void) {
+#ifdef HOT_RELOAD
+  uint64_t start = clk_now_ns();
+  plug_changed_at = 0;
+
+  // The new plugin is loaded next to the old one, which keeps running if
+  // it is broken
+  char copy[PLUG_COPY_MAX];
+  void *handle = hotreload_open(copy, sizeof(copy));
+  if (handle == nullptr) {
+    return;
+  }
+
+  struct hotreload_Functions fns;
+  if (!hotreload_bind(handle, &fns)) {
+    dlclose(handle);
+    remove(copy);
+    return;
+  }
+
+  struct plug_StateLayout prev = plug_state_layout();
+  struct plug_StateLayout next = fns.plug_state_layout();
+  bool compatible = prev.version == next.version && prev.size == next.size;
+
+  void *state = plug_pre_reload();
+  if (!compatible) {
+    plug_shutdown(state);
+  }
+
+  if (dlclose(plug) != 0) {
     fprintf(stderr, "%s\n", dlerror());
-    exit(EXIT_FAILURE);
   }
+  remove(plug_copy);
+
+  hotreload_use(handle, copy, &fns);
+
+  if (compatible) {
+    plug_post_reload(state);
+  } else {
+    plug_init(&res_host);
+  }
+  res_collect();
 
+  double ms = clk_ns_to_ms(clk_now_ns() - start);
+
+  if (compatible) {
+    printf("[INFO]: Reloaded %s in %.2f ms\n", PLUG_PATH, ms);
+  } else {
+    printf("[INFO]: Reloaded %s in %.2f ms, state rebuilt: layout changed "
+           "from v%u, %u bytes to v%u, %u bytes\n",
+           PLUG_PATH, ms, prev.version, prev.size, next.version, next.size);
+  }
 #endif
 }
 
@@ -81,5 +232,10 @@ void hotreload_cleanup(void) {
     fprintf(stderr, "%s\n", dlerror());
     exit(EXIT_FAILURE);
   }
+
+  remove(plug_copy);
+  plug = nullptr;
+
+  watch_free(&plug_watcher);
 #endif
 }
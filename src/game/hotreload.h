@@ -1,7 +1,19 @@
 #ifndef HOT_RELOAD_H
 #define HOT_RELOAD_H
 
+#include <stdbool.h>
+
 void hotreload_load_plug(void);
+
+// True once a new build of the plugin has been written and left alone for
+// a moment.
+bool hotreload_poll(void);
+
+// Swaps in the current build of the plugin, handing the state over if its
+// layout did not change and starting over otherwise. Keeps the loaded
+// plugin if the new one does not load. Call between frames.
+void hotreload_reload(void);
+
 void hotreload_cleanup(void);
 
 #endif // HOT_RELOAD_H
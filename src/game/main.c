@@ -1,6 +1,7 @@
 #include "raylib/src/raylib.h"
 #include "plugin-interface.h"
 #include "hotreload.h"
+#include "resources.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,7 +22,7 @@ int main(void) {
   InitWindow(WIDTH * FACTOR, HEIGHT * FACTOR, "Game");
   MaximizeWindow();
   hotreload_load_plug();
-  plug_init();
+  plug_init(&res_host);
   SetTargetFPS(60);
 
 #ifdef PLATFORM_WEB
@@ -35,14 +36,16 @@ int main(void) {
     plug_update();
 
 #ifdef HOT_RELOAD
-    if (IsKeyDown(KEY_LEFT_CONTROL) && IsKeyDown(KEY_R)) {
-      void *state = plug_pre_reload();
-      hotreload_load_plug();
-      plug_post_reload(state);
+    // Between frames, so no frame is drawn by two plugins
+    if (hotreload_poll() ||
+        (IsKeyDown(KEY_LEFT_CONTROL) && IsKeyPressed(KEY_R))) {
+      hotreload_reload();
     }
 #endif
   }
 
+  hotreload_cleanup();
+
 #endif
 
   CloseWindow();
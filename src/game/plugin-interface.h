@@ -8,10 +8,83 @@
 
 //typedef void (*plug_glfw_window_callback)(enum plug_callback_mode, ...);
 
-#define PLUGIN_FUNCTIONS()          \
-  X(plug_init, void, void)          \
-  X(plug_pre_reload, void *, void)  \
-  X(plug_post_reload, void, void *) \
+#include "raylib/src/raylib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PLUG_RESOURCE_KEY_MAX 128
+
+enum plug_ResourceKind {
+  PLUG_RESOURCE_TEXTURE,
+  PLUG_RESOURCE_IMAGE,
+  PLUG_RESOURCE_DATA,
+};
+
+// A resource owned by the host. The host frees it according to its kind,
+// never with plugin code, so it outlives the plugin that made it.
+struct plug_Resource {
+  char key[PLUG_RESOURCE_KEY_MAX];
+  enum plug_ResourceKind kind;
+  uint32_t refs;
+
+  union {
+    Texture2D texture;
+
+    // If map != NULL, image.data points into a private mapping of map_size
+    // bytes, otherwise raylib owns it
+    struct {
+      Image image;
+      void *map;
+      size_t map_size;
+    } image;
+
+    // malloc'd
+    struct {
+      void *data;
+      size_t size;
+    } data;
+  };
+};
+
+// Resource registry of the host, keyed by name and refcounted. Resources
+// nothing references are kept until the host collects them after a reload,
+// so a plugin that releases everything before it is unloaded finds it all
+// again when it is loaded back.
+struct plug_Host {
+  // Takes a reference to the resource called key. Returns NULL if there is
+  // none.
+  struct plug_Resource *(*acquire)(const char *key);
+
+  // Hands value over to the host as key, with one reference. Returns NULL,
+  // leaving value to the caller, if key is taken.
+  struct plug_Resource *(*insert)(const char *key,
+                                  const struct plug_Resource *value);
+
+  void (*release)(struct plug_Resource *resource);
+
+  // Makes the next acquire of key miss. The resource itself is freed once
+  // nothing references it.
+  void (*evict)(const char *key);
+};
+
+// What the plugin's state looks like. A reload only hands the state over
+// if the new plugin's layout is the same.
+struct plug_StateLayout {
+  uint32_t version;
+  uint32_t size;
+};
+
+// plug_pre_reload releases the host's resources and returns the state.
+// Then either plug_post_reload of the next plugin takes the state over, or,
+// if the layouts differ, plug_shutdown frees it and the next plugin starts
+// over with plug_init.
+#define PLUGIN_FUNCTIONS()                                    \
+  X(plug_init, void, const struct plug_Host *)                \
+  X(plug_pre_reload, void *, void)                            \
+  X(plug_post_reload, void, void *)                           \
+  X(plug_shutdown, void, void *)                              \
+  X(plug_state_layout, struct plug_StateLayout, void)         \
   X(plug_update, void, void)
 
 #ifdef HOT_RELOAD
@@ -0,0 +1,149 @@
+#include "resources.h"
+#include "plugin-interface.h"
+
+#include "util/dynamic_array.h"
+
+#include "raylib/src/raylib.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sys/mman.h>
+
+struct res_Entry {
+  struct plug_Resource resource;
+
+  // Evicted entries are only waiting for their last reference to go
+  bool evicted;
+};
+
+// Entries are allocated one by one, so the resources handed out never move
+static DA_TYPE(struct res_Entry *) res_entries = { 0 };
+
+static void res_free(struct res_Entry *entry) {
+  struct plug_Resource *resource = &entry->resource;
+
+  switch (resource->kind) {
+  case PLUG_RESOURCE_TEXTURE:
+    UnloadTexture(resource->texture);
+    break;
+  case PLUG_RESOURCE_IMAGE:
+    if (resource->image.map != NULL) {
+      munmap(resource->image.map, resource->image.map_size);
+    } else {
+      UnloadImage(resource->image.image);
+    }
+    break;
+  case PLUG_RESOURCE_DATA:
+    free(resource->data.data);
+    break;
+  }
+
+  free(entry);
+}
+
+static void res_remove(uint64_t index) {
+  res_free(res_entries.items[index]);
+
+  res_entries.items[index] = res_entries.items[res_entries.count - 1];
+  res_entries.count--;
+}
+
+static struct res_Entry *res_find(const char *key) {
+  for (uint64_t i = 0; i < res_entries.count; i++) {
+    struct res_Entry *entry = res_entries.items[i];
+
+    if (!entry->evicted && strcmp(entry->resource.key, key) == 0) {
+      return entry;
+    }
+  }
+
+  return nullptr;
+}
+
+static struct plug_Resource *res_acquire(const char *key) {
+  struct res_Entry *entry = res_find(key);
+  if (entry == nullptr) {
+    return nullptr;
+  }
+
+  entry->resource.refs++;
+  return &entry->resource;
+}
+
+static struct plug_Resource *res_insert(const char *key,
+                                        const struct plug_Resource *value) {
+  if (strlen(key) >= PLUG_RESOURCE_KEY_MAX) {
+    fprintf(stderr, "[ERROR]: Resource key too long: %s\n", key);
+    return nullptr;
+  }
+
+  if (res_find(key) != nullptr) {
+    return nullptr;
+  }
+
+  struct res_Entry *entry = malloc(sizeof(*entry));
+  assert(entry != NULL && "Failed to allocate memory");
+
+  *entry = (struct res_Entry){ .resource = *value };
+  strcpy(entry->resource.key, key);
+  entry->resource.refs = 1;
+
+  DA_APPEND(&res_entries, entry);
+
+  return &entry->resource;
+}
+
+static void res_release(struct plug_Resource *resource) {
+  assert(resource->refs > 0 && "Resource released too many times");
+  resource->refs--;
+
+  if (resource->refs > 0) {
+    return;
+  }
+
+  for (uint64_t i = 0; i < res_entries.count; i++) {
+    if (&res_entries.items[i]->resource == resource) {
+      if (res_entries.items[i]->evicted) {
+        res_remove(i);
+      }
+      return;
+    }
+  }
+}
+
+static void res_evict(const char *key) {
+  for (uint64_t i = 0; i < res_entries.count; i++) {
+    struct res_Entry *entry = res_entries.items[i];
+
+    if (entry->evicted || strcmp(entry->resource.key, key) != 0) {
+      continue;
+    }
+
+    if (entry->resource.refs == 0) {
+      res_remove(i);
+    } else {
+      entry->evicted = true;
+    }
+    return;
+  }
+}
+
+void res_collect(void) {
+  for (uint64_t i = 0; i < res_entries.count;) {
+    if (res_entries.items[i]->resource.refs == 0) {
+      res_remove(i);
+    } else {
+      i++;
+    }
+  }
+}
+
+const struct plug_Host res_host = {
+  .acquire = res_acquire,
+  .insert = res_insert,
+  .release = res_release,
+  .evict = res_evict,
+};
@@ -0,0 +1,13 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include "plugin-interface.h"
+
+// The registry handed to the plugin
+extern const struct plug_Host res_host;
+
+// Frees every resource nothing references. Called after a reload, once the
+// new plugin has taken back what it still uses.
+void res_collect(void);
+
+#endif // RESOURCES_H
@@ -0,0 +1,2 @@
+#define UTIL_ALLOC_IMPLEMENTATION
+#include "util/alloc.h"
@@ -0,0 +1,644 @@
+#include "atlas-pack.h"
+#include "image-cache.h"
+#include "plugin.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#define PACK_CACHE_FILE "atlas.pack"
+#define PACK_PATH_MAX 512
+#define PACK_IMAGES_DIR "images"
+
+static const char pack_magic[4] = { 'P', 'A', 'C', 'K' };
+
+struct pack_CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t page_count;
+  uint32_t source_count;
+  uint32_t entry_count;
+};
+
+// A rectangle of a source image waiting to be placed
+struct pack_Item {
+  char name[PACK_NAME_MAX];
+
+  uint32_t image;
+  uint32_t x, y;
+  uint32_t width, height;
+};
+
+typedef DA_TYPE(struct pack_Item) pack_ItemArray;
+
+// ---------------------- SKYLINE ----------------------
+
+void pack_skyline_init(struct pack_Skyline *skyline, uint32_t width,
+                       uint32_t height) {
+  *skyline = (struct pack_Skyline){ .width = width, .height = height };
+
+  struct pack_SkylineNode floor = { .x = 0, .y = 0, .width = width };
+  DA_APPEND(&skyline->nodes, floor);
+}
+
+void pack_skyline_free(struct pack_Skyline *skyline) {
+  DA_FREE(&skyline->nodes);
+}
+
+// Lowest y a width wide rectangle can sit at when its left edge is at node
+// i. Returns UINT32_MAX if it would stick out of the page.
+static uint32_t pack_skyline_fit(const struct pack_Skyline *skyline,
+                                 uint64_t i, uint32_t width, uint32_t height) {
+  const struct pack_SkylineNode *nodes = skyline->nodes.items;
+
+  if (nodes[i].x + width > skyline->width) {
+    return UINT32_MAX;
+  }
+
+  uint32_t y = 0;
+  uint32_t remaining = width;
+
+  for (uint64_t j = i; remaining > 0; j++) {
+    y = nodes[j].y > y ? nodes[j].y : y;
+    if (y + height > skyline->height) {
+      return UINT32_MAX;
+    }
+
+    remaining = nodes[j].width >= remaining ? 0 : remaining - nodes[j].width;
+  }
+
+  return y;
+}
+
+bool pack_skyline_insert(struct pack_Skyline *skyline, uint32_t width,
+                         uint32_t height, uint32_t *x, uint32_t *y) {
+  uint64_t best = UINT64_MAX;
+  uint32_t best_y = UINT32_MAX;
+
+  for (uint64_t i = 0; i < skyline->nodes.count; i++) {
+    uint32_t fit = pack_skyline_fit(skyline, i, width, height);
+
+    if (fit < best_y) {
+      best = i;
+      best_y = fit;
+    }
+  }
+
+  if (best == UINT64_MAX) {
+    return false;
+  }
+
+  struct pack_SkylineNode node = {
+    .x = skyline->nodes.items[best].x,
+    .y = best_y + height,
+    .width = width,
+  };
+
+  *x = node.x;
+  *y = best_y;
+
+  DA_APPEND_NO_ASSIGN(&skyline->nodes);
+  struct pack_SkylineNode *nodes = skyline->nodes.items;
+
+  memmove(&nodes[best + 1], &nodes[best],
+          (skyline->nodes.count - best - 1) * sizeof(*nodes));
+  nodes[best] = node;
+
+  // Cut the nodes the new one now covers
+  uint32_t right = node.x + node.width;
+  while (best + 1 < skyline->nodes.count && nodes[best + 1].x < right) {
+    struct pack_SkylineNode *next = &nodes[best + 1];
+    uint32_t overlap = right - next->x;
+
+    if (next->width > overlap) {
+      next->x += overlap;
+      next->width -= overlap;
+      break;
+    }
+
+    memmove(next, next + 1,
+            (skyline->nodes.count - best - 2) * sizeof(*nodes));
+    skyline->nodes.count--;
+  }
+
+  // Merge neighbours at the same height
+  for (uint64_t i = 0; i + 1 < skyline->nodes.count;) {
+    if (nodes[i].y != nodes[i + 1].y) {
+      i++;
+      continue;
+    }
+
+    nodes[i].width += nodes[i + 1].width;
+    memmove(&nodes[i + 1], &nodes[i + 2],
+            (skyline->nodes.count - i - 2) * sizeof(*nodes));
+    skyline->nodes.count--;
+  }
+
+  return true;
+}
+
+// ---------------------- PACKING ----------------------
+
+static int pack_compare_paths(const void *a, const void *b) {
+  return strcmp(GetFileName(*(char *const *)a), GetFileName(*(char *const *)b));
+}
+
+static int pack_compare_entries(const void *a, const void *b) {
+  return strcmp(((const struct pack_Entry *)a)->name,
+                ((const struct pack_Entry *)b)->name);
+}
+
+// Tallest first, then widest, then by name so packing is deterministic
+static int pack_compare_items(const void *a, const void *b) {
+  const struct pack_Item *ia = a, *ib = b;
+
+  if (ia->height != ib->height) {
+    return ia->height > ib->height ? -1 : 1;
+  }
+
+  if (ia->width != ib->width) {
+    return ia->width > ib->width ? -1 : 1;
+  }
+
+  return strcmp(ia->name, ib->name);
+}
+
+// The PNGs directly inside assets_dir, sorted by file name
+static FilePathList pack_list_sources(const char *assets_dir) {
+  FilePathList files = LoadDirectoryFilesEx(assets_dir, ".png", false);
+  qsort(files.paths, files.count, sizeof(*files.paths), pack_compare_paths);
+
+  return files;
+}
+
+static bool pack_hash_file(const char *path, struct pack_Source *source,
+                           unsigned char **data, int *size) {
+  if (snprintf(source->name, sizeof(source->name), "%s", GetFileName(path)) >=
+      (int)sizeof(source->name)) {
+    fprintf(stderr, "[ERROR]: Asset name too long: %s\n", path);
+    return false;
+  }
+
+  *data = LoadFileData(path, size);
+  if (*data == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to read %s\n", path);
+    return false;
+  }
+
+  source->hash = imgc_hash(*data, (uint64_t)*size);
+
+  return true;
+}
+
+static bool pack_is_transparent(Image image, uint32_t x, uint32_t y,
+                                uint32_t width, uint32_t height) {
+  const Color *pixels = image.data;
+
+  for (uint32_t py = y; py < y + height; py++) {
+    for (uint32_t px = x; px < x + width; px++) {
+      if (pixels[(size_t)py * image.width + px].a != 0) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Appends the sprites of image to items.
+static bool pack_add_items(pack_ItemArray *items, const char *path,
+                           Image image, uint32_t index) {
+  char base[PACK_NAME_MAX];
+  snprintf(base, sizeof(base), "%s", GetFileNameWithoutExt(path));
+
+  size_t name_len = strlen(GetFileName(path));
+  size_t suffix_len = strlen(PACK_GRID_SHEET_SUFFIX);
+  bool sheet = name_len >= suffix_len &&
+               strcmp(GetFileName(path) + name_len - suffix_len,
+                      PACK_GRID_SHEET_SUFFIX) == 0;
+
+  if (!sheet) {
+    struct pack_Item item = {
+      .image = index,
+      .width = (uint32_t)image.width,
+      .height = (uint32_t)image.height,
+    };
+    snprintf(item.name, sizeof(item.name), "%s", base);
+
+    DA_APPEND(items, item);
+    return true;
+  }
+
+  for (uint32_t ty = 0; ty < (uint32_t)image.height / ATLAS_GRID_SIZE; ty++) {
+    for (uint32_t tx = 0; tx < (uint32_t)image.width / ATLAS_GRID_SIZE;
+         tx++) {
+      struct pack_Item item = {
+        .image = index,
+        .x = tx * ATLAS_GRID_SIZE,
+        .y = ty * ATLAS_GRID_SIZE,
+        .width = ATLAS_GRID_SIZE,
+        .height = ATLAS_GRID_SIZE,
+      };
+
+      if (pack_is_transparent(image, item.x, item.y, item.width,
+                              item.height)) {
+        continue;
+      }
+
+      if (snprintf(item.name, sizeof(item.name), "%s/%u_%u", base, tx, ty) >=
+          (int)sizeof(item.name)) {
+        fprintf(stderr, "[ERROR]: Sprite name too long: %s\n", path);
+        return false;
+      }
+
+      DA_APPEND(items, item);
+    }
+  }
+
+  return true;
+}
+
+static Image pack_new_page(uint32_t page_size) {
+  Image page = {
+    .width = (int)page_size,
+    .height = (int)page_size,
+    .mipmaps = 1,
+    .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+  };
+
+  // Padding stays transparent
+  page.data = calloc((size_t)page_size * page_size, sizeof(Color));
+  assert(page.data != NULL && "Failed to allocate memory");
+
+  return page;
+}
+
+static void pack_blit(Image dst, uint32_t dst_x, uint32_t dst_y, Image src,
+                      uint32_t src_x, uint32_t src_y, uint32_t width,
+                      uint32_t height) {
+  for (uint32_t y = 0; y < height; y++) {
+    memcpy((Color *)dst.data + (size_t)(dst_y + y) * dst.width + dst_x,
+           (const Color *)src.data + (size_t)(src_y + y) * src.width + src_x,
+           width * sizeof(Color));
+  }
+}
+
+bool pack_atlas_build(const char *assets_dir, uint32_t page_size,
+                      const char *image_cache_dir, struct pack_Atlas *atlas) {
+  *atlas = (struct pack_Atlas){ .page_size = page_size };
+
+  FilePathList files = pack_list_sources(assets_dir);
+  DA_TYPE(struct imgc_Image) images = { 0 };
+  pack_ItemArray items = { 0 };
+  DA_TYPE(struct pack_Skyline) skylines = { 0 };
+
+  bool ok = true;
+
+  for (uint32_t i = 0; ok && i < files.count; i++) {
+    struct pack_Source source = { 0 };
+    unsigned char *data = NULL;
+    int size = 0;
+
+    ok = pack_hash_file(files.paths[i], &source, &data, &size);
+    if (!ok) {
+      break;
+    }
+
+    struct imgc_Image image;
+    ok = imgc_load_memory(".png", data, size, source.hash, image_cache_dir, 0,
+                          &image, NULL);
+    UnloadFileData(data);
+
+    if (!ok) {
+      fprintf(stderr, "[ERROR]: Failed to decode %s\n", files.paths[i]);
+      break;
+    }
+
+    DA_APPEND(&atlas->sources, source);
+    DA_APPEND(&images, image);
+    ok = pack_add_items(&items, files.paths[i], image.image,
+                        (uint32_t)images.count - 1);
+  }
+
+  if (ok) {
+    qsort(items.items, items.count, sizeof(*items.items), pack_compare_items);
+  }
+
+  for (uint64_t i = 0; ok && i < items.count; i++) {
+    const struct pack_Item *item = &items.items[i];
+
+    uint32_t x = 0, y = 0;
+    uint64_t page = 0;
+
+    while (page < skylines.count &&
+           !pack_skyline_insert(&skylines.items[page],
+                                item->width + PACK_PADDING,
+                                item->height + PACK_PADDING, &x, &y)) {
+      page++;
+    }
+
+    if (page == skylines.count) {
+      struct pack_Skyline skyline;
+      pack_skyline_init(&skyline, page_size, page_size);
+      DA_APPEND(&skylines, skyline);
+      DA_APPEND(&atlas->page_storage,
+                (struct imgc_Image){ .image = pack_new_page(page_size) });
+      DA_APPEND(&atlas->pages, atlas->page_storage.items[page].image);
+
+      if (!pack_skyline_insert(&skylines.items[page],
+                               item->width + PACK_PADDING,
+                               item->height + PACK_PADDING, &x, &y)) {
+        fprintf(stderr, "[ERROR]: %s does not fit on a %u px page\n",
+                item->name, page_size);
+        ok = false;
+        break;
+      }
+    }
+
+    pack_blit(atlas->pages.items[page], x, y, images.items[item->image].image,
+              item->x, item->y, item->width, item->height);
+
+    struct pack_Entry entry = {
+      .page = (uint32_t)page,
+      .x = x,
+      .y = y,
+      .width = item->width,
+      .height = item->height,
+    };
+    memcpy(entry.name, item->name, sizeof(entry.name));
+
+    DA_APPEND(&atlas->entries, entry);
+  }
+
+  qsort(atlas->entries.items, atlas->entries.count,
+        sizeof(*atlas->entries.items), pack_compare_entries);
+
+  for (uint64_t i = 0; i < images.count; i++) {
+    imgc_unload(&images.items[i]);
+  }
+
+  for (uint64_t i = 0; i < skylines.count; i++) {
+    pack_skyline_free(&skylines.items[i]);
+  }
+
+  DA_FREE(&images);
+  DA_FREE(&items);
+  DA_FREE(&skylines);
+  UnloadDirectoryFiles(files);
+
+  if (!ok) {
+    pack_atlas_free(atlas);
+  }
+
+  return ok;
+}
+
+// ---------------------- CACHE ----------------------
+
+static void pack_page_path(char *path, size_t size, const char *cache_dir,
+                           uint32_t page) {
+  snprintf(path, size, "%s/atlas-%u.rgba", cache_dir, page);
+}
+
+// What the pages of an atlas packed from sources are tagged with
+static uint64_t pack_sources_hash(const struct pack_Source *sources,
+                                  uint64_t count) {
+  return imgc_hash(sources, count * sizeof(*sources));
+}
+
+bool pack_atlas_save(const struct pack_Atlas *atlas, const char *cache_dir) {
+  if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "[ERROR]: Failed to create %s: %s\n", cache_dir,
+            strerror(errno));
+    return false;
+  }
+
+  char path[PACK_PATH_MAX];
+  uint64_t hash = pack_sources_hash(atlas->sources.items,
+                                    atlas->sources.count);
+
+  // Pages first, so a cache file never points at missing pages
+  for (uint32_t page = 0; page < atlas->pages.count; page++) {
+    pack_page_path(path, sizeof(path), cache_dir, page);
+
+    if (!imgc_write(path, atlas->pages.items[page], hash, 0)) {
+      return false;
+    }
+  }
+
+  snprintf(path, sizeof(path), "%s/" PACK_CACHE_FILE, cache_dir);
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  struct pack_CacheHeader header = {
+    .version = PACK_CACHE_VERSION,
+    .page_size = atlas->page_size,
+    .page_count = (uint32_t)atlas->pages.count,
+    .source_count = (uint32_t)atlas->sources.count,
+    .entry_count = (uint32_t)atlas->entries.count,
+  };
+  memcpy(header.magic, pack_magic, sizeof(header.magic));
+
+  bool ok =
+    fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(atlas->sources.items, sizeof(*atlas->sources.items),
+           atlas->sources.count, f) == atlas->sources.count &&
+    fwrite(atlas->entries.items, sizeof(*atlas->entries.items),
+           atlas->entries.count, f) == atlas->entries.count;
+
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "[ERROR]: Failed to write %s\n", path);
+    remove(path);
+    return false;
+  }
+
+  return true;
+}
+
+// Loads the cache if it matches sources. Returns false, leaving atlas empty,
+// if it is missing, stale or unreadable.
+static bool pack_atlas_load_cache(const char *cache_dir, uint32_t page_size,
+                                  const struct pack_Source *sources,
+                                  uint32_t source_count,
+                                  struct pack_Atlas *atlas) {
+  *atlas = (struct pack_Atlas){ .page_size = page_size };
+
+  char path[PACK_PATH_MAX];
+  snprintf(path, sizeof(path), "%s/" PACK_CACHE_FILE, cache_dir);
+
+  if (!FileExists(path)) {
+    return false;
+  }
+
+  int size = 0;
+  unsigned char *data = LoadFileData(path, &size);
+  if (data == NULL) {
+    return false;
+  }
+
+  struct pack_CacheHeader header;
+  bool fresh = (size_t)size >= sizeof(header);
+
+  if (fresh) {
+    memcpy(&header, data, sizeof(header));
+
+    fresh = memcmp(header.magic, pack_magic, sizeof(pack_magic)) == 0 &&
+            header.version == PACK_CACHE_VERSION &&
+            header.page_size == page_size &&
+            header.source_count == source_count &&
+            (size_t)size == sizeof(header) +
+                              header.source_count * sizeof(*sources) +
+                              header.entry_count * sizeof(struct pack_Entry);
+  }
+
+  // Sources are sorted the same way on both sides
+  const unsigned char *cursor = data + sizeof(header);
+  for (uint32_t i = 0; fresh && i < source_count; i++) {
+    struct pack_Source cached;
+    memcpy(&cached, cursor, sizeof(cached));
+    cursor += sizeof(cached);
+
+    fresh = strncmp(cached.name, sources[i].name, sizeof(cached.name)) == 0 &&
+            cached.hash == sources[i].hash;
+  }
+
+  for (uint32_t i = 0; fresh && i < header.entry_count; i++) {
+    struct pack_Entry entry;
+    memcpy(&entry, cursor, sizeof(entry));
+    cursor += sizeof(entry);
+
+    entry.name[sizeof(entry.name) - 1] = '\0';
+    fresh = entry.page < header.page_count;
+    DA_APPEND(&atlas->entries, entry);
+  }
+
+  UnloadFileData(data);
+
+  // Pages are mapped as they were packed, nothing is decoded
+  uint64_t hash = pack_sources_hash(sources, source_count);
+
+  for (uint32_t page = 0; fresh && page < header.page_count; page++) {
+    pack_page_path(path, sizeof(path), cache_dir, page);
+
+    struct imgc_Image image;
+    if (!imgc_map(path, hash, 0, &image)) {
+      fresh = false;
+      break;
+    }
+
+    DA_APPEND(&atlas->page_storage, image);
+
+    fresh = image.image.width == (int)page_size &&
+            image.image.height == (int)page_size &&
+            image.image.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    DA_APPEND(&atlas->pages, image.image);
+  }
+
+  if (!fresh) {
+    pack_atlas_free(atlas);
+    *atlas = (struct pack_Atlas){ .page_size = page_size };
+    return false;
+  }
+
+  for (uint32_t i = 0; i < source_count; i++) {
+    DA_APPEND(&atlas->sources, sources[i]);
+  }
+
+  return true;
+}
+
+bool pack_atlas_load(const char *assets_dir, const char *cache_dir,
+                     uint32_t page_size, struct pack_Atlas *atlas,
+                     bool *repacked) {
+  PROF_ZONE("pack_atlas_load");
+
+  FilePathList files = pack_list_sources(assets_dir);
+  DA_TYPE(struct pack_Source) sources = { 0 };
+
+  bool hashed = true;
+  for (uint32_t i = 0; hashed && i < files.count; i++) {
+    struct pack_Source source = { 0 };
+    unsigned char *data = NULL;
+    int size = 0;
+
+    hashed = pack_hash_file(files.paths[i], &source, &data, &size);
+    if (hashed) {
+      UnloadFileData(data);
+      DA_APPEND(&sources, source);
+    }
+  }
+
+  UnloadDirectoryFiles(files);
+
+  bool cached = hashed && pack_atlas_load_cache(cache_dir, page_size,
+                                                sources.items,
+                                                (uint32_t)sources.count,
+                                                atlas);
+  DA_FREE(&sources);
+
+  if (repacked != NULL) {
+    *repacked = !cached;
+  }
+
+  if (cached) {
+    return true;
+  }
+
+  char images_dir[PACK_PATH_MAX];
+  snprintf(images_dir, sizeof(images_dir), "%s/" PACK_IMAGES_DIR, cache_dir);
+
+  if (!pack_atlas_build(assets_dir, page_size, images_dir, atlas)) {
+    return false;
+  }
+
+  // A stale cache only costs a repack next time
+  pack_atlas_save(atlas, cache_dir);
+
+  return true;
+}
+
+void pack_atlas_free(struct pack_Atlas *atlas) {
+  for (uint64_t i = 0; i < atlas->page_storage.count; i++) {
+    imgc_unload(&atlas->page_storage.items[i]);
+  }
+
+  DA_FREE(&atlas->pages);
+  DA_FREE(&atlas->page_storage);
+  DA_FREE(&atlas->entries);
+  DA_FREE(&atlas->sources);
+}
+
+const struct pack_Entry *pack_find(const struct pack_Atlas *atlas,
+                                   const char *name) {
+  struct pack_Entry key = { 0 };
+  snprintf(key.name, sizeof(key.name), "%s", name);
+
+  return bsearch(&key, atlas->entries.items, atlas->entries.count,
+                 sizeof(*atlas->entries.items), pack_compare_entries);
+}
+
+Rectangle pack_entry_uv(const struct pack_Atlas *atlas,
+                        const struct pack_Entry *entry) {
+  float size = (float)atlas->page_size;
+
+  return CLITERAL(Rectangle){
+    .x = (float)entry->x / size,
+    .y = (float)entry->y / size,
+    .width = (float)entry->width / size,
+    .height = (float)entry->height / size,
+  };
+}
@@ -0,0 +1,110 @@
+#ifndef PLUGIN_ATLAS_PACK_H
+#define PLUGIN_ATLAS_PACK_H
+
+#include "image-cache.h"
+
+#include "util/dynamic_array.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+#define ASSETS_DIR "./assets"
+#define ASSETS_CACHE_DIR "./assets/.cache"
+
+#define PACK_NAME_MAX 64
+#define PACK_PAGE_SIZE 1024
+
+// Transparent pixels between sprites, so filtering never samples a
+// neighbour
+#define PACK_PADDING 1
+
+// Images whose file name ends with this are sprite sheets on the
+// ATLAS_GRID_SIZE grid. They are sliced into one sprite per non-empty tile,
+// named <sheet>/<column>_<row>. Every other image is one sprite named after
+// the file without its extension.
+#define PACK_GRID_SHEET_SUFFIX "-atlas.png"
+
+// Bump when the cache layout or the packing changes
+#define PACK_CACHE_VERSION 2
+
+struct pack_Entry {
+  char name[PACK_NAME_MAX];
+
+  uint32_t page;
+  uint32_t x, y;
+  uint32_t width, height;
+};
+
+// A source image and the hash of its file
+struct pack_Source {
+  char name[PACK_NAME_MAX];
+  uint64_t hash;
+};
+
+struct pack_Atlas {
+  uint32_t page_size;
+
+  // R8G8B8A8, page_size x page_size. Owned by page_storage, which holds
+  // the mappings of cached pages, so never unload or reformat them.
+  DA_TYPE(Image) pages;
+  DA_TYPE(struct imgc_Image) page_storage;
+
+  // Sorted by name
+  DA_TYPE(struct pack_Entry) entries;
+
+  // Sorted by name
+  DA_TYPE(struct pack_Source) sources;
+};
+
+// The top of the packed area from x to x + width
+struct pack_SkylineNode {
+  uint32_t x, y;
+  uint32_t width;
+};
+
+// Bottom-left skyline packer for one page
+struct pack_Skyline {
+  uint32_t width, height;
+
+  // Sorted by x, covering [0, width) without gaps
+  DA_TYPE(struct pack_SkylineNode) nodes;
+};
+
+void pack_skyline_init(struct pack_Skyline *skyline, uint32_t width,
+                       uint32_t height);
+void pack_skyline_free(struct pack_Skyline *skyline);
+
+// Places a width x height rectangle as low, then as far left, as possible.
+// Returns false if it does not fit.
+bool pack_skyline_insert(struct pack_Skyline *skyline, uint32_t width,
+                         uint32_t height, uint32_t *x, uint32_t *y);
+
+// Packs every PNG directly inside assets_dir into page_size pages. Decoded
+// PNGs are cached in image_cache_dir unless it is NULL.
+bool pack_atlas_build(const char *assets_dir, uint32_t page_size,
+                      const char *image_cache_dir, struct pack_Atlas *atlas);
+
+// Writes atlas.pack and one atlas-<page>.rgba image blob per page to
+// cache_dir.
+bool pack_atlas_save(const struct pack_Atlas *atlas, const char *cache_dir);
+
+// Loads the atlas cached in cache_dir if it was packed with page_size from
+// exactly the PNGs in assets_dir, with the same contents. Its pages are
+// mapped, not decoded. Otherwise packs them again, decoding only the PNGs
+// not already in cache_dir/images, and rewrites the cache. repacked may be
+// NULL.
+bool pack_atlas_load(const char *assets_dir, const char *cache_dir,
+                     uint32_t page_size, struct pack_Atlas *atlas,
+                     bool *repacked);
+
+void pack_atlas_free(struct pack_Atlas *atlas);
+
+// Returns NULL if there is no sprite called name.
+const struct pack_Entry *pack_find(const struct pack_Atlas *atlas,
+                                   const char *name);
+
+// Texture coordinates of entry, for shaders and vertex buffers.
+Rectangle pack_entry_uv(const struct pack_Atlas *atlas,
+                        const struct pack_Entry *entry);
+
+#endif // PLUGIN_ATLAS_PACK_H
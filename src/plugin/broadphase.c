@@ -0,0 +1,192 @@
+#include "broadphase.h"
+
+#include "util/dynamic_array.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#define BP_MIN_BUCKETS 64
+
+static inline int32_t bp_cell(const struct bp_Broadphase *bp, float v) {
+  return (int32_t)floorf(v / bp->cell_size);
+}
+
+static inline uint32_t bp_bucket(const struct bp_Broadphase *bp, int32_t cx,
+                                 int32_t cy) {
+  uint32_t h = ((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u);
+  return h & (bp->bucket_count - 1);
+}
+
+static inline bool bp_overlap(const struct bp_Entry *a,
+                              const struct bp_Entry *b) {
+  return a->min_x <= b->max_x && b->min_x <= a->max_x &&
+         a->min_y <= b->max_y && b->min_y <= a->max_y;
+}
+
+void bp_init(struct bp_Broadphase *bp, float cell_size) {
+  assert(cell_size > 0.0f && "Cell size must be positive");
+
+  *bp = (struct bp_Broadphase){
+    .cell_size = cell_size,
+  };
+}
+
+void bp_free(struct bp_Broadphase *bp) {
+  free(bp->bucket_start);
+  DA_FREE(&bp->entries);
+  DA_FREE(&bp->entry_bucket);
+  DA_FREE(&bp->unsorted);
+  DA_FREE(&bp->pairs);
+
+  bp->bucket_start = NULL;
+  bp->bucket_count = 0;
+}
+
+void bp_build(struct bp_Broadphase *bp, uint32_t count, const float *min_x,
+              const float *min_y, const float *max_x, const float *max_y) {
+  uint32_t bucket_count = BP_MIN_BUCKETS;
+  while (bucket_count < count * 2) {
+    bucket_count *= 2;
+  }
+
+  if (bucket_count != bp->bucket_count) {
+    free(bp->bucket_start);
+    bp->bucket_count = bucket_count;
+    bp->bucket_start = malloc((bucket_count + 1) * sizeof(*bp->bucket_start));
+    assert(bp->bucket_start != NULL && "Failed to allocate memory");
+  }
+
+  // Count entries per bucket. A body goes into every bucket its cells hash
+  // to, but only once per bucket.
+  memset(bp->bucket_start, 0, (bucket_count + 1) * sizeof(*bp->bucket_start));
+  bp->unsorted.count = 0;
+  bp->entry_bucket.count = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    struct bp_Entry entry = {
+      .body = i,
+      .min_x = min_x[i],
+      .min_y = min_y[i],
+      .max_x = max_x[i],
+      .max_y = max_y[i],
+    };
+
+    int32_t cx0 = bp_cell(bp, entry.min_x), cx1 = bp_cell(bp, entry.max_x);
+    int32_t cy0 = bp_cell(bp, entry.min_y), cy1 = bp_cell(bp, entry.max_y);
+    uint64_t first = bp->entry_bucket.count;
+
+    for (int32_t cy = cy0; cy <= cy1; cy++) {
+      for (int32_t cx = cx0; cx <= cx1; cx++) {
+        uint32_t bucket = bp_bucket(bp, cx, cy);
+
+        bool seen = false;
+        for (uint64_t e = first; e < bp->entry_bucket.count && !seen; e++) {
+          seen = bp->entry_bucket.items[e] == bucket;
+        }
+
+        if (seen) {
+          continue;
+        }
+
+        DA_APPEND(&bp->entry_bucket, bucket);
+        DA_APPEND(&bp->unsorted, entry);
+        bp->bucket_start[bucket + 1]++;
+      }
+    }
+  }
+
+  for (uint32_t b = 0; b < bucket_count; b++) {
+    bp->bucket_start[b + 1] += bp->bucket_start[b];
+  }
+
+  // Scatter. bucket_start[b] is used as the write cursor of bucket b and
+  // ends up at the start of bucket b + 1, so shift it back afterwards.
+  bp->entries.count = 0;
+  for (uint64_t e = 0; e < bp->unsorted.count; e++) {
+    DA_APPEND_NO_ASSIGN(&bp->entries);
+  }
+
+  for (uint64_t e = 0; e < bp->unsorted.count; e++) {
+    uint32_t bucket = bp->entry_bucket.items[e];
+    bp->entries.items[bp->bucket_start[bucket]++] = bp->unsorted.items[e];
+  }
+
+  for (uint32_t b = bucket_count; b > 0; b--) {
+    bp->bucket_start[b] = bp->bucket_start[b - 1];
+  }
+  bp->bucket_start[0] = 0;
+}
+
+void bp_find_pairs(struct bp_Broadphase *bp) {
+  bp->pairs.count = 0;
+
+  for (uint32_t b = 0; b < bp->bucket_count; b++) {
+    uint32_t begin = bp->bucket_start[b];
+    uint32_t end = bp->bucket_start[b + 1];
+
+    for (uint32_t i = begin; i < end; i++) {
+      const struct bp_Entry *a = &bp->entries.items[i];
+
+      for (uint32_t j = i + 1; j < end; j++) {
+        const struct bp_Entry *c = &bp->entries.items[j];
+
+        if (!bp_overlap(a, c)) {
+          continue;
+        }
+
+        // A pair shares every bucket its overlap touches. Only report it
+        // from the bucket holding the top left corner of the overlap.
+        int32_t cx = bp_cell(bp, fmaxf(a->min_x, c->min_x));
+        int32_t cy = bp_cell(bp, fmaxf(a->min_y, c->min_y));
+        if (bp_bucket(bp, cx, cy) != b) {
+          continue;
+        }
+
+        struct bp_Pair pair = {
+          .a = a->body < c->body ? a->body : c->body,
+          .b = a->body < c->body ? c->body : a->body,
+        };
+        DA_APPEND(&bp->pairs, pair);
+      }
+    }
+  }
+}
+
+void bp_query(const struct bp_Broadphase *bp, Rectangle aabb,
+              bp_IndexArray *out) {
+  if (bp->bucket_count == 0) {
+    return;
+  }
+
+  struct bp_Entry query = {
+    .min_x = aabb.x,
+    .min_y = aabb.y,
+    .max_x = aabb.x + aabb.width,
+    .max_y = aabb.y + aabb.height,
+  };
+
+  int32_t cx0 = bp_cell(bp, query.min_x), cx1 = bp_cell(bp, query.max_x);
+  int32_t cy0 = bp_cell(bp, query.min_y), cy1 = bp_cell(bp, query.max_y);
+
+  for (int32_t cy = cy0; cy <= cy1; cy++) {
+    for (int32_t cx = cx0; cx <= cx1; cx++) {
+      uint32_t b = bp_bucket(bp, cx, cy);
+
+      for (uint32_t i = bp->bucket_start[b]; i < bp->bucket_start[b + 1];
+           i++) {
+        const struct bp_Entry *e = &bp->entries.items[i];
+
+        // Same corner rule as bp_find_pairs, but with exact cell
+        // coordinates since several query cells can share a bucket.
+        if (!bp_overlap(e, &query) ||
+            bp_cell(bp, fmaxf(e->min_x, query.min_x)) != cx ||
+            bp_cell(bp, fmaxf(e->min_y, query.min_y)) != cy) {
+          continue;
+        }
+
+        DA_APPEND(out, e->body);
+      }
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef PLUGIN_BROADPHASE_H
+#define PLUGIN_BROADPHASE_H
+
+#include "util/dynamic_array.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+typedef DA_TYPE(uint32_t) bp_IndexArray;
+
+struct bp_Pair {
+  uint32_t a, b; // a < b
+};
+
+// A body as stored in a bucket. Bounds are copied next to the index so
+// scanning a bucket never touches the caller's arrays.
+struct bp_Entry {
+  uint32_t body;
+  float min_x, min_y;
+  float max_x, max_y;
+};
+
+// Uniform grid broadphase over a hashed, unbounded set of cells. Rebuilt
+// from scratch every step with a counting sort, which leaves the bodies
+// sorted by bucket in one contiguous array.
+struct bp_Broadphase {
+  float cell_size;
+
+  uint32_t bucket_count; // Power of two
+  uint32_t *bucket_start; // bucket_count + 1 offsets into entries
+
+  DA_TYPE(struct bp_Entry) entries;
+
+  // Scratch used while building
+  DA_TYPE(uint32_t) entry_bucket;
+  DA_TYPE(struct bp_Entry) unsorted;
+
+  DA_TYPE(struct bp_Pair) pairs;
+};
+
+void bp_init(struct bp_Broadphase *bp, float cell_size);
+void bp_free(struct bp_Broadphase *bp);
+
+// Inserts count bodies given as bounding boxes in SoA form. For moving
+// bodies pass the box swept over the step so fast bodies are not missed.
+void bp_build(struct bp_Broadphase *bp, uint32_t count, const float *min_x,
+              const float *min_y, const float *max_x, const float *max_y);
+
+// Fills bp->pairs with every pair of overlapping bodies, each exactly once.
+void bp_find_pairs(struct bp_Broadphase *bp);
+
+// Appends the index of every body overlapping aabb to out, each once.
+void bp_query(const struct bp_Broadphase *bp, Rectangle aabb,
+              bp_IndexArray *out);
+
+#endif // PLUGIN_BROADPHASE_H
@@ -0,0 +1,318 @@
+#include "chunks.h"
+#include "plugin.h"
+#include "level-bake.h"
+
+#include "util/dynamic_array.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+Rectangle chunk_camera_view(Camera2D camera, float screen_width,
+                            float screen_height) {
+  // Inverse of raylib's 2D camera transform:
+  // screen = rotate(world - target) * zoom + offset
+  float angle = -camera.rotation * DEG2RAD;
+  float c = cosf(angle), s = sinf(angle);
+
+  Vector2 corners[4] = {
+    { 0.0f, 0.0f },
+    { screen_width, 0.0f },
+    { 0.0f, screen_height },
+    { screen_width, screen_height },
+  };
+
+  float min_x = INFINITY, min_y = INFINITY;
+  float max_x = -INFINITY, max_y = -INFINITY;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    float x = (corners[i].x - camera.offset.x) / camera.zoom;
+    float y = (corners[i].y - camera.offset.y) / camera.zoom;
+
+    float world_x = x * c - y * s + camera.target.x;
+    float world_y = x * s + y * c + camera.target.y;
+
+    min_x = world_x < min_x ? world_x : min_x;
+    min_y = world_y < min_y ? world_y : min_y;
+    max_x = world_x > max_x ? world_x : max_x;
+    max_y = world_y > max_y ? world_y : max_y;
+  }
+
+  return CLITERAL(Rectangle){ min_x, min_y, max_x - min_x, max_y - min_y };
+}
+
+bool chunk_visible_range(Vector2 level_pos, float chunk_size,
+                         uint32_t chunks_x, uint32_t chunks_y, Rectangle view,
+                         struct chunk_Range *range) {
+  float x0 = floorf((view.x - level_pos.x) / chunk_size);
+  float y0 = floorf((view.y - level_pos.y) / chunk_size);
+  float x1 = floorf((view.x + view.width - level_pos.x) / chunk_size);
+  float y1 = floorf((view.y + view.height - level_pos.y) / chunk_size);
+
+  // Also rejects NaN, e.g. from a zero zoom
+  if (!(x1 >= 0.0f && y1 >= 0.0f && x0 < (float)chunks_x &&
+        y0 < (float)chunks_y)) {
+    return false;
+  }
+
+  range->x_begin = x0 < 0.0f ? 0 : (uint32_t)x0;
+  range->y_begin = y0 < 0.0f ? 0 : (uint32_t)y0;
+  range->x_end = x1 >= (float)chunks_x ? chunks_x : (uint32_t)x1 + 1;
+  range->y_end = y1 >= (float)chunks_y ? chunks_y : (uint32_t)y1 + 1;
+
+  return true;
+}
+
+void chunk_cache_init(struct chunk_Cache *cache,
+                      const struct plug_Level *level, uint64_t budget) {
+  *cache = (struct chunk_Cache){
+    .chunks_x = (level->grid_width + CHUNK_CELLS - 1) / CHUNK_CELLS,
+    .chunks_y = (level->grid_height + CHUNK_CELLS - 1) / CHUNK_CELLS,
+    .head = CHUNK_NONE,
+    .tail = CHUNK_NONE,
+    .budget = budget,
+  };
+
+  uint32_t count = cache->chunks_x * cache->chunks_y;
+  cache->resident = malloc(count * sizeof(*cache->resident));
+  assert((count == 0 || cache->resident != NULL) &&
+         "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < count; i++) {
+    cache->resident[i] = CHUNK_NONE;
+  }
+
+  // Drawing never grows them then
+  DA_RESERVE(&cache->entries, count);
+  DA_RESERVE(&cache->free_entries, count);
+
+  const uint32_t cs = level->cell_size;
+  if (count > 0 && cs > 0) {
+    cache->pixels = malloc((size_t)CHUNK_CELLS * CHUNK_CELLS * cs * cs *
+                           sizeof(*cache->pixels));
+    cache->map = malloc(cs * sizeof(*cache->map));
+    assert(cache->pixels != NULL && cache->map != NULL &&
+           "Failed to allocate memory");
+
+    bake_tile_map(cs, cache->map);
+  }
+}
+
+void chunk_cache_free(struct chunk_Cache *cache) {
+  for (uint32_t e = cache->head; e != CHUNK_NONE;
+       e = cache->entries.items[e].next) {
+    UnloadTexture(cache->entries.items[e].tex);
+  }
+
+  free(cache->resident);
+  free(cache->pixels);
+  free(cache->map);
+  DA_FREE(&cache->entries);
+  DA_FREE(&cache->free_entries);
+
+  *cache = (struct chunk_Cache){ .head = CHUNK_NONE, .tail = CHUNK_NONE };
+}
+
+static void chunk_unlink(struct chunk_Cache *cache, uint32_t e) {
+  struct chunk_Entry *entry = &cache->entries.items[e];
+
+  if (entry->prev != CHUNK_NONE) {
+    cache->entries.items[entry->prev].next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+
+  if (entry->next != CHUNK_NONE) {
+    cache->entries.items[entry->next].prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+static void chunk_push_front(struct chunk_Cache *cache, uint32_t e) {
+  struct chunk_Entry *entry = &cache->entries.items[e];
+
+  entry->prev = CHUNK_NONE;
+  entry->next = cache->head;
+
+  if (cache->head != CHUNK_NONE) {
+    cache->entries.items[cache->head].prev = e;
+  } else {
+    cache->tail = e;
+  }
+
+  cache->head = e;
+}
+
+// Cells covered by chunk (x, y), clipped to the level.
+static struct plug_CellRect chunk_cells(const struct plug_Level *level,
+                                        uint32_t x, uint32_t y) {
+  struct plug_CellRect cells = {
+    .x = x * CHUNK_CELLS,
+    .y = y * CHUNK_CELLS,
+    .width = CHUNK_CELLS,
+    .height = CHUNK_CELLS,
+  };
+
+  if (cells.x + cells.width > level->grid_width) {
+    cells.width = level->grid_width - cells.x;
+  }
+
+  if (cells.y + cells.height > level->grid_height) {
+    cells.height = level->grid_height - cells.y;
+  }
+
+  return cells;
+}
+
+static uint32_t chunk_load(struct chunk_Cache *cache,
+                           const struct plug_Level *level,
+                           const struct plug_Tiles *tiles, uint32_t x,
+                           uint32_t y) {
+  const uint32_t cs = level->cell_size;
+  struct plug_CellRect cells = chunk_cells(level, x, y);
+
+  Image image = {
+    .width = (int)(cells.width * cs),
+    .height = (int)(cells.height * cs),
+    .mipmaps = 1,
+    .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+  };
+
+  // Uploaded by LoadTextureFromImage, the buffer is the cache's
+  image.data = cache->pixels;
+
+  bake_level_region(level, tiles, cache->map, image.data,
+                    (uint32_t)image.width, cells.x, cells.x + cells.width,
+                    cells.y, cells.y + cells.height);
+
+  uint32_t e;
+  if (cache->free_entries.count > 0) {
+    e = cache->free_entries.items[--cache->free_entries.count];
+  } else {
+    e = (uint32_t)cache->entries.count;
+    DA_APPEND_NO_ASSIGN(&cache->entries);
+  }
+
+  cache->entries.items[e] = (struct chunk_Entry){
+    .chunk = y * cache->chunks_x + x,
+    .tex = LoadTextureFromImage(image),
+    .bytes = (uint64_t)image.width * image.height * sizeof(Color),
+  };
+
+  cache->resident[cache->entries.items[e].chunk] = e;
+  cache->bytes += cache->entries.items[e].bytes;
+  chunk_push_front(cache, e);
+
+  return e;
+}
+
+// Evicts least recently drawn chunks until the cache is within budget or
+// only chunks drawn this frame are left.
+static void chunk_evict(struct chunk_Cache *cache) {
+  while (cache->bytes > cache->budget && cache->tail != CHUNK_NONE) {
+    uint32_t e = cache->tail;
+    struct chunk_Entry *entry = &cache->entries.items[e];
+
+    if (entry->last_drawn == cache->frame) {
+      break;
+    }
+
+    chunk_unlink(cache, e);
+    UnloadTexture(entry->tex);
+
+    cache->resident[entry->chunk] = CHUNK_NONE;
+    cache->bytes -= entry->bytes;
+    DA_APPEND(&cache->free_entries, e);
+  }
+}
+
+uint32_t chunk_cache_draw(struct chunk_Cache *cache,
+                          const struct plug_Level *level,
+                          const struct plug_Tiles *tiles, Rectangle view) {
+  cache->frame++;
+
+  const float chunk_size = (float)(CHUNK_CELLS * level->cell_size);
+
+  struct chunk_Range range;
+  if (!chunk_visible_range(level->pos, chunk_size, cache->chunks_x,
+                           cache->chunks_y, view, &range)) {
+    return 0;
+  }
+
+  uint32_t drawn = 0;
+
+  for (uint32_t y = range.y_begin; y < range.y_end; y++) {
+    for (uint32_t x = range.x_begin; x < range.x_end; x++) {
+      uint32_t e = cache->resident[y * cache->chunks_x + x];
+
+      if (e == CHUNK_NONE) {
+        e = chunk_load(cache, level, tiles, x, y);
+      } else {
+        chunk_unlink(cache, e);
+        chunk_push_front(cache, e);
+      }
+
+      cache->entries.items[e].last_drawn = cache->frame;
+
+      Vector2 pos = {
+        .x = level->pos.x + (float)x * chunk_size,
+        .y = level->pos.y + (float)y * chunk_size,
+      };
+      DrawTextureV(cache->entries.items[e].tex, pos, WHITE);
+      drawn++;
+    }
+  }
+
+  chunk_evict(cache);
+
+  return drawn;
+}
+
+void chunk_cache_update(struct chunk_Cache *cache,
+                        const struct plug_Level *level,
+                        const struct plug_Tiles *tiles,
+                        struct plug_CellRect cells) {
+  if (cells.width == 0 || cells.height == 0 || cache->resident == NULL) {
+    return;
+  }
+
+  const uint32_t cs = level->cell_size;
+
+  uint32_t x_end = (cells.x + cells.width - 1) / CHUNK_CELLS + 1;
+  uint32_t y_end = (cells.y + cells.height - 1) / CHUNK_CELLS + 1;
+
+  for (uint32_t y = cells.y / CHUNK_CELLS; y < y_end; y++) {
+    for (uint32_t x = cells.x / CHUNK_CELLS; x < x_end; x++) {
+      uint32_t e = cache->resident[y * cache->chunks_x + x];
+      if (e == CHUNK_NONE) {
+        continue;
+      }
+
+      struct plug_CellRect chunk = chunk_cells(level, x, y);
+
+      uint32_t x0 = cells.x > chunk.x ? cells.x : chunk.x;
+      uint32_t y0 = cells.y > chunk.y ? cells.y : chunk.y;
+      uint32_t x1 = cells.x + cells.width < chunk.x + chunk.width
+                      ? cells.x + cells.width
+                      : chunk.x + chunk.width;
+      uint32_t y1 = cells.y + cells.height < chunk.y + chunk.height
+                      ? cells.y + cells.height
+                      : chunk.y + chunk.height;
+
+      // A chunk's worth of pixels is enough for any intersection
+      bake_level_region(level, tiles, cache->map, cache->pixels,
+                        (x1 - x0) * cs, x0, x1, y0, y1);
+
+      Rectangle dest = {
+        .x = (float)((x0 - chunk.x) * cs),
+        .y = (float)((y0 - chunk.y) * cs),
+        .width = (float)((x1 - x0) * cs),
+        .height = (float)((y1 - y0) * cs),
+      };
+      UpdateTextureRec(cache->entries.items[e].tex, dest, cache->pixels);
+    }
+  }
+}
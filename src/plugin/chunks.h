@@ -0,0 +1,92 @@
+#ifndef PLUGIN_CHUNKS_H
+#define PLUGIN_CHUNKS_H
+
+#include "util/dynamic_array.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+// Levels are drawn as square chunks of this many cells a side
+#define CHUNK_CELLS 16
+
+// Resident chunk textures are evicted, least recently drawn first, past
+// this many bytes. Chunks drawn this frame are never evicted.
+#define CHUNK_CACHE_BUDGET_BYTES (32 * 1024 * 1024)
+
+#define CHUNK_NONE UINT32_MAX
+
+struct plug_Level;
+struct plug_CellRect;
+struct plug_Tiles;
+
+// [begin, end) range of chunk coordinates
+struct chunk_Range {
+  uint32_t x_begin, x_end;
+  uint32_t y_begin, y_end;
+};
+
+struct chunk_Entry {
+  uint32_t chunk;
+  Texture2D tex;
+  uint64_t bytes;
+
+  // Doubly linked LRU list through entries, most recently drawn first
+  uint32_t prev, next;
+
+  uint64_t last_drawn;
+};
+
+struct chunk_Cache {
+  uint32_t chunks_x, chunks_y;
+
+  // Entry index of every chunk, CHUNK_NONE if not resident
+  uint32_t *resident;
+
+  // What chunks are baked into before they are uploaded, a whole chunk's
+  // worth, and the bake_tile_map of the level's cell size. Allocated by
+  // chunk_cache_init, so baking never allocates.
+  Color *pixels;
+  uint16_t *map;
+
+  DA_TYPE(struct chunk_Entry) entries;
+  DA_TYPE(uint32_t) free_entries;
+  uint32_t head, tail;
+
+  uint64_t bytes;
+  uint64_t budget;
+
+  uint64_t frame;
+};
+
+// The world space rectangle a screen_width x screen_height screen shows
+// through camera. Rotated cameras get the bounding box of the view.
+Rectangle chunk_camera_view(Camera2D camera, float screen_width,
+                            float screen_height);
+
+// Computes the chunks of a level at level_pos, chunk_size pixels a side and
+// chunks_x x chunks_y chunks large, that intersect view. Returns false if
+// none do.
+bool chunk_visible_range(Vector2 level_pos, float chunk_size,
+                         uint32_t chunks_x, uint32_t chunks_y, Rectangle view,
+                         struct chunk_Range *range);
+
+void chunk_cache_init(struct chunk_Cache *cache,
+                      const struct plug_Level *level, uint64_t budget);
+
+// Unloads every chunk texture.
+void chunk_cache_free(struct chunk_Cache *cache);
+
+// Draws the chunks of level visible through view, baking missing ones from
+// tiles. Returns the number of chunks drawn.
+uint32_t chunk_cache_draw(struct chunk_Cache *cache,
+                          const struct plug_Level *level,
+                          const struct plug_Tiles *tiles, Rectangle view);
+
+// Re-bakes the resident parts of cells. Chunks that are not resident are
+// baked from the grid when they are next drawn anyway.
+void chunk_cache_update(struct chunk_Cache *cache,
+                        const struct plug_Level *level,
+                        const struct plug_Tiles *tiles,
+                        struct plug_CellRect cells);
+
+#endif // PLUGIN_CHUNKS_H
@@ -0,0 +1,196 @@
+#include "effects.h"
+#include "plugin.h"
+#include "particles.h"
+#include "light.h"
+
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+
+#define EFFECT_PARTICLES 16384
+
+#define CAMPFIRE_FRAMES 5
+#define CAMPFIRE_FPS 10.0f
+#define FIRE_RATE 60.0f
+
+#define DUST_PARTICLES 24
+#define DEATH_PARTICLES 160
+
+// In cells, and out of 255
+#define CAMPFIRE_LIGHT_RADIUS 12
+#define CAMPFIRE_LIGHT 255
+#define PLAYER_LIGHT_RADIUS 6
+#define PLAYER_LIGHT 200
+
+// Read again every frame, so hot reloading this file retunes the fire
+static const struct part_Spawn fire_spawn = {
+  .extent = { 4.0f, 1.0f },
+  .angle = -90.0f,
+  .spread = 30.0f,
+  .speed_min = 10.0f,
+  .speed_max = 25.0f,
+  .life_min = 0.4f,
+  .life_max = 0.9f,
+  .size_start = 2.0f,
+  .size_end = 0.5f,
+  .gravity = -20.0f,
+  .color = { 255, 140, 40, 255 },
+};
+
+static const struct part_Spawn dust_spawn = {
+  .extent = { 4.0f, 0.0f },
+  .angle = -90.0f,
+  .spread = 160.0f,
+  .speed_min = 15.0f,
+  .speed_max = 40.0f,
+  .life_min = 0.2f,
+  .life_max = 0.5f,
+  .size_start = 1.5f,
+  .size_end = 2.5f,
+  .gravity = GRAVITY * 0.25f,
+  .color = { 200, 190, 170, 200 },
+  .collide = true,
+};
+
+static const struct part_Spawn death_spawn = {
+  .extent = { 4.0f, 4.0f },
+  .angle = 0.0f,
+  .spread = 360.0f,
+  .speed_min = 40.0f,
+  .speed_max = 120.0f,
+  .life_min = 0.5f,
+  .life_max = 1.2f,
+  .size_start = 2.0f,
+  .size_end = 1.0f,
+  .gravity = GRAVITY,
+  .color = { 200, 30, 40, 255 },
+  .collide = true,
+};
+
+static struct plug_Level *current_level(struct plug_State *state) {
+  if (state->current_level < 0) {
+    return NULL;
+  }
+
+  return &DA_AT(state->levels, (uint32_t)state->current_level);
+}
+
+// Where the campfire is drawn, a cell left of the spawn point and standing
+// on the same floor as the player
+static Rectangle campfire_rect(const struct plug_Level *level) {
+  float size = (float)level->cell_size;
+
+  return CLITERAL(Rectangle){
+    .x = level->spawn.x - size,
+    .y = level->spawn.y + PLAYER_SIZE - size,
+    .width = size,
+    .height = size,
+  };
+}
+
+void init_effects(struct plug_State *state) {
+  struct plug_Effects *effects = &state->effects;
+
+  part_system_init(&effects->particles, EFFECT_PARTICLES);
+  effects->campfire = part_emitter_add(&effects->particles,
+                                       CLITERAL(Vector2){ 0 }, FIRE_RATE,
+                                       &fire_spawn);
+
+  effects->landings = state->player.landings;
+  effects->deaths = state->player.deaths;
+}
+
+void free_effects(struct plug_State *state) {
+  part_system_free(&state->effects.particles);
+}
+
+static void draw_campfire(struct plug_State *state,
+                          const struct plug_Level *level) {
+  const struct pack_Entry *sprite = &state->campfire_sprite;
+  if (sprite->width == 0) {
+    return;
+  }
+
+  uint32_t frame = (uint32_t)(GetTime() * CAMPFIRE_FPS) % CAMPFIRE_FRAMES;
+  float width = (float)sprite->width / CAMPFIRE_FRAMES;
+
+  Rectangle src = {
+    .x = (float)sprite->x + (float)frame * width,
+    .y = (float)sprite->y,
+    .width = width,
+    .height = (float)sprite->height,
+  };
+
+  spr_batch_add(&state->sprites, DA_AT(state->atlas_pages, sprite->page),
+                src, campfire_rect(level), CLITERAL(Vector2){ 0, 0 }, 0.0f,
+                WHITE, SPRITE_LAYER_PROPS);
+}
+
+static void update_lights(struct plug_State *state, struct plug_Level *level) {
+  if (!level->loaded) {
+    return;
+  }
+
+  Rectangle fire = campfire_rect(level);
+  Vector2 player = state->pipeline.frame.player_pos;
+
+  light_begin(&level->light);
+  light_add(&level->light, level,
+            CLITERAL(Vector2){
+              fire.x + fire.width * 0.5f,
+              fire.y + fire.height * 0.5f,
+            },
+            CAMPFIRE_LIGHT_RADIUS, CAMPFIRE_LIGHT);
+  light_add(&level->light, level,
+            CLITERAL(Vector2){
+              player.x + PLAYER_SIZE * 0.5f,
+              player.y + PLAYER_SIZE * 0.5f,
+            },
+            PLAYER_LIGHT_RADIUS, PLAYER_LIGHT);
+  light_update(&level->light, level);
+}
+
+void update_effects(struct plug_State *state, float dt) {
+  PROF_ZONE("update_effects");
+
+  struct plug_Effects *effects = &state->effects;
+  struct part_System *particles = &effects->particles;
+  const struct pipe_Frame *frame = &state->pipeline.frame;
+  struct plug_Level *level = current_level(state);
+
+  // Counters only go back if the player was rebuilt, with nothing to show
+  if (frame->landings > effects->landings) {
+    part_emit(particles, &dust_spawn, frame->landed_at, DUST_PARTICLES);
+  }
+  if (frame->deaths > effects->deaths) {
+    part_emit(particles, &death_spawn, frame->died_at, DEATH_PARTICLES);
+  }
+  effects->landings = frame->landings;
+  effects->deaths = frame->deaths;
+
+  if (effects->campfire != PART_NO_EMITTER) {
+    struct part_Emitter *fire = &particles->emitters[effects->campfire];
+    fire->active = level != NULL;
+    fire->spawn = fire_spawn;
+
+    if (level != NULL) {
+      Rectangle rect = campfire_rect(level);
+      fire->pos = CLITERAL(Vector2){
+        rect.x + rect.width * 0.5f,
+        rect.y + rect.height * 0.6f,
+      };
+    }
+  }
+
+  part_update(particles, level, dt);
+  part_build(particles);
+
+  if (level != NULL) {
+    draw_campfire(state, level);
+    update_lights(state, level);
+  }
+}
+
+void draw_effects(const struct plug_State *state) {
+  part_submit(&state->effects.particles);
+}
@@ -0,0 +1,21 @@
+#ifndef PLUGIN_EFFECTS_H
+#define PLUGIN_EFFECTS_H
+
+#include "plugin.h"
+
+// Campfire by the spawn point, dust on landing and a burst on death, and
+// the light of the campfire and the player. They are only drawn, so they
+// run once per frame on the main thread off state->pipeline.frame, and are
+// neither rewound nor pipelined.
+void init_effects(struct plug_State *state);
+void free_effects(struct plug_State *state);
+
+// Bursts for the landings and deaths since the last frame, then advances
+// the particles by dt, adds the campfire to the sprite batch and moves the
+// lights of the level.
+void update_effects(struct plug_State *state, float dt);
+
+// Draws the particles. Call inside BeginMode2D, after the sprite batch.
+void draw_effects(const struct plug_State *state);
+
+#endif // PLUGIN_EFFECTS_H
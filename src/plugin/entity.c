@@ -0,0 +1,165 @@
+#include "entity.h"
+#include "plugin.h"
+#include "update-player.h"
+#include "util/profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ENT_INIT_CAPACITY 16
+
+static void *ent_alloc_array(uint32_t capacity, size_t size) {
+  size_t bytes = (capacity * size + ENT_ALIGN - 1) & ~(size_t)(ENT_ALIGN - 1);
+
+  void *array = aligned_alloc(ENT_ALIGN, bytes);
+  assert(array != NULL && "Failed to allocate memory");
+
+  return array;
+}
+
+// aligned_alloc memory cannot be realloc'd without losing the alignment
+static void ent_grow_array(void **array, uint32_t count, uint32_t capacity,
+                           size_t size) {
+  void *grown = ent_alloc_array(capacity, size);
+
+  if (*array != NULL) {
+    memcpy(grown, *array, count * size);
+    free(*array);
+  }
+
+  *array = grown;
+}
+
+static void ent_reserve(struct ent_Store *store, uint32_t capacity) {
+  if (capacity <= store->capacity) {
+    return;
+  }
+
+#define X(field)                                                    \
+  ent_grow_array((void **)&store->field, store->count, capacity, \
+                 sizeof(*store->field));
+  ENT_ARRAYS(X)
+#undef X
+
+  store->capacity = capacity;
+}
+
+void ent_store_init(struct ent_Store *store, uint32_t capacity) {
+  *store = (struct ent_Store){ 0 };
+  ent_reserve(store, capacity);
+}
+
+void ent_store_free(struct ent_Store *store) {
+#define X(field) free(store->field);
+  ENT_ARRAYS(X)
+#undef X
+
+  *store = (struct ent_Store){ 0 };
+}
+
+uint32_t ent_spawn(struct ent_Store *store, Vector2 pos, Rectangle hitbox) {
+  if (store->count == store->capacity) {
+    ent_reserve(store, store->capacity == 0 ? ENT_INIT_CAPACITY
+                                            : store->capacity * 2);
+  }
+
+  uint32_t i = store->count++;
+
+  store->pos_x[i] = pos.x;
+  store->pos_y[i] = pos.y;
+  store->vel_x[i] = 0.0f;
+  store->vel_y[i] = 0.0f;
+  store->hitbox_x[i] = hitbox.x;
+  store->hitbox_y[i] = hitbox.y;
+  store->hitbox_w[i] = hitbox.width;
+  store->hitbox_h[i] = hitbox.height;
+  store->grounded[i] = false;
+  store->input[i] = 0;
+
+  return i;
+}
+
+Vector2 ent_pos(const struct ent_Store *store, uint32_t actor) {
+  assert(actor < store->count && "Invalid actor");
+
+  return CLITERAL(Vector2){ store->pos_x[actor], store->pos_y[actor] };
+}
+
+Rectangle ent_hitbox(const struct ent_Store *store, uint32_t actor) {
+  assert(actor < store->count && "Invalid actor");
+
+  return CLITERAL(Rectangle){
+    .x = store->hitbox_x[actor],
+    .y = store->hitbox_y[actor],
+    .width = store->hitbox_w[actor],
+    .height = store->hitbox_h[actor],
+  };
+}
+
+void ent_teleport(struct ent_Store *store, uint32_t actor, Vector2 pos) {
+  assert(actor < store->count && "Invalid actor");
+
+  store->pos_x[actor] = pos.x;
+  store->pos_y[actor] = pos.y;
+  store->vel_x[actor] = 0.0f;
+  store->vel_y[actor] = 0.0f;
+}
+
+void ent_apply_input(struct ent_Store *store, float dt) {
+  float *restrict vel_x = __builtin_assume_aligned(store->vel_x, ENT_ALIGN);
+  float *restrict vel_y = __builtin_assume_aligned(store->vel_y, ENT_ALIGN);
+  const uint8_t *restrict grounded =
+    __builtin_assume_aligned(store->grounded, ENT_ALIGN);
+  const uint8_t *restrict input =
+    __builtin_assume_aligned(store->input, ENT_ALIGN);
+
+  uint32_t count = store->count;
+  for (uint32_t i = 0; i < count; i++) {
+    vel_x[i] = walk_velocity(vel_x[i], input[i], dt);
+    vel_y[i] = fall_velocity(vel_y[i], grounded[i], input[i], dt);
+  }
+}
+
+void ent_collide(struct ent_Store *store, const struct plug_Level *level,
+                 float dt) {
+  if (level == NULL) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < store->count; i++) {
+    Vector2 vel = { store->vel_x[i], store->vel_y[i] };
+    bool grounded = store->grounded[i];
+
+    level_collide(level, ent_pos(store, i), ent_hitbox(store, i), &vel,
+                  &grounded, dt);
+
+    store->vel_x[i] = vel.x;
+    store->vel_y[i] = vel.y;
+    store->grounded[i] = grounded;
+  }
+}
+
+void ent_integrate(struct ent_Store *store, float dt) {
+  float *restrict pos_x = __builtin_assume_aligned(store->pos_x, ENT_ALIGN);
+  float *restrict pos_y = __builtin_assume_aligned(store->pos_y, ENT_ALIGN);
+  float *restrict vel_x = __builtin_assume_aligned(store->vel_x, ENT_ALIGN);
+  const float *restrict vel_y =
+    __builtin_assume_aligned(store->vel_y, ENT_ALIGN);
+
+  uint32_t count = store->count;
+  for (uint32_t i = 0; i < count; i++) {
+    pos_x[i] += vel_x[i] * dt;
+    pos_y[i] += vel_y[i] * dt;
+    vel_x[i] = decelerate(vel_x[i], dt);
+  }
+}
+
+void ent_step(struct ent_Store *store, const struct plug_Level *level,
+              float dt) {
+  PROF_ZONE("ent_step");
+
+  ent_apply_input(store, dt);
+  ent_collide(store, level, dt);
+  ent_integrate(store, dt);
+}
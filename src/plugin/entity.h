@@ -0,0 +1,68 @@
+#ifndef PLUGIN_ENTITY_H
+#define PLUGIN_ENTITY_H
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+// Every component array starts on its own cache line
+#define ENT_ALIGN 64
+
+struct plug_Level;
+
+// Hot simulation components of every actor, one array per field, so the
+// integration passes stream through exactly the data they need. Cold,
+// per-actor data (camera, tuning, ...) lives with whoever owns the actor.
+struct ent_Store {
+  uint32_t count;
+  uint32_t capacity;
+
+  float *pos_x;
+  float *pos_y;
+  float *vel_x;
+  float *vel_y;
+
+  // Hitbox relative to the position
+  float *hitbox_x;
+  float *hitbox_y;
+  float *hitbox_w;
+  float *hitbox_h;
+
+  uint8_t *grounded;
+
+  // enum plug_InputFlags the actor wants to apply on the next step
+  uint8_t *input;
+};
+
+// Every array of struct ent_Store
+#define ENT_ARRAYS(X) \
+  X(pos_x)            \
+  X(pos_y)            \
+  X(vel_x)            \
+  X(vel_y)            \
+  X(hitbox_x)         \
+  X(hitbox_y)         \
+  X(hitbox_w)         \
+  X(hitbox_h)         \
+  X(grounded)         \
+  X(input)
+
+void ent_store_init(struct ent_Store *store, uint32_t capacity);
+void ent_store_free(struct ent_Store *store);
+
+// Returns the index of the new actor.
+uint32_t ent_spawn(struct ent_Store *store, Vector2 pos, Rectangle hitbox);
+
+Vector2 ent_pos(const struct ent_Store *store, uint32_t actor);
+Rectangle ent_hitbox(const struct ent_Store *store, uint32_t actor);
+void ent_teleport(struct ent_Store *store, uint32_t actor, Vector2 pos);
+
+// The passes of one step, in order. ent_step runs all of them.
+void ent_apply_input(struct ent_Store *store, float dt);
+void ent_collide(struct ent_Store *store, const struct plug_Level *level,
+                 float dt);
+void ent_integrate(struct ent_Store *store, float dt);
+
+void ent_step(struct ent_Store *store, const struct plug_Level *level,
+              float dt);
+
+#endif // PLUGIN_ENTITY_H
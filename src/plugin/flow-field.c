@@ -0,0 +1,638 @@
+#include "flow-field.h"
+#include "plugin.h"
+#include "level.h"
+
+#include "util/clock.h"
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+#include "util/thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+// Expands build.frontier[begin, end) of field by one step
+struct flow_Job {
+  struct flow_Field *field;
+  const struct plug_Level *level;
+
+  uint32_t begin, end;
+  uint32_t dist;
+
+  // Cells may be claimed by other jobs at the same time
+  bool shared;
+
+  // Cells this job reached first
+  DA_TYPE(uint32_t) out;
+};
+
+static uint32_t flow_neighbours(const struct flow_Field *field,
+                                uint32_t cell, uint32_t out[4]) {
+  uint32_t x = cell % field->width;
+  uint32_t y = cell / field->width;
+  uint32_t n = 0;
+
+  if (x > 0) {
+    out[n++] = cell - 1;
+  }
+  if (x + 1 < field->width) {
+    out[n++] = cell + 1;
+  }
+  if (y > 0) {
+    out[n++] = cell - field->width;
+  }
+  if (y + 1 < field->height) {
+    out[n++] = cell + field->width;
+  }
+
+  return n;
+}
+
+static void *flow_expand(void *p) {
+  struct flow_Job *job = p;
+  struct flow_Build *build = &job->field->build;
+  const enum plug_CellType *grid = job->level->grid;
+
+  job->out.count = 0;
+
+  for (uint32_t i = job->begin; i < job->end; i++) {
+    uint32_t neighbours[4];
+    uint32_t count = flow_neighbours(job->field, build->frontier.items[i],
+                                     neighbours);
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t n = neighbours[k];
+      if (!flow_walkable(grid[n])) {
+        continue;
+      }
+
+      if (job->shared) {
+        uint32_t expected = FLOW_UNREACHED;
+        if (!__atomic_compare_exchange_n(&build->dist[n], &expected,
+                                         job->dist, false, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED)) {
+          continue;
+        }
+      } else if (build->dist[n] == FLOW_UNREACHED) {
+        build->dist[n] = job->dist;
+      } else {
+        continue;
+      }
+
+      DA_APPEND(&job->out, n);
+    }
+  }
+
+  return NULL;
+}
+
+// Starts a breadth first build from target into the back buffer
+static void flow_build_start(struct flow_Field *field, uint32_t target) {
+  struct flow_Build *build = &field->build;
+  uint64_t cells = (uint64_t)field->width * field->height;
+
+  memset(build->dist, 0xff, cells * sizeof(*build->dist));
+
+  build->running = true;
+  build->target = target;
+  build->dist[target] = 0;
+  build->step = 0;
+  build->frontier.count = 0;
+  build->changed.count = 0;
+  DA_APPEND(&build->frontier, target);
+}
+
+// Goes on with the build a frontier at a time, until it is done or
+// budget_ns is spent. A frontier is split into jobs that claim the cells
+// they reach with a CAS. Returns true once the build is done.
+static bool flow_build_continue(struct flow_Field *field,
+                                const struct plug_Level *level,
+                                struct tp_ThreadPool *pool,
+                                uint64_t budget_ns) {
+  PROF_ZONE("flow_build");
+
+  struct flow_Build *build = &field->build;
+  uint64_t start = clk_now_ns();
+
+  if ((uint64_t)field->width * field->height < FLOW_PARALLEL_CELLS) {
+    pool = NULL;
+  }
+
+  do {
+    uint32_t threads = pool == NULL ? 1 : pool->count;
+    uint64_t frontier = build->frontier.count;
+
+    uint64_t per_job = frontier / ((uint64_t)threads * FLOW_JOBS_PER_THREAD);
+    per_job = per_job < FLOW_MIN_JOB_CELLS ? FLOW_MIN_JOB_CELLS : per_job;
+    uint64_t job_count = (frontier + per_job - 1) / per_job;
+
+    build->step++;
+
+    // Jobs are kept between frontiers, with whatever their out has grown to
+    while (field->jobs.count < job_count) {
+      DA_APPEND(&field->jobs, (struct flow_Job){ 0 });
+    }
+
+    for (uint64_t i = 0; i < job_count; i++) {
+      struct flow_Job *job = &field->jobs.items[i];
+      uint64_t end = (i + 1) * per_job;
+
+      job->field = field;
+      job->level = level;
+      job->begin = (uint32_t)(i * per_job);
+      job->end = (uint32_t)(end > frontier ? frontier : end);
+      job->dist = build->step;
+      job->shared = job_count > 1;
+    }
+
+    if (pool == NULL || job_count == 1) {
+      for (uint64_t i = 0; i < job_count; i++) {
+        flow_expand(&field->jobs.items[i]);
+      }
+
+    } else {
+      field->handles.count = 0;
+      for (uint64_t i = 0; i < job_count; i++) {
+        DA_APPEND(&field->handles,
+                  tp_add_job(pool, flow_expand, &field->jobs.items[i]));
+      }
+
+      for (uint64_t i = 0; i < job_count; i++) {
+        tp_wait_job(pool, field->handles.items[i]);
+      }
+    }
+
+    build->next.count = 0;
+    for (uint64_t i = 0; i < job_count; i++) {
+      const struct flow_Job *job = &field->jobs.items[i];
+
+      DA_RESERVE(&build->next, build->next.count + job->out.count);
+      memcpy(build->next.items + build->next.count, job->out.items,
+             job->out.count * sizeof(*job->out.items));
+      build->next.count += job->out.count;
+    }
+
+    typeof(build->frontier) swap = build->frontier;
+    build->frontier = build->next;
+    build->next = swap;
+  } while (build->frontier.count > 0 && clk_now_ns() - start < budget_ns);
+
+  return build->frontier.count == 0;
+}
+
+static uint64_t flow_seed(uint32_t dist, uint32_t cell) {
+  return (uint64_t)dist << 32 | cell;
+}
+
+static int flow_compare_seeds(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+// Pops whichever of the sorted seeds and the queue in next comes first.
+// Both are in order of distance, so cells come out in order too, as
+// Dijkstra would visit them. Seeds win ties, so nothing popped later can
+// be closer than what was popped before.
+static bool flow_pop(struct flow_Field *field, uint64_t *seed,
+                     uint64_t *head, uint32_t *dist, uint32_t *cell) {
+  bool has_seed = *seed < field->seeds.count;
+  bool has_queued = *head < field->next.count;
+
+  if (!has_seed && !has_queued) {
+    return false;
+  }
+
+  if (has_seed &&
+      (!has_queued || (uint32_t)(field->seeds.items[*seed] >> 32) <=
+                        field->dist[field->next.items[*head]])) {
+    *dist = (uint32_t)(field->seeds.items[*seed] >> 32);
+    *cell = (uint32_t)field->seeds.items[(*seed)++];
+  } else {
+    *cell = field->next.items[(*head)++];
+    *dist = field->dist[*cell];
+  }
+
+  return true;
+}
+
+// Lowers the distance of every cell a seed gives a shorter way to, and of
+// the cells past it. Returns the number of cells lowered.
+static uint64_t flow_relax(struct flow_Field *field,
+                           const struct plug_Level *level) {
+  qsort(field->seeds.items, field->seeds.count, sizeof(*field->seeds.items),
+        flow_compare_seeds);
+
+  uint64_t seed = 0, head = 0, lowered = 0;
+  uint32_t dist, cell;
+  field->next.count = 0;
+
+  while (flow_pop(field, &seed, &head, &dist, &cell)) {
+    if (dist > field->dist[cell]) {
+      continue;
+    }
+    if (dist < field->dist[cell]) {
+      field->dist[cell] = dist;
+      lowered++;
+    }
+
+    uint32_t neighbours[4];
+    uint32_t count = flow_neighbours(field, cell, neighbours);
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t n = neighbours[k];
+
+      if (flow_walkable(level->grid[n]) && field->dist[n] > dist + 1) {
+        field->dist[n] = dist + 1;
+        lowered++;
+        DA_APPEND(&field->next, n);
+      }
+    }
+  }
+
+  field->seeds.count = 0;
+
+  return lowered;
+}
+
+// Whether cell still has a neighbour one step closer to the target that is
+// not affected
+static bool flow_supported(const struct flow_Field *field, uint32_t cell) {
+  uint32_t neighbours[4];
+  uint32_t count = flow_neighbours(field, cell, neighbours);
+
+  for (uint32_t k = 0; k < count; k++) {
+    uint32_t n = neighbours[k];
+
+    if (!field->affected[n] && field->dist[n] + 1 == field->dist[cell]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Takes away the distance of the cells in rect that were closed, and of
+// every cell whose ways to the target all went through them, then works
+// theirs out again from the cells around them
+static void flow_close_cells(struct flow_Field *field,
+                             const struct plug_Level *level,
+                             struct plug_CellRect rect) {
+  for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+    for (uint32_t x = rect.x; x < rect.x + rect.width; x++) {
+      uint32_t cell = y * field->width + x;
+
+      if (cell != field->target && !flow_walkable(level->grid[cell]) &&
+          field->dist[cell] != FLOW_UNREACHED) {
+        field->affected[cell] = 1;
+        DA_APPEND(&field->seeds, flow_seed(field->dist[cell], cell));
+      }
+    }
+  }
+
+  if (field->seeds.count == 0) {
+    return;
+  }
+
+  qsort(field->seeds.items, field->seeds.count, sizeof(*field->seeds.items),
+        flow_compare_seeds);
+
+  // Cells are found in order of their old distance, so by the time one is
+  // checked for support, every affected cell one step closer is known
+  uint64_t seed = 0, head = 0;
+  uint32_t dist, cell;
+  field->next.count = 0;
+  field->frontier.count = 0;
+
+  while (flow_pop(field, &seed, &head, &dist, &cell)) {
+    DA_APPEND(&field->frontier, cell);
+
+    uint32_t neighbours[4];
+    uint32_t count = flow_neighbours(field, cell, neighbours);
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t n = neighbours[k];
+
+      if (!field->affected[n] && n != field->target &&
+          field->dist[n] == dist + 1 && !flow_supported(field, n)) {
+        field->affected[n] = 1;
+        DA_APPEND(&field->next, n);
+      }
+    }
+  }
+  field->seeds.count = 0;
+
+  for (uint64_t i = 0; i < field->frontier.count; i++) {
+    field->dist[field->frontier.items[i]] = FLOW_UNREACHED;
+  }
+
+  for (uint64_t i = 0; i < field->frontier.count; i++) {
+    uint32_t cell = field->frontier.items[i];
+    field->affected[cell] = 0;
+
+    if (!flow_walkable(level->grid[cell])) {
+      continue;
+    }
+
+    uint32_t best = FLOW_UNREACHED;
+    uint32_t neighbours[4];
+    uint32_t count = flow_neighbours(field, cell, neighbours);
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t dist = field->dist[neighbours[k]];
+      best = dist < best ? dist : best;
+    }
+
+    if (best != FLOW_UNREACHED) {
+      DA_APPEND(&field->seeds, flow_seed(best + 1, cell));
+    }
+  }
+
+  field->repaired += field->frontier.count;
+  flow_relax(field, level);
+}
+
+// Gives the cells in rect that were opened a distance, and passes it on
+static void flow_open_cells(struct flow_Field *field,
+                            const struct plug_Level *level,
+                            struct plug_CellRect rect) {
+  for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+    for (uint32_t x = rect.x; x < rect.x + rect.width; x++) {
+      uint32_t cell = y * field->width + x;
+
+      if (cell == field->target || !flow_walkable(level->grid[cell])) {
+        continue;
+      }
+
+      uint32_t best = FLOW_UNREACHED;
+      uint32_t neighbours[4];
+      uint32_t count = flow_neighbours(field, cell, neighbours);
+
+      for (uint32_t k = 0; k < count; k++) {
+        uint32_t dist = field->dist[neighbours[k]];
+        best = dist < best ? dist : best;
+      }
+
+      if (best != FLOW_UNREACHED && best + 1 < field->dist[cell]) {
+        DA_APPEND(&field->seeds, flow_seed(best + 1, cell));
+      }
+    }
+  }
+
+  if (field->seeds.count > 0) {
+    field->repaired += flow_relax(field, level);
+  }
+}
+
+// Steps to the goal from the cells in the FLOW_NEAR_SIZE square around
+// it, going only through the square. Agents there follow these, so they
+// get to the goal itself rather than the cell the field was built for.
+static void flow_near_build(struct flow_Field *field,
+                            const struct plug_Level *level) {
+  static const int8_t steps[4][2] = {
+    { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+  };
+
+  int64_t left = (int64_t)(field->goal % field->width) - FLOW_RETARGET_CELLS;
+  int64_t top = (int64_t)(field->goal / field->width) - FLOW_RETARGET_CELLS;
+
+  uint8_t queue[FLOW_NEAR_SIZE * FLOW_NEAR_SIZE];
+  uint32_t head = 0, tail = 0;
+
+  memset(field->near, 0xff, sizeof(field->near));
+
+  uint8_t center = FLOW_RETARGET_CELLS * FLOW_NEAR_SIZE + FLOW_RETARGET_CELLS;
+  field->near[center] = 0;
+  queue[tail++] = center;
+
+  while (head < tail) {
+    uint8_t i = queue[head++];
+    int64_t x = i % FLOW_NEAR_SIZE, y = i / FLOW_NEAR_SIZE;
+
+    for (uint32_t k = 0; k < 4; k++) {
+      int64_t nx = x + steps[k][0], ny = y + steps[k][1];
+      int64_t lx = left + nx, ly = top + ny;
+
+      if (nx < 0 || ny < 0 || nx >= FLOW_NEAR_SIZE || ny >= FLOW_NEAR_SIZE ||
+          lx < 0 || ly < 0 || lx >= field->width || ly >= field->height) {
+        continue;
+      }
+
+      uint8_t n = (uint8_t)(ny * FLOW_NEAR_SIZE + nx);
+      if (field->near[n] == UINT8_MAX &&
+          flow_walkable(level->grid[ly * field->width + lx])) {
+        field->near[n] = field->near[i] + 1;
+        queue[tail++] = n;
+      }
+    }
+  }
+}
+
+void flow_field_init(struct flow_Field *field,
+                     const struct plug_Level *level) {
+  *field = (struct flow_Field){
+    .width = level->grid_width,
+    .height = level->grid_height,
+  };
+
+  size_t cells = (size_t)field->width * field->height;
+
+  field->dist = malloc(cells * sizeof(*field->dist));
+  assert(field->dist != NULL && "Failed to allocate memory");
+  memset(field->dist, 0xff, cells * sizeof(*field->dist));
+
+  field->build.dist = malloc(cells * sizeof(*field->build.dist));
+  assert(field->build.dist != NULL && "Failed to allocate memory");
+
+  field->affected = calloc(cells, sizeof(*field->affected));
+  assert(field->affected != NULL && "Failed to allocate memory");
+}
+
+void flow_field_free(struct flow_Field *field) {
+  for (uint64_t i = 0; i < field->jobs.count; i++) {
+    DA_FREE(&field->jobs.items[i].out);
+  }
+
+  DA_FREE(&field->jobs);
+  DA_FREE(&field->handles);
+  DA_FREE(&field->frontier);
+  DA_FREE(&field->next);
+  DA_FREE(&field->seeds);
+  DA_FREE(&field->build.frontier);
+  DA_FREE(&field->build.next);
+  DA_FREE(&field->build.changed);
+
+  free(field->dist);
+  free(field->build.dist);
+  free(field->affected);
+
+  *field = (struct flow_Field){ 0 };
+}
+
+bool flow_field_target(struct flow_Field *field, const struct plug_Level *level,
+                       Vector2 target, uint64_t budget_ns,
+                       struct tp_ThreadPool *pool) {
+  assert(field->width == level->grid_width &&
+         field->height == level->grid_height && "Level changed size");
+
+  uint32_t x, x_end, y, y_end;
+  if (!level_cell_range(level, CLITERAL(Rectangle){ target.x, target.y, 0, 0 },
+                        &x, &x_end, &y, &y_end)) {
+    return false;
+  }
+
+  field->goal = y * field->width + x;
+  field->has_goal = true;
+  flow_near_build(field, level);
+
+  struct flow_Build *build = &field->build;
+
+  // A build under way is finished first, or a target that keeps moving
+  // would keep starting it over
+  if (!build->running) {
+    if (field->has_target) {
+      uint32_t target_x = field->target % field->width;
+      uint32_t target_y = field->target / field->width;
+
+      uint32_t dx = x > target_x ? x - target_x : target_x - x;
+      uint32_t dy = y > target_y ? y - target_y : target_y - y;
+
+      if (dx < FLOW_RETARGET_CELLS && dy < FLOW_RETARGET_CELLS) {
+        return false;
+      }
+    }
+
+    flow_build_start(field, field->goal);
+  }
+
+  if (!flow_build_continue(field, level, pool, budget_ns)) {
+    return false;
+  }
+
+  uint32_t *swap = field->dist;
+  field->dist = build->dist;
+  build->dist = swap;
+
+  field->target = build->target;
+  field->has_target = true;
+  build->running = false;
+  field->rebuilds++;
+
+  for (uint64_t i = 0; i < build->changed.count; i++) {
+    flow_field_update_cells(field, level, build->changed.items[i]);
+  }
+  build->changed.count = 0;
+
+  return true;
+}
+
+void flow_field_update_cells(struct flow_Field *field,
+                             const struct plug_Level *level,
+                             struct plug_CellRect rect) {
+  if (field->has_goal) {
+    flow_near_build(field, level);
+  }
+
+  // Frontiers already expanded saw the cells as they were
+  if (field->build.running) {
+    DA_APPEND(&field->build.changed, rect);
+  }
+
+  if (!field->has_target) {
+    return;
+  }
+
+  PROF_ZONE("flow_update_cells");
+
+  // Closed first, so the cells cut off have no distance left when the
+  // opened ones pass theirs on
+  flow_close_cells(field, level, rect);
+  flow_open_cells(field, level, rect);
+}
+
+// The step to the neighbour of (x, y) in the square around the goal that
+// is closest to it. Returns false if (x, y) is outside the square or has
+// no way to the goal through it.
+static bool flow_near_direction(const struct flow_Field *field, uint32_t x,
+                                uint32_t y, Vector2 *direction) {
+  static const int8_t steps[4][2] = {
+    { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+  };
+
+  int64_t nx = (int64_t)x - (field->goal % field->width) + FLOW_RETARGET_CELLS;
+  int64_t ny = (int64_t)y - (field->goal / field->width) + FLOW_RETARGET_CELLS;
+
+  if (nx < 0 || ny < 0 || nx >= FLOW_NEAR_SIZE || ny >= FLOW_NEAR_SIZE) {
+    return false;
+  }
+
+  uint8_t best = field->near[ny * FLOW_NEAR_SIZE + nx];
+  if (best == UINT8_MAX) {
+    return false;
+  }
+
+  *direction = CLITERAL(Vector2){ 0 };
+
+  for (uint32_t k = 0; k < 4; k++) {
+    int64_t sx = nx + steps[k][0], sy = ny + steps[k][1];
+
+    if (sx < 0 || sy < 0 || sx >= FLOW_NEAR_SIZE || sy >= FLOW_NEAR_SIZE) {
+      continue;
+    }
+
+    uint8_t dist = field->near[sy * FLOW_NEAR_SIZE + sx];
+    if (dist < best) {
+      best = dist;
+      *direction = CLITERAL(Vector2){ steps[k][0], steps[k][1] };
+    }
+  }
+
+  return true;
+}
+
+Vector2 flow_field_direction(const struct flow_Field *field,
+                             const struct plug_Level *level, Vector2 pos) {
+  if (!field->has_goal) {
+    return CLITERAL(Vector2){ 0 };
+  }
+
+  float fx = floorf((pos.x - level->pos.x) / level->cell_size);
+  float fy = floorf((pos.y - level->pos.y) / level->cell_size);
+
+  if (!(fx >= 0.0f && fy >= 0.0f && fx < (float)field->width &&
+        fy < (float)field->height)) {
+    return CLITERAL(Vector2){ 0 };
+  }
+
+  uint32_t x = (uint32_t)fx, y = (uint32_t)fy;
+  Vector2 direction = { 0 };
+
+  if (flow_near_direction(field, x, y, &direction) || !field->has_target) {
+    return direction;
+  }
+
+  static const int8_t steps[4][2] = {
+    { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+  };
+
+  uint32_t best = field->dist[y * field->width + x];
+
+  for (uint32_t k = 0; k < 4; k++) {
+    uint32_t nx = x + steps[k][0], ny = y + steps[k][1];
+
+    // Wraps around past 0
+    if (nx >= field->width || ny >= field->height) {
+      continue;
+    }
+
+    uint32_t dist = field->dist[ny * field->width + nx];
+    if (dist < best) {
+      best = dist;
+      direction = CLITERAL(Vector2){ steps[k][0], steps[k][1] };
+    }
+  }
+
+  return direction;
+}
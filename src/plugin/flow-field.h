@@ -0,0 +1,123 @@
+#ifndef PLUGIN_FLOW_FIELD_H
+#define PLUGIN_FLOW_FIELD_H
+
+#include "plugin.h"
+#include "util/dynamic_array.h"
+#include "util/thread_pool.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+#define FLOW_UNREACHED UINT32_MAX
+
+// The field is only rebuilt once the target is this many cells (on either
+// axis) from the cell it was built for. Agents this close to the target
+// follow a small field of its own instead, worked out on every call.
+#define FLOW_RETARGET_CELLS 4
+#define FLOW_NEAR_SIZE (2 * FLOW_RETARGET_CELLS + 1)
+
+// How long a frame spends building the field again. The time is checked
+// between frontiers, so a frontier can run over.
+#define FLOW_BUILD_BUDGET_NS 1000000ull
+
+// Levels with fewer cells are always built on the calling thread
+#define FLOW_PARALLEL_CELLS (256 * 256)
+
+// Fewest frontier cells worth a job of their own
+#define FLOW_MIN_JOB_CELLS 2048
+#define FLOW_JOBS_PER_THREAD 4
+
+struct flow_Job;
+
+// A field built again over several calls, in the back buffer, while agents
+// still follow the one built before
+struct flow_Build {
+  bool running;
+  uint32_t target;
+
+  uint32_t *dist;
+  // Distance of the cells in frontier, which are next to be expanded
+  uint32_t step;
+  DA_TYPE(uint32_t) frontier, next;
+
+  // Cells changed since the build started, worked into the field once it
+  // is done
+  DA_TYPE(struct plug_CellRect) changed;
+};
+
+// Steps to the target from every cell of a level, for any number of agents
+// chasing it. Agents look up where to go in O(1) instead of searching for
+// a path each.
+struct flow_Field {
+  uint32_t width, height;
+
+  // Steps along walkable cells to the target, FLOW_UNREACHED if there is
+  // no way. One per cell.
+  uint32_t *dist;
+
+  // The cell the field leads to
+  bool has_target;
+  uint32_t target;
+
+  // The cell flow_field_target was last called with, and steps to it from
+  // the FLOW_NEAR_SIZE square around it, UINT8_MAX if there is no way
+  // inside the square
+  bool has_goal;
+  uint32_t goal;
+  uint8_t near[FLOW_NEAR_SIZE * FLOW_NEAR_SIZE];
+
+  struct flow_Build build;
+
+  // Scratch for building and repairing, declared together so they can be
+  // swapped. seeds are distances in the high half and cells in the low
+  // half, so they sort by distance.
+  DA_TYPE(uint32_t) frontier, next;
+  DA_TYPE(uint64_t) seeds;
+  DA_TYPE(struct flow_Job) jobs;
+  DA_TYPE(tp_JobHandle) handles;
+  uint8_t *affected;
+
+  uint64_t rebuilds;
+  // Cells flow_field_update_cells has worked out again, in total
+  uint64_t repaired;
+};
+
+// Agents move through cells that are neither solid nor lethal.
+static inline bool flow_walkable(enum plug_CellType cell) {
+  return !cell_props[cell].solid && !cell_props[cell].lethal;
+}
+
+// The field has no target until flow_field_target.
+void flow_field_init(struct flow_Field *field, const struct plug_Level *level);
+void flow_field_free(struct flow_Field *field);
+
+// Leads the field to the cell under target, in world space. Starts
+// building it again if it has no target yet, or the target is
+// FLOW_RETARGET_CELLS or more from the cell it was built for, and goes on
+// with a build already started until it is done or budget_ns is spent.
+// Agents follow the field built before until then. Pass UINT64_MAX to
+// finish the build in this call.
+//
+// Builds go one breadth first frontier at a time, split into jobs on pool
+// for large levels, or on the calling thread if pool == NULL. Returns true
+// if a build was done and agents follow it now.
+bool flow_field_target(struct flow_Field *field, const struct plug_Level *level,
+                       Vector2 target, uint64_t budget_ns,
+                       struct tp_ThreadPool *pool);
+
+// Brings the field up to date after the cells in rect changed. Only cells
+// whose distance changes are visited, and those next to them. A build
+// still going takes the change in once it is done.
+void flow_field_update_cells(struct flow_Field *field,
+                             const struct plug_Level *level,
+                             struct plug_CellRect rect);
+
+// The axis aligned unit step an agent at pos, in world space, should take
+// to get closer to the target. Within FLOW_RETARGET_CELLS of the target,
+// the step leads to the target itself rather than the cell the field was
+// built for. Zero if it is outside the level, already there or cannot get
+// there.
+Vector2 flow_field_direction(const struct flow_Field *field,
+                             const struct plug_Level *level, Vector2 pos);
+
+#endif // PLUGIN_FLOW_FIELD_H
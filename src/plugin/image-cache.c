@@ -0,0 +1,222 @@
+#include "image-cache.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(struct imgc_Header) == IMGC_HEADER_SIZE,
+              "Blob header must be IMGC_HEADER_SIZE bytes");
+
+uint64_t imgc_hash(const void *data, uint64_t size) {
+  const unsigned char *bytes = data;
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (uint64_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+void imgc_blob_path(char *path, size_t size, const char *cache_dir,
+                    uint64_t hash, uint32_t flags) {
+  snprintf(path, size, "%s/%016llx-%x.rgba", cache_dir,
+           (unsigned long long)hash, flags);
+}
+
+// mkdir -p
+static bool imgc_make_dir(const char *dir) {
+  char path[IMGC_PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path)) {
+    return false;
+  }
+
+  for (char *c = path + 1;; c++) {
+    if (*c != '/' && *c != '\0') {
+      continue;
+    }
+
+    char end = *c;
+    *c = '\0';
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+      fprintf(stderr, "[ERROR]: Failed to create %s: %s\n", path,
+              strerror(errno));
+      return false;
+    }
+
+    if (end == '\0') {
+      return true;
+    }
+    *c = end;
+  }
+}
+
+bool imgc_write(const char *path, Image image, uint64_t hash, uint32_t flags) {
+  struct imgc_Header header = {
+    .version = IMGC_VERSION,
+    .hash = hash,
+    .width = (uint32_t)image.width,
+    .height = (uint32_t)image.height,
+    .format = (uint32_t)image.format,
+    .flags = flags,
+    .size = (uint64_t)GetPixelDataSize(image.width, image.height,
+                                       image.format),
+  };
+  memcpy(header.magic, IMGC_MAGIC, sizeof(header.magic));
+
+  char tmp[IMGC_PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+    return false;
+  }
+
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open %s: %s\n", tmp, strerror(errno));
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(image.data, 1, header.size, f) == header.size;
+
+  if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+    fprintf(stderr, "[ERROR]: Failed to write %s\n", path);
+    remove(tmp);
+    return false;
+  }
+
+  return true;
+}
+
+bool imgc_map(const char *path, uint64_t hash, uint32_t flags,
+              struct imgc_Image *out) {
+  *out = (struct imgc_Image){ 0 };
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < IMGC_HEADER_SIZE) {
+    close(fd);
+    return false;
+  }
+
+  // Private and writable, so the image can be modified like any other
+  size_t map_size = (size_t)st.st_size;
+  void *map =
+    mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  const struct imgc_Header *header = map;
+  bool valid =
+    memcmp(header->magic, IMGC_MAGIC, sizeof(header->magic)) == 0 &&
+    header->version == IMGC_VERSION && header->hash == hash &&
+    header->flags == flags && header->width > 0 && header->height > 0 &&
+    header->size == (uint64_t)GetPixelDataSize((int)header->width,
+                                               (int)header->height,
+                                               (int)header->format) &&
+    header->size <= map_size - IMGC_HEADER_SIZE;
+
+  if (!valid) {
+    munmap(map, map_size);
+    return false;
+  }
+
+  *out = (struct imgc_Image){
+    .image = {
+      .data = (unsigned char *)map + IMGC_HEADER_SIZE,
+      .width = (int)header->width,
+      .height = (int)header->height,
+      .mipmaps = 1,
+      .format = (int)header->format,
+    },
+    .map = map,
+    .map_size = map_size,
+  };
+
+  return true;
+}
+
+bool imgc_load_memory(const char *file_type, const unsigned char *data,
+                      int size, uint64_t hash, const char *cache_dir,
+                      uint32_t flags, struct imgc_Image *out, bool *hit) {
+  char path[IMGC_PATH_MAX];
+
+  if (cache_dir != NULL) {
+    imgc_blob_path(path, sizeof(path), cache_dir, hash, flags);
+
+    if (imgc_map(path, hash, flags, out)) {
+      if (hit != NULL) {
+        *hit = true;
+      }
+      return true;
+    }
+  }
+
+  if (hit != NULL) {
+    *hit = false;
+  }
+
+  *out = (struct imgc_Image){
+    .image = LoadImageFromMemory(file_type, data, size),
+  };
+
+  if (out->image.data == NULL) {
+    return false;
+  }
+
+  ImageFormat(&out->image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  if (flags & IMGC_PREMULTIPLIED) {
+    ImageAlphaPremultiply(&out->image);
+  }
+
+  // A failed write only costs decoding again next time
+  if (cache_dir != NULL && imgc_make_dir(cache_dir)) {
+    imgc_write(path, out->image, hash, flags);
+  }
+
+  return true;
+}
+
+bool imgc_load_file(const char *path, const char *cache_dir, uint32_t flags,
+                    struct imgc_Image *out, bool *hit) {
+  int size = 0;
+  unsigned char *data = LoadFileData(path, &size);
+
+  if (data == NULL) {
+    *out = (struct imgc_Image){ 0 };
+    return false;
+  }
+
+  bool ok = imgc_load_memory(GetFileExtension(path), data, size,
+                             imgc_hash(data, (uint64_t)size), cache_dir,
+                             flags, out, hit);
+  UnloadFileData(data);
+
+  return ok;
+}
+
+void imgc_unload(struct imgc_Image *image) {
+  if (image->map != NULL) {
+    munmap(image->map, image->map_size);
+  } else {
+    UnloadImage(image->image);
+  }
+
+  *image = (struct imgc_Image){ 0 };
+}
@@ -0,0 +1,81 @@
+#ifndef PLUGIN_IMAGE_CACHE_H
+#define PLUGIN_IMAGE_CACHE_H
+
+#include <raylib/src/raylib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMGC_MAGIC "IMGC"
+
+// Bump when the blob layout or the decoding changes
+#define IMGC_VERSION 1
+
+// Pixels start this far into a blob, so a mapped blob's pixels are as
+// aligned as its header
+#define IMGC_HEADER_SIZE 64
+
+#define IMGC_PATH_MAX 512
+
+enum imgc_Flags {
+  // Colour channels multiplied by alpha, for premultiplied blending
+  IMGC_PREMULTIPLIED = 1 << 0,
+};
+
+// The header of a decoded image blob, <hash>.rgba in the cache directory
+struct imgc_Header {
+  char magic[4];
+  uint32_t version;
+
+  // Of the encoded source file, so a changed source misses the cache
+  uint64_t hash;
+
+  uint32_t width, height;
+  uint32_t format;
+  uint32_t flags;
+
+  // Bytes of pixels after the header
+  uint64_t size;
+
+  unsigned char reserved[IMGC_HEADER_SIZE - 40];
+};
+
+// A decoded image. If map != NULL, image.data points into a private mapping
+// of a cache blob, otherwise raylib owns it.
+struct imgc_Image {
+  Image image;
+
+  void *map;
+  size_t map_size;
+};
+
+// FNV-1a
+uint64_t imgc_hash(const void *data, uint64_t size);
+
+// Path of the blob of a source hashing to hash, decoded with flags.
+void imgc_blob_path(char *path, size_t size, const char *cache_dir,
+                    uint64_t hash, uint32_t flags);
+
+// Writes image as a blob at path, through a temporary file so readers
+// never see half of one.
+bool imgc_write(const char *path, Image image, uint64_t hash, uint32_t flags);
+
+// Maps the blob at path. Returns false if it is missing, truncated, from
+// another version or not of a source hashing to hash decoded with flags.
+bool imgc_map(const char *path, uint64_t hash, uint32_t flags,
+              struct imgc_Image *out);
+
+// Decodes the encoded image data of file_type (".png", ...) hashing to hash
+// into R8G8B8A8, or maps it from cache_dir if it was decoded before. Misses
+// are written back. cache_dir may be NULL to always decode. hit may be
+// NULL.
+bool imgc_load_memory(const char *file_type, const unsigned char *data,
+                      int size, uint64_t hash, const char *cache_dir,
+                      uint32_t flags, struct imgc_Image *out, bool *hit);
+
+// imgc_load_memory on the contents of path.
+bool imgc_load_file(const char *path, const char *cache_dir, uint32_t flags,
+                    struct imgc_Image *out, bool *hit);
+
+void imgc_unload(struct imgc_Image *image);
+
+#endif // PLUGIN_IMAGE_CACHE_H
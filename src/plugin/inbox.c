@@ -0,0 +1,78 @@
+#include "inbox.h"
+#include "live-reload.h"
+
+#include "util/clock.h"
+#include "util/mpsc_queue.h"
+#include "util/profiler.h"
+
+#include <stdio.h>
+
+void inbox_init(struct plug_State *state) {
+  mpsc_init(&state->inbox, INBOX_CAPACITY);
+}
+
+static void inbox_take(struct plug_State *state,
+                       struct mpsc_Message message) {
+  switch ((enum plug_MessageKind)message.kind) {
+  case MESSAGE_LIVE_JOB:
+    live_finish(state, message.data);
+    break;
+
+  case MESSAGE_KINDS_COUNT:
+    fprintf(stderr, "[ERROR]: Unknown message kind %u\n", message.kind);
+    break;
+  }
+}
+
+static void inbox_drop(struct mpsc_Message message) {
+  switch ((enum plug_MessageKind)message.kind) {
+  case MESSAGE_LIVE_JOB:
+    live_drop(message.data);
+    break;
+
+  case MESSAGE_KINDS_COUNT:
+    break;
+  }
+}
+
+void inbox_free(struct plug_State *state) {
+  struct mpsc_Message batch[INBOX_BATCH];
+  uint32_t count;
+
+  while ((count = mpsc_drain(&state->inbox, batch, INBOX_BATCH)) > 0) {
+    for (uint32_t i = 0; i < count; i++) {
+      inbox_drop(batch[i]);
+    }
+  }
+
+  mpsc_free(&state->inbox);
+}
+
+bool inbox_post(struct plug_State *state, enum plug_MessageKind kind,
+                void *data) {
+  return mpsc_push(&state->inbox, (struct mpsc_Message){
+                                    .kind = kind,
+                                    .data = data,
+                                  });
+}
+
+uint32_t inbox_poll(struct plug_State *state, uint64_t budget_ns) {
+  PROF_ZONE("inbox_poll");
+
+  uint64_t start = clk_now_ns();
+  uint32_t taken = 0;
+
+  struct mpsc_Message batch[INBOX_BATCH];
+  uint32_t count;
+
+  do {
+    count = mpsc_drain(&state->inbox, batch, INBOX_BATCH);
+
+    for (uint32_t i = 0; i < count; i++) {
+      inbox_take(state, batch[i]);
+    }
+    taken += count;
+  } while (count == INBOX_BATCH && clk_now_ns() - start < budget_ns);
+
+  return taken;
+}
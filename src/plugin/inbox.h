@@ -0,0 +1,40 @@
+#ifndef PLUGIN_INBOX_H
+#define PLUGIN_INBOX_H
+
+#include "plugin.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Messages that fit in the inbox at once. A worker posting to a full inbox
+// waits for the next frame.
+#define INBOX_CAPACITY 256
+
+// Taken out at once, and how long a frame spends on them. The time is
+// checked between batches, so a slow message can run over.
+#define INBOX_BATCH 8
+#define INBOX_BUDGET_NS 2000000ull
+
+// Workers finish loading, baking and analysis off the main thread, but
+// only the main thread may touch raylib and the state. They hand their
+// results over through state->inbox, which the main thread polls once a
+// frame, so it never blocks on them.
+//
+// The inbox lives between load_resources and unload_resources, like the
+// workers that post to it.
+void inbox_init(struct plug_State *state);
+
+// Call once every worker that posts is stopped. Drops what is left,
+// freeing what the messages own.
+void inbox_free(struct plug_State *state);
+
+// Any thread. Returns false if the inbox is full; the message is still the
+// caller's.
+bool inbox_post(struct plug_State *state, enum plug_MessageKind kind,
+                void *data);
+
+// Main thread. Takes up messages, a batch at a time, until none are left or
+// budget_ns is spent. Returns how many it took up.
+uint32_t inbox_poll(struct plug_State *state, uint64_t budget_ns);
+
+#endif // PLUGIN_INBOX_H
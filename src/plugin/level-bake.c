@@ -0,0 +1,204 @@
+#include "level-bake.h"
+#include "plugin.h"
+
+#include "util/thread_pool.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define BAKE_BANDS_PER_THREAD 4
+
+struct bake_Band {
+  const struct plug_Level *level;
+  const struct plug_Tiles *tiles;
+  Image *out;
+
+  // Source column of every destination column of a tile
+  const uint16_t *map;
+
+  uint32_t y_begin, y_end;
+};
+
+void bake_tiles_from_grid(struct plug_Tiles *tiles, const Image *atlas) {
+  const int32_t atlas_grid_tex_off = -16;
+
+  *tiles = (struct plug_Tiles){ .pages = atlas };
+
+  for (uint32_t cell = 1; cell < CELL_TYPES_COUNT; cell++) {
+    uint32_t atlas_index = (cell * ATLAS_GRID_SIZE) + atlas_grid_tex_off;
+    uint32_t x = atlas_index % (uint32_t)atlas->width;
+    uint32_t y = atlas_index / (uint32_t)atlas->width;
+
+    tiles->cells[cell] = (struct plug_Tile){
+      .present = x + ATLAS_GRID_SIZE <= (uint32_t)atlas->width &&
+                 y + ATLAS_GRID_SIZE <= (uint32_t)atlas->height,
+      .page = 0,
+      .x = x,
+      .y = y,
+    };
+  }
+}
+
+void bake_tile_map(uint32_t cell_size, uint16_t *map) {
+  for (uint32_t c = 0; c < cell_size; c++) {
+    map[c] = (uint16_t)(((2 * c + 1) * ATLAS_GRID_SIZE) / (2 * cell_size));
+  }
+}
+
+static void bake_cells(const struct plug_Level *level,
+                       const struct plug_Tiles *tiles, const uint16_t *map,
+                       Color *out, uint32_t stride, uint32_t x_begin,
+                       uint32_t x_end, uint32_t y_begin, uint32_t y_end) {
+  const uint32_t cs = level->cell_size;
+  const uint32_t row_width = (x_end - x_begin) * cs;
+
+  for (uint32_t y = y_begin; y < y_end; y++) {
+    const enum plug_CellType *cells = &level->grid[y * level->grid_width];
+    Color *rows = &out[(size_t)(y - y_begin) * cs * stride];
+
+    for (uint32_t r = 0; r < cs; r++) {
+      Color *dst = &rows[(size_t)r * stride];
+
+      // Tiles are upside down, so the bottom source row comes first
+      uint32_t src_row = map[cs - r - 1];
+
+      // Upscaling repeats source rows, every cell in the row repeats it too
+      if (r > 0 && src_row == map[cs - r]) {
+        memcpy(dst, dst - stride, row_width * sizeof(*dst));
+        continue;
+      }
+
+      for (uint32_t x = x_begin; x < x_end; x++) {
+        Color *tile_dst = &dst[(x - x_begin) * cs];
+
+        const struct plug_Tile *tile = &tiles->cells[cells[x]];
+        if (cells[x] == CELL_TYPE_NONE || !tile->present) {
+          memset(tile_dst, 0, cs * sizeof(*tile_dst));
+          continue;
+        }
+
+        const Image *page = &tiles->pages[tile->page];
+        const Color *pixels = page->data;
+        const Color *src =
+          &pixels[(size_t)(tile->y + src_row) * (uint32_t)page->width +
+                  tile->x];
+
+        if (cs == ATLAS_GRID_SIZE) {
+          memcpy(tile_dst, src, ATLAS_GRID_SIZE * sizeof(*src));
+          continue;
+        }
+
+        for (uint32_t c = 0; c < cs; c++) {
+          tile_dst[c] = src[map[c]];
+        }
+      }
+    }
+  }
+}
+
+static void *bake_band(void *in) {
+  const struct bake_Band *band = in;
+  const struct plug_Level *level = band->level;
+
+  uint32_t stride = (uint32_t)band->out->width;
+  Color *out = band->out->data;
+
+  bake_cells(level, band->tiles, band->map,
+             &out[(size_t)band->y_begin * level->cell_size * stride], stride,
+             0, level->grid_width, band->y_begin, band->y_end);
+
+  return nullptr;
+}
+
+void bake_level_region(const struct plug_Level *level,
+                       const struct plug_Tiles *tiles, const uint16_t *map,
+                       Color *out, uint32_t stride, uint32_t x_begin,
+                       uint32_t x_end, uint32_t y_begin, uint32_t y_end) {
+  assert(x_end <= level->grid_width && y_end <= level->grid_height &&
+         "Invalid region");
+
+  if (x_begin >= x_end || y_begin >= y_end) {
+    return;
+  }
+
+  bake_cells(level, tiles, map, out, stride, x_begin, x_end, y_begin, y_end);
+}
+
+Image bake_level_image(const struct plug_Level *level,
+                       const struct plug_Tiles *tiles,
+                       struct tp_ThreadPool *pool) {
+  if (level->grid_width == 0 || level->grid_height == 0 ||
+      level->cell_size == 0) {
+    return (Image){ 0 };
+  }
+
+  const uint32_t cs = level->cell_size;
+
+  Image out = {
+    .width = (int)(level->grid_width * cs),
+    .height = (int)(level->grid_height * cs),
+    .mipmaps = 1,
+    .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+  };
+
+  out.data = malloc((size_t)out.width * (size_t)out.height * sizeof(Color));
+  assert(out.data != NULL && "Failed to allocate memory");
+
+  uint16_t *map = malloc(cs * sizeof(*map));
+  assert(map != NULL && "Failed to allocate memory");
+
+  bake_tile_map(cs, map);
+
+  uint32_t band_count =
+    pool == NULL ? 1 : pool->count * BAKE_BANDS_PER_THREAD;
+  if (band_count > level->grid_height) {
+    band_count = level->grid_height;
+  }
+
+  uint32_t per_band = (level->grid_height + band_count - 1) / band_count;
+  band_count = (level->grid_height + per_band - 1) / per_band;
+
+  struct bake_Band *bands = malloc(band_count * sizeof(*bands));
+  assert(bands != NULL && "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < band_count; i++) {
+    uint32_t y_begin = i * per_band;
+    uint32_t y_end = y_begin + per_band;
+
+    bands[i] = (struct bake_Band){
+      .level = level,
+      .tiles = tiles,
+      .out = &out,
+      .map = map,
+      .y_begin = y_begin,
+      .y_end = y_end > level->grid_height ? level->grid_height : y_end,
+    };
+  }
+
+  if (pool == NULL || band_count == 1) {
+    for (uint32_t i = 0; i < band_count; i++) {
+      bake_band(&bands[i]);
+    }
+  } else {
+    tp_JobHandle *handles = malloc(band_count * sizeof(*handles));
+    assert(handles != NULL && "Failed to allocate memory");
+
+    for (uint32_t i = 0; i < band_count; i++) {
+      handles[i] = tp_add_job(pool, bake_band, &bands[i]);
+    }
+
+    for (uint32_t i = 0; i < band_count; i++) {
+      tp_wait_job(pool, handles[i]);
+    }
+
+    free(handles);
+  }
+
+  free(bands);
+  free(map);
+
+  return out;
+}
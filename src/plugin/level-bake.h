@@ -0,0 +1,38 @@
+#ifndef PLUGIN_LEVEL_BAKE_H
+#define PLUGIN_LEVEL_BAKE_H
+
+#include "plugin.h"
+#include "util/thread_pool.h"
+
+// Composes level on the CPU into a new PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+// image of (grid_width * cell_size) x (grid_height * cell_size) pixels,
+// exactly as it appears on screen after the old DrawTexturePro bake: rows in
+// level order with every tile flipped vertically. Tiles are scaled with
+// nearest sampling and copied, not blended, and empty cells are left
+// transparent.
+//
+// Bands of rows are baked on pool, or on the calling thread if pool == NULL.
+// Returns an image with data == NULL if the level is empty. The caller owns
+// the image.
+Image bake_level_image(const struct plug_Level *level,
+                       const struct plug_Tiles *tiles,
+                       struct tp_ThreadPool *pool);
+
+// Fills map with the source column of every column of a tile scaled to
+// cell_size pixels: nearest sampling of the pixel centres, as DrawTexturePro
+// does with point filtering. map must have room for cell_size entries.
+void bake_tile_map(uint32_t cell_size, uint16_t *map);
+
+// Bakes the cells [x_begin, x_end) x [y_begin, y_end) of level the same way
+// into out, whose rows are stride pixels apart. Empty cells are cleared. map
+// is bake_tile_map of level->cell_size. Never allocates.
+void bake_level_region(const struct plug_Level *level,
+                       const struct plug_Tiles *tiles, const uint16_t *map,
+                       Color *out, uint32_t stride, uint32_t x_begin,
+                       uint32_t x_end, uint32_t y_begin, uint32_t y_end);
+
+// Tiles at the fixed positions of the original 16 px grid atlas, the way
+// load_level used to find them. atlas must outlive tiles.
+void bake_tiles_from_grid(struct plug_Tiles *tiles, const Image *atlas);
+
+#endif // PLUGIN_LEVEL_BAKE_H
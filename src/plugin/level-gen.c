@@ -0,0 +1,469 @@
+#include "level-gen.h"
+#include "plugin.h"
+#include "level.h"
+#include "update-player.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+#include "util/thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+// Edge heights are picked from the lowest this many rows
+#define GEN_EDGE_SPREAD 8
+
+// Columns a change of height takes, and flat columns after every gap or
+// run of spikes to land on
+#define GEN_STEP_COLUMNS 3
+#define GEN_LANDING_COLUMNS 2
+
+#define GEN_MAX_FLAT 6
+
+// Bridges of vanishing cells are up to this much longer than a gap
+#define GEN_BRIDGE_EXTRA 2
+
+// Chances in percent, of the features and of what goes on top of them.
+// Bridges of vanishing cells get the rest.
+#define GEN_CHANCE_FLAT 40
+#define GEN_CHANCE_GAP 15
+#define GEN_CHANCE_SPIKES 12
+#define GEN_CHANCE_STEP 25
+#define GEN_CHANCE_PICKUP 10
+#define GEN_CHANCE_PIT_SPIKES 50
+
+// A column of a segment, bottom up: floor up to height, except the top
+// cell, which is top, then above. Nothing but the top cell if hollow. A
+// height of 0 is a gap, with above in the bottom row.
+struct gen_Column {
+  uint32_t height;
+  enum plug_CellType top;
+  enum plug_CellType above;
+  bool hollow;
+};
+
+struct gen_Job {
+  const struct gen_Options *options;
+  struct gen_Limits limits;
+  struct plug_Level *level;
+
+  uint32_t first, last;
+};
+
+// Generates one segment
+struct gen_Segment {
+  const struct gen_Options *options;
+  const struct gen_Limits *limits;
+
+  uint64_t rng;
+  uint32_t max_height;
+
+  struct gen_Column columns[GEN_SEGMENT_WIDTH];
+  uint32_t count;
+};
+
+static uint64_t gen_mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+
+  return x ^ (x >> 31);
+}
+
+static uint64_t gen_next(struct gen_Segment *segment) {
+  segment->rng = gen_mix(segment->rng);
+  return segment->rng;
+}
+
+// Uniform in [min, max]
+static uint32_t gen_between(struct gen_Segment *segment, uint32_t min,
+                            uint32_t max) {
+  return min + (uint32_t)(gen_next(segment) % (max - min + 1));
+}
+
+static bool gen_chance(struct gen_Segment *segment, uint32_t percent) {
+  return gen_next(segment) % 100 < percent;
+}
+
+struct gen_Limits gen_limits(uint32_t cell_size) {
+  float jump_speed = fabsf((float)PLAYER_JUMP_SPEED);
+
+  float jump_height = jump_speed * jump_speed / (2.0f * GRAVITY);
+  float air_time = 2.0f * jump_speed / GRAVITY;
+  float jump_length = air_time * PLAYER_TERMINAL_SPEED;
+
+  return (struct gen_Limits){
+    .max_rise = (uint32_t)(jump_height * GEN_JUMP_MARGIN / (float)cell_size),
+    .max_drop = GEN_MAX_DROP,
+    .max_gap = (uint32_t)(jump_length * GEN_JUMP_MARGIN / (float)cell_size),
+  };
+}
+
+// Heights are rows of ground counted from the bottom
+static uint32_t gen_max_height(const struct gen_Options *options) {
+  return options->height - GEN_HEADROOM;
+}
+
+// The ground height at the first column of segment index, which the
+// segment before it ends on
+static uint32_t gen_edge_height(const struct gen_Options *options,
+                                const struct gen_Limits *limits,
+                                uint32_t index) {
+  uint32_t spread = gen_max_height(options);
+  spread = spread < GEN_EDGE_SPREAD ? spread : GEN_EDGE_SPREAD;
+
+  // A segment must be able to climb from any edge height to any other
+  uint32_t climb = limits->max_rise < limits->max_drop ? limits->max_rise
+                                                       : limits->max_drop;
+  uint64_t reach =
+    1 + (uint64_t)climb *
+          ((GEN_SEGMENT_WIDTH - 2 * GEN_EDGE_COLUMNS) / GEN_STEP_COLUMNS);
+  spread = reach < spread ? (uint32_t)reach : spread;
+
+  uint64_t hash = gen_mix(options->seed ^ gen_mix(index));
+  return 1 + (uint32_t)(hash % spread);
+}
+
+// Whether the ground can get from height to target in the columns left
+static bool gen_can_reach(const struct gen_Limits *limits, uint32_t height,
+                          uint32_t target, uint32_t columns) {
+  uint64_t steps = columns / GEN_STEP_COLUMNS;
+
+  if (height <= target) {
+    return target - height <= steps * limits->max_rise;
+  }
+
+  return height - target <= steps * limits->max_drop;
+}
+
+static void gen_push(struct gen_Segment *segment, struct gen_Column column) {
+  assert(segment->count < GEN_SEGMENT_WIDTH && "Segment overflow");
+  segment->columns[segment->count++] = column;
+
+  uint32_t top = column.height + 1;
+  segment->max_height = top > segment->max_height ? top : segment->max_height;
+}
+
+static void gen_flat(struct gen_Segment *segment, uint32_t height,
+                     uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    gen_push(segment, (struct gen_Column){
+                        .height = height,
+                        .top = CELL_TYPE_FLOOR,
+                      });
+  }
+}
+
+enum gen_Feature {
+  GEN_FEATURE_FLAT = 0,
+  GEN_FEATURE_GAP,
+  GEN_FEATURE_SPIKES,
+  GEN_FEATURE_BRIDGE,
+  GEN_FEATURE_STEP,
+};
+
+static enum gen_Feature gen_pick_feature(struct gen_Segment *segment) {
+  uint32_t roll = (uint32_t)(gen_next(segment) % 100);
+
+  if (roll < GEN_CHANCE_FLAT) {
+    return GEN_FEATURE_FLAT;
+  }
+  roll -= GEN_CHANCE_FLAT;
+
+  if (roll < GEN_CHANCE_GAP) {
+    return GEN_FEATURE_GAP;
+  }
+  roll -= GEN_CHANCE_GAP;
+
+  if (roll < GEN_CHANCE_SPIKES) {
+    return GEN_FEATURE_SPIKES;
+  }
+  roll -= GEN_CHANCE_SPIKES;
+
+  return roll < GEN_CHANCE_STEP ? GEN_FEATURE_STEP : GEN_FEATURE_BRIDGE;
+}
+
+// A run of count columns of the same kind, and flat ground after it to
+// land on
+static void gen_run_of(struct gen_Segment *segment, struct gen_Column column,
+                       uint32_t count, uint32_t landing) {
+  for (uint32_t i = 0; i < count; i++) {
+    gen_push(segment, column);
+  }
+
+  gen_flat(segment, landing, GEN_LANDING_COLUMNS);
+}
+
+// One feature of at most columns columns, starting at height. Returns the
+// height it ends on, from which target is still in reach.
+static uint32_t gen_feature(struct gen_Segment *segment, uint32_t height,
+                            uint32_t target, uint32_t columns) {
+  const struct gen_Limits *limits = segment->limits;
+
+  uint32_t gap = limits->max_gap > 0
+                   ? gen_between(segment, 1, limits->max_gap)
+                   : 0;
+  uint32_t jump = gap + GEN_LANDING_COLUMNS;
+
+  switch (gen_pick_feature(segment)) {
+  case GEN_FEATURE_FLAT: {
+    uint32_t count = gen_between(segment, 1, GEN_MAX_FLAT);
+    count = count < columns ? count : columns;
+
+    if (!gen_can_reach(limits, height, target, columns - count)) {
+      break;
+    }
+
+    uint32_t first = segment->count;
+    gen_flat(segment, height, count);
+
+    if (gen_chance(segment, GEN_CHANCE_PICKUP)) {
+      segment->columns[first].above = gen_chance(segment, 50)
+                                        ? CELL_TYPE_SHRINK_PLAYER
+                                        : CELL_TYPE_EXPAND_PLAYER;
+    }
+
+    return height;
+  }
+
+  case GEN_FEATURE_GAP: {
+    // Falling lengthens the jump, so the far side may be lower
+    uint32_t drop = gen_between(segment, 0, limits->max_drop);
+    uint32_t landing = height > drop ? height - drop : 1;
+
+    if (gap == 0 || jump > columns ||
+        !gen_can_reach(limits, landing, target, columns - jump)) {
+      break;
+    }
+
+    bool spikes = gen_chance(segment, GEN_CHANCE_PIT_SPIKES);
+    gen_run_of(segment,
+               (struct gen_Column){
+                 .height = 0,
+                 .above = spikes ? CELL_TYPE_SPIKES : CELL_TYPE_NONE,
+               },
+               gap, landing);
+
+    return landing;
+  }
+
+  case GEN_FEATURE_SPIKES:
+    if (gap == 0 || jump > columns ||
+        !gen_can_reach(limits, height, target, columns - jump)) {
+      break;
+    }
+
+    gen_run_of(segment,
+               (struct gen_Column){
+                 .height = height,
+                 .top = CELL_TYPE_SPIKE_FLOOR,
+               },
+               gap, height);
+
+    return height;
+
+  case GEN_FEATURE_BRIDGE: {
+    uint32_t bridge = gap + gen_between(segment, 0, GEN_BRIDGE_EXTRA);
+    uint32_t walk = bridge + GEN_LANDING_COLUMNS;
+
+    if (gap == 0 || walk > columns ||
+        !gen_can_reach(limits, height, target, columns - walk)) {
+      break;
+    }
+
+    gen_run_of(segment,
+               (struct gen_Column){
+                 .height = height,
+                 .top = CELL_TYPE_VANISH,
+                 .hollow = true,
+               },
+               bridge, height);
+
+    return height;
+  }
+
+  case GEN_FEATURE_STEP:
+    break;
+  }
+
+  // A step, picked at random or, if that or the feature picked does not
+  // leave target in reach, towards it. There is always room for that.
+  uint32_t count = columns < GEN_STEP_COLUMNS ? columns : GEN_STEP_COLUMNS;
+
+  int64_t next = (int64_t)height - limits->max_drop +
+                 gen_between(segment, 0, limits->max_rise + limits->max_drop);
+  next = next < 1 ? 1 : next;
+  next = next > gen_max_height(segment->options)
+           ? gen_max_height(segment->options)
+           : next;
+
+  if (!gen_can_reach(limits, (uint32_t)next, target, columns - count)) {
+    if (height < target) {
+      next = height + limits->max_rise < target ? height + limits->max_rise
+                                                : target;
+    } else {
+      next = height > target + limits->max_drop ? height - limits->max_drop
+                                                : target;
+    }
+  }
+
+  gen_flat(segment, (uint32_t)next, count);
+
+  return (uint32_t)next;
+}
+
+static void gen_segment(struct gen_Segment *segment, struct plug_Level *level,
+                        uint32_t index) {
+  const struct gen_Options *options = segment->options;
+  const struct gen_Limits *limits = segment->limits;
+
+  uint32_t first = index * GEN_SEGMENT_WIDTH;
+  uint32_t width = options->width - first;
+  width = width < GEN_SEGMENT_WIDTH ? width : GEN_SEGMENT_WIDTH;
+  bool last = first + width == options->width;
+
+  segment->rng = gen_mix(options->seed + gen_mix(~(uint64_t)index));
+  segment->count = 0;
+  segment->max_height = 0;
+
+  uint32_t height = gen_edge_height(options, limits, index);
+  uint32_t target =
+    last ? height : gen_edge_height(options, limits, index + 1);
+
+  // The last segment may be too short for both edges
+  uint32_t edges = width < 2 * GEN_EDGE_COLUMNS ? 0 : GEN_EDGE_COLUMNS;
+  gen_flat(segment, height, edges);
+
+  while (segment->count < width - edges) {
+    height = gen_feature(segment, height, target,
+                         width - edges - segment->count);
+  }
+
+  gen_flat(segment, height, edges);
+
+  if (index > 0) {
+    segment->columns[0].above = CELL_TYPE_CHECKPOINT;
+  }
+  if (last) {
+    segment->columns[width - 1].above = CELL_TYPE_FINISH;
+  }
+
+  // Row by row, so the writes stream
+  uint32_t rows = options->height;
+  for (uint32_t y = 0; y < rows; y++) {
+    enum plug_CellType *row =
+      &level->grid[(uint64_t)y * options->width + first];
+    uint32_t r = rows - y;
+
+    if (r > segment->max_height) {
+      memset(row, 0, width * sizeof(*row));
+      continue;
+    }
+
+    for (uint32_t x = 0; x < width; x++) {
+      const struct gen_Column *column = &segment->columns[x];
+
+      enum plug_CellType cell = CELL_TYPE_NONE;
+      if (r < column->height && !column->hollow) {
+        cell = CELL_TYPE_FLOOR;
+      } else if (r == column->height) {
+        cell = column->top;
+      } else if (r == column->height + 1) {
+        cell = column->above;
+      }
+
+      row[x] = cell;
+    }
+  }
+}
+
+static void *gen_run(void *p) {
+  struct gen_Job *job = p;
+
+  struct gen_Segment *segment = malloc(sizeof(*segment));
+  assert(segment != NULL && "Failed to allocate memory");
+
+  *segment = (struct gen_Segment){
+    .options = job->options,
+    .limits = &job->limits,
+  };
+
+  for (uint32_t i = job->first; i < job->last; i++) {
+    gen_segment(segment, job->level, i);
+  }
+
+  free(segment);
+
+  return NULL;
+}
+
+bool gen_level(struct plug_Level *level, const struct gen_Options *options) {
+  PROF_ZONE("gen_level");
+
+  if (options->width < GEN_MIN_WIDTH || options->height < GEN_MIN_HEIGHT ||
+      options->cell_size == 0) {
+    return false;
+  }
+
+  *level = (struct plug_Level){
+    .grid_width = options->width,
+    .grid_height = options->height,
+    .cell_size = options->cell_size,
+    .grid = malloc((uint64_t)options->width * options->height *
+                   sizeof(*level->grid)),
+    .owns_grid = true,
+  };
+  assert(level->grid != NULL && "Failed to allocate memory");
+
+  struct gen_Limits limits = gen_limits(options->cell_size);
+
+  uint32_t segments =
+    (options->width + GEN_SEGMENT_WIDTH - 1) / GEN_SEGMENT_WIDTH;
+  uint32_t job_count =
+    (segments + GEN_SEGMENTS_PER_JOB - 1) / GEN_SEGMENTS_PER_JOB;
+
+  DA_TYPE(struct gen_Job) jobs = { 0 };
+  DA_TYPE(tp_JobHandle) handles = { 0 };
+
+  for (uint32_t i = 0; i < job_count; i++) {
+    uint32_t last = (i + 1) * GEN_SEGMENTS_PER_JOB;
+
+    DA_APPEND(&jobs, ((struct gen_Job){
+                       .options = options,
+                       .limits = limits,
+                       .level = level,
+                       .first = i * GEN_SEGMENTS_PER_JOB,
+                       .last = last < segments ? last : segments,
+                     }));
+  }
+
+  if (options->pool == NULL || job_count == 1) {
+    for (uint32_t i = 0; i < job_count; i++) {
+      gen_run(&jobs.items[i]);
+    }
+
+  } else {
+    for (uint32_t i = 0; i < job_count; i++) {
+      DA_APPEND(&handles, tp_add_job(options->pool, gen_run, &jobs.items[i]));
+    }
+
+    for (uint32_t i = 0; i < job_count; i++) {
+      tp_wait_job(options->pool, handles.items[i]);
+    }
+  }
+
+  DA_FREE(&jobs);
+  DA_FREE(&handles);
+
+  // Standing on the ground of the first column
+  uint32_t spawn_height = gen_edge_height(options, &limits, 0);
+  level->spawn = CLITERAL(Vector2){
+    0.0f,
+    (float)((options->height - spawn_height) * options->cell_size) -
+      PLAYER_SIZE,
+  };
+
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef PLUGIN_LEVEL_GEN_H
+#define PLUGIN_LEVEL_GEN_H
+
+#include "plugin.h"
+#include "util/thread_pool.h"
+
+#include <stdint.h>
+
+// Levels are generated GEN_SEGMENT_WIDTH columns at a time. Segments only
+// share the ground height at their edges, which depends on nothing but the
+// seed, so they are generated independently and in any order.
+#define GEN_SEGMENT_WIDTH 256
+
+// Every segment starts and ends with this many flat columns, at the height
+// shared with its neighbour
+#define GEN_EDGE_COLUMNS 2
+
+// Rows kept clear above the highest ground, to jump in
+#define GEN_HEADROOM 4
+
+#define GEN_MIN_WIDTH (2 * GEN_EDGE_COLUMNS + 1)
+#define GEN_MIN_HEIGHT (GEN_HEADROOM + 1)
+
+// Share of the jump the player's physics allow that generated jumps need,
+// so they can be made without being frame perfect
+#define GEN_JUMP_MARGIN 0.8f
+
+// The furthest the ground drops from one column to the next, in cells
+#define GEN_MAX_DROP 3
+
+// Segments each thread pool job generates
+#define GEN_SEGMENTS_PER_JOB 16
+
+// What the player can get over, in cells, worked out from the physics in
+// plugin.h
+struct gen_Limits {
+  // Ground rising from one column to the next
+  uint32_t max_rise;
+  // Ground dropping from one column to the next
+  uint32_t max_drop;
+  // Gap or run of spikes jumped from and to the same height
+  uint32_t max_gap;
+};
+
+struct gen_Options {
+  uint64_t seed;
+
+  uint32_t width, height;
+  uint32_t cell_size;
+
+  // Segments are generated on the calling thread if pool == NULL
+  struct tp_ThreadPool *pool;
+};
+
+struct gen_Limits gen_limits(uint32_t cell_size);
+
+// Generates a level of floors, gaps, spikes, vanishing bridges, shrink and
+// expand cells, a checkpoint every segment and the finish in the last
+// column, walking right from the spawn in the first column. Only jumps
+// within gen_limits are needed to get through. The same options give the
+// same level, whatever the pool. level owns its grid. Returns false if the
+// level would be smaller than GEN_MIN_WIDTH by GEN_MIN_HEIGHT.
+bool gen_level(struct plug_Level *level, const struct gen_Options *options);
+
+#endif // PLUGIN_LEVEL_GEN_H
@@ -1,8 +1,32 @@
 #include "plugin.h"
 #include "level.h"
+#include "load-resources.h"
 #include "util/dynamic_array.h"
+#include "util/fileIO.h"
+#include "util/profiler.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+const struct plug_CellProps cell_props[CELL_TYPES_COUNT] = {
+  [CELL_TYPE_NONE] = { 0 },
+  [CELL_TYPE_FLOOR] = { .solid = true },
+  [CELL_TYPE_SPIKES] = { .lethal = true, .trigger = TRIGGER_HAZARD },
+  [CELL_TYPE_SPIKE_FLOOR] = { .solid = true,
+                              .lethal = true,
+                              .trigger = TRIGGER_HAZARD },
+  [CELL_TYPE_VANISH] = { .solid = true,
+                         .one_way = true,
+                         .trigger = TRIGGER_VANISH },
+  [CELL_TYPE_SHRINK_PLAYER] = { .trigger = TRIGGER_SHRINK },
+  [CELL_TYPE_EXPAND_PLAYER] = { .trigger = TRIGGER_EXPAND },
+  [CELL_TYPE_CHECKPOINT] = { .trigger = TRIGGER_CHECKPOINT },
+  [CELL_TYPE_FINISH] = { .trigger = TRIGGER_FINISH },
+  [CELL_TYPE_VANISHING] = { .solid = true, .one_way = true },
+};
 
 // clang-format off
 
@@ -26,89 +50,477 @@
 
 // clang-format on
 
-void import_level(const char *level_path, struct plug_State *state) {
-  (void)level_path;
+// Returns the next line that is neither empty nor a comment, terminated in
+// place, or NULL at the end of the text.
+static char *next_line(char **cursor) {
+  while (**cursor != '\0') {
+    char *line = *cursor;
+    char *end = strchr(line, '\n');
+
+    if (end != NULL) {
+      *end = '\0';
+      *cursor = end + 1;
+    } else {
+      *cursor = line + strlen(line);
+    }
+
+    if (end != NULL && end > line && end[-1] == '\r') {
+      end[-1] = '\0';
+    }
+
+    if (line[0] != '\0' && line[0] != '#') {
+      return line;
+    }
+  }
+
+  return NULL;
+}
+
+static bool parse_level(char *text, const char *path,
+                        struct plug_Level *level) {
+  char *cursor = text;
+
+  char *header = next_line(&cursor);
+  if (header == NULL ||
+      sscanf(header, "%u %u %u %f %f", &level->grid_width,
+             &level->grid_height, &level->cell_size, &level->spawn.x,
+             &level->spawn.y) != 5 ||
+      level->grid_width == 0 || level->grid_height == 0 ||
+      level->cell_size == 0) {
+    fprintf(stderr, "[ERROR]: %s: invalid level header\n", path);
+    return false;
+  }
+
+  level->grid = malloc((size_t)level->grid_width * level->grid_height *
+                       sizeof(*level->grid));
+  assert(level->grid != NULL && "Failed to allocate memory");
+  level->owns_grid = true;
+
+  for (uint32_t y = 0; y < level->grid_height; y++) {
+    char *row = next_line(&cursor);
+    if (row == NULL || strlen(row) < level->grid_width) {
+      fprintf(stderr, "[ERROR]: %s: row %u is missing or too short\n", path,
+              y);
+      free(level->grid);
+      return false;
+    }
+
+    for (uint32_t x = 0; x < level->grid_width; x++) {
+      // CELL_TYPE_VANISHING only ever comes from the fixed steps
+      int cell = row[x] - '0';
+      if (cell < 0 || cell >= CELL_TYPE_VANISHING) {
+        fprintf(stderr, "[ERROR]: %s: invalid cell '%c' at %u, %u\n", path,
+                row[x], x, y);
+        free(level->grid);
+        return false;
+      }
+
+      level->grid[y * level->grid_width + x] = cell;
+    }
+  }
+
+  return true;
+}
+
+bool level_read(const char *path, struct plug_Level *level) {
+  *level = (struct plug_Level){ 0 };
+
+  char *text = fio_read_file(path);
+  if (text == NULL) {
+    return false;
+  }
+
+  bool ok = parse_level(text, path, level);
+  UTIL_FREE(text);
+
+  return ok;
+}
+
+bool level_write(const char *path, const struct plug_Level *level) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open file %s: ", path);
+    perror(NULL);
+    return false;
+  }
+
+  fprintf(f, "%u %u %u %g %g\n", level->grid_width, level->grid_height,
+          level->cell_size, level->spawn.x, level->spawn.y);
+
+  char *row = malloc(level->grid_width + 1);
+  assert(row != NULL && "Failed to allocate memory");
+  row[level->grid_width] = '\n';
 
-  // Load default level for now
-  struct plug_Level level = {
-    .grid_width = DEFAULT_LEVEL_WIDTH,
-    .grid_height = DEFAULT_LEVEL_HEIGHT,
+  for (uint32_t y = 0; y < level->grid_height; y++) {
+    const enum plug_CellType *cells =
+      &level->grid[(uint64_t)y * level->grid_width];
+
+    // A vanishing cell is saved as the vanish cell it comes back as, since
+    // parse_level rejects CELL_TYPE_VANISHING
+    for (uint32_t x = 0; x < level->grid_width; x++) {
+      enum plug_CellType cell =
+        cells[x] == CELL_TYPE_VANISHING ? CELL_TYPE_VANISH : cells[x];
+      row[x] = (char)('0' + cell);
+    }
+
+    fwrite(row, 1, level->grid_width + 1, f);
+  }
+
+  free(row);
+
+  bool ok = !ferror(f);
+  ok &= fclose(f) == 0;
+  if (!ok) {
+    fprintf(stderr, "[ERROR]: Failed to write %s\n", path);
+  }
+
+  return ok;
+}
 
-    .cell_size = DEFAULT_LEVEL_CELL_SIZE,
+#define LEVEL_KEY "level/%s"
 
-    .pos = { 0 },
+// A parsed level file, as the host keeps it
+struct level_Shared {
+  uint32_t grid_width, grid_height;
+  uint32_t cell_size;
+  Vector2 spawn;
 
-    .grid = (enum plug_CellType *)defualt_grid,
-    .grid_tex = { 0 },
+  enum plug_CellType grid[];
+};
 
-    .loaded = false,
+// Points level at shared, copying the grid only when a cell is changed
+static void level_attach(struct plug_Level *level,
+                         const struct level_Shared *shared) {
+  *level = (struct plug_Level){
+    .grid_width = shared->grid_width,
+    .grid_height = shared->grid_height,
+    .cell_size = shared->cell_size,
+    .spawn = shared->spawn,
+    .grid = (enum plug_CellType *)shared->grid,
+    .owns_grid = false,
   };
+}
+
+static bool level_has_finish(const struct plug_Level *level) {
+  uint64_t cells = (uint64_t)level->grid_width * level->grid_height;
+
+  for (uint64_t i = 0; i < cells; i++) {
+    if (cell_props[level->grid[i]].trigger == TRIGGER_FINISH) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// A level without a finish can be played but never completed
+static void level_check_finish(const struct plug_Level *level) {
+  if (!level_has_finish(level)) {
+    fprintf(stderr, "[WARNING]: %s has no finish cell\n", level->path);
+  }
+}
+
+bool import_level(const char *level_path, struct plug_State *state) {
+  PROF_ZONE("import_level");
+
+  if (level_path == NULL) {
+    struct plug_Level level = {
+      .grid_width = DEFAULT_LEVEL_WIDTH,
+      .grid_height = DEFAULT_LEVEL_HEIGHT,
+
+      .cell_size = DEFAULT_LEVEL_CELL_SIZE,
+
+      .pos = { 0 },
+      .spawn = { DEFAULT_LEVEL_SPAWN_X, DEFAULT_LEVEL_SPAWN_Y },
+
+      .grid = (enum plug_CellType *)defualt_grid,
+      .owns_grid = false,
+
+      .loaded = false,
+    };
+
+    DA_APPEND(&state->levels, level);
+    return true;
+  }
+
+  char key[PLUG_RESOURCE_KEY_MAX];
+  snprintf(key, sizeof(key), LEVEL_KEY, level_path);
+
+  struct plug_Level level = { 0 };
+
+  // Parsed before, by this plugin or one loaded earlier
+  struct plug_Resource *resource = acquire_resource(state, key);
+  if (resource != NULL) {
+    level_attach(&level, resource->data.data);
+    level.path = strdup(level_path);
+    assert(level.path != NULL && "Failed to allocate memory");
+
+    DA_APPEND(&state->levels, level);
+    return true;
+  }
 
+  if (!level_read(level_path, &level)) {
+    return false;
+  }
+
+  if (state->host != NULL) {
+    size_t cells = (size_t)level.grid_width * level.grid_height;
+    size_t size = sizeof(struct level_Shared) + cells * sizeof(*level.grid);
+
+    struct level_Shared *shared = malloc(size);
+    assert(shared != NULL && "Failed to allocate memory");
+
+    *shared = (struct level_Shared){
+      .grid_width = level.grid_width,
+      .grid_height = level.grid_height,
+      .cell_size = level.cell_size,
+      .spawn = level.spawn,
+    };
+    memcpy(shared->grid, level.grid, cells * sizeof(*level.grid));
+    free(level.grid);
+
+    share_resource(state, key,
+                   &(struct plug_Resource){
+                     .kind = PLUG_RESOURCE_DATA,
+                     .data = { shared, size },
+                   });
+    level_attach(&level, shared);
+  }
+
+  level.path = strdup(level_path);
+  assert(level.path != NULL && "Failed to allocate memory");
+
+  level_check_finish(&level);
   DA_APPEND(&state->levels, level);
+
+  return true;
 }
 
 void unload_levels(struct plug_State *state) {
-  if (state->current_level >= 0) {
-    UnloadRenderTexture(
-      DA_AT(state->levels, (uint32_t)state->current_level).grid_tex);
+  unload_level(state);
+  state->current_level = -1;
+
+  for (uint64_t i = 0; i < state->levels.count; i++) {
+    struct plug_Level *level = &DA_AT(state->levels, i);
+
+    if (level->owns_grid) {
+      free(level->grid);
+    }
+    free(level->path);
 
-    DA_AT(state->levels, (uint32_t)state->current_level).loaded = false;
-    state->current_level = -1;
+    DA_FREE(&level->dirty);
+    DA_FREE(&level->stepped);
   }
 
   DA_FREE(&state->levels);
 }
 
-void load_level(struct plug_State *state) {
-  if (state->current_level < 0) {
+bool level_cell_range(const struct plug_Level *level, Rectangle aabb,
+                      uint32_t *x_begin, uint32_t *x_end, uint32_t *y_begin,
+                      uint32_t *y_end) {
+  float x0 = floorf((aabb.x - level->pos.x) / level->cell_size);
+  float y0 = floorf((aabb.y - level->pos.y) / level->cell_size);
+  float x1 = floorf((aabb.x + aabb.width - level->pos.x) / level->cell_size);
+  float y1 = floorf((aabb.y + aabb.height - level->pos.y) / level->cell_size);
+
+  if (!(x1 >= 0.0f && y1 >= 0.0f && x0 < (float)level->grid_width &&
+        y0 < (float)level->grid_height)) {
+    return false;
+  }
+
+  *x_begin = x0 < 0.0f ? 0 : (uint32_t)x0;
+  *y_begin = y0 < 0.0f ? 0 : (uint32_t)y0;
+  *x_end = x1 >= level->grid_width ? level->grid_width : (uint32_t)x1 + 1;
+  *y_end = y1 >= level->grid_height ? level->grid_height : (uint32_t)y1 + 1;
+
+  return true;
+}
+
+static uint64_t cell_rect_area(struct plug_CellRect rect) {
+  return (uint64_t)rect.width * rect.height;
+}
+
+static struct plug_CellRect cell_rect_union(struct plug_CellRect a,
+                                            struct plug_CellRect b) {
+  uint32_t x0 = a.x < b.x ? a.x : b.x;
+  uint32_t y0 = a.y < b.y ? a.y : b.y;
+  uint32_t x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+  uint32_t y1 =
+    a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+
+  return (struct plug_CellRect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static void level_mark_dirty(struct plug_Level *level,
+                             struct plug_CellRect rect) {
+  // A merged rect can reach others it could not before, so keep going until
+  // nothing merges
+  bool merged;
+  do {
+    merged = false;
+
+    for (uint64_t i = 0; i < level->dirty.count; i++) {
+      struct plug_CellRect other = level->dirty.items[i];
+      struct plug_CellRect joined = cell_rect_union(rect, other);
+
+      if (cell_rect_area(joined) <= cell_rect_area(rect) +
+                                      cell_rect_area(other) +
+                                      LEVEL_DIRTY_MERGE_SLACK) {
+        rect = joined;
+        level->dirty.items[i] = level->dirty.items[--level->dirty.count];
+        merged = true;
+        break;
+      }
+    }
+  } while (merged);
+
+  if (level->dirty.count < LEVEL_MAX_DIRTY_RECTS) {
+    DA_APPEND(&level->dirty, rect);
     return;
   }
 
-  struct plug_Level *level =
-    &DA_AT(state->levels, (uint32_t)state->current_level);
-  if (level->loaded) {
+  // Fold into whichever rect grows the least
+  uint64_t best = 0, best_growth = UINT64_MAX;
+  for (uint64_t i = 0; i < level->dirty.count; i++) {
+    struct plug_CellRect other = level->dirty.items[i];
+    uint64_t growth =
+      cell_rect_area(cell_rect_union(rect, other)) - cell_rect_area(other);
+
+    if (growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+
+  level->dirty.items[best] = cell_rect_union(rect, level->dirty.items[best]);
+}
+
+// Copies the grid if the level does not own it, so cells can change
+static void level_own_grid(struct plug_Level *level) {
+  if (level->owns_grid) {
     return;
   }
 
-  level->grid_tex = LoadRenderTexture(level->grid_width * level->cell_size,
-                                      level->grid_height * level->cell_size);
+  size_t size =
+    (size_t)level->grid_width * level->grid_height * sizeof(*level->grid);
+  enum plug_CellType *grid = malloc(size);
+  assert(grid != NULL && "Failed to allocate memory");
 
-  BeginTextureMode(level->grid_tex);
+  memcpy(grid, level->grid, size);
+  level->grid = grid;
+  level->owns_grid = true;
+}
 
-  const int32_t atlas_grid_tex_off = -16;
+void level_set_cell(struct plug_Level *level, uint32_t x, uint32_t y,
+                    enum plug_CellType cell) {
+  assert(x < level->grid_width && y < level->grid_height && "Invalid cell");
+  assert(cell < CELL_TYPES_COUNT && "Invalid cell type");
 
-  for (uint32_t y = 0; y < level->grid_height; y++) {
-    for (uint32_t x = 0; x < level->grid_width; x++) {
-      enum plug_CellType cell = level->grid[y * level->grid_width + x];
+  uint32_t index = y * level->grid_width + x;
+  if (level->grid[index] == cell) {
+    return;
+  }
 
-      if (cell == 0) {
-        continue;
-      }
+  level_own_grid(level);
+
+  level->grid[index] = cell;
+  level_mark_dirty(level, CLITERAL(struct plug_CellRect){ x, y, 1, 1 });
+}
+
+void level_step_cell(struct plug_Level *level, uint32_t index,
+                     enum plug_CellType cell) {
+  assert(index < level->grid_width * level->grid_height && "Invalid cell");
+  assert(cell < CELL_TYPES_COUNT && "Invalid cell type");
+  assert(level->owns_grid && "The level was not loaded");
+
+  enum plug_CellType before = level_cell(level, index);
+  if (before == cell) {
+    return;
+  }
+
+  if (level->stepped.count < level->stepped.capacity) {
+    level->stepped.items[level->stepped.count++] =
+      CLITERAL(struct plug_SteppedCell){ index, before, cell };
+  } else {
+    level->stepped_dropped++;
+  }
+}
+
+void level_sync_cells(struct plug_Level *level) {
+  if (level->stepped_dropped > 0) {
+    fprintf(stderr, "[WARNING]: Dropped %u cell changes of the steps\n",
+            level->stepped_dropped);
+    level->stepped_dropped = 0;
+  }
+
+  for (uint64_t i = 0; i < level->stepped.count; i++) {
+    struct plug_SteppedCell stepped = level->stepped.items[i];
+
+    level->grid[stepped.index] = stepped.after;
+    level_mark_dirty(level, CLITERAL(struct plug_CellRect){
+                              stepped.index % level->grid_width,
+                              stepped.index / level->grid_width, 1, 1 });
+  }
+
+  level->stepped.count = 0;
+  level->stepped_captured = 0;
+}
+
+uint32_t level_flush_dirty(struct plug_Level *level,
+                           const struct plug_Tiles *tiles, uint32_t budget) {
+  PROF_ZONE("level_flush_dirty");
+
+  uint32_t flushed = 0;
+
+  while (level->dirty.count > 0 && flushed < budget) {
+    struct plug_CellRect *rect = &level->dirty.items[level->dirty.count - 1];
+
+    uint32_t rows = (budget - flushed) / rect->width;
+    rows = rows == 0 ? 1 : rows;
+    rows = rows > rect->height ? rect->height : rows;
+
+    struct plug_CellRect part = { rect->x, rect->y, rect->width, rows };
+
+    if (level->loaded) {
+      chunk_cache_update(&level->chunks, level, tiles, part);
+      light_invalidate(&level->light, part);
+    }
+
+    flushed += part.width * part.height;
 
-      uint32_t atlas_index = (cell * ATLAS_GRID_SIZE) + atlas_grid_tex_off;
-
-      uint32_t atlas_x = atlas_index % state->atlas.width;
-      uint32_t atlas_y = atlas_index / state->atlas.width;
-      Rectangle src = {
-        .x = atlas_x,
-        .y = atlas_y,
-        .width = 16,
-        .height = 16,
-      };
-
-      Rectangle dest = {
-        .x = x * level->cell_size,
-        .y = (level->grid_height - y - 1) * level->cell_size,
-        .width = level->cell_size,
-        .height = level->cell_size,
-      };
-
-      DrawTexturePro(state->atlas, src, dest, CLITERAL(Vector2){ 0.0f, 0.0f },
-                     0.0f, WHITE);
+    rect->y += rows;
+    rect->height -= rows;
+    if (rect->height == 0) {
+      level->dirty.count--;
     }
   }
 
-  EndTextureMode();
+  return flushed;
+}
+
+void load_level(struct plug_State *state) {
+  if (state->current_level < 0) {
+    return;
+  }
+
+  struct plug_Level *level =
+    &DA_AT(state->levels, (uint32_t)state->current_level);
+  if (level->loaded) {
+    return;
+  }
+
+  // Every chunk is baked from the current grid
+  level->dirty.count = 0;
+
+  // Chunks are baked as they come into view
+  chunk_cache_init(&level->chunks, level, CHUNK_CACHE_BUDGET_BYTES);
+  light_map_init(&level->light, level, LIGHT_THREADS);
+
+  // So changing cells while playing never allocates
+  DA_RESERVE(&level->dirty, LEVEL_MAX_DIRTY_RECTS);
+  DA_RESERVE(&level->stepped, LEVEL_MAX_STEPPED_CELLS);
+  level_own_grid(level);
+
   level->loaded = true;
 }
 
@@ -117,10 +529,80 @@ void unload_level(struct plug_State *state) {
     return;
   }
 
-  if (DA_AT(state->levels, (uint32_t)state->current_level).loaded) {
+  struct plug_Level *level =
+    &DA_AT(state->levels, (uint32_t)state->current_level);
+  if (!level->loaded) {
+    return;
+  }
+
+  chunk_cache_free(&level->chunks);
+  light_map_free(&level->light);
+  level->loaded = false;
+}
+
+void level_rebake(struct plug_Level *level) {
+  if (!level->loaded) {
     return;
   }
 
-  UnloadRenderTexture(
-    DA_AT(state->levels, (uint32_t)state->current_level).grid_tex);
+  chunk_cache_free(&level->chunks);
+  chunk_cache_init(&level->chunks, level, CHUNK_CACHE_BUDGET_BYTES);
+
+  // The grid may have changed size, lights come back on the next frame
+  light_map_free(&level->light);
+  light_map_init(&level->light, level, LIGHT_THREADS);
+}
+
+uint64_t level_apply(struct plug_State *state, struct plug_Level *level,
+                     struct plug_Level *next) {
+  // The host's copy is stale now, the next import reads the file again
+  if (state->host != NULL && level->path != NULL) {
+    char key[PLUG_RESOURCE_KEY_MAX];
+    snprintf(key, sizeof(key), LEVEL_KEY, level->path);
+    state->host->evict(key);
+  }
+
+  level->spawn = next->spawn;
+
+  uint64_t cells = (uint64_t)next->grid_width * next->grid_height;
+
+  if (next->grid_width != level->grid_width ||
+      next->grid_height != level->grid_height ||
+      next->cell_size != level->cell_size) {
+    if (level->owns_grid) {
+      free(level->grid);
+    }
+
+    level->grid_width = next->grid_width;
+    level->grid_height = next->grid_height;
+    level->cell_size = next->cell_size;
+    level->grid = next->grid;
+    level->owns_grid = true;
+
+    level->dirty.count = 0;
+    level->stepped.count = 0;
+    level->stepped_captured = 0;
+    level->stepped_dropped = 0;
+    level_rebake(level);
+
+    return cells;
+  }
+
+  uint64_t changed = 0;
+
+  for (uint32_t y = 0; y < level->grid_height; y++) {
+    for (uint32_t x = 0; x < level->grid_width; x++) {
+      enum plug_CellType cell = next->grid[y * level->grid_width + x];
+
+      if (level->grid[y * level->grid_width + x] != cell) {
+        level_set_cell(level, x, y, cell);
+        changed++;
+      }
+    }
+  }
+
+  free(next->grid);
+  next->grid = NULL;
+
+  return changed;
 }
@@ -3,14 +3,106 @@
 
 #include "plugin.h"
 
+// Loaded at startup, the built in level if it is missing
+#define LEVEL_FILE "./assets/levels/0.level"
+
 #define DEFAULT_LEVEL_WIDTH 20
 #define DEFAULT_LEVEL_HEIGHT 6
 
 #define DEFAULT_LEVEL_CELL_SIZE 25
 
-void import_level(const char *level_path, struct plug_State *state);
+#define DEFAULT_LEVEL_SPAWN_X 0
+#define DEFAULT_LEVEL_SPAWN_Y 40
+
+// Level files are plain text. The first non-comment line is
+//   <width> <height> <cell size> <spawn x> <spawn y>
+// followed by height rows of width digits, one enum plug_CellType each,
+// below CELL_TYPE_VANISHING.
+// Lines starting with '#' are ignored.
+//
+// Appends the level at level_path to state->levels, or the built in default
+// level if level_path == NULL. Returns false if the file could not be read.
+// Parsed files are shared with the host, so they are only read once, and
+// warned about then if they have no finish cell.
+bool import_level(const char *level_path, struct plug_State *state);
+
+// Reads the level file at path into level, which owns its grid. Does not
+// touch the host, so it is safe off the main thread.
+bool level_read(const char *path, struct plug_Level *level);
+
+// Writes level to path in the format import_level reads. Returns false if
+// the file could not be written.
+bool level_write(const char *path, const struct plug_Level *level);
 void unload_levels(struct plug_State *state);
 
+// Computes the [begin, end) range of cells overlapping aabb (in world
+// space). Returns false if it does not overlap the level.
+bool level_cell_range(const struct plug_Level *level, Rectangle aabb,
+                      uint32_t *x_begin, uint32_t *x_end, uint32_t *y_begin,
+                      uint32_t *y_end);
+
+// Dirty rects are merged when that wastes at most this many clean cells
+#define LEVEL_DIRTY_MERGE_SLACK 4
+
+// Past this many dirty rects, new ones are folded into an existing one
+#define LEVEL_MAX_DIRTY_RECTS 32
+
+// Cells re-baked per frame by plug_update
+#define LEVEL_FLUSH_BUDGET_CELLS 256
+
+// Changes the cell at (x, y). Collision and triggers see the change
+// immediately, the grid texture catches up in level_flush_dirty. Copies the
+// grid first if the level does not own it.
+void level_set_cell(struct plug_Level *level, uint32_t x, uint32_t y,
+                    enum plug_CellType cell);
+
+// Cell changes the fixed steps of a frame can make before
+// level_sync_cells. Changes past that are dropped.
+#define LEVEL_MAX_STEPPED_CELLS 64
+
+// Changes the cell at index for the fixed steps, which may run on the
+// pipeline's worker while the main thread draws from the grid. The grid
+// is left alone: the change waits in level->stepped, where level_cell
+// finds it for the steps that follow, until level_sync_cells writes it.
+// level must be loaded.
+void level_step_cell(struct plug_Level *level, uint32_t index,
+                     enum plug_CellType cell);
+
+// Writes the cells level_step_cell changed into the grid and marks them
+// dirty. Call on the main thread while no steps run.
+void level_sync_cells(struct plug_Level *level);
+
+// The cell at index as the fixed steps see it, including what
+// level_step_cell changed since the last level_sync_cells. What the fixed
+// steps read of the grid goes through here.
+static inline enum plug_CellType level_cell(const struct plug_Level *level,
+                                            uint32_t index) {
+  for (uint64_t i = level->stepped.count; i > 0; i--) {
+    if (level->stepped.items[i - 1].index == index) {
+      return level->stepped.items[i - 1].after;
+    }
+  }
+
+  return level->grid[index];
+}
+
+// Re-bakes dirty cells of resident chunks and their light, whole rows of a
+// dirty rect at a time until about budget cells are done. Always
+// makes progress if anything is dirty. Returns the number of cells flushed.
+uint32_t level_flush_dirty(struct plug_Level *level,
+                           const struct plug_Tiles *tiles, uint32_t budget);
+
+// Drops every baked chunk of level, if it is loaded, so they are baked
+// again, from new tiles, as they come into view. Its light starts over.
+void level_rebake(struct plug_Level *level);
+
+// Brings level up to date with next, read from the same file by
+// level_read. Cells that differ go through level_set_cell and catch up in
+// level_flush_dirty. A grid of another size replaces the old one outright.
+// Takes next's grid. Returns the number of cells changed.
+uint64_t level_apply(struct plug_State *state, struct plug_Level *level,
+                     struct plug_Level *next);
+
 // Loads current_level. Exits if current_level < 0.
 void load_level(struct plug_State *state);
 
@@ -0,0 +1,541 @@
+#include "light.h"
+#include "plugin.h"
+#include "chunks.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Cells of the box a light of LIGHT_MAX_RADIUS can reach
+#define LIGHT_BOX_SIDE (2 * LIGHT_MAX_RADIUS + 1)
+#define LIGHT_BOX_CELLS (LIGHT_BOX_SIDE * LIGHT_BOX_SIDE)
+
+// Distances are in halves of a cell, rounded: two to step straight and
+// three to step diagonally. Round enough to light a circle, and small
+// enough to walk in buckets.
+#define LIGHT_STEP 2
+#define LIGHT_DIAGONAL_STEP 3
+#define LIGHT_MAX_DIST (LIGHT_STEP * LIGHT_MAX_RADIUS + 1)
+
+// Every cell is queued at most once for each of its neighbours, plus the
+// source
+#define LIGHT_MAX_NODES (8 * LIGHT_BOX_CELLS + 1)
+
+#define LIGHT_NO_NODE UINT16_MAX
+
+// A chunk's texels and the ring of its neighbours' around them, so texels
+// blend across chunk edges
+#define LIGHT_TEXTURE_SIDE (CHUNK_CELLS + 2)
+
+struct light_Node {
+  uint16_t cell;
+  uint16_t next;
+};
+
+struct light_Light {
+  uint32_t x, y;
+  uint32_t radius;
+  uint8_t intensity;
+
+  // Has to be worked out again
+  bool dirty;
+
+  // The cells the light can reach, clipped to the level, and the light it
+  // gives each of them, row by row
+  struct plug_CellRect rect;
+  uint8_t *field;
+
+  // Scratch for light_propagate: the distance to every cell of rect, and
+  // a list of the cells queued at every distance
+  uint16_t *dist;
+  struct light_Node *nodes;
+  uint16_t heads[LIGHT_MAX_DIST];
+
+  const struct plug_Level *level;
+};
+
+static void *light_alloc(size_t size) {
+  void *p = malloc(size);
+  assert(p != NULL && "Failed to allocate memory");
+  return p;
+}
+
+void light_map_init(struct light_Map *map, const struct plug_Level *level,
+                    uint32_t threads) {
+  *map = (struct light_Map){
+    .width = level->grid_width,
+    .height = level->grid_height,
+    .chunks_x = (level->grid_width + CHUNK_CELLS - 1) / CHUNK_CELLS,
+    .chunks_y = (level->grid_height + CHUNK_CELLS - 1) / CHUNK_CELLS,
+  };
+
+  size_t cells = (size_t)map->width * map->height;
+  uint32_t chunks = map->chunks_x * map->chunks_y;
+
+  map->cells = light_alloc(cells + 1);
+  memset(map->cells, LIGHT_AMBIENT, cells);
+
+  map->slots = light_alloc((chunks + 1) * sizeof(*map->slots));
+  for (uint32_t i = 0; i < chunks; i++) {
+    map->slots[i] = LIGHT_NONE;
+  }
+  map->chunk_dirty = calloc(chunks + 1, sizeof(*map->chunk_dirty));
+  assert(map->chunk_dirty != NULL && "Failed to allocate memory");
+
+  map->lights = calloc(LIGHT_MAX_LIGHTS, sizeof(*map->lights));
+  assert(map->lights != NULL && "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < LIGHT_MAX_LIGHTS; i++) {
+    struct light_Light *light = &map->lights[i];
+
+    light->field = light_alloc(LIGHT_BOX_CELLS * sizeof(*light->field));
+    light->dist = light_alloc(LIGHT_BOX_CELLS * sizeof(*light->dist));
+    light->nodes = light_alloc(LIGHT_MAX_NODES * sizeof(*light->nodes));
+  }
+
+  // Every light stales its old and new cells at most, so frames never grow
+  // them
+  DA_RESERVE(&map->stale, 2 * LIGHT_MAX_LIGHTS);
+  DA_RESERVE(&map->handles, LIGHT_MAX_LIGHTS);
+  DA_RESERVE(&map->textures, LIGHT_MAX_TEXTURES);
+
+  if (threads > 1) {
+    map->pool = tp_create_pool(threads);
+
+    if (map->pool == NULL) {
+      fprintf(stderr, "[WARNING]: Working out lights on one thread\n");
+    } else {
+      DA_RESERVE(&map->pool->job_queue, LIGHT_MAX_LIGHTS);
+      DA_RESERVE(&map->pool->completed, LIGHT_MAX_LIGHTS);
+    }
+  }
+}
+
+void light_map_free(struct light_Map *map) {
+  for (uint64_t i = 0; i < map->textures.count; i++) {
+    UnloadTexture(map->textures.items[i].tex);
+  }
+
+  if (map->lights != NULL) {
+    for (uint32_t i = 0; i < LIGHT_MAX_LIGHTS; i++) {
+      free(map->lights[i].field);
+      free(map->lights[i].dist);
+      free(map->lights[i].nodes);
+    }
+  }
+
+  tp_free_pool(map->pool);
+
+  free(map->cells);
+  free(map->slots);
+  free(map->chunk_dirty);
+  free(map->lights);
+  DA_FREE(&map->stale);
+  DA_FREE(&map->handles);
+  DA_FREE(&map->textures);
+
+  *map = (struct light_Map){ 0 };
+}
+
+static bool light_overlap(struct plug_CellRect a, struct plug_CellRect b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+         b.y < a.y + a.height;
+}
+
+static struct plug_CellRect light_intersect(struct plug_CellRect a,
+                                            struct plug_CellRect b) {
+  uint32_t x0 = a.x > b.x ? a.x : b.x;
+  uint32_t y0 = a.y > b.y ? a.y : b.y;
+  uint32_t x1 = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+  uint32_t y1 =
+    a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+  return (struct plug_CellRect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static void light_stale(struct light_Map *map, struct plug_CellRect rect) {
+  if (rect.width > 0 && rect.height > 0) {
+    DA_APPEND(&map->stale, rect);
+  }
+}
+
+void light_begin(struct light_Map *map) {
+  map->prev_count = map->count;
+  map->count = 0;
+}
+
+bool light_add(struct light_Map *map, const struct plug_Level *level,
+               Vector2 pos, uint32_t radius, uint8_t intensity) {
+  if (map->count == LIGHT_MAX_LIGHTS) {
+    map->dropped++;
+    return false;
+  }
+
+  float cx = (pos.x - level->pos.x) / (float)level->cell_size;
+  float cy = (pos.y - level->pos.y) / (float)level->cell_size;
+
+  // Also false for NaN
+  if (!(cx >= 0.0f && cy >= 0.0f && cx < (float)map->width &&
+        cy < (float)map->height)) {
+    return false;
+  }
+
+  uint32_t x = (uint32_t)cx, y = (uint32_t)cy;
+  radius = radius > LIGHT_MAX_RADIUS ? LIGHT_MAX_RADIUS : radius;
+
+  uint32_t i = map->count++;
+  struct light_Light *light = &map->lights[i];
+
+  // The same light as the frame before in the same place is left alone
+  if (i < map->prev_count && light->x == x && light->y == y &&
+      light->radius == radius && light->intensity == intensity) {
+    return true;
+  }
+
+  if (i < map->prev_count) {
+    light_stale(map, light->rect);
+  }
+
+  uint32_t x0 = x > radius ? x - radius : 0;
+  uint32_t y0 = y > radius ? y - radius : 0;
+  uint32_t x1 = x + radius + 1 < map->width ? x + radius + 1 : map->width;
+  uint32_t y1 = y + radius + 1 < map->height ? y + radius + 1 : map->height;
+
+  light->x = x;
+  light->y = y;
+  light->radius = radius;
+  light->intensity = intensity;
+  light->rect = (struct plug_CellRect){ x0, y0, x1 - x0, y1 - y0 };
+  light->dirty = true;
+
+  return true;
+}
+
+static bool light_blocks(const struct plug_Level *level, uint32_t x,
+                         uint32_t y) {
+  return cell_props[level->grid[(size_t)y * level->grid_width + x]].solid;
+}
+
+static void light_push(struct light_Light *light, uint32_t *nodes,
+                       uint16_t cell, uint16_t dist) {
+  light->dist[cell] = dist;
+  light->nodes[*nodes] = (struct light_Node){ cell, light->heads[dist] };
+  light->heads[dist] = (uint16_t)(*nodes)++;
+}
+
+// Dijkstra from the light's cell over the cells it can reach, a bucket of
+// equal distances at a time. Solid cells are lit but pass no light on, and
+// light only goes diagonally between two open cells.
+static void *light_propagate(void *p) {
+  struct light_Light *light = p;
+  const struct plug_Level *level = light->level;
+  const struct plug_CellRect rect = light->rect;
+
+  uint32_t cells = rect.width * rect.height;
+  uint32_t reach = LIGHT_STEP * light->radius + 1;
+
+  memset(light->field, 0, cells * sizeof(*light->field));
+  memset(light->dist, 0xff, cells * sizeof(*light->dist));
+  for (uint32_t d = 0; d < reach; d++) {
+    light->heads[d] = LIGHT_NO_NODE;
+  }
+
+  uint32_t nodes = 0;
+  light_push(light, &nodes,
+             (uint16_t)((light->y - rect.y) * rect.width + light->x - rect.x),
+             0);
+
+  for (uint32_t d = 0; d < reach; d++) {
+    for (uint16_t n = light->heads[d]; n != LIGHT_NO_NODE;
+         n = light->nodes[n].next) {
+      uint16_t cell = light->nodes[n].cell;
+
+      // Queued again closer since
+      if (light->dist[cell] != d) {
+        continue;
+      }
+
+      light->field[cell] = (uint8_t)(light->intensity * (reach - d) / reach);
+
+      uint32_t x = rect.x + cell % rect.width;
+      uint32_t y = rect.y + cell / rect.width;
+
+      if (light_blocks(level, x, y)) {
+        continue;
+      }
+
+      uint32_t x0 = x > rect.x ? x - 1 : x;
+      uint32_t y0 = y > rect.y ? y - 1 : y;
+      uint32_t x1 = x + 1 < rect.x + rect.width ? x + 1 : x;
+      uint32_t y1 = y + 1 < rect.y + rect.height ? y + 1 : y;
+
+      for (uint32_t ny = y0; ny <= y1; ny++) {
+        for (uint32_t nx = x0; nx <= x1; nx++) {
+          bool diagonal = nx != x && ny != y;
+
+          if ((nx == x && ny == y) ||
+              (diagonal &&
+               (light_blocks(level, nx, y) || light_blocks(level, x, ny)))) {
+            continue;
+          }
+
+          uint32_t next = d + (diagonal ? LIGHT_DIAGONAL_STEP : LIGHT_STEP);
+          uint16_t neighbour =
+            (uint16_t)((ny - rect.y) * rect.width + nx - rect.x);
+
+          if (next < reach && next < light->dist[neighbour]) {
+            light_push(light, &nodes, neighbour, (uint16_t)next);
+          }
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// Marks the chunks whose texels show rect, or border it, as behind.
+static void light_dirty_chunks(struct light_Map *map,
+                               struct plug_CellRect rect) {
+  uint32_t x0 = rect.x > 0 ? rect.x - 1 : 0;
+  uint32_t y0 = rect.y > 0 ? rect.y - 1 : 0;
+  uint32_t x1 = rect.x + rect.width + 1 < map->width ? rect.x + rect.width + 1
+                                                     : map->width;
+  uint32_t y1 = rect.y + rect.height + 1 < map->height
+                  ? rect.y + rect.height + 1
+                  : map->height;
+
+  for (uint32_t y = y0 / CHUNK_CELLS; y <= (y1 - 1) / CHUNK_CELLS; y++) {
+    for (uint32_t x = x0 / CHUNK_CELLS; x <= (x1 - 1) / CHUNK_CELLS; x++) {
+      map->chunk_dirty[y * map->chunks_x + x] = 1;
+    }
+  }
+}
+
+// Light of the cells of rect, from the lights added this frame.
+static void light_combine(struct light_Map *map, struct plug_CellRect rect) {
+  for (uint32_t y = rect.y; y < rect.y + rect.height; y++) {
+    memset(&map->cells[(size_t)y * map->width + rect.x], LIGHT_AMBIENT,
+           rect.width);
+  }
+
+  for (uint32_t i = 0; i < map->count; i++) {
+    const struct light_Light *light = &map->lights[i];
+    if (!light_overlap(light->rect, rect)) {
+      continue;
+    }
+
+    struct plug_CellRect part = light_intersect(light->rect, rect);
+
+    for (uint32_t y = part.y; y < part.y + part.height; y++) {
+      const uint8_t *src = &light->field[(y - light->rect.y) *
+                                         light->rect.width +
+                                         part.x - light->rect.x];
+      uint8_t *dst = &map->cells[(size_t)y * map->width + part.x];
+
+      for (uint32_t x = 0; x < part.width; x++) {
+        dst[x] = src[x] > dst[x] ? src[x] : dst[x];
+      }
+    }
+  }
+
+  light_dirty_chunks(map, rect);
+  map->combined += (uint64_t)rect.width * rect.height;
+}
+
+void light_update(struct light_Map *map, const struct plug_Level *level) {
+  PROF_ZONE("light_update");
+
+  // Gone out
+  for (uint32_t i = map->count; i < map->prev_count; i++) {
+    light_stale(map, map->lights[i].rect);
+  }
+  map->prev_count = map->count;
+
+  uint32_t dirty = 0;
+  for (uint32_t i = 0; i < map->count; i++) {
+    map->lights[i].level = level;
+    dirty += map->lights[i].dirty;
+  }
+
+  if (map->pool != NULL && dirty > 1) {
+    map->handles.count = 0;
+    for (uint32_t i = 0; i < map->count; i++) {
+      if (map->lights[i].dirty) {
+        DA_APPEND(&map->handles,
+                  tp_add_job(map->pool, light_propagate, &map->lights[i]));
+      }
+    }
+
+    for (uint64_t i = 0; i < map->handles.count; i++) {
+      tp_wait_job(map->pool, map->handles.items[i]);
+    }
+
+  } else if (dirty > 0) {
+    for (uint32_t i = 0; i < map->count; i++) {
+      if (map->lights[i].dirty) {
+        light_propagate(&map->lights[i]);
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < map->count; i++) {
+    struct light_Light *light = &map->lights[i];
+
+    if (light->dirty) {
+      light_stale(map, light->rect);
+      light->dirty = false;
+    }
+  }
+  map->recomputed += dirty;
+
+  for (uint64_t i = 0; i < map->stale.count; i++) {
+    light_combine(map, map->stale.items[i]);
+  }
+  map->stale.count = 0;
+}
+
+void light_invalidate(struct light_Map *map, struct plug_CellRect rect) {
+  uint32_t count = map->count > map->prev_count ? map->count : map->prev_count;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (light_overlap(map->lights[i].rect, rect)) {
+      map->lights[i].dirty = true;
+    }
+  }
+}
+
+void light_rebuild(struct light_Map *map) {
+  light_invalidate(map, CLITERAL(struct plug_CellRect){ 0, 0, map->width,
+                                                        map->height });
+  light_stale(map, CLITERAL(struct plug_CellRect){ 0, 0, map->width,
+                                                   map->height });
+}
+
+// The light of chunk (x, y) and the ring of cells around it, as texels.
+// Outside the level the nearest cell inside is repeated.
+static void light_texels(const struct light_Map *map, uint32_t x, uint32_t y,
+                         uint8_t *texels) {
+  for (uint32_t ty = 0; ty < LIGHT_TEXTURE_SIDE; ty++) {
+    int64_t cy = (int64_t)y * CHUNK_CELLS + ty - 1;
+    cy = cy < 0 ? 0 : cy >= map->height ? map->height - 1 : cy;
+
+    for (uint32_t tx = 0; tx < LIGHT_TEXTURE_SIDE; tx++) {
+      int64_t cx = (int64_t)x * CHUNK_CELLS + tx - 1;
+      cx = cx < 0 ? 0 : cx >= map->width ? map->width - 1 : cx;
+
+      texels[ty * LIGHT_TEXTURE_SIDE + tx] =
+        map->cells[(size_t)cy * map->width + (size_t)cx];
+    }
+  }
+}
+
+// Unloads the textures of chunks not drawn this frame, once there are too
+// many.
+static void light_evict(struct light_Map *map) {
+  if (map->textures.count <= LIGHT_MAX_TEXTURES) {
+    return;
+  }
+
+  uint64_t kept = 0;
+  for (uint64_t i = 0; i < map->textures.count; i++) {
+    struct light_Texture texture = map->textures.items[i];
+
+    if (texture.last_drawn != map->frame) {
+      UnloadTexture(texture.tex);
+      map->slots[texture.chunk] = LIGHT_NONE;
+      continue;
+    }
+
+    map->slots[texture.chunk] = (uint32_t)kept;
+    map->textures.items[kept++] = texture;
+  }
+
+  map->textures.count = kept;
+}
+
+uint32_t light_draw(struct light_Map *map, const struct plug_Level *level,
+                    Rectangle view) {
+  PROF_ZONE("light_draw");
+
+  map->frame++;
+
+  const float cs = (float)level->cell_size;
+  const float chunk_size = (float)CHUNK_CELLS * cs;
+
+  struct chunk_Range range;
+  if (!chunk_visible_range(level->pos, chunk_size, map->chunks_x,
+                           map->chunks_y, view, &range)) {
+    return 0;
+  }
+
+  uint8_t texels[LIGHT_TEXTURE_SIDE * LIGHT_TEXTURE_SIDE];
+  uint32_t drawn = 0;
+
+  BeginBlendMode(BLEND_MULTIPLIED);
+
+  for (uint32_t y = range.y_begin; y < range.y_end; y++) {
+    for (uint32_t x = range.x_begin; x < range.x_end; x++) {
+      uint32_t chunk = y * map->chunks_x + x;
+      uint32_t slot = map->slots[chunk];
+
+      if (slot == LIGHT_NONE) {
+        light_texels(map, x, y, texels);
+
+        Image image = {
+          .data = texels,
+          .width = LIGHT_TEXTURE_SIDE,
+          .height = LIGHT_TEXTURE_SIDE,
+          .mipmaps = 1,
+          .format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE,
+        };
+
+        struct light_Texture texture = {
+          .chunk = chunk,
+          .tex = LoadTextureFromImage(image),
+        };
+        SetTextureFilter(texture.tex, TEXTURE_FILTER_BILINEAR);
+
+        slot = (uint32_t)map->textures.count;
+        DA_APPEND(&map->textures, texture);
+        map->slots[chunk] = slot;
+
+      } else if (map->chunk_dirty[chunk]) {
+        light_texels(map, x, y, texels);
+        UpdateTexture(map->textures.items[slot].tex, texels);
+      }
+
+      map->chunk_dirty[chunk] = 0;
+      map->textures.items[slot].last_drawn = map->frame;
+
+      uint32_t width = map->width - x * CHUNK_CELLS;
+      uint32_t height = map->height - y * CHUNK_CELLS;
+      width = width > CHUNK_CELLS ? CHUNK_CELLS : width;
+      height = height > CHUNK_CELLS ? CHUNK_CELLS : height;
+
+      // Texel centres on cell centres, the ring only blended in at the edges
+      Rectangle src = { 1.0f, 1.0f, (float)width, (float)height };
+      Rectangle dest = {
+        .x = level->pos.x + (float)x * chunk_size,
+        .y = level->pos.y + (float)y * chunk_size,
+        .width = (float)width * cs,
+        .height = (float)height * cs,
+      };
+      DrawTexturePro(map->textures.items[slot].tex, src, dest,
+                     CLITERAL(Vector2){ 0, 0 }, 0.0f, WHITE);
+      drawn++;
+    }
+  }
+
+  EndBlendMode();
+
+  light_evict(map);
+
+  return drawn;
+}
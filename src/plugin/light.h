@@ -0,0 +1,112 @@
+#ifndef PLUGIN_LIGHT_H
+#define PLUGIN_LIGHT_H
+
+#include "util/dynamic_array.h"
+#include "util/thread_pool.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+// Lights added past this many in a frame are dropped
+#define LIGHT_MAX_LIGHTS 32
+
+// Furthest a light reaches, in cells. Larger radii are clamped.
+#define LIGHT_MAX_RADIUS 16
+
+// Light of cells no light reaches, out of 255
+#define LIGHT_AMBIENT 96
+
+// Workers loaded levels work out their lights on. The game's few lights
+// are small boxes, so they are worked out on the main thread and no pool
+// is kept for them. bench-light passes its own count.
+#define LIGHT_THREADS 1
+
+// Chunk light textures are unloaded past this many, apart from the ones
+// drawn this frame
+#define LIGHT_MAX_TEXTURES 512
+
+#define LIGHT_NONE UINT32_MAX
+
+struct plug_Level;
+struct plug_CellRect;
+struct light_Light;
+
+struct light_Texture {
+  uint32_t chunk;
+  Texture2D tex;
+  uint64_t last_drawn;
+};
+
+// Light levels of every cell of a level, from point lights spreading
+// around solid cells. Lights are added again every frame, and only those
+// that moved, changed or had cells in reach change are worked out again,
+// in parallel, along with the cells they reach. Drawn a chunk at a time,
+// as one texel per cell, multiplied over what is already there.
+struct light_Map {
+  uint32_t width, height;
+  uint32_t chunks_x, chunks_y;
+
+  // The brightest of LIGHT_AMBIENT and every light reaching a cell, one
+  // per cell
+  uint8_t *cells;
+
+  // LIGHT_MAX_LIGHTS of them, the first count added this frame and the
+  // first prev_count the frame before
+  struct light_Light *lights;
+  uint32_t count, prev_count;
+
+  // Cells whose light has to be combined again
+  DA_TYPE(struct plug_CellRect) stale;
+
+  // Texture index of every chunk, LIGHT_NONE if it has none, and whether
+  // its texture is behind cells
+  uint32_t *slots;
+  uint8_t *chunk_dirty;
+  DA_TYPE(struct light_Texture) textures;
+  uint64_t frame;
+
+  // Workers, NULL to work out every light on the calling thread
+  struct tp_ThreadPool *pool;
+  DA_TYPE(tp_JobHandle) handles;
+
+  // Lights worked out again and cells combined again, in total, and lights
+  // that did not fit
+  uint64_t recomputed, combined, dropped;
+};
+
+// Every cell starts at LIGHT_AMBIENT. Lights are worked out on threads
+// workers if there are more than one.
+void light_map_init(struct light_Map *map, const struct plug_Level *level,
+                    uint32_t threads);
+
+// Unloads every chunk texture and stops the workers.
+void light_map_free(struct light_Map *map);
+
+// Starts the lights of a frame. Lights not added again before
+// light_update go out.
+void light_begin(struct light_Map *map);
+
+// Adds a light at pos, in world space, reaching radius cells at intensity
+// out of 255 at its centre and fading to nothing. Returns false if pos is
+// outside the level or there are LIGHT_MAX_LIGHTS lights already.
+bool light_add(struct light_Map *map, const struct plug_Level *level,
+               Vector2 pos, uint32_t radius, uint8_t intensity);
+
+// Works out the lights that are new or changed since the last update, and
+// combines the cells they reach, or reached, again.
+void light_update(struct light_Map *map, const struct plug_Level *level);
+
+// Works the lights reaching the cells in rect out again on the next
+// light_update. Call when those cells change.
+void light_invalidate(struct light_Map *map, struct plug_CellRect rect);
+
+// Works every light and cell out again on the next light_update.
+void light_rebuild(struct light_Map *map);
+
+// Multiplies the light of the chunks of level visible through view over
+// what is drawn, uploading the chunks that changed. Returns the number of
+// chunks drawn.
+uint32_t light_draw(struct light_Map *map, const struct plug_Level *level,
+                    Rectangle view);
+
+#endif // PLUGIN_LIGHT_H
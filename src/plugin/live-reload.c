@@ -0,0 +1,324 @@
+#include "live-reload.h"
+#include "plugin.h"
+#include "inbox.h"
+#include "level.h"
+#include "load-resources.h"
+#include "atlas-pack.h"
+
+#include "util/clock.h"
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+
+enum live_JobKind {
+  LIVE_JOB_LEVEL,
+  LIVE_JOB_ATLAS,
+};
+
+struct live_Job {
+  enum live_JobKind kind;
+
+  // The level file, or ASSETS_DIR
+  char path[WATCH_PATH_MAX];
+  uint64_t queued_at;
+
+  // Filled in by the worker
+  bool ok;
+  union {
+    struct plug_Level level;
+    struct pack_Atlas atlas;
+  };
+};
+
+// Writes the path the watcher reports for changes to path, <dir>/<name>
+static void live_watched_path(char *out, size_t size, const char *path) {
+  const char *slash = strrchr(path, '/');
+
+  if (slash == NULL) {
+    snprintf(out, size, "./%s", path);
+  } else {
+    snprintf(out, size, "%s", path);
+  }
+}
+
+static bool live_watch_file(struct live_Reloader *live, const char *path) {
+  char dir[WATCH_PATH_MAX];
+  live_watched_path(dir, sizeof(dir), path);
+  *strrchr(dir, '/') = '\0';
+
+  return watch_add_dir(&live->watcher, dir);
+}
+
+static void live_run(struct live_Job *job) {
+  PROF_ZONE("live_run");
+
+  switch (job->kind) {
+  case LIVE_JOB_LEVEL:
+    job->ok = level_read(job->path, &job->level);
+    break;
+
+  case LIVE_JOB_ATLAS:
+    // Only the changed PNGs miss the image cache and are decoded
+    job->ok = pack_atlas_load(ASSETS_DIR, ASSETS_CACHE_DIR, PACK_PAGE_SIZE,
+                              &job->atlas, NULL);
+    break;
+  }
+}
+
+static void live_free_job(struct live_Job *job) {
+  if (!job->ok) {
+    return;
+  }
+
+  switch (job->kind) {
+  case LIVE_JOB_LEVEL:
+    free(job->level.grid);
+    break;
+
+  case LIVE_JOB_ATLAS:
+    pack_atlas_free(&job->atlas);
+    break;
+  }
+}
+
+static bool live_should_exit(struct live_Reloader *live) {
+  pthread_mutex_lock(&live->mutex);
+  bool should_exit = live->should_exit;
+  pthread_mutex_unlock(&live->mutex);
+
+  return should_exit;
+}
+
+static void *live_worker(void *p) {
+  struct plug_State *state = p;
+  struct live_Reloader *live = &state->live;
+  PROF_THREAD_NAME("live_reload");
+
+  pthread_mutex_lock(&live->mutex);
+
+  for (;;) {
+    while (!live->should_exit && live->pending.count == 0) {
+      pthread_cond_wait(&live->wake, &live->mutex);
+    }
+
+    if (live->should_exit) {
+      break;
+    }
+
+    struct live_Job *job = DA_POP(&live->pending, 0);
+    pthread_mutex_unlock(&live->mutex);
+
+    live_run(job);
+
+    // A full inbox is emptied a batch at a time every frame
+    bool posted;
+    while (!(posted = inbox_post(state, MESSAGE_LIVE_JOB, job)) &&
+           !live_should_exit(live)) {
+      sched_yield();
+    }
+
+    if (!posted) {
+      live_drop(job);
+    }
+
+    pthread_mutex_lock(&live->mutex);
+  }
+
+  pthread_mutex_unlock(&live->mutex);
+
+  return NULL;
+}
+
+void live_start(struct plug_State *state) {
+  struct live_Reloader *live = &state->live;
+  *live = (struct live_Reloader){ 0 };
+
+  if (!watch_init(&live->watcher)) {
+    watch_free(&live->watcher);
+    return;
+  }
+
+  watch_add_dir(&live->watcher, ASSETS_DIR);
+  for (uint64_t i = 0; i < state->levels.count; i++) {
+    const char *path = DA_AT(state->levels, i).path;
+
+    if (path != NULL && !live_watch_file(live, path)) {
+      fprintf(stderr, "[WARNING]: Not watching %s\n", path);
+    }
+  }
+
+  pthread_mutex_init(&live->mutex, NULL);
+  pthread_cond_init(&live->wake, NULL);
+
+  errno = pthread_create(&live->worker, NULL, live_worker, state);
+  if (errno != 0) {
+    fprintf(stderr, "[ERROR]: Failed to create thread: %s\n",
+            strerror(errno));
+
+    pthread_mutex_destroy(&live->mutex);
+    pthread_cond_destroy(&live->wake);
+    watch_free(&live->watcher);
+    return;
+  }
+
+  live->running = true;
+}
+
+void live_stop(struct plug_State *state) {
+  struct live_Reloader *live = &state->live;
+
+  if (!live->running) {
+    return;
+  }
+
+  pthread_mutex_lock(&live->mutex);
+  live->should_exit = true;
+  pthread_cond_signal(&live->wake);
+  pthread_mutex_unlock(&live->mutex);
+
+  pthread_join(live->worker, NULL);
+
+  // Never run, so they own nothing. The ones it posted are dropped with
+  // the inbox.
+  for (uint64_t i = 0; i < live->pending.count; i++) {
+    free(live->pending.items[i]);
+  }
+
+  DA_FREE(&live->pending);
+
+  pthread_mutex_destroy(&live->mutex);
+  pthread_cond_destroy(&live->wake);
+  watch_free(&live->watcher);
+
+  live->running = false;
+}
+
+// Queues a job for path unless one is already waiting
+static void live_queue(struct live_Reloader *live, enum live_JobKind kind,
+                       const char *path) {
+  pthread_mutex_lock(&live->mutex);
+
+  bool queued = false;
+  for (uint64_t i = 0; !queued && i < live->pending.count; i++) {
+    queued = strcmp(live->pending.items[i]->path, path) == 0;
+  }
+
+  if (!queued) {
+    struct live_Job *job = malloc(sizeof(*job));
+    assert(job != NULL && "Failed to allocate memory");
+
+    *job = (struct live_Job){
+      .kind = kind,
+      .queued_at = clk_now_ns(),
+    };
+    snprintf(job->path, sizeof(job->path), "%s", path);
+
+    DA_APPEND(&live->pending, job);
+    pthread_cond_signal(&live->wake);
+  }
+
+  pthread_mutex_unlock(&live->mutex);
+}
+
+// Queues the file at changed, if anything was loaded from it
+static void live_changed(struct plug_State *state, const char *changed) {
+  // Sprites are only packed from ASSETS_DIR itself
+  const char *assets = ASSETS_DIR "/";
+  size_t length = strlen(assets);
+
+  if (strncmp(changed, assets, length) == 0 &&
+      strchr(changed + length, '/') == NULL &&
+      strcmp(GetFileExtension(changed), ".png") == 0) {
+    live_queue(&state->live, LIVE_JOB_ATLAS, ASSETS_DIR);
+    return;
+  }
+
+  char path[WATCH_PATH_MAX];
+
+  for (uint64_t i = 0; i < state->levels.count; i++) {
+    const struct plug_Level *level = &DA_AT(state->levels, i);
+    if (level->path == NULL) {
+      continue;
+    }
+
+    live_watched_path(path, sizeof(path), level->path);
+    if (strcmp(changed, path) == 0) {
+      live_queue(&state->live, LIVE_JOB_LEVEL, level->path);
+      return;
+    }
+  }
+}
+
+static void live_apply(struct plug_State *state, struct live_Job *job) {
+  if (!job->ok) {
+    fprintf(stderr, "[WARNING]: Keeping what was loaded from %s\n",
+            job->path);
+    return;
+  }
+
+  switch (job->kind) {
+  case LIVE_JOB_LEVEL: {
+    struct plug_Level *level = NULL;
+    for (uint64_t i = 0; level == NULL && i < state->levels.count; i++) {
+      const char *path = DA_AT(state->levels, i).path;
+
+      if (path != NULL && strcmp(path, job->path) == 0) {
+        level = &DA_AT(state->levels, i);
+      }
+    }
+
+    if (level == NULL) {
+      live_free_job(job);
+      return;
+    }
+
+    uint64_t changed = level_apply(state, level, &job->level);
+
+    // The frames so far are of the old grid, rewinding must not undo the
+    // edit
+    snap_reset(&state->history);
+    printf("[INFO]: Reloaded %s, %llu cells changed, in %.2f ms\n",
+           job->path, (unsigned long long)changed,
+           clk_ns_to_ms(clk_now_ns() - job->queued_at));
+  } break;
+
+  case LIVE_JOB_ATLAS:
+    reload_atlas(state, &job->atlas);
+    printf("[INFO]: Reloaded %s, %llu sprites, in %.2f ms\n", job->path,
+           (unsigned long long)state->atlas.entries.count,
+           clk_ns_to_ms(clk_now_ns() - job->queued_at));
+    break;
+  }
+}
+
+void live_update(struct plug_State *state) {
+  struct live_Reloader *live = &state->live;
+
+  if (!live->running) {
+    return;
+  }
+
+  char changed[WATCH_PATH_MAX];
+  while (watch_next(&live->watcher, changed, sizeof(changed))) {
+    live_changed(state, changed);
+  }
+}
+
+void live_finish(struct plug_State *state, struct live_Job *job) {
+  // Applying takes over what the job owns
+  live_apply(state, job);
+  free(job);
+}
+
+void live_drop(struct live_Job *job) {
+  live_free_job(job);
+  free(job);
+}
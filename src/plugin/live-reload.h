@@ -0,0 +1,51 @@
+#ifndef PLUGIN_LIVE_RELOAD_H
+#define PLUGIN_LIVE_RELOAD_H
+
+#include "util/dynamic_array.h"
+#include "util/watch.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct plug_State;
+
+// Defined in live-reload.c
+struct live_Job;
+
+// Watches the files levels were imported from and the PNGs under
+// ASSETS_DIR. A changed file is read again on a worker thread, which posts
+// the result to state->inbox to be applied between frames: levels cell by
+// cell through level_set_cell, assets by swapping in the re-packed atlas.
+struct live_Reloader {
+  struct watch_Watcher watcher;
+
+  bool running;
+  pthread_t worker;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+
+  // Guarded by mutex
+  bool should_exit;
+  DA_TYPE(struct live_Job *) pending;
+};
+
+// Starts watching the levels and assets state has loaded. Does nothing
+// where files cannot be watched.
+void live_start(struct plug_State *state);
+
+// Waits for the worker and drops whatever it has not applied yet. Safe to
+// call if live_start did nothing.
+void live_stop(struct plug_State *state);
+
+// Queues the files that changed.
+void live_update(struct plug_State *state);
+
+// Applies a job the worker posted, and frees it.
+void live_finish(struct plug_State *state, struct live_Job *job);
+
+// Frees a job the worker posted without applying it.
+void live_drop(struct live_Job *job);
+
+#endif // PLUGIN_LIVE_RELOAD_H
@@ -1,24 +1,309 @@
 #include "plugin.h"
 #include "load-resources.h"
+#include "atlas-pack.h"
 #include "level.h"
+#include "inbox.h"
 
 #include "util/dynamic_array.h"
+#include "util/profiler.h"
 
 #include <raylib/src/raylib.h>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
 
-#define ATLAS_PATH "./assets/gmtk-texture-atlas.png"
+// Sprite of every cell type in the packed atlas. Cell types whose sprite
+// is missing, because it has not been drawn yet, are left transparent.
+static const char *const cell_sprites[CELL_TYPES_COUNT] = {
+  [CELL_TYPE_FLOOR] = "gmtk-texture-atlas/0_0",
+  [CELL_TYPE_SPIKES] = "gmtk-texture-atlas/1_0",
+  [CELL_TYPE_SPIKE_FLOOR] = "gmtk-texture-atlas/2_0",
+  [CELL_TYPE_VANISH] = "gmtk-texture-atlas/3_0",
+  [CELL_TYPE_SHRINK_PLAYER] = "gmtk-texture-atlas/4_0",
+  [CELL_TYPE_EXPAND_PLAYER] = "gmtk-texture-atlas/5_0",
+  [CELL_TYPE_CHECKPOINT] = "gmtk-texture-atlas/6_0",
+  [CELL_TYPE_FINISH] = "gmtk-texture-atlas/7_0",
+  [CELL_TYPE_VANISHING] = "gmtk-texture-atlas/3_0",
+};
+
+#define ATLAS_KEY "atlas"
+#define ATLAS_PAGE_KEY "atlas/page/%u"
+#define ATLAS_TEXTURE_KEY "atlas/texture/%u"
+
+// The ATLAS_KEY resource
+struct atlas_Shared {
+  uint32_t page_size;
+  uint32_t page_count;
+  uint64_t entry_count;
+  struct pack_Entry entries[];
+};
+
+struct plug_Resource *acquire_resource(struct plug_State *state,
+                                       const char *key) {
+  if (state->host == NULL) {
+    return nullptr;
+  }
+
+  struct plug_Resource *resource = state->host->acquire(key);
+  if (resource != NULL) {
+    DA_APPEND(&state->resources, resource);
+  }
+
+  return resource;
+}
+
+struct plug_Resource *share_resource(struct plug_State *state,
+                                     const char *key,
+                                     const struct plug_Resource *value) {
+  state->host->evict(key);
+
+  struct plug_Resource *resource = state->host->insert(key, value);
+  assert(resource != NULL && "Failed to share resource");
+
+  DA_APPEND(&state->resources, resource);
+
+  return resource;
+}
+
+// Releases every resource acquired since the first count were
+static void release_resources_from(struct plug_State *state, uint64_t count) {
+  while (state->resources.count > count) {
+    state->host->release(state->resources.items[--state->resources.count]);
+  }
+}
+
+// Evicts and releases every resource whose key starts with prefix
+static void drop_resources(struct plug_State *state, const char *prefix) {
+  size_t length = strlen(prefix);
+  uint64_t kept = 0;
+
+  for (uint64_t i = 0; i < state->resources.count; i++) {
+    struct plug_Resource *resource = state->resources.items[i];
+
+    if (strncmp(resource->key, prefix, length) != 0) {
+      state->resources.items[kept++] = resource;
+      continue;
+    }
+
+    state->host->evict(resource->key);
+    state->host->release(resource);
+  }
+
+  state->resources.count = kept;
+}
+
+// Takes the atlas from the host. Returns false if it has none.
+static bool attach_atlas(struct plug_State *state) {
+  uint64_t first = state->resources.count;
+
+  struct plug_Resource *meta = acquire_resource(state, ATLAS_KEY);
+  if (meta == NULL) {
+    return false;
+  }
+
+  const struct atlas_Shared *shared = meta->data.data;
+  state->atlas = (struct pack_Atlas){ .page_size = shared->page_size };
+
+  char key[PLUG_RESOURCE_KEY_MAX];
+  bool ok = true;
+
+  for (uint32_t i = 0; ok && i < shared->page_count; i++) {
+    snprintf(key, sizeof(key), ATLAS_PAGE_KEY, i);
+    struct plug_Resource *page = acquire_resource(state, key);
+
+    snprintf(key, sizeof(key), ATLAS_TEXTURE_KEY, i);
+    struct plug_Resource *texture = acquire_resource(state, key);
+
+    ok = page != NULL && texture != NULL;
+    if (ok) {
+      DA_APPEND(&state->atlas.pages, page->image.image);
+      DA_APPEND(&state->atlas_pages, texture->texture);
+    }
+  }
+
+  if (!ok) {
+    release_resources_from(state, first);
+    state->host->evict(ATLAS_KEY);
+
+    DA_FREE(&state->atlas.pages);
+    DA_FREE(&state->atlas_pages);
+    return false;
+  }
+
+  for (uint64_t i = 0; i < shared->entry_count; i++) {
+    DA_APPEND(&state->atlas.entries, shared->entries[i]);
+  }
+
+  return true;
+}
+
+// Hands the pages and their textures over to the host
+static void share_atlas(struct plug_State *state) {
+  const struct pack_Atlas *atlas = &state->atlas;
+  char key[PLUG_RESOURCE_KEY_MAX];
+
+  for (uint32_t i = 0; i < atlas->page_storage.count; i++) {
+    const struct imgc_Image *page = &atlas->page_storage.items[i];
+
+    snprintf(key, sizeof(key), ATLAS_PAGE_KEY, i);
+    share_resource(state, key,
+                   &(struct plug_Resource){
+                     .kind = PLUG_RESOURCE_IMAGE,
+                     .image = { page->image, page->map, page->map_size },
+                   });
+
+    snprintf(key, sizeof(key), ATLAS_TEXTURE_KEY, i);
+    share_resource(state, key,
+                   &(struct plug_Resource){
+                     .kind = PLUG_RESOURCE_TEXTURE,
+                     .texture = DA_AT(state->atlas_pages, i),
+                   });
+  }
+
+  // The pages are the host's now
+  state->atlas.page_storage.count = 0;
+
+  size_t size = sizeof(struct atlas_Shared) +
+                atlas->entries.count * sizeof(*atlas->entries.items);
+  struct atlas_Shared *shared = malloc(size);
+  assert(shared != NULL && "Failed to allocate memory");
+
+  shared->page_size = atlas->page_size;
+  shared->page_count = (uint32_t)atlas->pages.count;
+  shared->entry_count = atlas->entries.count;
+  memcpy(shared->entries, atlas->entries.items,
+         atlas->entries.count * sizeof(*atlas->entries.items));
+
+  // Last, so finding it means the pages are there too
+  share_resource(state, ATLAS_KEY,
+                 &(struct plug_Resource){
+                   .kind = PLUG_RESOURCE_DATA,
+                   .data = { shared, size },
+                 });
+}
+
+// Uploads the pages of a freshly packed state->atlas and shares them
+static void upload_atlas(struct plug_State *state) {
+  for (uint32_t i = 0; i < state->atlas.pages.count; i++) {
+    DA_APPEND(&state->atlas_pages,
+              LoadTextureFromImage(DA_AT(state->atlas.pages, i)));
+  }
+
+  if (state->host != NULL) {
+    share_atlas(state);
+  }
+}
+
+// Looks the cell and player sprites up in state->atlas
+static void find_sprites(struct plug_State *state) {
+  state->tiles = (struct plug_Tiles){ .pages = state->atlas.pages.items };
+
+  for (uint32_t cell = 0; cell < CELL_TYPES_COUNT; cell++) {
+    if (cell_sprites[cell] == NULL) {
+      continue;
+    }
+
+    const struct pack_Entry *entry =
+      pack_find(&state->atlas, cell_sprites[cell]);
+    if (entry == NULL) {
+      continue;
+    }
+
+    state->tiles.cells[cell] = (struct plug_Tile){
+      .present = true,
+      .page = entry->page,
+      .x = entry->x,
+      .y = entry->y,
+    };
+  }
+
+  const struct pack_Entry *player = pack_find(&state->atlas, PLAYER_SPRITE);
+  if (player == NULL) {
+    fprintf(stderr, "[ERROR]: Missing sprite %s\n", PLAYER_SPRITE);
+  }
+
+  state->player_sprite = player != NULL ? *player : (struct pack_Entry){ 0 };
+
+  // Only decoration, left out if it is missing
+  const struct pack_Entry *campfire = pack_find(&state->atlas, CAMPFIRE_SPRITE);
+  state->campfire_sprite =
+    campfire != NULL ? *campfire : (struct pack_Entry){ 0 };
+}
+
+static void load_atlas(struct plug_State *state) {
+  if (!attach_atlas(state)) {
+    // The CPU copies of the pages are what levels are baked from
+    if (!pack_atlas_load(ASSETS_DIR, ASSETS_CACHE_DIR, PACK_PAGE_SIZE,
+                         &state->atlas, NULL)) {
+      fprintf(stderr, "[ERROR]: Failed to pack %s\n", ASSETS_DIR);
+    }
+
+    upload_atlas(state);
+  }
+
+  find_sprites(state);
+}
+
+static void unload_atlas(struct plug_State *state) {
+  // Shared textures are the host's
+  for (uint32_t i = 0; state->host == NULL && i < state->atlas_pages.count;
+       i++) {
+    UnloadTexture(DA_AT(state->atlas_pages, i));
+  }
+
+  DA_FREE(&state->atlas_pages);
+  pack_atlas_free(&state->atlas);
+
+  state->tiles = (struct plug_Tiles){ 0 };
+}
+
+void reload_atlas(struct plug_State *state, struct pack_Atlas *atlas) {
+  if (state->host != NULL) {
+    drop_resources(state, ATLAS_KEY);
+  }
+  unload_atlas(state);
+
+  state->atlas = *atlas;
+  *atlas = (struct pack_Atlas){ 0 };
+
+  upload_atlas(state);
+  find_sprites(state);
+
+  if (state->current_level >= 0) {
+    level_rebake(&DA_AT(state->levels, (uint32_t)state->current_level));
+  }
+}
 
 void load_resources(struct plug_State *state) {
-  state->atlas = LoadTexture(ATLAS_PATH);
+  PROF_ZONE("load_resources");
 
-  import_level(NULL, state);
+  load_atlas(state);
+
+  if (!FileExists(LEVEL_FILE) || !import_level(LEVEL_FILE, state)) {
+    import_level(NULL, state);
+  }
   state->current_level = 0;
   load_level(state);
+
+  // Before the workers that post to it
+  inbox_init(state);
+  live_start(state);
+  pipe_start(state);
 }
 
 void unload_resources(struct plug_State *state) {
+  // Before anything they could be reloading into or stepping on goes
+  pipe_stop(state);
+  live_stop(state);
+  inbox_free(state);
+
   unload_levels(state);
-  UnloadTexture(state->atlas);
+  unload_atlas(state);
+
+  if (state->host != NULL) {
+    release_resources_from(state, 0);
+  }
+  DA_FREE(&state->resources);
 }
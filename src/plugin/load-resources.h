@@ -3,7 +3,26 @@
 
 #include "plugin.h"
 
+// Takes the resource called key from the host and keeps a reference until
+// unload_resources. Returns NULL if the host has none, or there is no host.
+struct plug_Resource *acquire_resource(struct plug_State *state,
+                                       const char *key);
+
+// Hands value over to the host as key, replacing what was there, and keeps
+// a reference until unload_resources. Needs a host.
+struct plug_Resource *share_resource(struct plug_State *state,
+                                     const char *key,
+                                     const struct plug_Resource *value);
+
+// Swaps atlas, packed from ASSETS_DIR again, in for state->atlas and
+// re-bakes the current level with it. Takes atlas.
+void reload_atlas(struct plug_State *state, struct pack_Atlas *atlas);
+
+// Loads everything from the host, or from disk and shares it with the host
+// if it has not got it yet.
 void load_resources(struct plug_State *state);
+
+// Also releases every host resource.
 void unload_resources(struct plug_State *state);
 
 #endif // PLUGIN_LOAD_RESOURCES_H
@@ -0,0 +1,308 @@
+#include "particles.h"
+#include "plugin.h"
+
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+#include <raylib/src/rlgl.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+typedef float part_v4 __attribute__((vector_size(16)));
+
+#define PART_LOAD(array, i) (*(const part_v4 *)&(array)[(i)])
+#define PART_STORE(array, i, value) (*(part_v4 *)&(array)[(i)] = (value))
+
+static void *part_alloc_array(uint32_t count, size_t size) {
+  size_t bytes = (count * size + PART_ALIGN - 1) & ~(size_t)(PART_ALIGN - 1);
+
+  // Padding lanes are computed but never read back, keep them finite
+  void *array = aligned_alloc(PART_ALIGN, bytes);
+  assert(array != NULL && "Failed to allocate memory");
+  memset(array, 0, bytes);
+
+  return array;
+}
+
+void part_system_init(struct part_System *system, uint32_t capacity) {
+  *system = (struct part_System){ .rng = 0x9e3779b97f4a7c15ull };
+
+  capacity = (capacity + PART_LANES - 1) & ~(uint32_t)(PART_LANES - 1);
+  system->capacity = capacity;
+
+#define X(field) \
+  system->field = part_alloc_array(capacity, sizeof(*system->field));
+  PART_ARRAYS(X)
+  PART_QUAD_ARRAYS(X)
+#undef X
+}
+
+void part_system_free(struct part_System *system) {
+#define X(field) free(system->field);
+  PART_ARRAYS(X)
+  PART_QUAD_ARRAYS(X)
+#undef X
+
+  *system = (struct part_System){ 0 };
+}
+
+void part_clear(struct part_System *system) {
+  system->count = 0;
+  system->colliding = 0;
+}
+
+// Uniform in [0, 1)
+static float part_random(struct part_System *system) {
+  system->rng ^= system->rng << 13;
+  system->rng ^= system->rng >> 7;
+  system->rng ^= system->rng << 17;
+
+  return (float)(system->rng >> 40) * (1.0f / (float)(1 << 24));
+}
+
+static float part_between(struct part_System *system, float min, float max) {
+  return min + (max - min) * part_random(system);
+}
+
+uint32_t part_emit(struct part_System *system, const struct part_Spawn *spawn,
+                   Vector2 pos, uint32_t count) {
+  uint32_t room = system->capacity - system->count;
+  if (count > room) {
+    system->dropped += count - room;
+    count = room;
+  }
+
+  for (uint32_t k = 0; k < count; k++) {
+    uint32_t i = system->count++;
+
+    float angle =
+      (spawn->angle + (part_random(system) - 0.5f) * spawn->spread) * DEG2RAD;
+    float speed = part_between(system, spawn->speed_min, spawn->speed_max);
+    float life = part_between(system, spawn->life_min, spawn->life_max);
+
+    system->pos_x[i] = pos.x + part_between(system, -spawn->extent.x,
+                                            spawn->extent.x);
+    system->pos_y[i] = pos.y + part_between(system, -spawn->extent.y,
+                                            spawn->extent.y);
+    system->vel_x[i] = cosf(angle) * speed;
+    system->vel_y[i] = sinf(angle) * speed;
+    system->gravity[i] = spawn->gravity;
+
+    system->life[i] = life;
+    system->inv_life[i] = life > 0.0f ? 1.0f / life : 0.0f;
+    system->size_end[i] = spawn->size_end;
+    system->size_range[i] = spawn->size_start - spawn->size_end;
+
+    system->color[i] = spawn->color;
+    system->collide[i] = spawn->collide;
+    system->colliding += spawn->collide;
+  }
+
+  return count;
+}
+
+uint32_t part_emitter_add(struct part_System *system, Vector2 pos, float rate,
+                          const struct part_Spawn *spawn) {
+  if (system->emitter_count == PART_MAX_EMITTERS) {
+    return PART_NO_EMITTER;
+  }
+
+  system->emitters[system->emitter_count] = (struct part_Emitter){
+    .active = true,
+    .pos = pos,
+    .rate = rate,
+    .spawn = *spawn,
+  };
+
+  return system->emitter_count++;
+}
+
+void part_run_emitters(struct part_System *system, float dt) {
+  for (uint32_t e = 0; e < system->emitter_count; e++) {
+    struct part_Emitter *emitter = &system->emitters[e];
+    if (!emitter->active) {
+      continue;
+    }
+
+    emitter->pending += emitter->rate * dt;
+    uint32_t count = (uint32_t)emitter->pending;
+    emitter->pending -= (float)count;
+
+    part_emit(system, &emitter->spawn, emitter->pos, count);
+  }
+}
+
+void part_integrate(struct part_System *system, float dt) {
+  part_v4 step = { dt, dt, dt, dt };
+
+  for (uint32_t i = 0; i < system->count; i += PART_LANES) {
+    part_v4 vel_x = PART_LOAD(system->vel_x, i);
+    part_v4 vel_y =
+      PART_LOAD(system->vel_y, i) + PART_LOAD(system->gravity, i) * step;
+
+    PART_STORE(system->vel_y, i, vel_y);
+    PART_STORE(system->pos_x, i, PART_LOAD(system->pos_x, i) + vel_x * step);
+    PART_STORE(system->pos_y, i, PART_LOAD(system->pos_y, i) + vel_y * step);
+    PART_STORE(system->life, i, PART_LOAD(system->life, i) - step);
+  }
+}
+
+// The cell lookups of part_collide, with what is the same for every
+// particle worked out once
+struct part_Grid {
+  const struct plug_Level *level;
+  float inv_cell_size;
+  float width, height;
+};
+
+static bool part_solid(const struct part_Grid *grid, float x, float y) {
+  const struct plug_Level *level = grid->level;
+
+  float cx = (x - level->pos.x) * grid->inv_cell_size;
+  float cy = (y - level->pos.y) * grid->inv_cell_size;
+
+  // Also false for NaN
+  bool inside = cx >= 0.0f && cy >= 0.0f && cx < grid->width &&
+                cy < grid->height;
+
+  // Truncating is flooring inside the level, and cell 0 stands in outside
+  // it, so there is no branch to mispredict
+  uint32_t cell = inside ? (uint32_t)cy * level->grid_width + (uint32_t)cx
+                         : 0;
+  return inside & cell_props[level->grid[cell]].solid;
+}
+
+// Particles that ended up in a solid cell are moved back along the axis
+// they came in on, and bounce. One cell lookup for every particle that did
+// not hit anything.
+void part_collide(struct part_System *system, const struct plug_Level *level,
+                  float dt) {
+  if (level == NULL || system->colliding == 0) {
+    return;
+  }
+
+  struct part_Grid grid = {
+    .level = level,
+    .inv_cell_size = 1.0f / (float)level->cell_size,
+    .width = (float)level->grid_width,
+    .height = (float)level->grid_height,
+  };
+
+  for (uint32_t i = 0; i < system->count; i++) {
+    float x = system->pos_x[i], y = system->pos_y[i];
+
+    // Rare, so the only branch most particles take the same way
+    if (!(system->collide[i] & part_solid(&grid, x, y))) {
+      continue;
+    }
+
+    float *vel_x = &system->vel_x[i], *vel_y = &system->vel_y[i];
+    float prev_x = x - *vel_x * dt, prev_y = y - *vel_y * dt;
+
+    if (!part_solid(&grid, prev_x, y)) {
+      system->pos_x[i] = prev_x;
+      *vel_x *= -PART_BOUNCE;
+
+    } else if (!part_solid(&grid, x, prev_y)) {
+      system->pos_y[i] = prev_y;
+      *vel_y *= -PART_BOUNCE;
+      *vel_x *= PART_FRICTION;
+
+    } else {
+      system->pos_x[i] = prev_x;
+      system->pos_y[i] = prev_y;
+      *vel_x *= -PART_BOUNCE;
+      *vel_y *= -PART_BOUNCE;
+    }
+  }
+}
+
+void part_compact(struct part_System *system) {
+  uint32_t i = 0;
+
+  while (i < system->count) {
+    if (system->life[i] > 0.0f) {
+      i++;
+      continue;
+    }
+
+    system->colliding -= system->collide[i];
+
+    // The last particle takes its place, and is looked at next
+    uint32_t last = --system->count;
+#define X(field) system->field[i] = system->field[last];
+    PART_ARRAYS(X)
+#undef X
+  }
+}
+
+void part_update(struct part_System *system, const struct plug_Level *level,
+                 float dt) {
+  PROF_ZONE("part_update");
+
+  part_run_emitters(system, dt);
+  part_integrate(system, dt);
+  part_collide(system, level, dt);
+  part_compact(system);
+}
+
+void part_build(struct part_System *system) {
+  PROF_ZONE("part_build");
+
+  part_v4 half = { 0.5f, 0.5f, 0.5f, 0.5f };
+
+  for (uint32_t i = 0; i < system->count; i += PART_LANES) {
+    part_v4 t = PART_LOAD(system->life, i) * PART_LOAD(system->inv_life, i);
+    part_v4 extent = (PART_LOAD(system->size_end, i) +
+                      PART_LOAD(system->size_range, i) * t) *
+                     half;
+
+    part_v4 x = PART_LOAD(system->pos_x, i), y = PART_LOAD(system->pos_y, i);
+    PART_STORE(system->left, i, x - extent);
+    PART_STORE(system->right, i, x + extent);
+    PART_STORE(system->top, i, y - extent);
+    PART_STORE(system->bottom, i, y + extent);
+
+    // Padding lanes may have died long ago
+    for (uint32_t k = 0; k < PART_LANES; k++) {
+      Color tint = system->color[i + k];
+      tint.a = (unsigned char)((float)tint.a * (t[k] > 0.0f ? t[k] : 0.0f));
+      system->tint[i + k] = tint;
+    }
+  }
+}
+
+void part_submit(const struct part_System *system) {
+  PROF_ZONE("part_submit");
+
+  if (system->count == 0) {
+    return;
+  }
+
+  rlSetTexture(rlGetTextureIdDefault());
+  rlBegin(RL_QUADS);
+  rlNormal3f(0.0f, 0.0f, 1.0f);
+
+  // The default texture is a single white texel
+  rlTexCoord2f(0.0f, 0.0f);
+
+  for (uint32_t i = 0; i < system->count; i++) {
+    // Splits the draw call only if rlgl's vertex buffer is full
+    rlCheckRenderBatchLimit(4);
+
+    Color c = system->tint[i];
+    rlColor4ub(c.r, c.g, c.b, c.a);
+
+    // Top-left, bottom-left, bottom-right, top-right, as the sprite batch
+    rlVertex2f(system->left[i], system->top[i]);
+    rlVertex2f(system->left[i], system->bottom[i]);
+    rlVertex2f(system->right[i], system->bottom[i]);
+    rlVertex2f(system->right[i], system->top[i]);
+  }
+
+  rlEnd();
+  rlSetTexture(0);
+}
@@ -0,0 +1,157 @@
+#ifndef PLUGIN_PARTICLES_H
+#define PLUGIN_PARTICLES_H
+
+#include <raylib/src/raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Arrays are padded to a multiple of PART_LANES, the width of the passes
+#define PART_LANES 4
+#define PART_ALIGN 64
+
+#define PART_MAX_EMITTERS 16
+#define PART_NO_EMITTER UINT32_MAX
+
+// Velocity kept along the axis a colliding particle hit, reversed, and
+// across it when it hit a floor
+#define PART_BOUNCE 0.3f
+#define PART_FRICTION 0.8f
+
+struct plug_Level;
+
+// How particles start out. Each one picks its values uniformly from the
+// ranges.
+struct part_Spawn {
+  // Half the size of the box around the emitting point they start in
+  Vector2 extent;
+
+  // Direction in degrees, 0 is +x and 90 is +y (down), give or take half
+  // the spread
+  float angle, spread;
+  float speed_min, speed_max;
+
+  float life_min, life_max;
+
+  // Side of the square, shrinking or growing from start to end over the
+  // particle's life
+  float size_start, size_end;
+
+  // Added to the vertical velocity every second. Negative rises.
+  float gravity;
+
+  // Alpha fades to 0 over the particle's life
+  Color color;
+
+  // Bounces off solid cells of the level
+  bool collide;
+};
+
+// Spawns rate particles a second at pos, while active
+struct part_Emitter {
+  bool active;
+  Vector2 pos;
+  float rate;
+
+  // Particles owed since the last one, less than one
+  float pending;
+
+  struct part_Spawn spawn;
+};
+
+// A fixed pool of particles, one array per field, so the passes stream
+// through exactly what they need, PART_LANES at a time. Dead particles are
+// swapped out for the last live one, so the live ones are always
+// [0, count).
+struct part_System {
+  uint32_t capacity;
+  uint32_t count;
+
+  float *pos_x, *pos_y;
+  float *vel_x, *vel_y;
+  float *gravity;
+
+  // Seconds left, and 1 / the seconds it started with
+  float *life;
+  float *inv_life;
+
+  // size_end + size_range * life * inv_life is the current size
+  float *size_end, *size_range;
+
+  Color *color;
+  uint8_t *collide;
+
+  // Live particles with collide set. The collision pass is skipped while
+  // there are none.
+  uint32_t colliding;
+
+  // Built quads, one per live particle, axis aligned
+  float *left, *top, *right, *bottom;
+  Color *tint;
+
+  struct part_Emitter emitters[PART_MAX_EMITTERS];
+  uint32_t emitter_count;
+
+  uint64_t rng;
+
+  // Particles not spawned because the pool was full
+  uint64_t dropped;
+};
+
+// Every particle array of struct part_System
+#define PART_ARRAYS(X) \
+  X(pos_x)             \
+  X(pos_y)             \
+  X(vel_x)             \
+  X(vel_y)             \
+  X(gravity)           \
+  X(life)              \
+  X(inv_life)          \
+  X(size_end)          \
+  X(size_range)        \
+  X(color)             \
+  X(collide)
+
+// Every quad array of struct part_System
+#define PART_QUAD_ARRAYS(X) \
+  X(left)                   \
+  X(top)                    \
+  X(right)                  \
+  X(bottom)                 \
+  X(tint)
+
+// Allocates room for capacity particles up front. Nothing allocates after.
+void part_system_init(struct part_System *system, uint32_t capacity);
+void part_system_free(struct part_System *system);
+
+// Kills every particle. Emitters are kept.
+void part_clear(struct part_System *system);
+
+// Spawns count particles at pos, as many as fit. Returns how many did.
+uint32_t part_emit(struct part_System *system, const struct part_Spawn *spawn,
+                   Vector2 pos, uint32_t count);
+
+// Returns the index of the new emitter in emitters, or PART_NO_EMITTER if
+// there are PART_MAX_EMITTERS already. It starts active.
+uint32_t part_emitter_add(struct part_System *system, Vector2 pos, float rate,
+                          const struct part_Spawn *spawn);
+
+// The passes of one update, in order. part_update runs all of them.
+void part_run_emitters(struct part_System *system, float dt);
+void part_integrate(struct part_System *system, float dt);
+void part_collide(struct part_System *system, const struct plug_Level *level,
+                  float dt);
+void part_compact(struct part_System *system);
+
+// Advances every particle by dt. Colliding particles only collide if
+// level != NULL.
+void part_update(struct part_System *system, const struct plug_Level *level,
+                 float dt);
+
+// Builds the quads of the live particles.
+void part_build(struct part_System *system);
+
+// Submits the built quads with raylib's white texture, as one draw call as
+// long as rlgl's batch does not fill up. Call inside BeginMode2D.
+void part_submit(const struct part_System *system);
+
+#endif // PLUGIN_PARTICLES_H
@@ -0,0 +1,105 @@
+#include "pipeline.h"
+#include "plugin.h"
+#include "update-player.h"
+#include "level.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <stdio.h>
+
+static void *pipe_steps(void *p) {
+  struct pipe_Pipeline *pipeline = p;
+  struct plug_State *state = pipeline->state;
+
+  for (uint32_t i = 0; i < pipeline->steps; i++) {
+    update_player(state, pipeline->input, SIM_STEP_DT);
+    snap_capture(&state->history, state, ++state->sim_step);
+  }
+
+  return NULL;
+}
+
+// Hands the cells the steps changed to the main thread
+static void pipe_sync_cells(struct plug_State *state) {
+  if (state->current_level >= 0) {
+    level_sync_cells(&DA_AT(state->levels, (uint32_t)state->current_level));
+  }
+}
+
+void pipe_start(struct plug_State *state) {
+  struct pipe_Pipeline *pipeline = &state->pipeline;
+
+  if (!pipeline->enabled || pipeline->pool != NULL) {
+    return;
+  }
+
+  pipeline->pool = tp_create_pool(1);
+  if (pipeline->pool == NULL) {
+    fprintf(stderr, "[WARNING]: Not pipelining frames\n");
+    pipeline->enabled = false;
+    return;
+  }
+
+  // Room for the one job in flight, so frames never grow the queues
+  DA_RESERVE(&pipeline->pool->job_queue, 1);
+  DA_RESERVE(&pipeline->pool->completed, 1);
+}
+
+void pipe_stop(struct plug_State *state) {
+  struct pipe_Pipeline *pipeline = &state->pipeline;
+
+  pipe_sync(state);
+
+  tp_free_pool(pipeline->pool);
+  pipeline->pool = NULL;
+}
+
+void pipe_set_enabled(struct plug_State *state, bool enabled) {
+  pipe_stop(state);
+
+  state->pipeline.enabled = enabled;
+  pipe_start(state);
+}
+
+void pipe_sync(struct plug_State *state) {
+  struct pipe_Pipeline *pipeline = &state->pipeline;
+
+  if (!pipeline->busy) {
+    return;
+  }
+
+  PROF_ZONE("pipe_sync");
+
+  tp_wait_job(pipeline->pool, pipeline->job);
+  pipeline->busy = false;
+
+  pipe_sync_cells(state);
+}
+
+void pipe_run(struct plug_State *state, uint8_t input, uint32_t steps) {
+  struct pipe_Pipeline *pipeline = &state->pipeline;
+
+  pipe_sync(state);
+
+  pipeline->state = state;
+  pipeline->input = input;
+  pipeline->steps = steps;
+
+  if (pipeline->pool == NULL) {
+    pipe_steps(pipeline);
+    pipe_sync_cells(state);
+  }
+
+  pipeline->frame.camera = state->player.camera;
+  pipeline->frame.player_pos = ent_pos(&state->actors, state->player.actor);
+  pipeline->frame.landings = state->player.landings;
+  pipeline->frame.deaths = state->player.deaths;
+  pipeline->frame.landed_at = state->player.landed_at;
+  pipeline->frame.died_at = state->player.died_at;
+
+  if (pipeline->pool != NULL && steps > 0) {
+    pipeline->job = tp_add_job(pipeline->pool, pipe_steps, pipeline);
+    pipeline->busy = true;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef PLUGIN_PIPELINE_H
+#define PLUGIN_PIPELINE_H
+
+#include "snapshot.h"
+#include "util/thread_pool.h"
+
+#include <raylib/src/raylib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct plug_State;
+
+// What drawing reads of the simulation. Copied out of it once per frame,
+// so the simulation can step on while the copy is drawn.
+struct pipe_Frame {
+  Camera2D camera;
+  Vector2 player_pos;
+
+  // The player's landing and death counters and where the last ones were
+  uint32_t landings, deaths;
+  Vector2 landed_at, died_at;
+
+  // Only filled in while the history is on screen
+  bool show_history;
+  struct snap_Stats history;
+};
+
+// Runs the fixed steps of a frame, either right away or, when enabled, on a
+// worker while the main thread draws the frame before them. Either way the
+// main thread samples input and waits for the worker once per frame, in
+// pipe_sync.
+struct pipe_Pipeline {
+  // Kept across hot reloads
+  bool enabled;
+
+  // A single worker, while enabled and started
+  struct tp_ThreadPool *pool;
+
+  // The steps in flight
+  bool busy;
+  tp_JobHandle job;
+
+  struct plug_State *state;
+  uint8_t input;
+  uint32_t steps;
+
+  struct pipe_Frame frame;
+};
+
+// Starts the worker if the pipeline is enabled.
+void pipe_start(struct plug_State *state);
+
+// Waits for the steps in flight and stops the worker. Leaves enabled as it
+// is. Safe to call if the worker is not running.
+void pipe_stop(struct plug_State *state);
+
+// Starts or stops the worker, and remembers the choice.
+void pipe_set_enabled(struct plug_State *state, bool enabled);
+
+// Waits for the steps in flight, and marks the cells they changed dirty.
+// Until the next pipe_run nothing else touches the simulation, so it can
+// be changed freely.
+void pipe_sync(struct plug_State *state);
+
+// Takes steps fixed steps with input, a set of enum plug_InputFlags, and
+// fills in the camera and player of frame. Without the worker the steps
+// run right away and frame shows where they end. With it frame shows the
+// state before them and they run until the next pipe_sync, so what is
+// drawn trails input by one more frame.
+void pipe_run(struct plug_State *state, uint8_t input, uint32_t steps);
+
+#endif // PLUGIN_PIPELINE_H
@@ -1,6 +1,11 @@
 #include "plugin.h"
 #include "load-resources.h"
 #include "update-player.h"
+#include "effects.h"
+#include "inbox.h"
+#include "level.h"
+#include "util/profiler.h"
+#include "util/alloc.h"
 
 #include <raylib/src/raylib.h>
 #include <cglm/include/cglm/cglm.h>
@@ -11,27 +16,83 @@
 #include <string.h>
 #include <math.h>
 
+// Held to step back through the history, pressed to go back to where the
+// level started
+#define REWIND_KEY KEY_BACKSPACE
+#define RESTART_KEY KEY_HOME
+
+// Toggles stepping on a worker while the previous step is drawn
+#define PIPELINE_KEY KEY_F6
+
+// Restarts the level and records the input of every step from there, until
+// pressed again, then writes it to REPLAY_PATH
+#define RECORD_KEY KEY_F7
+
+#define CARRY_KEY "state/carry"
+#define CARRY_VERSION 1
+
+// What plug_shutdown leaves with the host for the next plugin, when the
+// state itself cannot be handed over
+struct plug_Carry {
+  uint32_t version;
+
+  Vector2 player_pos;
+  Camera2D camera;
+};
+
 static struct plug_State *plug_state = NULL;
-static Texture2D tex;
 
-void plug_init(void) {
+// Puts the player back where the previous plugin left them, if it left a
+// carry
+static void take_carry(struct plug_State *state) {
+  if (state->host == NULL) {
+    return;
+  }
+
+  struct plug_Resource *resource = state->host->acquire(CARRY_KEY);
+  if (resource == NULL) {
+    return;
+  }
+
+  const struct plug_Carry *carry = resource->data.data;
+  if (resource->data.size == sizeof(*carry) &&
+      carry->version == CARRY_VERSION) {
+    ent_teleport(&state->actors, state->player.actor, carry->player_pos);
+    state->player.camera = carry->camera;
+  }
+
+  state->host->release(resource);
+  state->host->evict(CARRY_KEY);
+}
+
+struct plug_StateLayout plug_state_layout(void) {
+  return (struct plug_StateLayout){
+    .version = PLUG_STATE_VERSION,
+    .size = sizeof(struct plug_State),
+  };
+}
+
+void plug_init(const struct plug_Host *host) {
   plug_state = malloc(sizeof(*plug_state));
   assert(plug_state != NULL && "Failed to initialize plugin state");
 
   memset(plug_state, 0, sizeof(*plug_state));
+  plug_state->host = host;
 
   load_resources(plug_state);
+  spr_batch_init(&plug_state->sprites, SPRITE_BATCH_CAPACITY);
+  snap_init(&plug_state->history);
+  replay_init(&plug_state->replay);
+  tw_init(&plug_state->timers, SIM_TIMER_CAPACITY, 0);
+  init_effects(plug_state);
 
-  plug_state->player.grounded = false;
-  plug_state->player.pos.y = 40;
-  plug_state->player.cam_move_pad_x = 50;
-  plug_state->player.cam_move_pad_y = 50;
-  plug_state->player.hitbox = CLITERAL(Rectangle){
-    .x = 3.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
-    .y = 3.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
-    .width = 10.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
-    .height = 13.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
-  };
+  Vector2 spawn = { 0 };
+  if (plug_state->current_level >= 0) {
+    spawn =
+      DA_AT(plug_state->levels, (uint32_t)plug_state->current_level).spawn;
+  }
+
+  init_player(plug_state, spawn);
   plug_state->player.camera = CLITERAL(Camera2D) {
 		.offset = {
 			.x = (float)GetScreenWidth() * 0.5f, 
@@ -47,12 +108,17 @@ void plug_init(void) {
 		.zoom = 5.0f,
 	};
 
-  tex = LoadTexture("./assets/NewerCampFire_2.png");
+  take_carry(plug_state);
 }
 
 void *plug_pre_reload(void) {
   unload_resources(plug_state);
 
+#ifdef PROFILE
+  // The zone names are in this plugin
+  prof_shutdown();
+#endif
+
   return plug_state;
 }
 
@@ -62,36 +128,248 @@ void plug_post_reload(void *prev_state) {
   load_resources(plug_state);
 }
 
+void plug_shutdown(void *prev_state) {
+  struct plug_State *state = prev_state;
+
+  if (state->host != NULL) {
+    struct plug_Carry *carry = malloc(sizeof(*carry));
+    assert(carry != NULL && "Failed to allocate memory");
+
+    *carry = (struct plug_Carry){
+      .version = CARRY_VERSION,
+      .player_pos = ent_pos(&state->actors, state->player.actor),
+      .camera = state->player.camera,
+    };
+
+    state->host->evict(CARRY_KEY);
+    struct plug_Resource *resource =
+      state->host->insert(CARRY_KEY, &(struct plug_Resource){
+                                       .kind = PLUG_RESOURCE_DATA,
+                                       .data = { carry, sizeof(*carry) },
+                                     });
+
+    // Unreferenced, it is kept until the next plugin is in
+    if (resource != NULL) {
+      state->host->release(resource);
+    } else {
+      free(carry);
+    }
+  }
+
+  if (state == plug_state) {
+    plug_state = NULL;
+  }
+
+  spr_batch_free(&state->sprites);
+  free_effects(state);
+  snap_free(&state->history);
+  replay_free(&state->replay);
+  tw_free(&state->timers);
+  ent_store_free(&state->actors);
+  free(state);
+}
+
 static void draw_level(struct plug_State *state) {
+  PROF_ZONE("draw_level");
+
   if (state->current_level < 0) {
     return;
   }
 
-  const struct plug_Level *level =
+  struct plug_Level *level =
     &DA_AT(state->levels, (uint32_t)state->current_level);
-  DrawTextureV(level->grid_tex.texture, level->pos, WHITE);
+
+  Rectangle view =
+    chunk_camera_view(state->pipeline.frame.camera, (float)GetScreenWidth(),
+                      (float)GetScreenHeight());
+  chunk_cache_draw(&level->chunks, level, &state->tiles, view);
+  light_draw(&level->light, level, view);
 }
 
 static void draw_player(struct plug_State *state) {
+  PROF_ZONE("draw_player");
+
+  const struct pack_Entry *sprite = &state->player_sprite;
+  if (sprite->width == 0) {
+    return;
+  }
+
+  Vector2 pos = state->pipeline.frame.player_pos;
+
   Rectangle src = {
-    .x = 0,
-    .y = PLAYER_SPRITE_Y,
-    .width = 16,
-    .height = 16,
+    .x = (float)sprite->x,
+    .y = (float)sprite->y,
+    .width = (float)sprite->width,
+    .height = (float)sprite->height,
   };
 
   Rectangle dest = {
-    .x = state->player.pos.x,
-    .y = state->player.pos.y,
+    .x = pos.x,
+    .y = pos.y,
     .width = PLAYER_SIZE,
     .height = PLAYER_SIZE,
   };
 
-  DrawTexturePro(state->atlas, src, dest, CLITERAL(Vector2){ 0, 0 }, 0.0f,
-                 WHITE);
+  spr_batch_add(&state->sprites, DA_AT(state->atlas_pages, sprite->page),
+                src, dest, CLITERAL(Vector2){ 0, 0 }, 0.0f, WHITE,
+                SPRITE_LAYER_PLAYER);
+}
+
+static void stop_recording(struct plug_State *state) {
+  uint32_t steps = (uint32_t)state->replay.inputs.count;
+
+  if (replay_end(&state->replay, REPLAY_PATH)) {
+    printf("[INFO]: Wrote %u steps to %s\n", steps, REPLAY_PATH);
+  }
+}
+
+// Runs the fixed steps the frame time adds up to, capturing each one, or,
+// while REWIND_KEY is held, stepping back one captured step instead. Only
+// the steps forward can run on the pipeline's worker.
+static void simulate(struct plug_State *state) {
+  struct snap_History *history = &state->history;
+  struct replay_Recorder *replay = &state->replay;
+
+  state->sim_accumulator += GetFrameTime();
+  if (state->sim_accumulator > SIM_MAX_STEPS * SIM_STEP_DT) {
+    state->sim_accumulator = SIM_MAX_STEPS * SIM_STEP_DT;
+  }
+
+  // A replay only has steps forward, from the start of the level
+  bool restart = IsKeyPressed(RESTART_KEY);
+  if (replay->active &&
+      (restart || IsKeyPressed(RECORD_KEY) || IsKeyDown(REWIND_KEY))) {
+    stop_recording(state);
+  } else if (IsKeyPressed(RECORD_KEY)) {
+    restart = true;
+    replay_begin(replay);
+    printf("[INFO]: Recording to %s\n", REPLAY_PATH);
+  }
+
+  if (restart && snap_restart(history, state)) {
+    printf("[INFO]: Restarted the level in %.3f ms\n",
+           snap_stats(history).last_restore_ms);
+  }
+
+  // Where a restart goes back to
+  if (history->start_size == 0) {
+    snap_capture(history, state, state->sim_step);
+  }
+
+  uint32_t steps = 0;
+  while (state->sim_accumulator >= SIM_STEP_DT) {
+    state->sim_accumulator -= SIM_STEP_DT;
+    steps++;
+  }
+
+  bool rewind = IsKeyDown(REWIND_KEY);
+  for (uint32_t i = 0; rewind && i < steps; i++) {
+    if (snap_step_back(history, state)) {
+      state->sim_step--;
+    }
+  }
+
+  struct pipe_Frame *frame = &state->pipeline.frame;
+  frame->show_history = rewind || IsKeyDown(RESTART_KEY);
+  if (frame->show_history) {
+    frame->history = snap_stats(history);
+  }
+
+  uint8_t input = read_player_input();
+  if (replay->active && !rewind && !replay_record(replay, input, steps)) {
+    stop_recording(state);
+  }
+
+  pipe_run(state, input, rewind ? 0 : steps);
+}
+
+// How much history is kept and what it costs, while it is being used
+static void draw_history(const struct plug_State *state) {
+  const struct pipe_Frame *frame = &state->pipeline.frame;
+  if (!frame->show_history) {
+    return;
+  }
+
+  struct snap_Stats stats = frame->history;
+
+  DrawText(TextFormat("%.1f s kept, %.0f B/frame (%u B raw), "
+                      "restore %.3f ms",
+                      stats.frames * SIM_STEP_DT, stats.bytes_per_frame,
+                      stats.frame_size, stats.last_restore_ms),
+           0, 20, 10, BLACK);
+}
+
+#ifdef ALLOC_TRACK
+
+// Frames plug_update may allocate in, while what it fills every frame
+// grows to its working size
+#define ALLOC_WARMUP_FRAMES 60
+
+static uint64_t alloc_frames = 0;
+
+#endif
+
+#ifdef PROFILE
+
+#define PROFILE_TRACE_PATH "trace.json"
+
+// Toggled with F3
+static bool profile_overlay = false;
+
+// Average and p99 time per frame of every zone. F4 writes the trace.
+static void draw_profile(void) {
+  if (IsKeyPressed(KEY_F3)) {
+    profile_overlay = !profile_overlay;
+  }
+
+  if (IsKeyPressed(KEY_F4) && prof_write_trace(PROFILE_TRACE_PATH)) {
+    printf("[INFO]: Wrote %s\n", PROFILE_TRACE_PATH);
+  }
+
+  if (!profile_overlay) {
+    return;
+  }
+
+  struct prof_Stats stats[PROF_MAX_ZONES];
+  uint32_t count = prof_stats(stats, PROF_MAX_ZONES);
+
+  const int x = 10, y = 30, size = 10, line = 12;
+  const int columns[] = { x, x + 160, x + 220, x + 280 };
+
+  DrawRectangle(x - 5, y - 5, 330, (int)(count + 1) * line + 10,
+                Fade(BLACK, 0.6f));
+
+  DrawText("zone", columns[0], y, size, WHITE);
+  DrawText("avg ms", columns[1], y, size, WHITE);
+  DrawText("p99 ms", columns[2], y, size, WHITE);
+  DrawText("calls", columns[3], y, size, WHITE);
+
+  for (uint32_t i = 0; i < count; i++) {
+    int row = y + (int)(i + 1) * line;
+    int indent = (int)(stats[i].depth < 8 ? stats[i].depth : 8) * 8;
+
+    DrawText(stats[i].name, columns[0] + indent, row, size, WHITE);
+    DrawText(TextFormat("%.3f", stats[i].avg_ms), columns[1], row, size,
+             WHITE);
+    DrawText(TextFormat("%.3f", stats[i].p99_ms), columns[2], row, size,
+             WHITE);
+    DrawText(TextFormat("%.1f", stats[i].calls), columns[3], row, size,
+             WHITE);
+  }
 }
 
+#endif
+
 void plug_update(void) {
+  // Nothing below runs alongside the steps in flight, up to simulate
+  pipe_sync(plug_state);
+
+  if (IsKeyPressed(PIPELINE_KEY)) {
+    pipe_set_enabled(plug_state, !plug_state->pipeline.enabled);
+    printf("[INFO]: Pipelined frames %s\n",
+           plug_state->pipeline.enabled ? "on" : "off");
+  }
+
   if (IsWindowResized()) {
     plug_state->player.camera.offset.x = (float)GetScreenWidth() * 0.5f;
     plug_state->player.camera.offset.y = (float)GetScreenHeight() * 0.5f;
@@ -103,14 +381,43 @@ void plug_update(void) {
 
   //printf("%f\n", plug_state->player.vel.y);
 
+  // Reloads and a growing history allocate, the rest of the frame must not
+  live_update(plug_state);
+  inbox_poll(plug_state, INBOX_BUDGET_NS);
+  snap_prepare(&plug_state->history, plug_state);
+
+#ifdef ALLOC_TRACK
+  if (IsKeyPressed(KEY_F5)) {
+    alloc_track_report(stdout);
+  }
+
+  ALLOC_FORBID_IF(++alloc_frames > ALLOC_WARMUP_FRAMES, "plug_update");
+#endif
+
   BeginDrawing();
-  update_player(plug_state);
+  simulate(plug_state);
+
+  if (plug_state->current_level >= 0) {
+    level_flush_dirty(
+      &DA_AT(plug_state->levels, (uint32_t)plug_state->current_level),
+      &plug_state->tiles, LEVEL_FLUSH_BUDGET_CELLS);
+  }
+
   ClearBackground(GetColor(0x33c6f2ff));
 
-  BeginMode2D(plug_state->player.camera);
+  BeginMode2D(plug_state->pipeline.frame.camera);
+
+  // Not stepped, so just the frame time, but never more than the steps
+  // could catch up on
+  float dt = GetFrameTime();
+  update_effects(plug_state, dt < SIM_MAX_STEPS * SIM_STEP_DT
+                               ? dt
+                               : SIM_MAX_STEPS * SIM_STEP_DT);
 
   draw_level(plug_state);
   draw_player(plug_state);
+  spr_batch_flush(&plug_state->sprites);
+  draw_effects(plug_state);
 
   //{
   //  Rectangle r = {
@@ -126,5 +433,11 @@ void plug_update(void) {
   EndMode2D();
 
   DrawText(fps_str, 0, 0, 20, BLACK);
+  draw_history(plug_state);
+#ifdef PROFILE
+  draw_profile();
+#endif
   EndDrawing();
+
+  PROF_FRAME();
 }
@@ -1,18 +1,46 @@
 #ifndef PLUGIN_H
 #define PLUGIN_H
 
+#include "atlas-pack.h"
+#include "chunks.h"
+#include "light.h"
+#include "entity.h"
+#include "live-reload.h"
+#include "particles.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "sprite-batch.h"
+#include "timer-wheel.h"
+#include "game/plugin-interface.h"
 #include "util/dynamic_array.h"
+#include "util/mpsc_queue.h"
 
 #include <raylib/src/raylib.h>
 #include <stdint.h>
 
+// Bump whenever struct plug_State or anything in it changes layout, so a
+// hot reload rebuilds the state instead of misreading it. Size changes are
+// caught anyway.
+#define PLUG_STATE_VERSION 9
+
+// The simulation advances in steps of SIM_STEP_DT, however long frames
+// take. A frame runs at most SIM_MAX_STEPS of them, the rest of a long
+// frame is dropped rather than caught up on.
+#define SIM_STEP_DT (1.0f / 60.0f)
+#define SIM_MAX_STEPS 4
+
+// Timers the simulation can have pending at once. They are part of every
+// snapshot, so keep it small.
+#define SIM_TIMER_CAPACITY 256
+
 #define ATLAS_GRID_SIZE 16
 #define EPS 1e-6f
 
 #define PLAYER_TERMINAL_SPEED 100
 #define PLAYER_GRAV_TERMINAL_SPEED 500
-#define PLAYER_SPRITE_X 0
-#define PLAYER_SPRITE_Y (ATLAS_GRID_SIZE * 4)
+#define PLAYER_SPRITE "gmtk-texture-atlas/0_4"
+#define CAMPFIRE_SPRITE "NewerCampFire_2"
 #define PLAYER_SIZE 20
 #define PLAYER_ACCELERATION 600
 #define PLAYER_DECELERATION 300
@@ -22,10 +50,29 @@
 #define PLAYER_FEET_HITBOX_HEIGHT EPS
 #define PLAYER_FEET_HITBOX_WIDTH_FACT 0.8f
 
+// Triggers fire on cells within this distance of the hitbox, so solid
+// trigger cells fire on contact.
+#define TRIGGER_TOUCH_MARGIN 1.0f
+
 #define GRAVITY 350
 
 #define PLAYER_JUMP_SPEED -150
 
+// Landing at least this fast kicks up dust
+#define PLAYER_LANDING_SPEED 100
+
+// Steps a vanishing cell holds once touched, and stays gone after. One
+// that would come back inside the player tries again a little later.
+#define VANISH_DELAY_STEPS 30
+#define VANISH_RESPAWN_STEPS 180
+#define VANISH_RETRY_STEPS 10
+
+enum plug_InputFlags {
+  INPUT_LEFT = 1 << 0,
+  INPUT_RIGHT = 1 << 1,
+  INPUT_JUMP = 1 << 2,
+};
+
 enum plug_PlayerState {
   PLAYER_STATE_NORMAL = 0,
   PLAYER_STATE_BIG,
@@ -34,6 +81,8 @@ enum plug_PlayerState {
   PLAYER_STATE_COUNT,
 };
 
+// Cold, player only data. The simulated body is actor `actor` in
+// plug_State.actors.
 struct plug_Player {
   float walk_acceleration;
   float walk_deceleration;
@@ -41,19 +90,20 @@ struct plug_Player {
 
   enum plug_PlayerState state;
 
-  Vector2 pos;
-  Vector2 vel;
+  uint32_t actor;
 
   Vector2 respawn_point;
 
-  Rectangle hitbox; // Relative
-
   Camera2D camera;
 
+  // Counted by the steps, for the effects. Not part of the history, so
+  // they only ever go up.
+  uint32_t landings, deaths;
+  // Feet on the last landing, centre on the last death
+  Vector2 landed_at, died_at;
+
   float cam_move_pad_x;
   float cam_move_pad_y;
-
-  bool grounded;
 };
 
 enum plug_CellType {
@@ -66,34 +116,180 @@ enum plug_CellType {
   CELL_TYPE_EXPAND_PLAYER,
   CELL_TYPE_CHECKPOINT,
   CELL_TYPE_FINISH,
+  // A vanishing cell that was touched and is about to go
+  CELL_TYPE_VANISHING,
 
   CELL_TYPES_COUNT,
 };
 
+enum plug_TriggerKind {
+  TRIGGER_NONE = 0,
+  TRIGGER_HAZARD,
+  TRIGGER_VANISH,
+  TRIGGER_SHRINK,
+  TRIGGER_EXPAND,
+  TRIGGER_CHECKPOINT,
+  TRIGGER_FINISH,
+
+  TRIGGER_KINDS_COUNT,
+};
+
+// What the simulation's timers do when they fire, with the grid index of
+// their cell
+enum plug_TimerKind {
+  TIMER_VANISH = 0,
+  TIMER_REAPPEAR,
+
+  TIMER_KINDS_COUNT,
+};
+
+// What workers hand the main thread through state->inbox, see inbox_post
+enum plug_MessageKind {
+  // A struct live_Job the live reload worker is done with
+  MESSAGE_LIVE_JOB = 0,
+
+  MESSAGE_KINDS_COUNT,
+};
+
+struct plug_CellProps {
+  bool solid;
+  bool lethal;
+
+  // Only blocks bodies falling onto it from above
+  bool one_way;
+
+  enum plug_TriggerKind trigger;
+};
+
+// Indexed by enum plug_CellType
+extern const struct plug_CellProps cell_props[CELL_TYPES_COUNT];
+
+// Where the ATLAS_GRID_SIZE square tile of a cell type is
+struct plug_Tile {
+  bool present;
+  uint32_t page;
+  uint32_t x, y;
+};
+
+struct plug_Tiles {
+  // R8G8B8A8 images the tiles are in
+  const Image *pages;
+
+  // Indexed by enum plug_CellType
+  struct plug_Tile cells[CELL_TYPES_COUNT];
+};
+
+// A rectangle of cells
+struct plug_CellRect {
+  uint32_t x, y;
+  uint32_t width, height;
+};
+
+// A cell a fixed step changed
+struct plug_SteppedCell {
+  uint32_t index;
+  enum plug_CellType before, after;
+};
+
 struct plug_Level {
   uint32_t grid_width, grid_height;
 
   uint32_t cell_size;
   Vector2 pos;
+  Vector2 spawn;
+
+  // The file the level was imported from, NULL for the built in one
+  char *path;
 
   enum plug_CellType *grid;
-  RenderTexture2D grid_tex;
+  bool owns_grid;
+  // Baked chunks of the grid, drawn and kept while the level is loaded
+  struct chunk_Cache chunks;
+  // Light of every cell, and its chunk textures, while the level is loaded
+  struct light_Map light;
+
+  // Cells changed by level_set_cell that the chunks and light have not
+  // caught up with yet
+  DA_TYPE(struct plug_CellRect) dirty;
+
+  // Cells changed by level_step_cell, not yet in the grid, in the order
+  // they changed
+  DA_TYPE(struct plug_SteppedCell) stepped;
+  // How many of them snap_capture has stored
+  uint64_t stepped_captured;
+  // Changes dropped since the last level_sync_cells, for want of room
+  uint32_t stepped_dropped;
 
   bool loaded;
 };
 
+// Sprite batch layers, drawn in increasing order
+enum plug_SpriteLayer {
+  SPRITE_LAYER_PROPS = 0,
+  SPRITE_LAYER_ACTORS,
+  SPRITE_LAYER_PLAYER,
+};
+
+// Particles that are only drawn, see effects.h
+struct plug_Effects {
+  struct part_System particles;
+
+  // Index of the campfire's emitter in particles
+  uint32_t campfire;
+
+  // Player landings and deaths that have had their burst
+  uint32_t landings, deaths;
+};
+
 struct plug_State {
+  // NULL without a host, in headless tools, where the plugin owns every
+  // resource itself
+  const struct plug_Host *host;
+
+  // Every host resource this plugin holds a reference to
+  DA_TYPE(struct plug_Resource *) resources;
+
   struct plug_Player player;
+  struct ent_Store actors;
 
   DA_TYPE(struct plug_Level) levels;
   int32_t current_level;
+  bool level_complete;
 
-  Texture2D atlas;
-};
+  // Fixed steps taken, and frame time not yet stepped
+  uint64_t sim_step;
+  float sim_accumulator;
+
+  // Timers of the cells, ticking once a step, see process_timers
+  struct tw_Wheel timers;
+
+  // Every step of the last few minutes, for rewinding and restarting
+  struct snap_History history;
 
-void plug_init(void);
-void *plug_pre_reload(void);
-void plug_post_reload(void *prev_state);
-void plug_update(void);
+  // Runs the steps, and holds the copy of them that is drawn
+  struct pipe_Pipeline pipeline;
+
+  // Every sprite under assets/, packed. atlas_pages are the GPU copies of
+  // atlas.pages.
+  struct pack_Atlas atlas;
+  DA_TYPE(Texture2D) atlas_pages;
+
+  struct plug_Tiles tiles;
+  struct pack_Entry player_sprite;
+  struct pack_Entry campfire_sprite;
+
+  struct spr_Batch sprites;
+  struct plug_Effects effects;
+
+  // Picks up edits to the level files and assets/ while the game runs
+  struct live_Reloader live;
+
+  // What workers are done with, for the main thread to take up between
+  // frames, see inbox_poll
+  struct mpsc_Queue inbox;
+
+  // The input of every step since recording started, see RECORD_KEY
+  struct replay_Recorder replay;
+};
 
 #endif // PLUGIN_H
@@ -0,0 +1,2 @@
+#define UTIL_PROFILER_IMPLEMENTATION
+#include "util/profiler.h"
@@ -0,0 +1,436 @@
+#include "reachability.h"
+#include "plugin.h"
+#include "update-player.h"
+#include "level.h"
+
+#include "util/dynamic_array.h"
+#include "util/thread_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#define REACH_MIN_JOB_NODES 1024
+#define REACH_JOBS_PER_THREAD 4
+#define REACH_NO_PARENT UINT32_MAX
+#define REACH_NO_GOAL UINT64_MAX
+
+static const uint8_t reach_actions[] = {
+  0,
+  INPUT_LEFT,
+  INPUT_RIGHT,
+  INPUT_JUMP,
+  INPUT_LEFT | INPUT_JUMP,
+  INPUT_RIGHT | INPUT_JUMP,
+};
+
+#define REACH_ACTION_COUNT (sizeof(reach_actions) / sizeof(reach_actions[0]))
+
+struct reach_Node {
+  float pos_x, pos_y;
+  float vel_x, vel_y;
+
+  uint32_t parent;
+  uint8_t action;
+  bool grounded;
+};
+
+// Open addressing set of packed state keys. Keys are never 0, so 0 marks an
+// empty slot and slots can be claimed with a single CAS.
+struct reach_Set {
+  uint64_t *keys;
+  uint64_t capacity;
+};
+
+struct reach_Search {
+  const struct plug_Level *level;
+  const struct reach_Options *options;
+  Rectangle hitbox;
+
+  struct reach_Set set;
+  const struct reach_Node *nodes;
+  uint8_t *reachable;
+
+  Rectangle bounds;
+};
+
+struct reach_Job {
+  struct reach_Search *search;
+  uint32_t begin, end;
+
+  DA_TYPE(struct reach_Node) out;
+  uint64_t goal;
+};
+
+static inline uint64_t reach_hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  key ^= key >> 31;
+
+  return key;
+}
+
+// Returns true if key was not in the set before.
+static bool reach_set_insert(struct reach_Set *set, uint64_t key) {
+  uint64_t mask = set->capacity - 1;
+
+  for (uint64_t i = reach_hash(key) & mask;; i = (i + 1) & mask) {
+    uint64_t current = __atomic_load_n(&set->keys[i], __ATOMIC_RELAXED);
+    if (current == key) {
+      return false;
+    }
+
+    if (current == 0) {
+      uint64_t expected = 0;
+      if (__atomic_compare_exchange_n(&set->keys[i], &expected, key, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return true;
+      }
+
+      if (expected == key) {
+        return false;
+      }
+    }
+  }
+}
+
+static void reach_set_grow(struct reach_Set *set, uint64_t capacity) {
+  struct reach_Set grown = {
+    .keys = calloc(capacity, sizeof(*grown.keys)),
+    .capacity = capacity,
+  };
+  assert(grown.keys != NULL && "Failed to allocate memory");
+
+  for (uint64_t i = 0; i < set->capacity; i++) {
+    if (set->keys[i] != 0) {
+      reach_set_insert(&grown, set->keys[i]);
+    }
+  }
+
+  free(set->keys);
+  *set = grown;
+}
+
+static bool reach_quantise(float value, float quantum, uint32_t bits,
+                           uint64_t *out) {
+  int64_t half = 1ll << (bits - 1);
+  int64_t q = (int64_t)lroundf(value / quantum);
+
+  if (q < -half || q >= half) {
+    return false;
+  }
+
+  *out = (uint64_t)(q + half);
+  return true;
+}
+
+// Packs a quantised state into 21 + 21 + 10 + 11 + 1 bits. Returns 0 if the
+// state does not fit, which never collides with a valid key because of the
+// +1.
+static uint64_t reach_key(const struct reach_Options *options,
+                          const struct reach_Node *node) {
+  uint64_t x, y, vx, vy;
+
+  if (!reach_quantise(node->pos_x, options->pos_quantum, 21, &x) ||
+      !reach_quantise(node->pos_y, options->pos_quantum, 21, &y) ||
+      !reach_quantise(node->vel_x, options->vel_quantum, 10, &vx) ||
+      !reach_quantise(node->vel_y, options->vel_quantum, 11, &vy)) {
+    return 0;
+  }
+
+  uint64_t key = x;
+  key = (key << 21) | y;
+  key = (key << 10) | vx;
+  key = (key << 11) | vy;
+  key = (key << 1) | (node->grounded ? 1 : 0);
+
+  return key + 1;
+}
+
+enum reach_Contact {
+  REACH_CONTACT_NONE = 0,
+  REACH_CONTACT_FINISH,
+  REACH_CONTACT_LETHAL,
+};
+
+// Marks every cell under the hitbox as reachable and reports whether the
+// state ends the search or the run.
+static enum reach_Contact reach_visit(const struct reach_Search *search,
+                                      Vector2 pos) {
+  const struct plug_Level *level = search->level;
+
+  Rectangle touch = {
+    .x = pos.x + search->hitbox.x - TRIGGER_TOUCH_MARGIN,
+    .y = pos.y + search->hitbox.y - TRIGGER_TOUCH_MARGIN,
+    .width = search->hitbox.width + 2.0f * TRIGGER_TOUCH_MARGIN,
+    .height = search->hitbox.height + 2.0f * TRIGGER_TOUCH_MARGIN,
+  };
+
+  uint32_t x_begin, x_end, y_begin, y_end;
+  if (!level_cell_range(level, touch, &x_begin, &x_end, &y_begin, &y_end)) {
+    return REACH_CONTACT_NONE;
+  }
+
+  bool finish = false;
+  bool lethal = false;
+
+  for (uint32_t y = y_begin; y < y_end; y++) {
+    for (uint32_t x = x_begin; x < x_end; x++) {
+      uint64_t index = (uint64_t)y * level->grid_width + x;
+      const struct plug_CellProps *props = &cell_props[level->grid[index]];
+
+      finish |= props->trigger == TRIGGER_FINISH;
+      lethal |= props->lethal;
+      __atomic_store_n(&search->reachable[index], 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  // Dying and finishing on the same step counts as dying
+  return lethal ? REACH_CONTACT_LETHAL
+                : (finish ? REACH_CONTACT_FINISH : REACH_CONTACT_NONE);
+}
+
+static void *reach_expand(void *in) {
+  struct reach_Job *job = in;
+  struct reach_Search *search = job->search;
+  const struct reach_Options *options = search->options;
+  Rectangle bounds = search->bounds;
+
+  for (uint32_t i = job->begin; i < job->end; i++) {
+    const struct reach_Node *node = &search->nodes[i];
+
+    for (uint32_t a = 0; a < REACH_ACTION_COUNT; a++) {
+      Vector2 pos = { node->pos_x, node->pos_y };
+      Vector2 vel = { node->vel_x, node->vel_y };
+      bool grounded = node->grounded;
+      bool alive = true;
+
+      for (uint32_t s = 0; s < options->frames_per_action; s++) {
+        step_body(&pos, &vel, &grounded, search->hitbox, search->level,
+                  reach_actions[a], options->dt);
+
+        if (pos.x < bounds.x || pos.x > bounds.x + bounds.width ||
+            pos.y < bounds.y || pos.y > bounds.y + bounds.height) {
+          alive = false;
+          break;
+        }
+
+        enum reach_Contact contact = reach_visit(search, pos);
+        if (contact == REACH_CONTACT_FINISH) {
+          uint64_t goal = (((uint64_t)i * REACH_ACTION_COUNT + a) << 8) | s;
+          job->goal = goal < job->goal ? goal : job->goal;
+        }
+
+        if (contact != REACH_CONTACT_NONE) {
+          alive = false;
+          break;
+        }
+      }
+
+      if (!alive) {
+        continue;
+      }
+
+      struct reach_Node next = {
+        .pos_x = pos.x,
+        .pos_y = pos.y,
+        .vel_x = vel.x,
+        .vel_y = vel.y,
+        .parent = i,
+        .action = (uint8_t)a,
+        .grounded = grounded,
+      };
+
+      uint64_t key = reach_key(options, &next);
+      if (key != 0 && reach_set_insert(&search->set, key)) {
+        DA_APPEND(&job->out, next);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static void reach_build_inputs(struct reach_Result *result,
+                               const struct reach_Node *nodes, uint64_t goal,
+                               uint32_t frames_per_action) {
+  uint32_t last_steps = (uint32_t)(goal & 0xff) + 1;
+  uint64_t edge = goal >> 8;
+  uint32_t node = (uint32_t)(edge / REACH_ACTION_COUNT);
+  uint8_t last_action = reach_actions[edge % REACH_ACTION_COUNT];
+
+  uint32_t length = 0;
+  for (uint32_t n = node; nodes[n].parent != REACH_NO_PARENT;
+       n = nodes[n].parent) {
+    length++;
+  }
+
+  uint64_t total = (uint64_t)length * frames_per_action + last_steps;
+  for (uint64_t i = 0; i < total; i++) {
+    DA_APPEND_NO_ASSIGN(&result->inputs);
+  }
+
+  uint64_t cursor = (uint64_t)length * frames_per_action;
+  memset(&result->inputs.items[cursor], last_action, last_steps);
+
+  for (uint32_t n = node; nodes[n].parent != REACH_NO_PARENT;
+       n = nodes[n].parent) {
+    cursor -= frames_per_action;
+    memset(&result->inputs.items[cursor], reach_actions[nodes[n].action],
+           frames_per_action);
+  }
+}
+
+struct reach_Result reach_analyse(const struct plug_Level *level,
+                                  Vector2 spawn, Rectangle hitbox,
+                                  const struct reach_Options *options) {
+  assert(options->frames_per_action > 0 && options->frames_per_action <= 256);
+  assert(options->max_states < REACH_NO_PARENT);
+
+  struct reach_Result result = { 0 };
+
+  uint64_t cells = (uint64_t)level->grid_width * level->grid_height;
+  result.reachable = calloc(cells, sizeof(*result.reachable));
+  assert(result.reachable != NULL && "Failed to allocate memory");
+
+  // Anything that leaves the level by more than a few cells is dead.
+  float margin = 4.0f * level->cell_size;
+  struct reach_Search search = {
+    .level = level,
+    .options = options,
+    .hitbox = hitbox,
+    .reachable = result.reachable,
+    .bounds = {
+      .x = level->pos.x - margin,
+      .y = level->pos.y - margin,
+      .width = level->grid_width * level->cell_size + 2.0f * margin,
+      .height = level->grid_height * level->cell_size + 2.0f * margin,
+    },
+  };
+
+  reach_set_grow(&search.set, 1024);
+
+  DA_TYPE(struct reach_Node) nodes = { 0 };
+  struct reach_Node root = {
+    .pos_x = spawn.x,
+    .pos_y = spawn.y,
+    .vel_x = 0.0f,
+    .vel_y = 0.0f,
+    .parent = REACH_NO_PARENT,
+    .action = 0,
+    .grounded = false,
+  };
+
+  DA_APPEND(&nodes, root);
+  reach_set_insert(&search.set, reach_key(options, &root));
+  reach_visit(&search, spawn);
+
+  DA_TYPE(struct reach_Job) jobs = { 0 };
+  DA_TYPE(tp_JobHandle) handles = { 0 };
+
+  uint64_t frontier_begin = 0;
+  uint64_t frontier_end = nodes.count;
+
+  while (frontier_begin < frontier_end) {
+    uint64_t frontier = frontier_end - frontier_begin;
+    uint64_t worst_case = nodes.count + frontier * REACH_ACTION_COUNT;
+
+    if (worst_case > options->max_states) {
+      result.state_limit_hit = true;
+      break;
+    }
+
+    // Never resized while workers insert, so keep it at most half full even
+    // if every successor of this level turns out to be new.
+    if (worst_case * 2 > search.set.capacity) {
+      uint64_t capacity = search.set.capacity;
+      while (worst_case * 2 > capacity) {
+        capacity *= 2;
+      }
+
+      reach_set_grow(&search.set, capacity);
+    }
+
+    search.nodes = nodes.items;
+
+    uint32_t threads = options->pool == NULL ? 1 : options->pool->count;
+    uint64_t per_job = frontier / ((uint64_t)threads * REACH_JOBS_PER_THREAD);
+    per_job = per_job < REACH_MIN_JOB_NODES ? REACH_MIN_JOB_NODES : per_job;
+
+    jobs.count = 0;
+    for (uint64_t begin = frontier_begin; begin < frontier_end;
+         begin += per_job) {
+      uint64_t end = begin + per_job;
+
+      struct reach_Job job = {
+        .search = &search,
+        .begin = (uint32_t)begin,
+        .end = (uint32_t)(end > frontier_end ? frontier_end : end),
+        .out = { 0 },
+        .goal = REACH_NO_GOAL,
+      };
+
+      DA_APPEND(&jobs, job);
+    }
+
+    if (options->pool == NULL || jobs.count == 1) {
+      for (uint64_t i = 0; i < jobs.count; i++) {
+        reach_expand(&jobs.items[i]);
+      }
+
+    } else {
+      handles.count = 0;
+      for (uint64_t i = 0; i < jobs.count; i++) {
+        DA_APPEND(&handles,
+                  tp_add_job(options->pool, reach_expand, &jobs.items[i]));
+      }
+
+      for (uint64_t i = 0; i < handles.count; i++) {
+        tp_wait_job(options->pool, handles.items[i]);
+      }
+    }
+
+    uint64_t goal = REACH_NO_GOAL;
+    frontier_begin = frontier_end;
+
+    for (uint64_t i = 0; i < jobs.count; i++) {
+      struct reach_Job *job = &jobs.items[i];
+      goal = job->goal < goal ? job->goal : goal;
+
+      for (uint64_t n = 0; n < job->out.count; n++) {
+        DA_APPEND(&nodes, job->out.items[n]);
+      }
+
+      DA_FREE(&job->out);
+    }
+
+    frontier_end = nodes.count;
+    result.depth++;
+
+    if (goal != REACH_NO_GOAL) {
+      result.finish_reached = true;
+      reach_build_inputs(&result, nodes.items, goal,
+                         options->frames_per_action);
+      break;
+    }
+  }
+
+  result.states_visited = nodes.count;
+
+  DA_FREE(&handles);
+  DA_FREE(&jobs);
+  DA_FREE(&nodes);
+  free(search.set.keys);
+
+  return result;
+}
+
+void reach_free_result(struct reach_Result *result) {
+  free(result->reachable);
+  DA_FREE(&result->inputs);
+
+  *result = (struct reach_Result){ 0 };
+}
@@ -0,0 +1,53 @@
+#ifndef PLUGIN_REACHABILITY_H
+#define PLUGIN_REACHABILITY_H
+
+#include "plugin.h"
+#include "util/dynamic_array.h"
+#include "util/thread_pool.h"
+
+#define REACH_DEFAULT_FRAMES_PER_ACTION 8
+#define REACH_DEFAULT_POS_QUANTUM 4.0f
+#define REACH_DEFAULT_VEL_QUANTUM 50.0f
+#define REACH_DEFAULT_MAX_STATES (1ull << 24)
+
+struct reach_Options {
+  // Every edge of the search holds one input for this many steps of dt.
+  uint32_t frames_per_action;
+  float dt;
+
+  // States that quantise to the same cell are considered visited.
+  float pos_quantum;
+  float vel_quantum;
+
+  // The search gives up once this many distinct states have been visited.
+  uint64_t max_states;
+
+  // Frontier expansion runs on the calling thread if pool == NULL.
+  struct tp_ThreadPool *pool;
+};
+
+struct reach_Result {
+  bool finish_reached;
+  bool state_limit_hit;
+
+  // grid_width * grid_height flags, non-zero where the hitbox of some
+  // visited state overlapped the cell.
+  uint8_t *reachable;
+
+  // Per step inputs of the shortest (in actions) route from spawn to the
+  // first contact with a CELL_TYPE_FINISH cell. Empty if not reached.
+  DA_TYPE(uint8_t) inputs;
+
+  uint64_t states_visited;
+  uint32_t depth;
+};
+
+// Breadth first search over quantised player states starting at rest at
+// spawn, stepped with the same physics as the game (step_body).
+struct reach_Result reach_analyse(const struct plug_Level *level,
+                                  Vector2 spawn, Rectangle hitbox,
+                                  const struct reach_Options *options);
+
+void reach_free_result(struct reach_Result *result);
+
+#endif // PLUGIN_REACHABILITY_H
@@ -0,0 +1,99 @@
+#include "replay.h"
+
+#include "util/dynamic_array.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+void replay_init(struct replay_Recorder *recorder) {
+  *recorder = (struct replay_Recorder){ 0 };
+  DA_RESERVE(&recorder->inputs, REPLAY_MAX_STEPS);
+}
+
+void replay_free(struct replay_Recorder *recorder) {
+  DA_FREE(&recorder->inputs);
+  recorder->active = false;
+}
+
+void replay_begin(struct replay_Recorder *recorder) {
+  recorder->inputs.count = 0;
+  recorder->active = true;
+}
+
+bool replay_record(struct replay_Recorder *recorder, uint8_t input,
+                   uint32_t steps) {
+  if (recorder->inputs.count + steps > REPLAY_MAX_STEPS) {
+    return false;
+  }
+
+  memset(&recorder->inputs.items[recorder->inputs.count], input, steps);
+  recorder->inputs.count += steps;
+
+  return true;
+}
+
+bool replay_end(struct replay_Recorder *recorder, const char *path) {
+  recorder->active = false;
+
+  struct replay_Header header = {
+    .version = REPLAY_VERSION,
+    .steps = (uint32_t)recorder->inputs.count,
+  };
+  memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(recorder->inputs.items, 1, header.steps, f) ==
+              header.steps;
+
+  if (fclose(f) != 0 || !ok) {
+    fprintf(stderr, "[ERROR]: Failed to write %s\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+bool replay_read(const char *path, uint8_t **inputs, uint32_t *steps) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  struct replay_Header header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != REPLAY_VERSION) {
+    fprintf(stderr, "[ERROR]: %s is not a replay of version %u\n", path,
+            REPLAY_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  *inputs = malloc(header.steps > 0 ? header.steps : 1);
+  assert(*inputs != NULL && "Failed to allocate memory");
+
+  if (fread(*inputs, 1, header.steps, f) != header.steps) {
+    fprintf(stderr, "[ERROR]: %s is cut short\n", path);
+    free(*inputs);
+    *inputs = NULL;
+    fclose(f);
+    return false;
+  }
+
+  *steps = header.steps;
+  fclose(f);
+
+  return true;
+}
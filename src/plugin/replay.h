@@ -0,0 +1,55 @@
+#ifndef PLUGIN_REPLAY_H
+#define PLUGIN_REPLAY_H
+
+#include "util/dynamic_array.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REPLAY_MAGIC "RPLY"
+#define REPLAY_VERSION 1
+
+// Where the game writes what it recorded
+#define REPLAY_PATH "session.replay"
+
+// Ten minutes of steps at 60 a second. Recording stops there.
+#define REPLAY_MAX_STEPS (10 * 60 * 60)
+
+// A .replay file is this header and then one set of enum plug_InputFlags
+// per step, from the start of the level.
+struct replay_Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t steps;
+  uint32_t reserved;
+};
+
+// The input of every step of a session, so it can be stepped through
+// again without a window, see tools/replay.c. The release build trains its
+// profile on one.
+struct replay_Recorder {
+  bool active;
+
+  // Reserved up front, recording never allocates
+  DA_TYPE(uint8_t) inputs;
+};
+
+// Reserves room for REPLAY_MAX_STEPS.
+void replay_init(struct replay_Recorder *recorder);
+void replay_free(struct replay_Recorder *recorder);
+
+// Drops what was recorded and starts again.
+void replay_begin(struct replay_Recorder *recorder);
+
+// Adds steps steps of input. Returns false, leaving the recorder as it was,
+// once REPLAY_MAX_STEPS are in.
+bool replay_record(struct replay_Recorder *recorder, uint8_t input,
+                   uint32_t steps);
+
+// Stops recording and writes what was recorded to path.
+bool replay_end(struct replay_Recorder *recorder, const char *path);
+
+// Reads the inputs of a .replay file into inputs, which it allocates.
+bool replay_read(const char *path, uint8_t **inputs, uint32_t *steps);
+
+#endif // PLUGIN_REPLAY_H
@@ -0,0 +1,177 @@
+#include "sim-batch.h"
+#include "plugin.h"
+#include "update-player.h"
+
+#include "util/clock.h"
+#include "util/thread_pool.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+// Shards are multiples of this many instances so that two threads never
+// write to the same cache line of the float arrays.
+#define SIM_SHARD_ALIGN 16
+#define SIM_SHARDS_PER_THREAD 4
+
+struct sim_Shard {
+  struct sim_Batch *batch;
+  const struct plug_Level *level;
+
+  uint32_t begin, end;
+  uint32_t steps;
+  float dt;
+};
+
+struct sim_Batch sim_batch_create(uint32_t count, Vector2 spawn,
+                                  Rectangle hitbox) {
+  struct sim_Batch batch = {
+    .count = count,
+    .hitbox = hitbox,
+    .step = 0,
+  };
+
+  batch.pos_x = malloc(count * sizeof(*batch.pos_x));
+  batch.pos_y = malloc(count * sizeof(*batch.pos_y));
+  batch.vel_x = malloc(count * sizeof(*batch.vel_x));
+  batch.vel_y = malloc(count * sizeof(*batch.vel_y));
+  batch.grounded = malloc(count * sizeof(*batch.grounded));
+  batch.scripts = calloc(count, sizeof(*batch.scripts));
+  batch.script_len = calloc(count, sizeof(*batch.script_len));
+
+  assert(batch.pos_x != NULL && batch.pos_y != NULL && batch.vel_x != NULL &&
+         batch.vel_y != NULL && batch.grounded != NULL &&
+         batch.scripts != NULL && batch.script_len != NULL &&
+         "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < count; i++) {
+    batch.pos_x[i] = spawn.x;
+    batch.pos_y[i] = spawn.y;
+    batch.vel_x[i] = 0.0f;
+    batch.vel_y[i] = 0.0f;
+    batch.grounded[i] = false;
+  }
+
+  return batch;
+}
+
+void sim_batch_free(struct sim_Batch *batch) {
+  free(batch->pos_x);
+  free(batch->pos_y);
+  free(batch->vel_x);
+  free(batch->vel_y);
+  free(batch->grounded);
+  free(batch->scripts);
+  free(batch->script_len);
+
+  *batch = (struct sim_Batch){ 0 };
+}
+
+void sim_batch_set_script(struct sim_Batch *batch, uint32_t instance,
+                          const uint8_t *script, uint32_t len) {
+  assert(instance < batch->count && "Invalid instance");
+
+  batch->scripts[instance] = len == 0 ? NULL : script;
+  batch->script_len[instance] = len;
+}
+
+static void *sim_run_shard(void *in) {
+  struct sim_Shard *shard = in;
+  struct sim_Batch *batch = shard->batch;
+
+  // Instance-major: each instance is loaded once, stepped in registers and
+  // written back once, so the arrays are streamed through exactly once.
+  for (uint32_t i = shard->begin; i < shard->end; i++) {
+    Vector2 pos = { batch->pos_x[i], batch->pos_y[i] };
+    Vector2 vel = { batch->vel_x[i], batch->vel_y[i] };
+    bool grounded = batch->grounded[i];
+
+    const uint8_t *script = batch->scripts[i];
+    uint32_t len = batch->script_len[i];
+    uint64_t cursor = len == 0 ? 0 : batch->step % len;
+
+    for (uint32_t s = 0; s < shard->steps; s++) {
+      uint8_t input = 0;
+      if (script != NULL) {
+        input = script[cursor];
+        cursor = cursor + 1 == len ? 0 : cursor + 1;
+      }
+
+      step_body(&pos, &vel, &grounded, batch->hitbox, shard->level, input,
+                shard->dt);
+    }
+
+    batch->pos_x[i] = pos.x;
+    batch->pos_y[i] = pos.y;
+    batch->vel_x[i] = vel.x;
+    batch->vel_y[i] = vel.y;
+    batch->grounded[i] = grounded;
+  }
+
+  return NULL;
+}
+
+struct sim_BatchStats sim_batch_run(struct sim_Batch *batch,
+                                    const struct plug_Level *level,
+                                    struct tp_ThreadPool *pool, uint32_t steps,
+                                    float dt) {
+  uint64_t start = clk_now_ns();
+
+  uint32_t shard_count = pool == NULL ? 1 : pool->count * SIM_SHARDS_PER_THREAD;
+  uint32_t per_shard = (batch->count + shard_count - 1) / shard_count;
+  per_shard = (per_shard + SIM_SHARD_ALIGN - 1) & ~(SIM_SHARD_ALIGN - 1);
+
+  if (pool == NULL || per_shard >= batch->count) {
+    struct sim_Shard shard = {
+      .batch = batch,
+      .level = level,
+      .begin = 0,
+      .end = batch->count,
+      .steps = steps,
+      .dt = dt,
+    };
+    sim_run_shard(&shard);
+
+  } else {
+    shard_count = (batch->count + per_shard - 1) / per_shard;
+
+    struct sim_Shard *shards = malloc(shard_count * sizeof(*shards));
+    tp_JobHandle *handles = malloc(shard_count * sizeof(*handles));
+    assert(shards != NULL && handles != NULL && "Failed to allocate memory");
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+      uint32_t begin = i * per_shard;
+      uint32_t end = begin + per_shard;
+
+      shards[i] = (struct sim_Shard){
+        .batch = batch,
+        .level = level,
+        .begin = begin,
+        .end = end > batch->count ? batch->count : end,
+        .steps = steps,
+        .dt = dt,
+      };
+
+      handles[i] = tp_add_job(pool, sim_run_shard, &shards[i]);
+    }
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+      tp_wait_job(pool, handles[i]);
+    }
+
+    free(handles);
+    free(shards);
+  }
+
+  batch->step += steps;
+
+  uint64_t elapsed = clk_now_ns() - start;
+
+  struct sim_BatchStats stats = {
+    .total_steps = (uint64_t)batch->count * steps,
+    .seconds = clk_ns_to_s(elapsed),
+  };
+  stats.steps_per_second =
+    stats.seconds > 0.0 ? (double)stats.total_steps / stats.seconds : 0.0;
+
+  return stats;
+}
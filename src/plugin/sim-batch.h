@@ -0,0 +1,53 @@
+#ifndef PLUGIN_SIM_BATCH_H
+#define PLUGIN_SIM_BATCH_H
+
+#include "plugin.h"
+#include "util/thread_pool.h"
+
+// A batch of independent player simulations stored as structure of arrays.
+// Every instance runs against the same read-only level with its own input
+// script, so instances can be sharded across threads without any locking.
+struct sim_Batch {
+  uint32_t count;
+
+  float *pos_x;
+  float *pos_y;
+  float *vel_x;
+  float *vel_y;
+  bool *grounded;
+
+  // Instance i replays scripts[i][0 .. script_len[i]) in a loop. A NULL
+  // script means no input.
+  const uint8_t **scripts;
+  uint32_t *script_len;
+
+  // Shared by all instances
+  Rectangle hitbox;
+
+  // Number of steps every instance has taken so far
+  uint64_t step;
+};
+
+struct sim_BatchStats {
+  uint64_t total_steps;
+  double seconds;
+  double steps_per_second;
+};
+
+// Every instance starts at rest at spawn.
+struct sim_Batch sim_batch_create(uint32_t count, Vector2 spawn,
+                                  Rectangle hitbox);
+void sim_batch_free(struct sim_Batch *batch);
+
+// The batch does not take ownership of script.
+void sim_batch_set_script(struct sim_Batch *batch, uint32_t instance,
+                          const uint8_t *script, uint32_t len);
+
+// Advances every instance by steps fixed steps of dt. Runs on the calling
+// thread if pool == NULL.
+struct sim_BatchStats sim_batch_run(struct sim_Batch *batch,
+                                    const struct plug_Level *level,
+                                    struct tp_ThreadPool *pool, uint32_t steps,
+                                    float dt);
+
+#endif // PLUGIN_SIM_BATCH_H
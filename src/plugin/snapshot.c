@@ -0,0 +1,616 @@
+#include "snapshot.h"
+#include "plugin.h"
+#include "level.h"
+
+#include "util/clock.h"
+#include "util/profiler.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+// Upper bound on what snap_encode writes for size bytes. Every run pair
+// costs at most two varint bytes per SNAP_MIN_ZERO_RUN + 1 bytes it covers,
+// plus a few for the lengths past 127.
+#define SNAP_ENCODED_MAX(size) ((size) + (size) / 2 + 32)
+
+// Everything in a frame but the actor arrays and the timers, which follow
+// it. The grid size only tells frames of another grid apart.
+struct snap_Header {
+  int32_t level;
+  uint32_t grid_width, grid_height;
+  uint32_t actors;
+  uint32_t timers;
+
+  enum plug_PlayerState player_state;
+  Vector2 respawn_point;
+  Vector2 camera_target;
+
+  bool level_complete;
+};
+
+static struct plug_Level *snap_level(const struct plug_State *state) {
+  if (state->current_level < 0) {
+    return NULL;
+  }
+
+  return &DA_AT(state->levels, (uint32_t)state->current_level);
+}
+
+static uint32_t snap_frame_size(const struct plug_State *state) {
+  uint32_t size = sizeof(struct snap_Header);
+
+#define X(field) size += state->actors.count * sizeof(*state->actors.field);
+  ENT_ARRAYS(X)
+#undef X
+
+  size += tw_save_size(&state->timers);
+
+  return size;
+}
+
+static void snap_write(const struct plug_State *state, uint8_t *frame) {
+  const struct plug_Level *level = snap_level(state);
+
+  // Padding included, so equal states give equal bytes
+  struct snap_Header header;
+  memset(&header, 0, sizeof(header));
+
+  header.level = state->current_level;
+  header.grid_width = level != NULL ? level->grid_width : 0;
+  header.grid_height = level != NULL ? level->grid_height : 0;
+  header.actors = state->actors.count;
+  header.timers = state->timers.capacity;
+  header.player_state = state->player.state;
+  header.respawn_point = state->player.respawn_point;
+  header.camera_target = state->player.camera.target;
+  header.level_complete = state->level_complete;
+
+  memcpy(frame, &header, sizeof(header));
+  uint8_t *cursor = frame + sizeof(header);
+
+#define X(field)                                               \
+  memcpy(cursor, state->actors.field,                          \
+         state->actors.count * sizeof(*state->actors.field)); \
+  cursor += state->actors.count * sizeof(*state->actors.field);
+  ENT_ARRAYS(X)
+#undef X
+
+  tw_save(&state->timers, cursor);
+}
+
+// Returns false, leaving state as it is, if frame was taken on another
+// level, grid size, number of actors or timer capacity.
+static bool snap_read(struct plug_State *state, const uint8_t *frame) {
+  struct plug_Level *level = snap_level(state);
+
+  struct snap_Header header;
+  memcpy(&header, frame, sizeof(header));
+
+  if (header.level != state->current_level ||
+      header.actors != state->actors.count ||
+      header.timers != state->timers.capacity ||
+      header.grid_width != (level != NULL ? level->grid_width : 0) ||
+      header.grid_height != (level != NULL ? level->grid_height : 0)) {
+    return false;
+  }
+
+  state->player.state = header.player_state;
+  state->player.respawn_point = header.respawn_point;
+  state->player.camera.target = header.camera_target;
+  state->level_complete = header.level_complete;
+
+  const uint8_t *cursor = frame + sizeof(header);
+
+#define X(field)                                               \
+  memcpy(state->actors.field, cursor,                          \
+         state->actors.count * sizeof(*state->actors.field)); \
+  cursor += state->actors.count * sizeof(*state->actors.field);
+  ENT_ARRAYS(X)
+#undef X
+
+  tw_load(&state->timers, cursor);
+
+  return true;
+}
+
+// Puts a cell back through level_set_cell, so the chunks follow
+static void snap_put_cell(struct plug_Level *level, uint32_t index,
+                          enum plug_CellType cell) {
+  assert(level->stepped.count == 0 && "Steps are running");
+
+  level_set_cell(level, index % level->grid_width, index / level->grid_width,
+                 cell);
+}
+
+static uint32_t snap_put_varint(uint8_t *out, uint32_t value) {
+  uint32_t n = 0;
+
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+
+  return n;
+}
+
+static uint32_t snap_get_varint(const uint8_t **in) {
+  uint32_t value = 0;
+
+  for (uint32_t shift = 0;; shift += 7) {
+    uint8_t byte = *(*in)++;
+    value |= (uint32_t)(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+}
+
+static inline uint8_t snap_xor(const uint8_t *frame, const uint8_t *base,
+                               uint32_t i) {
+  return base != NULL ? frame[i] ^ base[i] : frame[i];
+}
+
+static inline bool snap_zero_word(const uint8_t *frame, const uint8_t *base,
+                                  uint32_t i) {
+  uint64_t a, b = 0;
+  memcpy(&a, frame + i, sizeof(a));
+  if (base != NULL) {
+    memcpy(&b, base + i, sizeof(b));
+  }
+
+  return a == b;
+}
+
+// Encodes frame XOR base (frame itself if base == NULL) as pairs of a zero
+// run and a literal run, each length a varint followed by the literal
+// bytes. Trailing zeros are left out. Returns the encoded size.
+static uint32_t snap_encode(const uint8_t *frame, const uint8_t *base,
+                            uint32_t size, uint8_t *out) {
+  uint32_t i = 0;
+  uint32_t n = 0;
+
+  while (i < size) {
+    uint32_t zeros_begin = i;
+
+    while (i + sizeof(uint64_t) <= size && snap_zero_word(frame, base, i)) {
+      i += sizeof(uint64_t);
+    }
+    while (i < size && snap_xor(frame, base, i) == 0) {
+      i++;
+    }
+
+    if (i == size) {
+      break;
+    }
+
+    // The literal ends where SNAP_MIN_ZERO_RUN zeros in a row start
+    uint32_t literal_begin = i;
+    uint32_t run = 0;
+
+    while (i < size && run < SNAP_MIN_ZERO_RUN) {
+      run = snap_xor(frame, base, i) == 0 ? run + 1 : 0;
+      i++;
+    }
+    i -= run;
+
+    n += snap_put_varint(out + n, literal_begin - zeros_begin);
+    n += snap_put_varint(out + n, i - literal_begin);
+
+    for (uint32_t j = literal_begin; j < i; j++) {
+      out[n++] = snap_xor(frame, base, j);
+    }
+  }
+
+  return n;
+}
+
+// XORs what snap_encode wrote into frame
+static void snap_decode(uint8_t *frame, uint32_t frame_size,
+                        const uint8_t *in, uint32_t size) {
+  const uint8_t *end = in + size;
+  uint32_t pos = 0;
+
+  while (in < end) {
+    pos += snap_get_varint(&in);
+    uint32_t literal = snap_get_varint(&in);
+    assert(pos + literal <= frame_size && "Corrupt snapshot");
+
+    for (uint32_t i = 0; i < literal; i++) {
+      frame[pos + i] ^= in[i];
+    }
+
+    in += literal;
+    pos += literal;
+  }
+}
+
+static struct snap_Record *snap_record(const struct snap_History *history,
+                                       uint32_t i) {
+  return &history->records[(history->first + i) % SNAP_MAX_FRAMES];
+}
+
+// Where the cells of record start in the ring
+static const uint8_t *snap_cells(const struct snap_History *history,
+                                 const struct snap_Record *record) {
+  return history->data + record->offset + record->size;
+}
+
+// Ring bytes of record, its cells included
+static uint32_t snap_record_bytes(const struct snap_Record *record) {
+  return record->size + record->cells * sizeof(struct plug_SteppedCell);
+}
+
+// Puts back the cells the steps of records from and newer changed, newest
+// first, so state is left as the frame before from has it.
+static void snap_undo_cells(const struct snap_History *history,
+                            struct plug_State *state, uint32_t from) {
+  struct plug_Level *level = snap_level(state);
+
+  for (uint32_t i = history->count; i > from; i--) {
+    const struct snap_Record *record = snap_record(history, i - 1);
+    const uint8_t *cells = snap_cells(history, record);
+
+    for (uint32_t c = record->cells; c > 0; c--) {
+      struct plug_SteppedCell cell;
+      memcpy(&cell, cells + (c - 1) * sizeof(cell), sizeof(cell));
+
+      snap_put_cell(level, cell.index, cell.before);
+    }
+  }
+}
+
+// Notes the cells a step changed in start_cells, unless they changed since
+// start already
+static void snap_note_start_cells(struct snap_History *history,
+                                  const struct plug_SteppedCell *cells,
+                                  uint32_t count) {
+  for (uint32_t c = 0; c < count; c++) {
+    bool noted = false;
+
+    for (uint32_t i = 0; !noted && i < history->start_cells_count; i++) {
+      noted = history->start_cells[i].index == cells[c].index;
+    }
+
+    if (!noted) {
+      assert(history->start_cells_count < history->start_cells_capacity &&
+             "snap_prepare was not called");
+      history->start_cells[history->start_cells_count++] = cells[c];
+    }
+  }
+}
+
+static void snap_drop_oldest(struct snap_History *history) {
+  history->first = (history->first + 1) % SNAP_MAX_FRAMES;
+  history->count--;
+
+  if (history->count == 0) {
+    history->first = 0;
+    history->write = 0;
+  }
+}
+
+// Finds room for size bytes after the newest record, dropping the oldest
+// records it overlaps. Returns false if size can never fit.
+static bool snap_make_room(struct snap_History *history, uint32_t size) {
+  if (size > SNAP_HISTORY_BYTES) {
+    return false;
+  }
+
+  if (history->count == SNAP_MAX_FRAMES) {
+    snap_drop_oldest(history);
+  }
+
+  while (history->count > 0) {
+    uint32_t tail = snap_record(history, 0)->offset;
+
+    if (history->write > tail) {
+      if (SNAP_HISTORY_BYTES - history->write >= size) {
+        return true;
+      }
+
+      // Wrap around, the end of the buffer stays unused
+      if (tail >= size) {
+        history->write = 0;
+        return true;
+      }
+    } else if (tail - history->write >= size) {
+      return true;
+    }
+
+    snap_drop_oldest(history);
+  }
+
+  return true;
+}
+
+void snap_init(struct snap_History *history) {
+  *history = (struct snap_History){ 0 };
+
+  history->data = malloc(SNAP_HISTORY_BYTES);
+  assert(history->data != NULL && "Failed to allocate memory");
+
+  history->records = malloc(SNAP_MAX_FRAMES * sizeof(*history->records));
+  assert(history->records != NULL && "Failed to allocate memory");
+}
+
+void snap_free(struct snap_History *history) {
+  free(history->data);
+  free(history->records);
+  free(history->prev);
+  free(history->frame);
+  free(history->encoded);
+  free(history->start);
+  free(history->start_cells);
+
+  *history = (struct snap_History){ 0 };
+}
+
+void snap_reset(struct snap_History *history) {
+  history->write = 0;
+  history->first = 0;
+  history->count = 0;
+  history->since_keyframe = 0;
+  history->frame_size = 0;
+  history->start_size = 0;
+  history->start_cells_count = 0;
+}
+
+void snap_prepare(struct snap_History *history,
+                  const struct plug_State *state) {
+  // However many steps run, a frame changes at most this many cells
+  uint32_t cells = history->start_cells_count + LEVEL_MAX_STEPPED_CELLS;
+  if (cells > history->start_cells_capacity) {
+    cells = cells > 2 * history->start_cells_capacity
+              ? cells
+              : 2 * history->start_cells_capacity;
+
+    history->start_cells =
+      realloc(history->start_cells, cells * sizeof(*history->start_cells));
+    assert(history->start_cells != NULL && "Failed to allocate memory");
+
+    history->start_cells_capacity = cells;
+  }
+
+  uint32_t size = snap_frame_size(state);
+  if (size <= history->frame_capacity) {
+    return;
+  }
+
+  // prev and start keep their frames
+  history->prev = realloc(history->prev, size);
+  history->frame = realloc(history->frame, size);
+  history->start = realloc(history->start, size);
+  assert(history->prev != NULL && history->frame != NULL &&
+         history->start != NULL && "Failed to allocate memory");
+
+  free(history->encoded);
+  history->encoded = malloc(SNAP_ENCODED_MAX(size));
+  assert(history->encoded != NULL && "Failed to allocate memory");
+
+  history->frame_capacity = size;
+}
+
+void snap_capture(struct snap_History *history, struct plug_State *state,
+                  uint64_t step) {
+  PROF_ZONE("snap_capture");
+
+  // What the steps changed since the last capture
+  struct plug_Level *level = snap_level(state);
+  const struct plug_SteppedCell *cells = NULL;
+  uint32_t cell_count = 0;
+
+  if (level != NULL && level->stepped.count > level->stepped_captured) {
+    cells = &level->stepped.items[level->stepped_captured];
+    cell_count = (uint32_t)(level->stepped.count - level->stepped_captured);
+    level->stepped_captured = level->stepped.count;
+  }
+  uint32_t cell_bytes = cell_count * sizeof(*cells);
+
+  uint32_t size = snap_frame_size(state);
+  assert(size <= history->frame_capacity && "snap_prepare was not called");
+
+  if (history->count > 0 &&
+      snap_record(history, history->count - 1)->step + 1 != step) {
+    snap_reset(history);
+  }
+
+  snap_write(state, history->frame);
+
+  bool keyframe = history->count == 0 || size != history->frame_size ||
+                  history->since_keyframe + 1 >= SNAP_KEYFRAME_INTERVAL;
+  uint32_t encoded = snap_encode(history->frame,
+                                 keyframe ? NULL : history->prev, size,
+                                 history->encoded);
+
+  if (snap_make_room(history, encoded + cell_bytes)) {
+    *snap_record(history, history->count++) = (struct snap_Record){
+      .step = step,
+      .offset = history->write,
+      .size = encoded,
+      .cells = cell_count,
+      .frame_size = size,
+      .keyframe = keyframe,
+    };
+
+    memcpy(history->data + history->write, history->encoded, encoded);
+    if (cell_count > 0) {
+      memcpy(history->data + history->write + encoded, cells, cell_bytes);
+    }
+    history->write += encoded + cell_bytes;
+    history->since_keyframe = keyframe ? 0 : history->since_keyframe + 1;
+  } else {
+    // The next frame starts over with a keyframe
+    history->first = 0;
+    history->count = 0;
+    history->write = 0;
+  }
+
+  uint8_t *prev = history->prev;
+  history->prev = history->frame;
+  history->frame = prev;
+  history->frame_size = size;
+
+  if (history->start_size == 0) {
+    memcpy(history->start, history->prev, size);
+    history->start_size = size;
+    history->start_cells_count = 0;
+  } else {
+    snap_note_start_cells(history, cells, cell_count);
+  }
+}
+
+bool snap_step_back(struct snap_History *history, struct plug_State *state) {
+  if (history->count < 2) {
+    return false;
+  }
+
+  const struct snap_Record *newest =
+    snap_record(history, history->count - 1);
+  if (newest->keyframe) {
+    return snap_restore(history, state, newest->step - 1);
+  }
+
+  uint64_t start = clk_now_ns();
+
+  // prev is the newest frame, XOR its delta back out and it is the one
+  // before
+  snap_decode(history->prev, history->frame_size,
+              history->data + newest->offset, newest->size);
+
+  bool restored = snap_read(state, history->prev);
+  if (restored) {
+    snap_undo_cells(history, state, history->count - 1);
+  }
+
+  history->write = newest->offset;
+  history->count--;
+  history->since_keyframe--;
+
+  history->last_restore_ns = clk_now_ns() - start;
+
+  return restored;
+}
+
+bool snap_restore(struct snap_History *history, struct plug_State *state,
+                  uint64_t step) {
+  PROF_ZONE("snap_restore");
+
+  if (history->count == 0) {
+    return false;
+  }
+
+  uint64_t oldest = snap_record(history, 0)->step;
+  if (step < oldest || step - oldest >= history->count) {
+    return false;
+  }
+
+  uint64_t start = clk_now_ns();
+
+  // Steps are consecutive, a frame is at its distance from the oldest
+  uint32_t index = (uint32_t)(step - oldest);
+  uint32_t key = index;
+
+  while (!snap_record(history, key)->keyframe) {
+    if (key == 0) {
+      return false;
+    }
+    key--;
+  }
+
+  uint32_t size = snap_record(history, key)->frame_size;
+  memset(history->frame, 0, size);
+
+  for (uint32_t i = key; i <= index; i++) {
+    const struct snap_Record *record = snap_record(history, i);
+    snap_decode(history->frame, size, history->data + record->offset,
+                record->size);
+  }
+
+  if (!snap_read(state, history->frame)) {
+    return false;
+  }
+
+  snap_undo_cells(history, state, index + 1);
+
+  uint8_t *prev = history->prev;
+  history->prev = history->frame;
+  history->frame = prev;
+  history->frame_size = size;
+
+  const struct snap_Record *restored = snap_record(history, index);
+  history->write = restored->offset + snap_record_bytes(restored);
+  history->count = index + 1;
+  history->since_keyframe = index - key;
+
+  history->last_restore_ns = clk_now_ns() - start;
+
+  return true;
+}
+
+bool snap_restart(struct snap_History *history, struct plug_State *state) {
+  if (history->start_size == 0) {
+    return false;
+  }
+
+  uint64_t start = clk_now_ns();
+
+  if (!snap_read(state, history->start)) {
+    return false;
+  }
+
+  struct plug_Level *level = snap_level(state);
+  for (uint32_t i = 0; i < history->start_cells_count; i++) {
+    snap_put_cell(level, history->start_cells[i].index,
+                  history->start_cells[i].before);
+  }
+  history->start_cells_count = 0;
+
+  // The start frame is kept, the next capture is the first keyframe
+  history->write = 0;
+  history->first = 0;
+  history->count = 0;
+  history->since_keyframe = 0;
+
+  history->last_restore_ns = clk_now_ns() - start;
+
+  return true;
+}
+
+bool snap_range(const struct snap_History *history, uint64_t *oldest,
+                uint64_t *newest) {
+  for (uint32_t i = 0; i < history->count; i++) {
+    if (snap_record(history, i)->keyframe) {
+      *oldest = snap_record(history, i)->step;
+      *newest = snap_record(history, history->count - 1)->step;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+struct snap_Stats snap_stats(const struct snap_History *history) {
+  struct snap_Stats stats = {
+    .frames = history->count,
+    .frame_size = history->frame_size,
+    .last_restore_ms = clk_ns_to_ms(history->last_restore_ns),
+  };
+
+  for (uint32_t i = 0; i < history->count; i++) {
+    const struct snap_Record *record = snap_record(history, i);
+
+    stats.keyframes += record->keyframe;
+    stats.bytes += snap_record_bytes(record);
+  }
+
+  if (stats.frames > 0) {
+    stats.bytes_per_frame = (double)stats.bytes / stats.frames;
+  }
+
+  return stats;
+}
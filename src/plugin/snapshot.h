@@ -0,0 +1,133 @@
+#ifndef PLUGIN_SNAPSHOT_H
+#define PLUGIN_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct plug_State;
+struct plug_SteppedCell;
+
+// Encoded frames are kept in this many bytes, oldest dropped first
+#define SNAP_HISTORY_BYTES (4u << 20)
+
+// At most this many frames are kept, five minutes of fixed steps
+#define SNAP_MAX_FRAMES (5 * 60 * 60)
+
+// Every this many frames one is stored whole rather than as a delta, so
+// restoring any frame decodes at most this many records
+#define SNAP_KEYFRAME_INTERVAL 64
+
+// Equal bytes shorter than this stay in a literal run
+#define SNAP_MIN_ZERO_RUN 4
+
+// One frame in the ring. A keyframe is the frame itself, any other frame is
+// its XOR with the frame before it. Both are stored as runs of zeros and
+// literals, followed by the cells the step changed.
+struct snap_Record {
+  uint64_t step;
+
+  uint32_t offset;
+  uint32_t size;
+
+  // struct plug_SteppedCell after the size encoded bytes
+  uint32_t cells;
+
+  // Size of the frame before encoding
+  uint32_t frame_size;
+
+  bool keyframe;
+};
+
+// The mutable simulation state of every fixed step, kept for rewinding and
+// restarting. Frames are flat copies of the player, the actors and the
+// timers. Consecutive frames barely differ, so XOR deltas of them are mostly
+// zeros and encode to a few bytes. The grid only changes through
+// level_step_cell, so each frame keeps the cells its step changed, before
+// and after, and going back puts the cells of the dropped frames back.
+struct snap_History {
+  // Encoded frames, written in a circle
+  uint8_t *data;
+  uint32_t write;
+
+  // A ring of SNAP_MAX_FRAMES records, oldest at first
+  struct snap_Record *records;
+  uint32_t first;
+  uint32_t count;
+
+  // Deltas stored since the newest keyframe
+  uint32_t since_keyframe;
+
+  // Frame buffers, grown by snap_prepare. prev is the newest frame in the
+  // ring, start the first one since the last reset.
+  uint32_t frame_capacity;
+  uint32_t frame_size;
+  uint8_t *prev;
+  uint8_t *frame;
+  uint8_t *encoded;
+  uint8_t *start;
+  uint32_t start_size;
+
+  // Every cell changed since start, once, before is what it was at start.
+  // Grown by snap_prepare.
+  struct plug_SteppedCell *start_cells;
+  uint32_t start_cells_count;
+  uint32_t start_cells_capacity;
+
+  uint64_t last_restore_ns;
+};
+
+struct snap_Stats {
+  uint32_t frames;
+  uint32_t keyframes;
+  uint64_t bytes;
+
+  double bytes_per_frame;
+
+  // Size of the newest frame before encoding
+  uint32_t frame_size;
+
+  double last_restore_ms;
+};
+
+void snap_init(struct snap_History *history);
+void snap_free(struct snap_History *history);
+
+// Drops every frame, including the one snap_restart goes back to.
+void snap_reset(struct snap_History *history);
+
+// Grows the frame buffers to fit the current state of state, and the cells
+// kept for snap_restart to fit what a frame's steps can change. Call it
+// where allocating is fine, before the fixed steps of a frame.
+void snap_prepare(struct snap_History *history,
+                  const struct plug_State *state);
+
+// Stores the current state of state as the frame of step, with the cells
+// level_step_cell changed since the last capture. step must follow the
+// newest frame, otherwise the history is reset first.
+void snap_capture(struct snap_History *history, struct plug_State *state,
+                  uint64_t step);
+
+// Puts state back to the frame before the newest and drops the newest.
+// Returns false if there is no such frame. Cells are put back through
+// level_set_cell, so call it while no steps run.
+bool snap_step_back(struct snap_History *history, struct plug_State *state);
+
+// Puts state back to the frame of step and drops every newer frame.
+// Decodes at most SNAP_KEYFRAME_INTERVAL records. Returns false if step is
+// not held or the state no longer matches it (another level, grid size or
+// actor count).
+bool snap_restore(struct snap_History *history, struct plug_State *state,
+                  uint64_t step);
+
+// Puts state back to the first frame since the last reset, and starts the
+// history over from there.
+bool snap_restart(struct snap_History *history, struct plug_State *state);
+
+// The steps of the oldest and newest restorable frame. Returns false if
+// there is none.
+bool snap_range(const struct snap_History *history, uint64_t *oldest,
+                uint64_t *newest);
+
+struct snap_Stats snap_stats(const struct snap_History *history);
+
+#endif // PLUGIN_SNAPSHOT_H
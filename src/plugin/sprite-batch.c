@@ -0,0 +1,338 @@
+#include "sprite-batch.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <raylib/src/raylib.h>
+#include <raylib/src/rlgl.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define SPR_ALIGN 64
+
+// Keys are (layer << 16) | texture slot
+#define SPR_KEY_TEXTURE_MASK 0xffffu
+#define SPR_MAX_TEXTURES (SPR_KEY_TEXTURE_MASK + 1)
+#define SPR_RADIX_BITS 8
+#define SPR_RADIX_SIZE (1u << SPR_RADIX_BITS)
+
+typedef float spr_v4 __attribute__((vector_size(16)));
+typedef int32_t spr_v4i __attribute__((vector_size(16)));
+
+#if defined(__clang__)
+#define SPR_SHUFFLE(a, b, i0, i1, i2, i3) \
+  __builtin_shufflevector((a), (b), i0, i1, i2, i3)
+#else
+#define SPR_SHUFFLE(a, b, i0, i1, i2, i3) \
+  __builtin_shuffle((a), (b), (spr_v4i){ i0, i1, i2, i3 })
+#endif
+
+// Sprite arrays, in lanes
+#define SPR_SPRITE_ARRAYS(X) \
+  X(dest_x)                  \
+  X(dest_y)                  \
+  X(dest_w)                  \
+  X(dest_h)                  \
+  X(origin_x)                \
+  X(origin_y)                \
+  X(sin_r)                   \
+  X(cos_r)                   \
+  X(u0)                      \
+  X(v0)                      \
+  X(u1)                      \
+  X(v1)                      \
+  X(tint)                    \
+  X(key)                     \
+  X(rank)                    \
+  X(order)                   \
+  X(order_tmp)
+
+// Quad arrays, four entries per sprite
+#define SPR_QUAD_ARRAYS(X) \
+  X(x)                     \
+  X(y)                     \
+  X(u)                     \
+  X(v)                     \
+  X(colors)
+
+static void *spr_alloc_array(uint32_t count, size_t size) {
+  size_t bytes = (count * size + SPR_ALIGN - 1) & ~(size_t)(SPR_ALIGN - 1);
+
+  // Padding lanes are computed but never stored, keep them finite
+  void *array = aligned_alloc(SPR_ALIGN, bytes);
+  assert(array != NULL && "Failed to allocate memory");
+  memset(array, 0, bytes);
+
+  return array;
+}
+
+void spr_batch_init(struct spr_Batch *batch, uint32_t capacity) {
+  *batch = (struct spr_Batch){ 0 };
+
+  capacity = (capacity + SPR_LANES - 1) & ~(uint32_t)(SPR_LANES - 1);
+  batch->capacity = capacity;
+
+#define X(field) \
+  batch->field = spr_alloc_array(capacity, sizeof(*batch->field));
+  SPR_SPRITE_ARRAYS(X)
+#undef X
+
+#define X(field) \
+  batch->field = spr_alloc_array(capacity * 4, sizeof(*batch->field));
+  SPR_QUAD_ARRAYS(X)
+#undef X
+}
+
+void spr_batch_free(struct spr_Batch *batch) {
+#define X(field) free(batch->field);
+  SPR_SPRITE_ARRAYS(X)
+  SPR_QUAD_ARRAYS(X)
+#undef X
+
+  DA_FREE(&batch->textures);
+  DA_FREE(&batch->runs);
+
+  *batch = (struct spr_Batch){ 0 };
+}
+
+void spr_batch_clear(struct spr_Batch *batch) {
+  batch->count = 0;
+  batch->textures.count = 0;
+  batch->runs.count = 0;
+}
+
+static uint32_t spr_texture_slot(struct spr_Batch *batch, Texture2D texture) {
+  // Frames use a handful of textures, most recently added first
+  for (uint64_t i = batch->textures.count; i > 0; i--) {
+    if (batch->textures.items[i - 1].id == texture.id) {
+      return (uint32_t)(i - 1);
+    }
+  }
+
+  assert(batch->textures.count < SPR_MAX_TEXTURES && "Too many textures");
+  DA_APPEND(&batch->textures, texture);
+
+  return (uint32_t)(batch->textures.count - 1);
+}
+
+bool spr_batch_add(struct spr_Batch *batch, Texture2D texture, Rectangle src,
+                   Rectangle dest, Vector2 origin, float rotation, Color tint,
+                   int16_t layer) {
+  if (batch->count == batch->capacity) {
+    return false;
+  }
+
+  // DrawTexturePro draws nothing either
+  if (texture.id == 0) {
+    return true;
+  }
+
+  // Flips are handled the same way as DrawTexturePro
+  bool flip_x = false;
+  if (src.width < 0) {
+    flip_x = true;
+    src.width *= -1;
+  }
+
+  if (src.height < 0) {
+    src.y -= src.height;
+  }
+
+  uint32_t i = batch->count++;
+  float width = (float)texture.width, height = (float)texture.height;
+
+  batch->dest_x[i] = dest.x;
+  batch->dest_y[i] = dest.y;
+  batch->dest_w[i] = dest.width;
+  batch->dest_h[i] = dest.height;
+  batch->origin_x[i] = origin.x;
+  batch->origin_y[i] = origin.y;
+
+  batch->sin_r[i] = rotation == 0.0f ? 0.0f : sinf(rotation * DEG2RAD);
+  batch->cos_r[i] = rotation == 0.0f ? 1.0f : cosf(rotation * DEG2RAD);
+
+  float left = src.x / width, right = (src.x + src.width) / width;
+  batch->u0[i] = flip_x ? right : left;
+  batch->u1[i] = flip_x ? left : right;
+  batch->v0[i] = src.y / height;
+  batch->v1[i] = (src.y + src.height) / height;
+
+  batch->tint[i] = tint;
+  batch->key[i] = ((uint32_t)(uint16_t)(layer + INT16_MIN) << 16) |
+                  spr_texture_slot(batch, texture);
+
+  return true;
+}
+
+// Stable LSD radix sort of the sprite indices by key. Digits every key
+// shares are skipped, so a frame with one texture and layer costs one
+// counting pass.
+static void spr_sort(struct spr_Batch *batch) {
+  const uint32_t count = batch->count;
+  uint32_t *order = batch->order, *tmp = batch->order_tmp;
+
+  for (uint32_t i = 0; i < count; i++) {
+    order[i] = i;
+  }
+
+  for (uint32_t shift = 0; shift < 32; shift += SPR_RADIX_BITS) {
+    uint32_t histogram[SPR_RADIX_SIZE] = { 0 };
+
+    for (uint32_t i = 0; i < count; i++) {
+      histogram[(batch->key[i] >> shift) & (SPR_RADIX_SIZE - 1)]++;
+    }
+
+    uint32_t digit = (batch->key[0] >> shift) & (SPR_RADIX_SIZE - 1);
+    if (histogram[digit] == count) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t d = 0; d < SPR_RADIX_SIZE; d++) {
+      uint32_t n = histogram[d];
+      histogram[d] = offset;
+      offset += n;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t sprite = order[i];
+      uint32_t d = (batch->key[sprite] >> shift) & (SPR_RADIX_SIZE - 1);
+      tmp[histogram[d]++] = sprite;
+    }
+
+    uint32_t *swap = order;
+    order = tmp;
+    tmp = swap;
+  }
+
+  batch->order = order;
+  batch->order_tmp = tmp;
+
+  for (uint32_t i = 0; i < count; i++) {
+    batch->rank[order[i]] = i;
+  }
+}
+
+// Rows of the result are the columns of a, b, c, d
+static void spr_transpose(spr_v4 *a, spr_v4 *b, spr_v4 *c, spr_v4 *d) {
+  spr_v4 t0 = SPR_SHUFFLE(*a, *b, 0, 4, 1, 5);
+  spr_v4 t1 = SPR_SHUFFLE(*a, *b, 2, 6, 3, 7);
+  spr_v4 t2 = SPR_SHUFFLE(*c, *d, 0, 4, 1, 5);
+  spr_v4 t3 = SPR_SHUFFLE(*c, *d, 2, 6, 3, 7);
+
+  *a = SPR_SHUFFLE(t0, t2, 0, 1, 4, 5);
+  *b = SPR_SHUFFLE(t0, t2, 2, 3, 6, 7);
+  *c = SPR_SHUFFLE(t1, t3, 0, 1, 4, 5);
+  *d = SPR_SHUFFLE(t1, t3, 2, 3, 6, 7);
+}
+
+// Stores the quad of every valid lane at its place in draw order
+static void spr_store_quads(float *out, const uint32_t *rank, uint32_t lanes,
+                            spr_v4 c0, spr_v4 c1, spr_v4 c2, spr_v4 c3) {
+  spr_transpose(&c0, &c1, &c2, &c3);
+  spr_v4 quads[SPR_LANES] = { c0, c1, c2, c3 };
+
+  for (uint32_t i = 0; i < lanes; i++) {
+    memcpy(&out[rank[i] * 4], &quads[i], sizeof(quads[i]));
+  }
+}
+
+#define SPR_LOAD(array, i) (*(const spr_v4 *)&(array)[(i)])
+
+static void spr_build_quads(struct spr_Batch *batch) {
+  const uint32_t count = batch->count;
+
+  for (uint32_t s = 0; s < count; s += SPR_LANES) {
+    uint32_t lanes = count - s < SPR_LANES ? count - s : SPR_LANES;
+    const uint32_t *rank = &batch->rank[s];
+
+    spr_v4 x = SPR_LOAD(batch->dest_x, s);
+    spr_v4 y = SPR_LOAD(batch->dest_y, s);
+    spr_v4 sn = SPR_LOAD(batch->sin_r, s);
+    spr_v4 cs = SPR_LOAD(batch->cos_r, s);
+
+    spr_v4 dx = -SPR_LOAD(batch->origin_x, s);
+    spr_v4 dy = -SPR_LOAD(batch->origin_y, s);
+    spr_v4 dxw = dx + SPR_LOAD(batch->dest_w, s);
+    spr_v4 dyh = dy + SPR_LOAD(batch->dest_h, s);
+
+    // Corners rotated about dest.x, dest.y, as in DrawTexturePro
+    spr_store_quads(batch->x, rank, lanes, x + dx * cs - dy * sn,
+                    x + dx * cs - dyh * sn, x + dxw * cs - dyh * sn,
+                    x + dxw * cs - dy * sn);
+    spr_store_quads(batch->y, rank, lanes, y + dx * sn + dy * cs,
+                    y + dx * sn + dyh * cs, y + dxw * sn + dyh * cs,
+                    y + dxw * sn + dy * cs);
+
+    spr_v4 u0 = SPR_LOAD(batch->u0, s), u1 = SPR_LOAD(batch->u1, s);
+    spr_v4 v0 = SPR_LOAD(batch->v0, s), v1 = SPR_LOAD(batch->v1, s);
+    spr_store_quads(batch->u, rank, lanes, u0, u0, u1, u1);
+    spr_store_quads(batch->v, rank, lanes, v0, v1, v1, v0);
+
+    for (uint32_t i = 0; i < lanes; i++) {
+      Color *colors = &batch->colors[rank[i] * 4];
+      colors[0] = colors[1] = colors[2] = colors[3] = batch->tint[s + i];
+    }
+  }
+}
+
+void spr_batch_build(struct spr_Batch *batch) {
+  batch->runs.count = 0;
+
+  if (batch->count == 0) {
+    return;
+  }
+
+  spr_sort(batch);
+  spr_build_quads(batch);
+
+  for (uint32_t i = 0; i < batch->count; i++) {
+    uint32_t texture = batch->key[batch->order[i]] & SPR_KEY_TEXTURE_MASK;
+
+    if (batch->runs.count > 0 &&
+        batch->runs.items[batch->runs.count - 1].texture == texture) {
+      batch->runs.items[batch->runs.count - 1].count++;
+      continue;
+    }
+
+    struct spr_Run run = { .texture = texture, .first = i, .count = 1 };
+    DA_APPEND(&batch->runs, run);
+  }
+}
+
+void spr_batch_submit(const struct spr_Batch *batch) {
+  for (uint64_t r = 0; r < batch->runs.count; r++) {
+    const struct spr_Run *run = &batch->runs.items[r];
+
+    rlSetTexture(batch->textures.items[run->texture].id);
+    rlBegin(RL_QUADS);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+
+    for (uint32_t q = run->first; q < run->first + run->count; q++) {
+      // Splits the draw call only if rlgl's vertex buffer is full
+      rlCheckRenderBatchLimit(4);
+
+      for (uint32_t k = q * 4; k < q * 4 + 4; k++) {
+        Color c = batch->colors[k];
+        rlColor4ub(c.r, c.g, c.b, c.a);
+        rlTexCoord2f(batch->u[k], batch->v[k]);
+        rlVertex2f(batch->x[k], batch->y[k]);
+      }
+    }
+
+    rlEnd();
+  }
+
+  rlSetTexture(0);
+}
+
+void spr_batch_flush(struct spr_Batch *batch) {
+  PROF_ZONE("spr_batch_flush");
+
+  spr_batch_build(batch);
+  spr_batch_submit(batch);
+  spr_batch_clear(batch);
+}
@@ -0,0 +1,71 @@
+#ifndef PLUGIN_SPRITE_BATCH_H
+#define PLUGIN_SPRITE_BATCH_H
+
+#include "util/dynamic_array.h"
+
+#include <raylib/src/raylib.h>
+#include <stdint.h>
+
+// Sprites per batch. Arrays are padded to a multiple of SPR_LANES.
+#define SPRITE_BATCH_CAPACITY 16384
+#define SPR_LANES 4
+
+// A run of quads sharing a texture, one rlgl draw call
+struct spr_Run {
+  uint32_t texture;
+  uint32_t first, count;
+};
+
+// Collects sprites for one frame. spr_batch_build turns them into quads
+// sorted by layer, then texture, and spr_batch_submit hands the quads to
+// rlgl. Building touches no GPU state.
+struct spr_Batch {
+  uint32_t capacity;
+  uint32_t count;
+
+  // One entry per sprite, in the order they were added
+  float *dest_x, *dest_y, *dest_w, *dest_h;
+  float *origin_x, *origin_y;
+  float *sin_r, *cos_r;
+  float *u0, *v0, *u1, *v1;
+  Color *tint;
+  uint32_t *key;
+
+  DA_TYPE(Texture2D) textures;
+
+  // Draw order position of every sprite, and scratch for sorting it
+  uint32_t *rank;
+  uint32_t *order, *order_tmp;
+
+  // Built quads in draw order, corners top-left, bottom-left, bottom-right,
+  // top-right as DrawTexturePro emits them
+  float *x, *y, *u, *v;
+  Color *colors;
+
+  DA_TYPE(struct spr_Run) runs;
+};
+
+void spr_batch_init(struct spr_Batch *batch, uint32_t capacity);
+void spr_batch_free(struct spr_Batch *batch);
+
+// Drops every sprite added since the last clear.
+void spr_batch_clear(struct spr_Batch *batch);
+
+// Same arguments as DrawTexturePro, plus a layer. Lower layers are drawn
+// first; sprites on the same layer and texture keep their order. Returns
+// false if the batch is full.
+bool spr_batch_add(struct spr_Batch *batch, Texture2D texture, Rectangle src,
+                   Rectangle dest, Vector2 origin, float rotation, Color tint,
+                   int16_t layer);
+
+// Sorts the sprites and builds their quads and runs.
+void spr_batch_build(struct spr_Batch *batch);
+
+// Submits the built quads, one draw call per run as long as rlgl's batch
+// does not fill up.
+void spr_batch_submit(const struct spr_Batch *batch);
+
+// Builds, submits and clears.
+void spr_batch_flush(struct spr_Batch *batch);
+
+#endif // PLUGIN_SPRITE_BATCH_H
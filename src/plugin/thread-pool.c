@@ -0,0 +1,2 @@
+#define UTIL_THREAD_POOL_IMPLEMENTATION
+#include "util/thread_pool.h"
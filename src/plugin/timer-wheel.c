@@ -0,0 +1,286 @@
+#include "timer-wheel.h"
+
+#include "util/dynamic_array.h"
+#include "util/profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// What tw_save writes ahead of the heads and the timers
+struct tw_SaveHeader {
+  uint64_t now;
+  uint64_t scheduled;
+  uint32_t capacity;
+  uint32_t count;
+  uint32_t free;
+  uint32_t reserved;
+};
+
+static void tw_reset(struct tw_Wheel *wheel, uint64_t now) {
+  wheel->now = now;
+  wheel->scheduled = 0;
+  wheel->count = 0;
+  wheel->fired.count = 0;
+
+  for (uint32_t i = 0; i < TW_LEVELS * TW_SLOTS; i++) {
+    wheel->heads[i] = TW_NONE;
+  }
+
+  // Generations go on, so handles from before still cancel nothing
+  for (uint32_t i = 0; i < wheel->capacity; i++) {
+    struct tw_Timer *timer = &wheel->timers[i];
+
+    if (timer->slot != TW_NONE) {
+      timer->generation++;
+      timer->generation += timer->generation == 0;
+    }
+
+    timer->slot = TW_NONE;
+    timer->next = i + 1 < wheel->capacity ? i + 1 : TW_NONE;
+  }
+  wheel->free = wheel->capacity > 0 ? 0 : TW_NONE;
+}
+
+void tw_init(struct tw_Wheel *wheel, uint32_t capacity, uint64_t now) {
+  *wheel = (struct tw_Wheel){ .capacity = capacity };
+
+  wheel->timers = calloc(capacity, sizeof(*wheel->timers));
+  assert((capacity == 0 || wheel->timers != NULL) &&
+         "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    wheel->timers[i].generation = 1;
+    wheel->timers[i].slot = TW_NONE;
+  }
+
+  // Every timer can fire on the same tick without it growing
+  DA_RESERVE(&wheel->fired, capacity);
+
+  tw_reset(wheel, now);
+}
+
+void tw_free(struct tw_Wheel *wheel) {
+  free(wheel->timers);
+  DA_FREE(&wheel->fired);
+
+  *wheel = (struct tw_Wheel){ .free = TW_NONE };
+}
+
+void tw_clear(struct tw_Wheel *wheel, uint64_t now) {
+  tw_reset(wheel, now);
+}
+
+// The slot a timer due on due goes in: the lowest level whose reach from
+// now it is within, at the slot its tick falls on in that level. Timers
+// past the top level's reach wait in the slot it gets to last, and are
+// placed again from there.
+static uint32_t tw_slot(const struct tw_Wheel *wheel, uint64_t due) {
+  uint64_t delta = due - wheel->now;
+
+  if (delta >= TW_RANGE) {
+    due = wheel->now + TW_RANGE - 1;
+    delta = TW_RANGE - 1;
+  }
+
+  uint32_t level = 0;
+  while (level + 1 < TW_LEVELS &&
+         delta >= 1ull << (TW_SLOT_BITS * (level + 1))) {
+    level++;
+  }
+
+  return level * TW_SLOTS +
+         (uint32_t)((due >> (TW_SLOT_BITS * level)) & (TW_SLOTS - 1));
+}
+
+static void tw_link(struct tw_Wheel *wheel, uint32_t i) {
+  struct tw_Timer *timer = &wheel->timers[i];
+  uint32_t slot = tw_slot(wheel, timer->due);
+
+  timer->slot = slot;
+  timer->prev = TW_NONE;
+  timer->next = wheel->heads[slot];
+
+  if (timer->next != TW_NONE) {
+    wheel->timers[timer->next].prev = i;
+  }
+  wheel->heads[slot] = i;
+}
+
+static void tw_unlink(struct tw_Wheel *wheel, uint32_t i) {
+  struct tw_Timer *timer = &wheel->timers[i];
+
+  if (timer->prev != TW_NONE) {
+    wheel->timers[timer->prev].next = timer->next;
+  } else {
+    wheel->heads[timer->slot] = timer->next;
+  }
+
+  if (timer->next != TW_NONE) {
+    wheel->timers[timer->next].prev = timer->prev;
+  }
+}
+
+static void tw_release(struct tw_Wheel *wheel, uint32_t i) {
+  struct tw_Timer *timer = &wheel->timers[i];
+
+  timer->slot = TW_NONE;
+  timer->generation++;
+  timer->generation += timer->generation == 0;
+
+  timer->next = wheel->free;
+  wheel->free = i;
+  wheel->count--;
+}
+
+tw_Handle tw_schedule(struct tw_Wheel *wheel, uint64_t due,
+                      struct tw_Event event) {
+  uint32_t i = wheel->free;
+  if (i == TW_NONE) {
+    return TW_NO_TIMER;
+  }
+
+  struct tw_Timer *timer = &wheel->timers[i];
+  wheel->free = timer->next;
+  wheel->count++;
+
+  timer->due = due > wheel->now ? due : wheel->now + 1;
+  timer->order = wheel->scheduled++;
+  timer->event = event;
+  tw_link(wheel, i);
+
+  return (uint64_t)timer->generation << 32 | i;
+}
+
+bool tw_cancel(struct tw_Wheel *wheel, tw_Handle handle) {
+  uint32_t i = (uint32_t)handle;
+  uint32_t generation = (uint32_t)(handle >> 32);
+
+  if (i >= wheel->capacity) {
+    return false;
+  }
+
+  struct tw_Timer *timer = &wheel->timers[i];
+  if (timer->generation != generation || timer->slot == TW_NONE) {
+    return false;
+  }
+
+  tw_unlink(wheel, i);
+  tw_release(wheel, i);
+
+  return true;
+}
+
+// Places the timers of a slot again, a level or more further down now
+// that the wheel has reached the ticks the slot spans.
+static void tw_cascade(struct tw_Wheel *wheel, uint32_t slot) {
+  uint32_t i = wheel->heads[slot];
+  wheel->heads[slot] = TW_NONE;
+
+  while (i != TW_NONE) {
+    uint32_t next = wheel->timers[i].next;
+    tw_link(wheel, i);
+    i = next;
+  }
+}
+
+static int tw_fired_order(const void *a, const void *b) {
+  const struct tw_Fired *x = a, *y = b;
+
+  if (x->due != y->due) {
+    return x->due < y->due ? -1 : 1;
+  }
+  return x->order < y->order ? -1 : x->order > y->order;
+}
+
+uint32_t tw_advance(struct tw_Wheel *wheel, uint64_t tick) {
+  PROF_ZONE("tw_advance");
+
+  wheel->fired.count = 0;
+
+  while (wheel->now < tick) {
+    uint64_t now = ++wheel->now;
+
+    // A level's next slot is reached whenever the ticks below it wrap
+    uint32_t wrapped = 0;
+    while (wrapped + 1 < TW_LEVELS &&
+           (now & ((1ull << (TW_SLOT_BITS * (wrapped + 1))) - 1)) == 0) {
+      wrapped++;
+    }
+
+    for (uint32_t level = wrapped; level > 0; level--) {
+      uint64_t index = (now >> (TW_SLOT_BITS * level)) & (TW_SLOTS - 1);
+      tw_cascade(wheel, level * TW_SLOTS + (uint32_t)index);
+    }
+
+    // Everything left in the slot is due now
+    uint32_t slot = (uint32_t)(now & (TW_SLOTS - 1));
+    uint32_t i = wheel->heads[slot];
+    wheel->heads[slot] = TW_NONE;
+
+    while (i != TW_NONE) {
+      struct tw_Timer *timer = &wheel->timers[i];
+      uint32_t next = timer->next;
+
+      wheel->fired.items[wheel->fired.count++] = (struct tw_Fired){
+        .due = timer->due,
+        .order = timer->order,
+        .event = timer->event,
+      };
+      tw_release(wheel, i);
+
+      i = next;
+    }
+  }
+
+  // Slots are lists in no particular order, and cascading shuffles them
+  qsort(wheel->fired.items, wheel->fired.count, sizeof(*wheel->fired.items),
+        tw_fired_order);
+
+  return (uint32_t)wheel->fired.count;
+}
+
+uint32_t tw_save_size(const struct tw_Wheel *wheel) {
+  return (uint32_t)(sizeof(struct tw_SaveHeader) + sizeof(wheel->heads) +
+                    wheel->capacity * sizeof(*wheel->timers));
+}
+
+void tw_save(const struct tw_Wheel *wheel, uint8_t *out) {
+  struct tw_SaveHeader header = {
+    .now = wheel->now,
+    .scheduled = wheel->scheduled,
+    .capacity = wheel->capacity,
+    .count = wheel->count,
+    .free = wheel->free,
+  };
+
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  memcpy(out, wheel->heads, sizeof(wheel->heads));
+  out += sizeof(wheel->heads);
+
+  memcpy(out, wheel->timers, wheel->capacity * sizeof(*wheel->timers));
+}
+
+bool tw_load(struct tw_Wheel *wheel, const uint8_t *in) {
+  struct tw_SaveHeader header;
+  memcpy(&header, in, sizeof(header));
+
+  if (header.capacity != wheel->capacity) {
+    return false;
+  }
+
+  wheel->now = header.now;
+  wheel->scheduled = header.scheduled;
+  wheel->count = header.count;
+  wheel->free = header.free;
+  in += sizeof(header);
+
+  memcpy(wheel->heads, in, sizeof(wheel->heads));
+  in += sizeof(wheel->heads);
+
+  memcpy(wheel->timers, in, wheel->capacity * sizeof(*wheel->timers));
+
+  return true;
+}
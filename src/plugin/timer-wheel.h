@@ -0,0 +1,110 @@
+#ifndef PLUGIN_TIMER_WHEEL_H
+#define PLUGIN_TIMER_WHEEL_H
+
+#include "util/dynamic_array.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Each level of the wheel has TW_SLOTS slots, and every slot of a level
+// spans TW_SLOTS slots of the level below. Four levels of 256 reach 2^32
+// ticks ahead, over two years of fixed steps.
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 8
+#define TW_SLOTS (1u << TW_SLOT_BITS)
+#define TW_RANGE (1ull << (TW_LEVELS * TW_SLOT_BITS))
+
+#define TW_NONE UINT32_MAX
+
+// Never returned by tw_schedule for a timer it scheduled
+#define TW_NO_TIMER 0
+
+// The low half is the timer's index, the high half its generation, so a
+// handle kept after its timer fired cancels nothing
+typedef uint64_t tw_Handle;
+
+// What a timer fires, for the caller to make sense of
+struct tw_Event {
+  uint32_t kind;
+  uint32_t data;
+};
+
+struct tw_Timer {
+  uint64_t due;
+
+  // Timers due on the same tick fire in the order they were scheduled
+  uint64_t order;
+
+  struct tw_Event event;
+
+  // Links of the slot's list, or of the free list through next
+  uint32_t prev, next;
+
+  // TW_NONE while free
+  uint32_t slot;
+  uint32_t generation;
+};
+
+struct tw_Fired {
+  uint64_t due;
+  uint64_t order;
+  struct tw_Event event;
+};
+
+// Timers keyed on ticks, the simulation's fixed steps, in a hierarchical
+// timing wheel. Scheduling and cancelling are O(1), and a tick only looks at
+// the timers due on it, and once in a while moves a slot's worth down a
+// level. The timers are a fixed pool, so nothing is allocated once the
+// wheel is made, and it copies flat, see tw_save.
+struct tw_Wheel {
+  // The last tick tw_advance went through
+  uint64_t now;
+  // Timers scheduled so far, the order of the next
+  uint64_t scheduled;
+
+  uint32_t capacity;
+  uint32_t count;
+
+  // Head of the free timers
+  uint32_t free;
+
+  struct tw_Timer *timers;
+
+  // First timer of every slot, level by level
+  uint32_t heads[TW_LEVELS * TW_SLOTS];
+
+  // What the last tw_advance fired, by due tick then order
+  DA_TYPE(struct tw_Fired) fired;
+};
+
+// Makes a wheel of capacity timers, starting at tick now.
+void tw_init(struct tw_Wheel *wheel, uint32_t capacity, uint64_t now);
+void tw_free(struct tw_Wheel *wheel);
+
+// Drops every timer and starts again at tick now.
+void tw_clear(struct tw_Wheel *wheel, uint64_t now);
+
+// Fires event on tick due, or on the next tick if due has passed. Returns
+// TW_NO_TIMER if the wheel is full.
+tw_Handle tw_schedule(struct tw_Wheel *wheel, uint64_t due,
+                      struct tw_Event event);
+
+// Returns false if the timer already fired or was cancelled.
+bool tw_cancel(struct tw_Wheel *wheel, tw_Handle handle);
+
+// Goes through every tick up to and including tick, and fills in
+// wheel->fired. Returns how many fired.
+uint32_t tw_advance(struct tw_Wheel *wheel, uint64_t tick);
+
+// Bytes tw_save writes, the same for as long as the wheel lives.
+uint32_t tw_save_size(const struct tw_Wheel *wheel);
+
+// Writes every timer and where it is to out, tw_save_size bytes. Equal
+// wheels give equal bytes.
+void tw_save(const struct tw_Wheel *wheel, uint8_t *out);
+
+// Puts back what tw_save wrote. Returns false, leaving the wheel as it is,
+// if it was saved from a wheel of another capacity.
+bool tw_load(struct tw_Wheel *wheel, const uint8_t *in);
+
+#endif // PLUGIN_TIMER_WHEEL_H
@@ -0,0 +1,223 @@
+#include "triggers.h"
+#include "plugin.h"
+#include "level.h"
+
+#include <raylib/src/raylib.h>
+
+typedef void (*trigger_Handler)(struct plug_State *state,
+                                struct plug_Level *level, uint32_t cell);
+
+static void trigger_hazard(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  (void)level;
+  (void)cell;
+
+  Vector2 pos = ent_pos(&state->actors, state->player.actor);
+  state->player.died_at = CLITERAL(Vector2){
+    pos.x + PLAYER_SIZE * 0.5f,
+    pos.y + PLAYER_SIZE * 0.5f,
+  };
+  state->player.deaths++;
+
+  ent_teleport(&state->actors, state->player.actor,
+               state->player.respawn_point);
+  state->player.state = PLAYER_STATE_NORMAL;
+}
+
+// Starts the cell vanishing, unless there is no timer left to bring it back
+static void trigger_vanish(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  struct tw_Wheel *timers = &state->timers;
+
+  tw_Handle timer =
+    tw_schedule(timers, timers->now + VANISH_DELAY_STEPS,
+                CLITERAL(struct tw_Event){ TIMER_VANISH, cell });
+  if (timer != TW_NO_TIMER) {
+    level_step_cell(level, cell, CELL_TYPE_VANISHING);
+  }
+}
+
+static void trigger_shrink(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  (void)level;
+  (void)cell;
+
+  state->player.state = PLAYER_STATE_SMOL;
+}
+
+static void trigger_expand(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  (void)level;
+  (void)cell;
+
+  state->player.state = PLAYER_STATE_BIG;
+}
+
+static void trigger_checkpoint(struct plug_State *state,
+                               struct plug_Level *level, uint32_t cell) {
+  // Respawn standing in the checkpoint cell
+  uint32_t x = cell % level->grid_width;
+  uint32_t y = cell / level->grid_width;
+
+  state->player.respawn_point = CLITERAL(Vector2){
+    .x = level->pos.x + x * level->cell_size,
+    .y = level->pos.y + (y + 1.0f) * level->cell_size - PLAYER_SIZE,
+  };
+}
+
+static void trigger_finish(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  (void)level;
+  (void)cell;
+
+  state->level_complete = true;
+}
+
+static const trigger_Handler trigger_handlers[TRIGGER_KINDS_COUNT] = {
+  [TRIGGER_NONE] = NULL,
+  [TRIGGER_HAZARD] = trigger_hazard,
+  [TRIGGER_VANISH] = trigger_vanish,
+  [TRIGGER_SHRINK] = trigger_shrink,
+  [TRIGGER_EXPAND] = trigger_expand,
+  [TRIGGER_CHECKPOINT] = trigger_checkpoint,
+  [TRIGGER_FINISH] = trigger_finish,
+};
+
+// Kinds fired for every cell touched, because what they do is to the cell.
+// The rest do the same whichever cell it is, so they fire once a pass.
+static const bool trigger_per_cell[TRIGGER_KINDS_COUNT] = {
+  [TRIGGER_VANISH] = true,
+};
+
+void process_triggers(struct plug_State *state) {
+  if (state->current_level < 0) {
+    return;
+  }
+
+  struct plug_Level *level =
+    &DA_AT(state->levels, (uint32_t)state->current_level);
+  Vector2 pos = ent_pos(&state->actors, state->player.actor);
+  Rectangle hitbox = ent_hitbox(&state->actors, state->player.actor);
+
+  Rectangle touch = {
+    .x = pos.x + hitbox.x - TRIGGER_TOUCH_MARGIN,
+    .y = pos.y + hitbox.y - TRIGGER_TOUCH_MARGIN,
+    .width = hitbox.width + 2.0f * TRIGGER_TOUCH_MARGIN,
+    .height = hitbox.height + 2.0f * TRIGGER_TOUCH_MARGIN,
+  };
+
+  uint32_t x_begin, x_end, y_begin, y_end;
+  if (!level_cell_range(level, touch, &x_begin, &x_end, &y_begin, &y_end)) {
+    return;
+  }
+
+  // Collect first so that a handler moving the player (e.g. a respawn)
+  // does not change which cells the rest of this pass looks at.
+  uint32_t fired[TRIGGER_KINDS_COUNT];
+  uint32_t fired_mask = 0;
+
+  for (uint32_t y = y_begin; y < y_end; y++) {
+    for (uint32_t x = x_begin; x < x_end; x++) {
+      uint32_t cell = y * level->grid_width + x;
+      enum plug_TriggerKind kind = cell_props[level_cell(level, cell)].trigger;
+
+      fired[kind] = cell;
+      fired_mask |= 1u << kind;
+    }
+  }
+
+  for (uint32_t kind = TRIGGER_NONE + 1; kind < TRIGGER_KINDS_COUNT; kind++) {
+    if (!(fired_mask & (1u << kind)) || trigger_handlers[kind] == NULL) {
+      continue;
+    }
+
+    if (!trigger_per_cell[kind]) {
+      trigger_handlers[kind](state, level, fired[kind]);
+      continue;
+    }
+
+    for (uint32_t y = y_begin; y < y_end; y++) {
+      for (uint32_t x = x_begin; x < x_end; x++) {
+        uint32_t cell = y * level->grid_width + x;
+
+        if (cell_props[level_cell(level, cell)].trigger == kind) {
+          trigger_handlers[kind](state, level, cell);
+        }
+      }
+    }
+  }
+}
+
+typedef void (*timer_Handler)(struct plug_State *state,
+                              struct plug_Level *level, uint32_t cell);
+
+static void timer_vanish(struct plug_State *state, struct plug_Level *level,
+                         uint32_t cell) {
+  // The level was reloaded since
+  if (level_cell(level, cell) != CELL_TYPE_VANISHING) {
+    return;
+  }
+
+  struct tw_Wheel *timers = &state->timers;
+  tw_Handle timer =
+    tw_schedule(timers, timers->now + VANISH_RESPAWN_STEPS,
+                CLITERAL(struct tw_Event){ TIMER_REAPPEAR, cell });
+
+  // Gone for good otherwise
+  level_step_cell(level, cell,
+                  timer != TW_NO_TIMER ? CELL_TYPE_NONE : CELL_TYPE_VANISH);
+}
+
+static void timer_reappear(struct plug_State *state, struct plug_Level *level,
+                           uint32_t cell) {
+  if (level_cell(level, cell) != CELL_TYPE_NONE) {
+    return;
+  }
+
+  Vector2 pos = ent_pos(&state->actors, state->player.actor);
+  Rectangle hitbox = ent_hitbox(&state->actors, state->player.actor);
+  Rectangle body = { pos.x + hitbox.x, pos.y + hitbox.y, hitbox.width,
+                     hitbox.height };
+
+  uint32_t x = cell % level->grid_width, y = cell / level->grid_width;
+  uint32_t x_begin, x_end, y_begin, y_end;
+
+  bool inside =
+    level_cell_range(level, body, &x_begin, &x_end, &y_begin, &y_end) &&
+    x >= x_begin && x < x_end && y >= y_begin && y < y_end;
+
+  if (inside) {
+    struct tw_Wheel *timers = &state->timers;
+    tw_schedule(timers, timers->now + VANISH_RETRY_STEPS,
+                CLITERAL(struct tw_Event){ TIMER_REAPPEAR, cell });
+    return;
+  }
+
+  level_step_cell(level, cell, CELL_TYPE_VANISH);
+}
+
+static const timer_Handler timer_handlers[TIMER_KINDS_COUNT] = {
+  [TIMER_VANISH] = timer_vanish,
+  [TIMER_REAPPEAR] = timer_reappear,
+};
+
+void process_timers(struct plug_State *state) {
+  struct tw_Wheel *timers = &state->timers;
+  uint32_t fired = tw_advance(timers, timers->now + 1);
+
+  if (fired == 0 || state->current_level < 0) {
+    return;
+  }
+
+  struct plug_Level *level =
+    &DA_AT(state->levels, (uint32_t)state->current_level);
+  uint32_t cells = level->grid_width * level->grid_height;
+
+  for (uint32_t i = 0; i < fired; i++) {
+    struct tw_Event event = timers->fired.items[i].event;
+
+    if (event.kind < TIMER_KINDS_COUNT && event.data < cells) {
+      timer_handlers[event.kind](state, level, event.data);
+    }
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef PLUGIN_TRIGGERS_H
+#define PLUGIN_TRIGGERS_H
+
+#include "plugin.h"
+
+// Fires the triggers of the cells the player touches. Cells start
+// vanishing each on their own; the other kinds fire once a pass, however
+// many of their cells are touched. Only looks at the cells under the
+// hitbox, so the cost does not depend on the level size.
+void process_triggers(struct plug_State *state);
+
+// Advances state->timers a tick and fires what is due, in the order it was
+// scheduled. Cells change through level_step_cell, so it is safe on the
+// pipeline's worker.
+void process_timers(struct plug_State *state);
+
+#endif // PLUGIN_TRIGGERS_H
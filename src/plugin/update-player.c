@@ -1,5 +1,8 @@
 #include "update-player.h"
 #include "plugin.h"
+#include "level.h"
+#include "triggers.h"
+#include "util/profiler.h"
 
 #include <raylib/src/raylib.h>
 #include <cglm/include/cglm/cglm.h>
@@ -163,25 +166,68 @@ static float resolve_collision(vec2 player_aabb[2], vec2 grid_aabb[2], vec2 vel,
   return t_min;
 }
 
-static void level_collide(struct plug_State *state, bool *is_grounded,
-                          float dt) {
-  if (state->current_level < 0) {
-    return;
+// Computes the [begin, end) range of cells along one axis that overlap
+// [lo, hi] grown by one cell. Returns false if the range is empty.
+static bool cell_span(float lo, float hi, float origin, uint32_t cell_size,
+                      uint32_t count, uint32_t *begin, uint32_t *end) {
+  float first = floorf((lo - origin) / cell_size) - 1.0f;
+  float last = floorf((hi - origin) / cell_size) + 1.0f;
+
+  if (!(last >= 0.0f) || !(first < (float)count)) {
+    return false;
   }
 
-  struct plug_Level *level =
-    &DA_AT(state->levels, (uint32_t)state->current_level);
-  struct plug_Player *player = &state->player;
+  *begin = first < 0.0f ? 0 : (uint32_t)first;
+  *end = last >= (float)count ? count : (uint32_t)last + 1;
+
+  return *begin < *end;
+}
+
+void level_collide(const struct plug_Level *level, Vector2 pos,
+                   Rectangle hitbox, Vector2 *vel, bool *is_grounded,
+                   float dt) {
+  PROF_ZONE("level_collide");
+
+  if (level == NULL) {
+    return;
+  }
 
   vec2 min_t_xy = { 1.0f, 1.0f };
   float joint_t_min = 1.0f;
   int8_t min_index = -1;
 
-  for (uint32_t y = 0; y < level->grid_height; y++) {
-    for (uint32_t x = 0; x < level->grid_width; x++) {
+  vec2 player_aabb[2] = {
+    {
+      pos.x + hitbox.x,
+      pos.y + hitbox.y,
+    },
+    {
+      pos.x + hitbox.x + hitbox.width,
+      pos.y + hitbox.y + hitbox.height,
+    },
+  };
+
+  // Only cells touching the swept hitbox can stop it, so the cost does not
+  // depend on the size of the level.
+  vec2 delta = { vel->x * dt, vel->y * dt };
+  uint32_t x_begin, x_end, y_begin, y_end;
+
+  if (!cell_span(player_aabb[0][0] + fminf(delta[0], 0.0f),
+                 player_aabb[1][0] + fmaxf(delta[0], 0.0f), level->pos.x,
+                 level->cell_size, level->grid_width, &x_begin, &x_end) ||
+      !cell_span(player_aabb[0][1] + fminf(delta[1], 0.0f),
+                 player_aabb[1][1] + fmaxf(delta[1], 0.0f), level->pos.y,
+                 level->cell_size, level->grid_height, &y_begin, &y_end)) {
+    x_begin = x_end = y_begin = y_end = 0;
+  }
+
+  for (uint32_t y = y_begin; y < y_end; y++) {
+    for (uint32_t x = x_begin; x < x_end; x++) {
       uint32_t grid_index = y * level->grid_width + x;
+      const struct plug_CellProps *props =
+        &cell_props[level_cell(level, grid_index)];
 
-      if (level->grid[grid_index] == 0) {
+      if (!props->solid) {
         continue;
       }
 
@@ -203,29 +249,27 @@ static void level_collide(struct plug_State *state, bool *is_grounded,
         },
       };
 
-      Rectangle *hitbox = &player->hitbox;
-
-      vec2 player_aabb[2] = {
-        {
-          player->pos.x + hitbox->x,
-          player->pos.y + hitbox->y,
-        },
-        {
-          player->pos.x + hitbox->x + hitbox->width,
-          player->pos.y + hitbox->y + hitbox->height,
-        },
-      };
+      // One way cells never block sideways, and only block vertically when
+      // falling onto them from above. Selected rather than branched on so
+      // every cell type goes through the same path.
+      bool from_above =
+        vel->y > 0.0f && player_aabb[1][1] <= cell_rect.y + EPS;
+      bool blocks_x = !props->one_way;
+      bool blocks_y = !props->one_way || from_above;
 
       vec2 t_xy = { 0 };
       t_xy[0] = resolve_collision(player_aabb, grid_aabb,
-                                  (vec2){ player->vel.x, 0.0f }, dt, NULL);
+                                  (vec2){ vel->x, 0.0f }, dt, NULL);
       t_xy[1] = resolve_collision(player_aabb, grid_aabb,
-                                  (vec2){ 0.0f, player->vel.y }, dt, NULL);
+                                  (vec2){ 0.0f, vel->y }, dt, NULL);
 
       int8_t index;
       float t = resolve_collision(player_aabb, grid_aabb,
-                                  (vec2){ player->vel.x, player->vel.y }, dt,
-                                  &index);
+                                  (vec2){ vel->x, vel->y }, dt, &index);
+
+      t_xy[0] = blocks_x ? t_xy[0] : 1.0f;
+      t_xy[1] = blocks_y ? t_xy[1] : 1.0f;
+      t = blocks_y ? t : 1.0f;
       if (t != 1.0f) {
         if (t < joint_t_min) {
           joint_t_min = t;
@@ -238,43 +282,119 @@ static void level_collide(struct plug_State *state, bool *is_grounded,
     }
   }
 
-  min_t_xy[min_index] = joint_t_min;
+  if (min_index >= 0) {
+    min_t_xy[min_index] = joint_t_min;
+  }
 
   *is_grounded = is_zero(min_t_xy[1], EPS) ? true : false;
 
-  player->vel.x *= min_t_xy[0];
-  player->vel.y *= min_t_xy[1];
+  vel->x *= min_t_xy[0];
+  vel->y *= min_t_xy[1];
+}
+
+float sweep_aabb(Rectangle a, Vector2 vel_a, Rectangle b, Vector2 vel_b,
+                 float dt) {
+  vec2 a_aabb[2] = {
+    { a.x, a.y },
+    { a.x + a.width, a.y + a.height },
+  };
+
+  vec2 b_aabb[2] = {
+    { b.x, b.y },
+    { b.x + b.width, b.y + b.height },
+  };
+
+  return resolve_collision(a_aabb, b_aabb,
+                           (vec2){ vel_a.x - vel_b.x, vel_a.y - vel_b.y }, dt,
+                           NULL);
 }
 
-void update_player(struct plug_State *state) {
-  float dt = GetFrameTime();
+uint8_t read_player_input(void) {
+  uint8_t input = 0;
 
   if (IsKeyDown(KEY_A)) {
-    state->player.vel.x -= PLAYER_ACCELERATION * dt;
+    input |= INPUT_LEFT;
   }
 
   if (IsKeyDown(KEY_D)) {
-    state->player.vel.x += PLAYER_ACCELERATION * dt;
+    input |= INPUT_RIGHT;
   }
 
-  state->player.vel.x = glm_clamp(state->player.vel.x, -PLAYER_TERMINAL_SPEED,
-                                  PLAYER_TERMINAL_SPEED);
-
-  if (state->player.grounded && IsKeyDown(KEY_SPACE)) {
-    //state->player.grounded = false;
-    state->player.vel.y = PLAYER_JUMP_SPEED;
+  if (IsKeyDown(KEY_SPACE)) {
+    input |= INPUT_JUMP;
   }
 
-  state->player.vel.y += GRAVITY * dt;
-  state->player.vel.y = fmin(state->player.vel.y, PLAYER_GRAV_TERMINAL_SPEED);
+  return input;
+}
 
-  level_collide(state, &state->player.grounded, dt);
+Rectangle player_hitbox(void) {
+  return CLITERAL(Rectangle){
+    .x = 3.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
+    .y = 3.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
+    .width = 10.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
+    .height = 13.0f * (PLAYER_SIZE / (float)ATLAS_GRID_SIZE),
+  };
+}
 
-  state->player.pos.x += state->player.vel.x * dt;
-  state->player.pos.y += state->player.vel.y * dt;
+void init_player(struct plug_State *state, Vector2 spawn) {
+  struct plug_Player *player = &state->player;
+
+  player->actor = ent_spawn(&state->actors, spawn, player_hitbox());
+  player->respawn_point = spawn;
+  player->cam_move_pad_x = 50;
+  player->cam_move_pad_y = 50;
+}
+
+void step_body(Vector2 *pos, Vector2 *vel, bool *grounded, Rectangle hitbox,
+               const struct plug_Level *level, uint8_t input, float dt) {
+  vel->x = walk_velocity(vel->x, input, dt);
+  vel->y = fall_velocity(vel->y, *grounded, input, dt);
+
+  level_collide(level, *pos, hitbox, vel, grounded, dt);
+
+  pos->x += vel->x * dt;
+  pos->y += vel->y * dt;
+
+  vel->x = decelerate(vel->x, dt);
+}
 
-  state->player.camera.target.x = state->player.pos.x + PLAYER_SIZE * 0.5f;
-  state->player.camera.target.y = state->player.pos.y + PLAYER_SIZE * 0.5f;
+void update_player(struct plug_State *state, uint8_t input, float dt) {
+  PROF_ZONE("update_player");
+
+  const struct plug_Level *level =
+    state->current_level < 0
+      ? NULL
+      : &DA_AT(state->levels, (uint32_t)state->current_level);
+
+  struct plug_Player *player = &state->player;
+  struct ent_Store *actors = &state->actors;
+  actors->input[player->actor] = input;
+
+  // Cells that vanish or come back this step do so before anything moves
+  process_timers(state);
+
+  bool was_grounded = actors->grounded[player->actor];
+  float fall_speed = actors->vel_y[player->actor];
+
+  ent_step(actors, level, dt);
+
+  if (!was_grounded && actors->grounded[player->actor] &&
+      fall_speed >= PLAYER_LANDING_SPEED) {
+    Rectangle hitbox = ent_hitbox(actors, player->actor);
+    Vector2 pos = ent_pos(actors, player->actor);
+
+    player->landed_at = CLITERAL(Vector2){
+      pos.x + hitbox.x + hitbox.width * 0.5f,
+      pos.y + hitbox.y + hitbox.height,
+    };
+    player->landings++;
+  }
+
+  process_triggers(state);
+
+  Vector2 pos = ent_pos(&state->actors, player->actor);
+  state->player.camera.target.x = pos.x + PLAYER_SIZE * 0.5f;
+  state->player.camera.target.y = pos.y + PLAYER_SIZE * 0.5f;
 
   //DrawCircleV((Vector2){ state->player.pos.x - state->player.cam_move_pad_x,
   //                       state->player.pos.y },
@@ -302,11 +422,4 @@ void update_player(struct plug_State *state) {
 
   //state->player.camera.target.y =
   //  glm_lerp(state->player.camera.target.y, state->player.pos.y, 0.10f);
-
-  if (state->player.vel.x >= 0) {
-    state->player.vel.x -= fmin(PLAYER_DECELERATION * dt, state->player.vel.x);
-
-  } else {
-    state->player.vel.x -= fmax(-PLAYER_DECELERATION * dt, state->player.vel.x);
-  }
 }
@@ -3,6 +3,69 @@
 
 #include "plugin.h"
 
-void update_player(struct plug_State *state);
+// Samples the keyboard into a set of enum plug_InputFlags.
+uint8_t read_player_input(void);
+
+Rectangle player_hitbox(void);
+
+// Spawns the player's actor at spawn and sets up the rest of the player,
+// except for the camera.
+void init_player(struct plug_State *state, Vector2 spawn);
+
+// Sweeps hitbox (relative to pos) along vel against the solid cells of level
+// and scales vel down so that the body stops at the first contact.
+// Does nothing if level == NULL.
+void level_collide(const struct plug_Level *level, Vector2 pos,
+                   Rectangle hitbox, Vector2 *vel, bool *is_grounded,
+                   float dt);
+
+// Swept AABB test between two moving boxes in world space, the narrowphase
+// for candidate pairs from the broadphase. Returns the fraction of the step
+// at which they first touch, or 1.0f if they do not.
+float sweep_aabb(Rectangle a, Vector2 vel_a, Rectangle b, Vector2 vel_b,
+                 float dt);
+
+// The per axis parts of a step. Shared by step_body and the entity passes
+// so that every actor integrates exactly like the player. Written with
+// selects only (no fminf/fmaxf) so loops over them vectorise.
+static inline float walk_velocity(float vel_x, uint8_t input, float dt) {
+  // Scaled by 0 or 1 rather than selected, a conditional add cannot be
+  // if-converted without -fno-trapping-math.
+  float accel = PLAYER_ACCELERATION * dt;
+
+  vel_x -= accel * (float)((input / INPUT_LEFT) & 1);
+  vel_x += accel * (float)((input / INPUT_RIGHT) & 1);
+
+  vel_x = vel_x > -PLAYER_TERMINAL_SPEED ? vel_x : -PLAYER_TERMINAL_SPEED;
+  return vel_x < PLAYER_TERMINAL_SPEED ? vel_x : PLAYER_TERMINAL_SPEED;
+}
+
+static inline float fall_velocity(float vel_y, bool grounded, uint8_t input,
+                                  float dt) {
+  bool jump = grounded & ((input & INPUT_JUMP) != 0);
+
+  vel_y = jump ? PLAYER_JUMP_SPEED : vel_y;
+  vel_y += GRAVITY * dt;
+
+  return vel_y < PLAYER_GRAV_TERMINAL_SPEED ? vel_y
+                                            : PLAYER_GRAV_TERMINAL_SPEED;
+}
+
+static inline float decelerate(float vel_x, float dt) {
+  float decel = PLAYER_DECELERATION * dt;
+
+  float towards_zero = vel_x >= 0 ? (decel < vel_x ? decel : vel_x)
+                                  : (-decel > vel_x ? -decel : vel_x);
+  return vel_x - towards_zero;
+}
+
+// Advances a single body by dt. Touches nothing but its arguments, so any
+// number of bodies can be stepped concurrently against the same level.
+void step_body(Vector2 *pos, Vector2 *vel, bool *grounded, Rectangle hitbox,
+               const struct plug_Level *level, uint8_t input, float dt);
+
+// Advances the player by one step of dt with input, a set of enum
+// plug_InputFlags.
+void update_player(struct plug_State *state, uint8_t input, float dt);
 
 #endif // PLUG_UPDATE_PLAYER_H
@@ -0,0 +1,108 @@
+#include "plugin/plugin.h"
+#include "plugin/level.h"
+#include "plugin/sim-batch.h"
+#include "plugin/update-player.h"
+
+#include "util/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_INSTANCES 4096
+#define DEFAULT_STEPS 600
+#define SCRIPT_LENGTH 240
+
+#define SIM_DT (1.0f / 60.0f)
+
+// Random but plausible input: each input is held for a few frames.
+static void fill_script(uint8_t *script, uint32_t len, uint64_t *rng) {
+  uint8_t input = 0;
+
+  for (uint32_t i = 0; i < len; i++) {
+    if (i % 8 == 0) {
+      *rng ^= *rng << 13;
+      *rng ^= *rng >> 7;
+      *rng ^= *rng << 17;
+      input = *rng & (INPUT_LEFT | INPUT_RIGHT | INPUT_JUMP);
+    }
+
+    script[i] = input;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    printf("usage: %s [instances] [steps] [max threads]\n", argv[0]);
+    return 0;
+  }
+
+  uint32_t instances =
+    argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_INSTANCES;
+  uint32_t steps = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_STEPS;
+  uint32_t max_threads = argc > 3 ? strtoul(argv[3], NULL, 10)
+                                  : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (instances == 0 || steps == 0 || max_threads == 0) {
+    fprintf(stderr, "[ERROR]: arguments must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  struct plug_State state = { .current_level = -1 };
+  import_level(NULL, &state);
+  const struct plug_Level *level = &DA_AT(state.levels, 0);
+
+  uint8_t *scripts = malloc((size_t)instances * SCRIPT_LENGTH);
+  if (scripts == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  for (uint32_t i = 0; i < instances; i++) {
+    fill_script(&scripts[(size_t)i * SCRIPT_LENGTH], SCRIPT_LENGTH, &rng);
+  }
+
+  printf("%u instances x %u steps\n", instances, steps);
+  printf("%8s %16s %10s %8s\n", "threads", "steps/s", "seconds", "speedup");
+
+  double single_thread = 0.0;
+
+  for (uint32_t threads = 1;; threads *= 2) {
+    if (threads > max_threads) {
+      threads = max_threads;
+    }
+
+    struct sim_Batch batch =
+      sim_batch_create(instances, level->spawn, player_hitbox());
+    for (uint32_t i = 0; i < instances; i++) {
+      sim_batch_set_script(&batch, i, &scripts[(size_t)i * SCRIPT_LENGTH],
+                           SCRIPT_LENGTH);
+    }
+
+    struct tp_ThreadPool *pool = threads == 1 ? NULL : tp_create_pool(threads);
+    struct sim_BatchStats stats =
+      sim_batch_run(&batch, level, pool, steps, SIM_DT);
+    tp_free_pool(pool);
+
+    if (threads == 1) {
+      single_thread = stats.steps_per_second;
+    }
+
+    printf("%8u %16.0f %10.3f %8.2fx\n", threads, stats.steps_per_second,
+           stats.seconds, stats.steps_per_second / single_thread);
+
+    sim_batch_free(&batch);
+
+    if (threads == max_threads) {
+      break;
+    }
+  }
+
+  free(scripts);
+  unload_levels(&state);
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include "plugin/plugin.h"
+#include "plugin/level-bake.h"
+
+#include "util/clock.h"
+#include "util/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ATLAS_PATH "./assets/gmtk-texture-atlas.png"
+
+#define DEFAULT_WIDTH 400
+#define DEFAULT_HEIGHT 100
+#define DEFAULT_CELL_SIZE 25
+#define REPEATS 5
+#define REGION_SIZE 16
+
+// One pixel at a time, the way DrawTexturePro samples with point filtering
+// into a vertically flipped render texture.
+static Image reference_bake(const struct plug_Level *level, Image atlas) {
+  uint32_t cs = level->cell_size;
+  Image out = GenImageColor((int)(level->grid_width * cs),
+                            (int)(level->grid_height * cs), BLANK);
+  const Color *src = atlas.data;
+  Color *dst = out.data;
+
+  for (uint32_t py = 0; py < (uint32_t)out.height; py++) {
+    for (uint32_t px = 0; px < (uint32_t)out.width; px++) {
+      uint32_t cell = level->grid[(py / cs) * level->grid_width + px / cs];
+      if (cell == CELL_TYPE_NONE) {
+        continue;
+      }
+
+      uint32_t index = cell * ATLAS_GRID_SIZE - ATLAS_GRID_SIZE;
+      uint32_t tile_x = index % (uint32_t)atlas.width;
+      uint32_t tile_y = index / (uint32_t)atlas.width;
+
+      float u = ((float)(px % cs) + 0.5f) * ATLAS_GRID_SIZE / (float)cs;
+      float v = ((float)(cs - py % cs - 1) + 0.5f) * ATLAS_GRID_SIZE /
+                (float)cs;
+
+      dst[(size_t)py * out.width + px] =
+        src[(size_t)(tile_y + (uint32_t)v) * atlas.width + tile_x +
+            (uint32_t)u];
+    }
+  }
+
+  return out;
+}
+
+static double time_bake(const struct plug_Level *level,
+                        const struct plug_Tiles *tiles,
+                        struct tp_ThreadPool *pool, Image *last) {
+  uint64_t best = UINT64_MAX;
+
+  for (uint32_t i = 0; i < REPEATS; i++) {
+    uint64_t start = clk_now_ns();
+    Image baked = bake_level_image(level, tiles, pool);
+    uint64_t elapsed = clk_now_ns() - start;
+
+    best = elapsed < best ? elapsed : best;
+
+    if (i + 1 == REPEATS) {
+      *last = baked;
+    } else {
+      UnloadImage(baked);
+    }
+  }
+
+  return clk_ns_to_ms(best);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    printf("usage: %s [width] [height] [cell size] [max threads]\n", argv[0]);
+    return 0;
+  }
+
+  uint32_t width = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_WIDTH;
+  uint32_t height = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_HEIGHT;
+  uint32_t cell_size =
+    argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_CELL_SIZE;
+  uint32_t max_threads = argc > 4 ? strtoul(argv[4], NULL, 10)
+                                  : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (width == 0 || height == 0 || cell_size == 0 || max_threads == 0) {
+    fprintf(stderr, "[ERROR]: arguments must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  Image atlas = LoadImage(ATLAS_PATH);
+  if (atlas.data == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to load %s\n", ATLAS_PATH);
+    return EXIT_FAILURE;
+  }
+  ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  struct plug_Tiles tiles;
+  bake_tiles_from_grid(&tiles, &atlas);
+
+  struct plug_Level level = {
+    .grid_width = width,
+    .grid_height = height,
+    .cell_size = cell_size,
+  };
+
+  level.grid = malloc((size_t)width * height * sizeof(*level.grid));
+  if (level.grid == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  for (uint32_t i = 0; i < width * height; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    level.grid[i] = (enum plug_CellType)(rng % CELL_TYPES_COUNT);
+  }
+
+  Image expected = reference_bake(&level, atlas);
+  size_t bytes = (size_t)expected.width * expected.height * sizeof(Color);
+  double megapixels = (double)expected.width * expected.height / 1e6;
+
+  printf("%ux%u cells of %u px, %.1f Mpx\n", width, height, cell_size,
+         megapixels);
+  printf("%8s %12s %12s %8s\n", "threads", "ms", "Mpx/s", "speedup");
+
+  double single_thread = 0.0;
+
+  for (uint32_t threads = 1;; threads *= 2) {
+    if (threads > max_threads) {
+      threads = max_threads;
+    }
+
+    struct tp_ThreadPool *pool = threads == 1 ? NULL : tp_create_pool(threads);
+    Image baked;
+    double ms = time_bake(&level, &tiles, pool, &baked);
+    tp_free_pool(pool);
+
+    if (memcmp(baked.data, expected.data, bytes) != 0) {
+      fprintf(stderr, "[ERROR]: %u thread bake differs from reference\n",
+              threads);
+      return EXIT_FAILURE;
+    }
+    UnloadImage(baked);
+
+    if (threads == 1) {
+      single_thread = ms;
+    }
+
+    printf("%8u %12.3f %12.1f %8.2fx\n", threads, ms, megapixels / ms * 1e3,
+           single_thread / ms);
+
+    if (threads == max_threads) {
+      break;
+    }
+  }
+
+  // A re-bake of one dirty rect, as level_flush_dirty does
+  uint32_t rect_w = width < REGION_SIZE ? width : REGION_SIZE;
+  uint32_t rect_h = height < REGION_SIZE ? height : REGION_SIZE;
+  uint32_t rect_x = (width - rect_w) / 2, rect_y = (height - rect_h) / 2;
+  uint32_t stride = rect_w * cell_size;
+
+  Color *region =
+    malloc((size_t)stride * rect_h * cell_size * sizeof(*region));
+  uint16_t *map = malloc(cell_size * sizeof(*map));
+  if (region == NULL || map == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t start = clk_now_ns();
+  bake_tile_map(cell_size, map);
+  bake_level_region(&level, &tiles, map, region, stride, rect_x,
+                    rect_x + rect_w, rect_y, rect_y + rect_h);
+  uint64_t region_ns = clk_now_ns() - start;
+
+  const Color *full = expected.data;
+  for (uint32_t py = 0; py < rect_h * cell_size; py++) {
+    size_t offset = (size_t)(rect_y * cell_size + py) * expected.width +
+                    rect_x * cell_size;
+    const Color *row = &full[offset];
+
+    if (memcmp(&region[(size_t)py * stride], row, stride * sizeof(*row)) !=
+        0) {
+      fprintf(stderr, "[ERROR]: region bake differs from reference\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("%ux%u region: %.3f ms\n", rect_w, rect_h, clk_ns_to_ms(region_ns));
+
+  free(region);
+  free(map);
+  UnloadImage(expected);
+  UnloadImage(atlas);
+  free(level.grid);
+
+  return 0;
+}
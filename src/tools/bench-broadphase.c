@@ -0,0 +1,176 @@
+#include "plugin/broadphase.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_BODIES 10000
+#define DEFAULT_STEPS 300
+
+#define WORLD_SIZE 4000.0f
+#define CELL_SIZE 32.0f
+#define MIN_BODY_SIZE 4.0f
+#define MAX_BODY_SIZE 24.0f
+#define MAX_SPEED 200.0f
+
+#define SIM_DT (1.0f / 60.0f)
+
+struct Bodies {
+  uint32_t count;
+
+  float *x, *y, *w, *h;
+  float *vx, *vy;
+
+  // Swept bounds for the current step
+  float *min_x, *min_y, *max_x, *max_y;
+};
+
+static float randf(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  return (float)(*rng >> 40) / (float)(1ull << 24);
+}
+
+static float *alloc_floats(uint32_t count) {
+  float *p = malloc(count * sizeof(*p));
+  if (p == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return p;
+}
+
+static void move_bodies(struct Bodies *b, float dt) {
+  for (uint32_t i = 0; i < b->count; i++) {
+    b->x[i] += b->vx[i] * dt;
+    b->y[i] += b->vy[i] * dt;
+
+    if (b->x[i] < 0.0f || b->x[i] + b->w[i] > WORLD_SIZE) {
+      b->vx[i] = -b->vx[i];
+    }
+
+    if (b->y[i] < 0.0f || b->y[i] + b->h[i] > WORLD_SIZE) {
+      b->vy[i] = -b->vy[i];
+    }
+
+    float dx = b->vx[i] * dt, dy = b->vy[i] * dt;
+    b->min_x[i] = b->x[i] + (dx < 0.0f ? dx : 0.0f);
+    b->min_y[i] = b->y[i] + (dy < 0.0f ? dy : 0.0f);
+    b->max_x[i] = b->x[i] + b->w[i] + (dx > 0.0f ? dx : 0.0f);
+    b->max_y[i] = b->y[i] + b->h[i] + (dy > 0.0f ? dy : 0.0f);
+  }
+}
+
+static uint64_t brute_force_pairs(const struct Bodies *b) {
+  uint64_t pairs = 0;
+
+  for (uint32_t i = 0; i < b->count; i++) {
+    for (uint32_t j = i + 1; j < b->count; j++) {
+      pairs += b->min_x[i] <= b->max_x[j] && b->min_x[j] <= b->max_x[i] &&
+               b->min_y[i] <= b->max_y[j] && b->min_y[j] <= b->max_y[i];
+    }
+  }
+
+  return pairs;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_BODIES;
+  uint32_t steps = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_STEPS;
+
+  if (count == 0 || steps == 0) {
+    printf("usage: %s [bodies] [steps]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct Bodies b = { .count = count };
+  b.x = alloc_floats(count);
+  b.y = alloc_floats(count);
+  b.w = alloc_floats(count);
+  b.h = alloc_floats(count);
+  b.vx = alloc_floats(count);
+  b.vy = alloc_floats(count);
+  b.min_x = alloc_floats(count);
+  b.min_y = alloc_floats(count);
+  b.max_x = alloc_floats(count);
+  b.max_y = alloc_floats(count);
+
+  uint64_t rng = 0x2545f4914f6cdd1dull;
+  for (uint32_t i = 0; i < count; i++) {
+    b.w[i] = MIN_BODY_SIZE + randf(&rng) * (MAX_BODY_SIZE - MIN_BODY_SIZE);
+    b.h[i] = MIN_BODY_SIZE + randf(&rng) * (MAX_BODY_SIZE - MIN_BODY_SIZE);
+    b.x[i] = randf(&rng) * (WORLD_SIZE - b.w[i]);
+    b.y[i] = randf(&rng) * (WORLD_SIZE - b.h[i]);
+    b.vx[i] = (randf(&rng) * 2.0f - 1.0f) * MAX_SPEED;
+    b.vy[i] = (randf(&rng) * 2.0f - 1.0f) * MAX_SPEED;
+  }
+
+  struct bp_Broadphase bp;
+  bp_init(&bp, CELL_SIZE);
+
+  // Check against O(n^2) once before timing anything
+  move_bodies(&b, SIM_DT);
+  bp_build(&bp, count, b.min_x, b.min_y, b.max_x, b.max_y);
+  bp_find_pairs(&bp);
+
+  uint64_t expected = brute_force_pairs(&b);
+  if (bp.pairs.count != expected) {
+    fprintf(stderr, "[ERROR]: broadphase found %llu pairs, expected %llu\n",
+            (unsigned long long)bp.pairs.count,
+            (unsigned long long)expected);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t build_ns = 0, pairs_ns = 0, narrow_ns = 0;
+  uint64_t total_pairs = 0, total_hits = 0;
+
+  for (uint32_t s = 0; s < steps; s++) {
+    move_bodies(&b, SIM_DT);
+
+    uint64_t t0 = clk_now_ns();
+    bp_build(&bp, count, b.min_x, b.min_y, b.max_x, b.max_y);
+    uint64_t t1 = clk_now_ns();
+    bp_find_pairs(&bp);
+    uint64_t t2 = clk_now_ns();
+
+    for (uint64_t p = 0; p < bp.pairs.count; p++) {
+      uint32_t i = bp.pairs.items[p].a, j = bp.pairs.items[p].b;
+
+      float t = sweep_aabb(
+        CLITERAL(Rectangle){ b.x[i], b.y[i], b.w[i], b.h[i] },
+        CLITERAL(Vector2){ b.vx[i], b.vy[i] },
+        CLITERAL(Rectangle){ b.x[j], b.y[j], b.w[j], b.h[j] },
+        CLITERAL(Vector2){ b.vx[j], b.vy[j] }, SIM_DT);
+
+      total_hits += t < 1.0f;
+    }
+    uint64_t t3 = clk_now_ns();
+
+    build_ns += t1 - t0;
+    pairs_ns += t2 - t1;
+    narrow_ns += t3 - t2;
+    total_pairs += bp.pairs.count;
+  }
+
+  printf("%u bodies, %u steps, %llu pairs/step, %llu hits/step\n", count,
+         steps, (unsigned long long)(total_pairs / steps),
+         (unsigned long long)(total_hits / steps));
+  printf("build:  %8.3f ms/step\n", clk_ns_to_ms(build_ns) / steps);
+  printf("pairs:  %8.3f ms/step\n", clk_ns_to_ms(pairs_ns) / steps);
+  printf("narrow: %8.3f ms/step\n", clk_ns_to_ms(narrow_ns) / steps);
+
+  bp_free(&bp);
+
+  float *arrays[] = { b.x, b.y, b.w, b.h, b.vx, b.vy,
+                      b.min_x, b.min_y, b.max_x, b.max_y };
+  for (uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+    free(arrays[i]);
+  }
+
+  return EXIT_SUCCESS;
+}
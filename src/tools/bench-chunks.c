@@ -0,0 +1,162 @@
+#include "plugin/chunks.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_QUERIES 1000000
+
+#define LEVEL_CHUNKS_X 256
+#define LEVEL_CHUNKS_Y 64
+#define CHUNK_SIZE 400.0f
+
+#define SCREEN_WIDTH 1280.0f
+#define SCREEN_HEIGHT 720.0f
+
+#define POINTS_PER_CAMERA 16
+
+static float randf(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  return (float)(*rng >> 40) / (float)(1ull << 24);
+}
+
+static Camera2D random_camera(uint64_t *rng) {
+  Vector2 level_size = { LEVEL_CHUNKS_X * CHUNK_SIZE,
+                         LEVEL_CHUNKS_Y * CHUNK_SIZE };
+
+  // Some cameras look past the edges of the level
+  return CLITERAL(Camera2D){
+    .offset = { SCREEN_WIDTH * 0.5f, SCREEN_HEIGHT * 0.5f },
+    .target = { (randf(rng) * 1.2f - 0.1f) * level_size.x,
+                (randf(rng) * 1.2f - 0.1f) * level_size.y },
+    .rotation = randf(rng) < 0.5f ? 0.0f : randf(rng) * 360.0f,
+    .zoom = 0.1f + randf(rng) * 8.0f,
+  };
+}
+
+// Forward 2D camera transform, as raylib applies it
+static Vector2 world_to_screen(Camera2D camera, Vector2 world) {
+  float angle = camera.rotation * DEG2RAD;
+  float c = cosf(angle), s = sinf(angle);
+
+  float x = world.x - camera.target.x, y = world.y - camera.target.y;
+
+  return CLITERAL(Vector2){
+    (x * c - y * s) * camera.zoom + camera.offset.x,
+    (x * s + y * c) * camera.zoom + camera.offset.y,
+  };
+}
+
+static bool check_camera(Camera2D camera, uint64_t *rng) {
+  Rectangle view = chunk_camera_view(camera, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+  // Every world point that lands on screen must be inside the view
+  for (uint32_t i = 0; i < POINTS_PER_CAMERA; i++) {
+    Vector2 world = {
+      view.x + (randf(rng) * 2.0f - 0.5f) * view.width,
+      view.y + (randf(rng) * 2.0f - 0.5f) * view.height,
+    };
+    Vector2 screen = world_to_screen(camera, world);
+
+    bool on_screen = screen.x >= 1.0f && screen.x <= SCREEN_WIDTH - 1.0f &&
+                     screen.y >= 1.0f && screen.y <= SCREEN_HEIGHT - 1.0f;
+    bool in_view = world.x >= view.x && world.x <= view.x + view.width &&
+                   world.y >= view.y && world.y <= view.y + view.height;
+
+    if (on_screen && !in_view) {
+      return false;
+    }
+  }
+
+  struct chunk_Range range;
+  bool any = chunk_visible_range(CLITERAL(Vector2){ 0 }, CHUNK_SIZE,
+                                 LEVEL_CHUNKS_X, LEVEL_CHUNKS_Y, view, &range);
+
+  // Compare with testing every chunk
+  for (uint32_t y = 0; y < LEVEL_CHUNKS_Y; y++) {
+    for (uint32_t x = 0; x < LEVEL_CHUNKS_X; x++) {
+      float cx = (float)x * CHUNK_SIZE, cy = (float)y * CHUNK_SIZE;
+
+      bool expected = cx <= view.x + view.width &&
+                      cx + CHUNK_SIZE > view.x &&
+                      cy <= view.y + view.height && cy + CHUNK_SIZE > view.y;
+      bool found = any && x >= range.x_begin && x < range.x_end &&
+                   y >= range.y_begin && y < range.y_end;
+
+      if (expected != found) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    printf("usage: %s [queries]\n", argv[0]);
+    return 0;
+  }
+
+  uint32_t queries = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_QUERIES;
+  if (queries == 0) {
+    fprintf(stderr, "[ERROR]: arguments must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x2545f4914f6cdd1dull;
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    Camera2D camera = random_camera(&rng);
+
+    if (!check_camera(camera, &rng)) {
+      fprintf(stderr,
+              "[ERROR]: wrong chunks for target (%f, %f), rotation %f, "
+              "zoom %f\n",
+              camera.target.x, camera.target.y, camera.rotation, camera.zoom);
+      return EXIT_FAILURE;
+    }
+  }
+
+  Camera2D *cameras = malloc(queries * sizeof(*cameras));
+  if (cameras == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (uint32_t i = 0; i < queries; i++) {
+    cameras[i] = random_camera(&rng);
+  }
+
+  uint64_t visible = 0;
+
+  uint64_t start = clk_now_ns();
+  for (uint32_t i = 0; i < queries; i++) {
+    Rectangle view =
+      chunk_camera_view(cameras[i], SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    struct chunk_Range range;
+    if (chunk_visible_range(CLITERAL(Vector2){ 0 }, CHUNK_SIZE,
+                            LEVEL_CHUNKS_X, LEVEL_CHUNKS_Y, view, &range)) {
+      visible += (uint64_t)(range.x_end - range.x_begin) *
+                 (range.y_end - range.y_begin);
+    }
+  }
+  uint64_t elapsed = clk_now_ns() - start;
+
+  printf("%u queries against %u chunks\n", queries,
+         LEVEL_CHUNKS_X * LEVEL_CHUNKS_Y);
+  printf("visible: %.1f chunks/query\n", (double)visible / queries);
+  printf("time:    %.1f ns/query\n", (double)elapsed / queries);
+
+  free(cameras);
+
+  return 0;
+}
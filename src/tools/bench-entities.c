@@ -0,0 +1,147 @@
+#include "plugin/plugin.h"
+#include "plugin/entity.h"
+#include "plugin/level.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ACTORS 100000
+#define DEFAULT_STEPS 600
+
+#define SIM_DT (1.0f / 60.0f)
+
+// What the player looked like before the hot fields were split out, used as
+// the baseline for the integration passes.
+struct AosActor {
+  float walk_acceleration;
+  float walk_deceleration;
+  float jump_speed;
+
+  enum plug_PlayerState state;
+
+  Vector2 pos;
+  Vector2 vel;
+
+  Vector2 respawn_point;
+
+  Rectangle hitbox;
+
+  Camera2D camera;
+
+  float cam_move_pad_x;
+  float cam_move_pad_y;
+
+  bool grounded;
+  uint8_t input;
+};
+
+static void aos_integrate(struct AosActor *actors, uint32_t count, float dt) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct AosActor *a = &actors[i];
+
+    a->vel.x = walk_velocity(a->vel.x, a->input, dt);
+    a->vel.y = fall_velocity(a->vel.y, a->grounded, a->input, dt);
+
+    a->pos.x += a->vel.x * dt;
+    a->pos.y += a->vel.y * dt;
+    a->vel.x = decelerate(a->vel.x, dt);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ACTORS;
+  uint32_t steps = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_STEPS;
+
+  if (count == 0 || steps == 0) {
+    printf("usage: %s [actors] [steps]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct plug_State state = { .current_level = -1 };
+  import_level(NULL, &state);
+  const struct plug_Level *level = &DA_AT(state.levels, 0);
+
+  struct ent_Store store;
+  ent_store_init(&store, count);
+
+  struct AosActor *aos = calloc(count, sizeof(*aos));
+  if (aos == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x853c49e6748fea9bull;
+  float level_width = (float)level->grid_width * level->cell_size;
+
+  for (uint32_t i = 0; i < count; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+
+    Vector2 pos = {
+      .x = (float)(rng % (uint64_t)level_width),
+      .y = level->spawn.y,
+    };
+
+    uint32_t actor = ent_spawn(&store, pos, player_hitbox());
+    store.input[actor] = (rng >> 32) & (INPUT_LEFT | INPUT_RIGHT | INPUT_JUMP);
+
+    aos[i].pos = pos;
+    aos[i].hitbox = player_hitbox();
+    aos[i].input = store.input[actor];
+  }
+
+  // Integration only, the part that vectorises
+  uint64_t start = clk_now_ns();
+  for (uint32_t s = 0; s < steps; s++) {
+    ent_apply_input(&store, SIM_DT);
+    ent_integrate(&store, SIM_DT);
+  }
+  uint64_t soa_ns = clk_now_ns() - start;
+
+  start = clk_now_ns();
+  for (uint32_t s = 0; s < steps; s++) {
+    aos_integrate(aos, count, SIM_DT);
+  }
+  uint64_t aos_ns = clk_now_ns() - start;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (store.pos_x[i] != aos[i].pos.x || store.pos_y[i] != aos[i].pos.y) {
+      fprintf(stderr, "[ERROR]: SoA and AoS diverged at actor %u\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Full steps including collision against the level
+  for (uint32_t i = 0; i < count; i++) {
+    ent_teleport(&store, i, aos[i].pos);
+    store.pos_y[i] = level->spawn.y;
+  }
+
+  uint32_t collide_steps = steps / 10 == 0 ? 1 : steps / 10;
+  start = clk_now_ns();
+  for (uint32_t s = 0; s < collide_steps; s++) {
+    ent_step(&store, level, SIM_DT);
+  }
+  uint64_t step_ns = clk_now_ns() - start;
+
+  double soa_ms = clk_ns_to_ms(soa_ns) / steps;
+  double aos_ms = clk_ns_to_ms(aos_ns) / steps;
+  double step_ms = clk_ns_to_ms(step_ns) / collide_steps;
+
+  printf("%u actors\n", count);
+  printf("integrate SoA: %8.3f ms/step (%.1f M actors/s)\n", soa_ms,
+         count / soa_ms * 1e-3);
+  printf("integrate AoS: %8.3f ms/step (%.1f M actors/s)\n", aos_ms,
+         count / aos_ms * 1e-3);
+  printf("full step:     %8.3f ms/step (with level collision)\n", step_ms);
+
+  free(aos);
+  ent_store_free(&store);
+  unload_levels(&state);
+
+  return EXIT_SUCCESS;
+}
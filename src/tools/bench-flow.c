@@ -0,0 +1,307 @@
+#include "plugin/plugin.h"
+#include "plugin/flow-field.h"
+
+#include "util/clock.h"
+#include "util/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_AGENTS 10000
+#define DEFAULT_WIDTH 2000
+#define DEFAULT_HEIGHT 500
+
+#define CELL_SIZE 25
+#define SOLID_PERCENT 25
+
+#define FRAMES 600
+#define RETARGET_FRAMES 120
+#define EDITS 1000
+#define SEARCH_SAMPLES 8
+
+static uint64_t next_random(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  return *rng;
+}
+
+static Vector2 cell_center(const struct plug_Level *level, uint32_t cell) {
+  return CLITERAL(Vector2){
+    level->pos.x + (cell % level->grid_width + 0.5f) * level->cell_size,
+    level->pos.y + (cell / level->grid_width + 0.5f) * level->cell_size,
+  };
+}
+
+static uint32_t random_walkable(const struct plug_Level *level,
+                                uint64_t *rng) {
+  uint32_t cells = level->grid_width * level->grid_height;
+
+  for (;;) {
+    uint32_t cell = next_random(rng) % cells;
+    if (flow_walkable(level->grid[cell])) {
+      return cell;
+    }
+  }
+}
+
+// What a chasing agent would do without the field: search from itself
+// until it finds the target. Returns the steps to it.
+static uint32_t search_path(const struct plug_Level *level, uint32_t from,
+                            uint32_t to, uint32_t *dist, uint32_t *queue) {
+  uint32_t w = level->grid_width, h = level->grid_height;
+  memset(dist, 0xff, (size_t)w * h * sizeof(*dist));
+
+  uint32_t head = 0, tail = 0;
+  dist[from] = 0;
+  queue[tail++] = from;
+
+  while (head < tail) {
+    uint32_t cell = queue[head++];
+    if (cell == to) {
+      return dist[cell];
+    }
+
+    uint32_t x = cell % w, y = cell / w;
+    uint32_t neighbours[4], count = 0;
+
+    if (x > 0) neighbours[count++] = cell - 1;
+    if (x + 1 < w) neighbours[count++] = cell + 1;
+    if (y > 0) neighbours[count++] = cell - w;
+    if (y + 1 < h) neighbours[count++] = cell + w;
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t n = neighbours[k];
+
+      if (flow_walkable(level->grid[n]) && dist[n] == FLOW_UNREACHED) {
+        dist[n] = dist[cell] + 1;
+        queue[tail++] = n;
+      }
+    }
+  }
+
+  return FLOW_UNREACHED;
+}
+
+static bool same_field(const struct flow_Field *a, const struct flow_Field *b) {
+  size_t cells = (size_t)a->width * a->height;
+
+  for (size_t i = 0; i < cells; i++) {
+    if (a->dist[i] != b->dist[i]) {
+      fprintf(stderr, "[ERROR]: Cell %zu is %u steps away, not %u\n", i,
+              a->dist[i], b->dist[i]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t agents = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_AGENTS;
+  uint32_t width = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_WIDTH;
+  uint32_t height = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_HEIGHT;
+  uint32_t threads = argc > 4 ? strtoul(argv[4], NULL, 10)
+                               : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (agents == 0 || width < 2 * FLOW_RETARGET_CELLS || height == 0 ||
+      threads == 0) {
+    printf("usage: %s [agents] [width] [height] [threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x853c49e6748fea9bull;
+  size_t cells = (size_t)width * height;
+
+  struct plug_Level level = {
+    .grid_width = width,
+    .grid_height = height,
+    .cell_size = CELL_SIZE,
+    .grid = malloc(cells * sizeof(enum plug_CellType)),
+    .owns_grid = true,
+  };
+
+  uint32_t *dist = malloc(cells * sizeof(*dist));
+  uint32_t *queue = malloc(cells * sizeof(*queue));
+  uint32_t *agent_cells = malloc(agents * sizeof(*agent_cells));
+
+  if (level.grid == NULL || dist == NULL || queue == NULL ||
+      agent_cells == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < cells; i++) {
+    level.grid[i] = next_random(&rng) % 100 < SOLID_PERCENT
+                      ? CELL_TYPE_FLOOR
+                      : CELL_TYPE_NONE;
+  }
+
+  uint32_t target = (height / 2) * width + width / 2;
+  level.grid[target] = CELL_TYPE_NONE;
+
+  struct tp_ThreadPool *pool = threads > 1 ? tp_create_pool(threads) : NULL;
+
+  struct flow_Field field, reference;
+  flow_field_init(&field, &level);
+  flow_field_init(&reference, &level);
+
+  uint64_t start = clk_now_ns();
+  flow_field_target(&reference, &level, cell_center(&level, target),
+                    UINT64_MAX, NULL);
+  uint64_t serial_ns = clk_now_ns() - start;
+
+  start = clk_now_ns();
+  flow_field_target(&field, &level, cell_center(&level, target), UINT64_MAX,
+                    pool);
+  uint64_t parallel_ns = clk_now_ns() - start;
+
+  if (!same_field(&field, &reference)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("%ux%u cells, %u%% solid, %u agents\n", width, height,
+         SOLID_PERCENT, agents);
+  printf("build:     %8.3f ms on 1 thread, %8.3f ms on %u\n",
+         clk_ns_to_ms(serial_ns), clk_ns_to_ms(parallel_ns), threads);
+
+  // Agents step a cell per frame along the field
+  for (uint32_t i = 0; i < agents; i++) {
+    agent_cells[i] = random_walkable(&level, &rng);
+  }
+
+  uint64_t lookup_ns = 0;
+  uint32_t arrived = 0;
+
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    start = clk_now_ns();
+    for (uint32_t i = 0; i < agents; i++) {
+      Vector2 step = flow_field_direction(&field, &level,
+                                          cell_center(&level, agent_cells[i]));
+      agent_cells[i] += (int32_t)step.x + (int32_t)step.y * (int32_t)width;
+    }
+    lookup_ns += clk_now_ns() - start;
+  }
+
+  for (uint32_t i = 0; i < agents; i++) {
+    arrived += agent_cells[i] == target;
+  }
+
+  printf("lookups:   %8.3f ms/frame, %.1f ns/agent, %u of %u arrived in "
+         "%u frames\n",
+         clk_ns_to_ms(lookup_ns) / FRAMES,
+         (double)lookup_ns / ((double)FRAMES * agents), arrived, agents,
+         FRAMES);
+
+  // The same agents each searching for their own path instead
+  start = clk_now_ns();
+  for (uint32_t i = 0; i < SEARCH_SAMPLES; i++) {
+    search_path(&level, random_walkable(&level, &rng), target, dist, queue);
+  }
+  double search_ms = clk_ns_to_ms(clk_now_ns() - start) / SEARCH_SAMPLES;
+
+  printf("per agent: %8.3f ms/agent searching, %.1f s/frame for %u agents\n",
+         search_ms, search_ms * agents * 1e-3, agents);
+
+  // The target walks right a cell per frame, and the field is built again
+  // a budget at a time
+  uint32_t rebuilds = 0;
+  uint64_t retarget_ns = 0, retarget_max_ns = 0;
+  Vector2 pos = cell_center(&level, target);
+
+  for (uint32_t f = 1; f <= RETARGET_FRAMES; f++) {
+    pos = cell_center(&level, target);
+    pos.x += (float)(f % width) * CELL_SIZE;
+
+    start = clk_now_ns();
+    rebuilds += flow_field_target(&field, &level, pos, FLOW_BUILD_BUDGET_NS,
+                                  pool);
+    uint64_t frame_ns = clk_now_ns() - start;
+
+    retarget_ns += frame_ns;
+    retarget_max_ns = frame_ns > retarget_max_ns ? frame_ns : retarget_max_ns;
+  }
+
+  printf("retarget:  %8.3f ms/frame, %.3f ms at most, %u rebuilds in %u "
+         "frames\n",
+         clk_ns_to_ms(retarget_ns) / RETARGET_FRAMES,
+         clk_ns_to_ms(retarget_max_ns), rebuilds, RETARGET_FRAMES);
+
+  // Agents around the target walk to it, not to the cell the field was
+  // built for
+  uint32_t near = 0;
+  for (uint32_t i = 0; i < FLOW_NEAR_SIZE * FLOW_NEAR_SIZE; i++) {
+    if (field.near[i] == UINT8_MAX) {
+      continue;
+    }
+
+    uint32_t cell = field.goal + (i % FLOW_NEAR_SIZE - FLOW_RETARGET_CELLS) +
+                    (i / FLOW_NEAR_SIZE - FLOW_RETARGET_CELLS) * width;
+
+    for (uint32_t s = 0; s < field.near[i]; s++) {
+      Vector2 step = flow_field_direction(&field, &level,
+                                          cell_center(&level, cell));
+      cell += (int32_t)step.x + (int32_t)step.y * (int32_t)width;
+    }
+
+    if (cell != field.goal) {
+      fprintf(stderr, "[ERROR]: Agent %u cells from the target missed it\n",
+              field.near[i]);
+      return EXIT_FAILURE;
+    }
+    near++;
+  }
+
+  printf("near:      %u cells around the target lead to it, %d cells "
+         "right of where the field leads\n",
+         near, (int32_t)(field.goal % width) - (int32_t)(field.target % width));
+
+  // Cells opened and closed one at a time, with a build maybe still going.
+  // The field it leads to once done is checked against a full build.
+
+  uint64_t edit_ns = 0;
+  for (uint32_t e = 0; e < EDITS; e++) {
+    uint32_t cell = next_random(&rng) % cells;
+    level.grid[cell] = flow_walkable(level.grid[cell]) ? CELL_TYPE_FLOOR
+                                                       : CELL_TYPE_NONE;
+
+    struct plug_CellRect rect = { cell % width, cell / width, 1, 1 };
+
+    start = clk_now_ns();
+    flow_field_update_cells(&field, &level, rect);
+    edit_ns += clk_now_ns() - start;
+  }
+
+  bool building = field.build.running;
+  flow_field_target(&field, &level, pos, UINT64_MAX, pool);
+
+  reference.has_target = false;
+  start = clk_now_ns();
+  flow_field_target(&reference, &level, cell_center(&level, field.target),
+                    UINT64_MAX, NULL);
+  uint64_t rebuild_ns = clk_now_ns() - start;
+
+  if (!same_field(&field, &reference)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("edits:     %8.3f ms/edit repaired (%.1f cells each), %.3f ms "
+         "to rebuild%s\n",
+         clk_ns_to_ms(edit_ns) / EDITS, (double)field.repaired / EDITS,
+         clk_ns_to_ms(rebuild_ns),
+         building ? ", during a build" : "");
+
+  flow_field_free(&field);
+  flow_field_free(&reference);
+  tp_free_pool(pool);
+
+  free(agent_cells);
+  free(queue);
+  free(dist);
+  free(level.grid);
+
+  return EXIT_SUCCESS;
+}
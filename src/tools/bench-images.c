@@ -0,0 +1,191 @@
+#include "plugin/atlas-pack.h"
+#include "plugin/image-cache.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define REPEATS 10
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [assets dir]\n"
+          "\n"
+          "Times loading the PNGs in assets dir (default: %s) and starting\n"
+          "from their packed atlas, decoding every time and from a cold and\n"
+          "a warm cache. Caches are written to a temporary directory.\n",
+          name, ASSETS_DIR);
+}
+
+// Removes the files in dir, then dir
+static void remove_files(const char *dir) {
+  FilePathList files = LoadDirectoryFilesEx(dir, NULL, false);
+  for (uint32_t i = 0; i < files.count; i++) {
+    remove(files.paths[i]);
+  }
+  UnloadDirectoryFiles(files);
+
+  rmdir(dir);
+}
+
+// Removes a cache directory and the images directory in it
+static void remove_dir(const char *dir) {
+  char images_dir[IMGC_PATH_MAX];
+  snprintf(images_dir, sizeof(images_dir), "%s/images", dir);
+
+  remove_files(images_dir);
+  remove_files(dir);
+}
+
+static void print_row(const char *what, uint64_t ns) {
+  printf("  %-28s %10.3f ms\n", what, clk_ns_to_ms(ns));
+}
+
+// Best of REPEATS loads of every PNG, decoded or through cache_dir, which is
+// emptied first if cold
+static uint64_t time_images(const FilePathList *files, const char *cache_dir,
+                            bool cold) {
+  uint64_t best = UINT64_MAX;
+
+  for (uint32_t r = 0; r < REPEATS; r++) {
+    if (cold) {
+      remove_dir(cache_dir);
+    }
+
+    uint64_t start = clk_now_ns();
+    for (uint32_t i = 0; i < files->count; i++) {
+      struct imgc_Image image;
+      if (!imgc_load_file(files->paths[i], cache_dir, 0, &image, NULL)) {
+        fprintf(stderr, "[ERROR]: Failed to load %s\n", files->paths[i]);
+        exit(EXIT_FAILURE);
+      }
+      imgc_unload(&image);
+    }
+    uint64_t elapsed = clk_now_ns() - start;
+
+    best = elapsed < best ? elapsed : best;
+  }
+
+  return best;
+}
+
+// Best of REPEATS atlas startups. cache_dir == NULL packs every time,
+// otherwise the cache is emptied first if cold.
+static uint64_t time_atlas(const char *assets_dir, const char *cache_dir,
+                           bool cold) {
+  uint64_t best = UINT64_MAX;
+
+  for (uint32_t r = 0; r < REPEATS; r++) {
+    if (cache_dir != NULL && cold) {
+      remove_dir(cache_dir);
+    }
+
+    struct pack_Atlas atlas;
+
+    uint64_t start = clk_now_ns();
+    bool ok = cache_dir == NULL
+                ? pack_atlas_build(assets_dir, PACK_PAGE_SIZE, NULL, &atlas)
+                : pack_atlas_load(assets_dir, cache_dir, PACK_PAGE_SIZE,
+                                  &atlas, NULL);
+    uint64_t elapsed = clk_now_ns() - start;
+
+    if (!ok) {
+      fprintf(stderr, "[ERROR]: Failed to pack %s\n", assets_dir);
+      exit(EXIT_FAILURE);
+    }
+    pack_atlas_free(&atlas);
+
+    best = elapsed < best ? elapsed : best;
+  }
+
+  return best;
+}
+
+// Best of REPEATS decodes of the atlas pages saved as PNGs, what a warm
+// start cost before pages were cached decoded
+static uint64_t time_png_pages(const char *assets_dir, const char *dir) {
+  struct pack_Atlas atlas;
+  if (!pack_atlas_build(assets_dir, PACK_PAGE_SIZE, NULL, &atlas)) {
+    fprintf(stderr, "[ERROR]: Failed to pack %s\n", assets_dir);
+    exit(EXIT_FAILURE);
+  }
+
+  char path[IMGC_PATH_MAX];
+  for (uint32_t page = 0; page < atlas.pages.count; page++) {
+    snprintf(path, sizeof(path), "%s/page-%u.png", dir, page);
+    ExportImage(atlas.pages.items[page], path);
+  }
+
+  uint64_t best = UINT64_MAX;
+
+  for (uint32_t r = 0; r < REPEATS; r++) {
+    uint64_t start = clk_now_ns();
+    for (uint32_t page = 0; page < atlas.pages.count; page++) {
+      snprintf(path, sizeof(path), "%s/page-%u.png", dir, page);
+
+      Image image = LoadImage(path);
+      ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+      UnloadImage(image);
+    }
+    uint64_t elapsed = clk_now_ns() - start;
+
+    best = elapsed < best ? elapsed : best;
+  }
+
+  pack_atlas_free(&atlas);
+  remove_dir(dir);
+
+  return best;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  const char *assets_dir = argc > 1 ? argv[1] : ASSETS_DIR;
+
+  char cache_dir[] = "/tmp/bench-images-XXXXXX";
+  if (mkdtemp(cache_dir) == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to create a temporary directory\n");
+    return EXIT_FAILURE;
+  }
+
+  FilePathList files = LoadDirectoryFilesEx(assets_dir, ".png", false);
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < files.count; i++) {
+    struct imgc_Image image;
+    if (imgc_load_file(files.paths[i], NULL, 0, &image, NULL)) {
+      bytes += (uint64_t)image.image.width * image.image.height * 4;
+      imgc_unload(&image);
+    }
+  }
+
+  printf("%u PNGs, %.2f MB decoded, best of %u\n", files.count,
+         (double)bytes / (1024.0 * 1024.0), REPEATS);
+
+  printf("images:\n");
+  print_row("decode", time_images(&files, NULL, false));
+  print_row("cold cache", time_images(&files, cache_dir, true));
+  print_row("warm cache", time_images(&files, cache_dir, false));
+  remove_dir(cache_dir);
+
+  printf("atlas startup:\n");
+  print_row("pack every time", time_atlas(assets_dir, NULL, false));
+  print_row("cold cache", time_atlas(assets_dir, cache_dir, true));
+  print_row("warm cache", time_atlas(assets_dir, cache_dir, false));
+  remove_dir(cache_dir);
+
+  mkdir(cache_dir, 0755);
+  print_row("PNG pages instead", time_png_pages(assets_dir, cache_dir));
+
+  UnloadDirectoryFiles(files);
+
+  return EXIT_SUCCESS;
+}
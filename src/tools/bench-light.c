@@ -0,0 +1,190 @@
+#include "plugin/plugin.h"
+#include "plugin/light.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_LIGHTS LIGHT_MAX_LIGHTS
+#define DEFAULT_FRAMES 600
+
+#define LEVEL_WIDTH 1024
+#define LEVEL_HEIGHT 256
+#define CELL_SIZE 16
+#define SOLID_PERCENT 20
+
+#define RADIUS LIGHT_MAX_RADIUS
+#define INTENSITY 255
+
+static uint64_t rng = 0x853c49e6748fea9bull;
+
+static uint32_t next_random(uint32_t below) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+
+  return (uint32_t)(rng % below);
+}
+
+static Vector2 cell_center(uint32_t x, uint32_t y) {
+  return CLITERAL(Vector2){
+    ((float)x + 0.5f) * CELL_SIZE,
+    ((float)y + 0.5f) * CELL_SIZE,
+  };
+}
+
+static void add_lights(struct light_Map *map, const struct plug_Level *level,
+                       const uint32_t *xs, const uint32_t *ys,
+                       uint32_t count) {
+  light_begin(map);
+  for (uint32_t i = 0; i < count; i++) {
+    light_add(map, level, cell_center(xs[i], ys[i]), RADIUS, INTENSITY);
+  }
+}
+
+// Works every light and cell of a new map out and compares it to map
+static bool matches_full(const struct light_Map *map,
+                         const struct plug_Level *level, const uint32_t *xs,
+                         const uint32_t *ys, uint32_t count) {
+  struct light_Map full;
+  light_map_init(&full, level, 1);
+
+  add_lights(&full, level, xs, ys, count);
+  light_update(&full, level);
+
+  bool same = memcmp(map->cells, full.cells,
+                     (size_t)level->grid_width * level->grid_height) == 0;
+
+  light_map_free(&full);
+  return same;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_LIGHTS;
+  uint32_t frames = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FRAMES;
+  uint32_t threads = argc > 3 ? strtoul(argv[3], NULL, 10)
+                              : (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (count == 0 || count > LIGHT_MAX_LIGHTS || frames == 0 || threads == 0) {
+    printf("usage: %s [lights, at most %u] [frames] [threads]\n", argv[0],
+           LIGHT_MAX_LIGHTS);
+    return EXIT_FAILURE;
+  }
+
+  size_t cells = (size_t)LEVEL_WIDTH * LEVEL_HEIGHT;
+
+  struct plug_Level level = {
+    .grid_width = LEVEL_WIDTH,
+    .grid_height = LEVEL_HEIGHT,
+    .cell_size = CELL_SIZE,
+    .grid = malloc(cells * sizeof(enum plug_CellType)),
+    .owns_grid = true,
+  };
+
+  if (level.grid == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < cells; i++) {
+    level.grid[i] =
+      next_random(100) < SOLID_PERCENT ? CELL_TYPE_FLOOR : CELL_TYPE_NONE;
+  }
+
+  uint32_t xs[LIGHT_MAX_LIGHTS], ys[LIGHT_MAX_LIGHTS];
+  for (uint32_t i = 0; i < count; i++) {
+    xs[i] = next_random(LEVEL_WIDTH);
+    ys[i] = next_random(LEVEL_HEIGHT);
+  }
+
+  struct light_Map serial, parallel;
+  light_map_init(&serial, &level, 1);
+  light_map_init(&parallel, &level, threads);
+
+  add_lights(&serial, &level, xs, ys, count);
+  light_update(&serial, &level);
+  add_lights(&parallel, &level, xs, ys, count);
+  light_update(&parallel, &level);
+
+  // Every light and every cell of the level, every frame
+  uint64_t full_ns[2] = { 0 };
+  struct light_Map *maps[2] = { &serial, &parallel };
+
+  for (uint32_t m = 0; m < 2; m++) {
+    for (uint32_t f = 0; f < frames; f++) {
+      uint64_t start = clk_now_ns();
+      light_rebuild(maps[m]);
+      light_update(maps[m], &level);
+      full_ns[m] += clk_now_ns() - start;
+    }
+  }
+
+  // One light walks a cell a frame
+  uint64_t move_ns = 0, recomputed = parallel.recomputed;
+  uint64_t combined = parallel.combined;
+
+  for (uint32_t f = 0; f < frames; f++) {
+    xs[0] = (xs[0] + 1) % LEVEL_WIDTH;
+
+    uint64_t start = clk_now_ns();
+    add_lights(&parallel, &level, xs, ys, count);
+    light_update(&parallel, &level);
+    move_ns += clk_now_ns() - start;
+  }
+
+  uint64_t move_recomputed = parallel.recomputed - recomputed;
+  uint64_t move_combined = parallel.combined - combined;
+
+  // A cell next to a light opens or closes every frame
+  uint64_t cell_ns = 0;
+  recomputed = parallel.recomputed;
+  combined = parallel.combined;
+
+  for (uint32_t f = 0; f < frames; f++) {
+    uint32_t i = next_random(count);
+    uint32_t x = xs[i] + 1 < LEVEL_WIDTH ? xs[i] + 1 : xs[i] - 1;
+    size_t cell = (size_t)ys[i] * LEVEL_WIDTH + x;
+
+    level.grid[cell] =
+      level.grid[cell] == CELL_TYPE_NONE ? CELL_TYPE_FLOOR : CELL_TYPE_NONE;
+
+    uint64_t start = clk_now_ns();
+    light_invalidate(&parallel,
+                     CLITERAL(struct plug_CellRect){ x, ys[i], 1, 1 });
+    add_lights(&parallel, &level, xs, ys, count);
+    light_update(&parallel, &level);
+    cell_ns += clk_now_ns() - start;
+  }
+
+  uint64_t cell_recomputed = parallel.recomputed - recomputed;
+  uint64_t cell_combined = parallel.combined - combined;
+
+  bool ok = matches_full(&parallel, &level, xs, ys, count);
+
+  double per_frame = 1.0 / frames;
+
+  printf("%ux%u cells, %u lights of radius %u, %u frames, %u threads\n",
+         LEVEL_WIDTH, LEVEL_HEIGHT, count, RADIUS, frames, threads);
+  printf("full, 1 thread:  %8.3f ms/frame\n",
+         clk_ns_to_ms(full_ns[0]) * per_frame);
+  printf("full, %u threads: %8.3f ms/frame\n", threads,
+         clk_ns_to_ms(full_ns[1]) * per_frame);
+  printf("light moved:     %8.3f ms/frame, %.1f lights and %.0f cells\n",
+         clk_ns_to_ms(move_ns) * per_frame,
+         (double)move_recomputed * per_frame,
+         (double)move_combined * per_frame);
+  printf("cell changed:    %8.3f ms/frame, %.1f lights and %.0f cells\n",
+         clk_ns_to_ms(cell_ns) * per_frame,
+         (double)cell_recomputed * per_frame,
+         (double)cell_combined * per_frame);
+  printf("incremental %s a full rebuild\n", ok ? "matches" : "DIFFERS from");
+
+  light_map_free(&serial);
+  light_map_free(&parallel);
+  free(level.grid);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,274 @@
+#include "util/clock.h"
+#include "util/dynamic_array.h"
+#include "util/mpsc_queue.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_PRODUCERS 8
+#define DEFAULT_MESSAGES 250000
+#define DEFAULT_BATCH 64
+
+#define QUEUE_CAPACITY 1024
+
+// The most messages the consumer takes at once
+#define MAX_BATCH 4096
+
+typedef DA_TYPE(struct mpsc_Message) MessageList;
+
+// What every producer posts, in the order it posts it
+struct Producer {
+  pthread_t thread;
+  uint32_t id;
+  uint32_t messages;
+
+  struct mpsc_Queue *queue;
+
+  // For the baseline
+  pthread_mutex_t *mutex;
+  MessageList *list;
+
+  // Pushes that found the queue full
+  uint64_t full;
+};
+
+static pthread_barrier_t start_line;
+
+// Messages carry their producer as the kind and their number, from 1, as
+// the data, so the consumer can tell one went missing, twice or out of
+// order
+static struct mpsc_Message message_of(uint32_t producer, uint32_t n) {
+  return (struct mpsc_Message){
+    .kind = producer,
+    .data = (void *)(uintptr_t)(n + 1),
+  };
+}
+
+static void *produce_queue(void *p) {
+  struct Producer *producer = p;
+  pthread_barrier_wait(&start_line);
+
+  for (uint32_t n = 0; n < producer->messages; n++) {
+    while (!mpsc_push(producer->queue, message_of(producer->id, n))) {
+      producer->full++;
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+static void *produce_list(void *p) {
+  struct Producer *producer = p;
+  pthread_barrier_wait(&start_line);
+
+  for (uint32_t n = 0; n < producer->messages; n++) {
+    pthread_mutex_lock(producer->mutex);
+    DA_APPEND(producer->list, message_of(producer->id, n));
+    pthread_mutex_unlock(producer->mutex);
+  }
+
+  return NULL;
+}
+
+// Counts a message in. Returns false if it is not the one expected next
+// from its producer.
+static bool take(uint32_t *next, uint32_t producers,
+                 struct mpsc_Message message) {
+  if (message.kind >= producers ||
+      (uintptr_t)message.data != (uintptr_t)next[message.kind] + 1) {
+    fprintf(stderr, "[ERROR]: Message %llu from producer %u out of order\n",
+            (unsigned long long)(uintptr_t)message.data, message.kind);
+    return false;
+  }
+
+  next[message.kind]++;
+  return true;
+}
+
+struct Result {
+  uint64_t ns;
+  uint64_t full;
+  bool ok;
+};
+
+static void start(struct Producer *producers, uint32_t count,
+                  void *(*produce)(void *)) {
+  for (uint32_t i = 0; i < count; i++) {
+    errno = pthread_create(&producers[i].thread, NULL, produce,
+                           &producers[i]);
+    if (errno != 0) {
+      fprintf(stderr, "[ERROR]: Failed to create thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static uint64_t join(struct Producer *producers, uint32_t count) {
+  uint64_t full = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    pthread_join(producers[i].thread, NULL);
+    full += producers[i].full;
+  }
+
+  return full;
+}
+
+// Drains the queue a batch at a time while every producer pushes into it
+static struct Result run_queue(struct Producer *producers, uint32_t count,
+                               uint32_t messages, uint32_t batch) {
+  struct mpsc_Queue queue;
+  mpsc_init(&queue, QUEUE_CAPACITY);
+
+  uint32_t *next = calloc(count, sizeof(*next));
+  struct mpsc_Message *out = malloc(batch * sizeof(*out));
+  assert(next != NULL && out != NULL && "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < count; i++) {
+    producers[i] = (struct Producer){
+      .id = i,
+      .messages = messages,
+      .queue = &queue,
+    };
+  }
+
+  pthread_barrier_init(&start_line, NULL, count + 1);
+  start(producers, count, produce_queue);
+  pthread_barrier_wait(&start_line);
+
+  uint64_t begin = clk_now_ns();
+  uint64_t total = (uint64_t)count * messages, taken = 0;
+  bool ok = true;
+
+  // Drained to the end even once one is out of order, or the producers
+  // would wait on a full queue forever
+  while (taken < total) {
+    uint32_t n = mpsc_drain(&queue, out, batch);
+    if (n == 0) {
+      sched_yield();
+    }
+
+    for (uint32_t i = 0; ok && i < n; i++) {
+      ok = take(next, count, out[i]);
+    }
+    taken += n;
+  }
+
+  struct Result result = { .ns = clk_now_ns() - begin, .ok = ok };
+  result.full = join(producers, count);
+  pthread_barrier_destroy(&start_line);
+
+  // Nothing is left over
+  result.ok = result.ok && mpsc_drain(&queue, out, 1) == 0;
+
+  mpsc_free(&queue);
+  free(next);
+  free(out);
+
+  return result;
+}
+
+// The same with the list and mutex the workers handed results over with:
+// producers append under the lock, and the consumer swaps the list out for
+// an empty one
+static struct Result run_list(struct Producer *producers, uint32_t count,
+                              uint32_t messages) {
+  pthread_mutex_t mutex;
+  pthread_mutex_init(&mutex, NULL);
+
+  MessageList list = { 0 }, spare = { 0 };
+  uint32_t *next = calloc(count, sizeof(*next));
+  assert(next != NULL && "Failed to allocate memory");
+
+  for (uint32_t i = 0; i < count; i++) {
+    producers[i] = (struct Producer){
+      .id = i,
+      .messages = messages,
+      .mutex = &mutex,
+      .list = &list,
+    };
+  }
+
+  pthread_barrier_init(&start_line, NULL, count + 1);
+  start(producers, count, produce_list);
+  pthread_barrier_wait(&start_line);
+
+  uint64_t begin = clk_now_ns();
+  uint64_t total = (uint64_t)count * messages, taken = 0;
+  bool ok = true;
+
+  while (taken < total) {
+    pthread_mutex_lock(&mutex);
+    MessageList taking = list;
+    list = spare;
+    pthread_mutex_unlock(&mutex);
+
+    if (taking.count == 0) {
+      sched_yield();
+    }
+
+    for (uint64_t i = 0; ok && i < taking.count; i++) {
+      ok = take(next, count, taking.items[i]);
+    }
+    taken += taking.count;
+
+    spare = taking;
+    spare.count = 0;
+  }
+
+  struct Result result = { .ns = clk_now_ns() - begin, .ok = ok };
+
+  join(producers, count);
+  pthread_barrier_destroy(&start_line);
+  pthread_mutex_destroy(&mutex);
+
+  result.ok = result.ok && list.count == 0;
+
+  DA_FREE(&list);
+  DA_FREE(&spare);
+  free(next);
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_PRODUCERS;
+  uint32_t messages =
+    argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MESSAGES;
+  uint32_t batch = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_BATCH;
+
+  if (count == 0 || messages == 0 || batch == 0 || batch > MAX_BATCH) {
+    printf("usage: %s [producers] [messages per producer] "
+           "[batch, at most %u]\n",
+           argv[0], MAX_BATCH);
+    return EXIT_FAILURE;
+  }
+
+  struct Producer *producers = malloc(count * sizeof(*producers));
+  assert(producers != NULL && "Failed to allocate memory");
+
+  struct Result queue = run_queue(producers, count, messages, batch);
+  struct Result list = run_list(producers, count, messages);
+
+  double total = (double)count * messages;
+
+  printf("%u producers, %u messages each, drained %u at a time\n", count,
+         messages, batch);
+  printf("queue of %u:   %8.2f M messages/s, %llu pushes found it full\n",
+         QUEUE_CAPACITY, total / clk_ns_to_s(queue.ns) * 1e-6,
+         (unsigned long long)queue.full);
+  printf("mutex and list: %8.2f M messages/s\n",
+         total / clk_ns_to_s(list.ns) * 1e-6);
+  printf("every message arrived once, in order per producer: %s\n",
+         queue.ok && list.ok ? "yes" : "NO");
+
+  free(producers);
+
+  return queue.ok && list.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+#include "plugin/plugin.h"
+#include "plugin/particles.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_PARTICLES 1000000
+#define DEFAULT_FRAMES 120
+
+#define FRAME_DT (1.0f / 60.0f)
+
+#define LEVEL_WIDTH 400
+#define LEVEL_HEIGHT 100
+#define CELL_SIZE 25
+#define SOLID_PERCENT 10
+
+// A particle as one struct, the baseline for the integration pass
+struct AosParticle {
+  float pos_x, pos_y;
+  float vel_x, vel_y;
+  float gravity;
+  float life, inv_life;
+  float size_end, size_range;
+  Color color;
+  bool collide;
+};
+
+static void aos_integrate(struct AosParticle *particles, uint32_t count,
+                          float dt) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct AosParticle *p = &particles[i];
+
+    p->vel_y += p->gravity * dt;
+    p->pos_x += p->vel_x * dt;
+    p->pos_y += p->vel_y * dt;
+    p->life -= dt;
+  }
+}
+
+// Half the particles fall and bounce off the level, half rise through it
+static void refill(struct part_System *system, const struct plug_Level *level) {
+  Vector2 size = {
+    (float)level->grid_width * level->cell_size,
+    (float)level->grid_height * level->cell_size,
+  };
+
+  struct part_Spawn spawn = {
+    .extent = { size.x * 0.5f, size.y * 0.5f },
+    .angle = 0.0f,
+    .spread = 360.0f,
+    .speed_min = 10.0f,
+    .speed_max = 100.0f,
+    .life_min = 1.0f,
+    .life_max = 3.0f,
+    .size_start = 2.0f,
+    .size_end = 0.5f,
+    .gravity = GRAVITY,
+    .color = { 255, 255, 255, 255 },
+    .collide = true,
+  };
+
+  Vector2 center = { size.x * 0.5f, size.y * 0.5f };
+  uint32_t room = system->capacity - system->count;
+
+  part_emit(system, &spawn, center, room / 2);
+
+  spawn.gravity = -GRAVITY * 0.1f;
+  spawn.collide = false;
+  part_emit(system, &spawn, center, room - room / 2);
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_PARTICLES;
+  uint32_t frames = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FRAMES;
+
+  if (count == 0 || frames == 0) {
+    printf("usage: %s [particles] [frames]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x853c49e6748fea9bull;
+  size_t cells = (size_t)LEVEL_WIDTH * LEVEL_HEIGHT;
+
+  struct plug_Level level = {
+    .grid_width = LEVEL_WIDTH,
+    .grid_height = LEVEL_HEIGHT,
+    .cell_size = CELL_SIZE,
+    .grid = malloc(cells * sizeof(enum plug_CellType)),
+    .owns_grid = true,
+  };
+
+  struct part_System system;
+  part_system_init(&system, count);
+
+  struct AosParticle *aos = malloc(system.capacity * sizeof(*aos));
+
+  if (level.grid == NULL || aos == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < cells; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+
+    level.grid[i] =
+      rng % 100 < SOLID_PERCENT ? CELL_TYPE_FLOOR : CELL_TYPE_NONE;
+  }
+
+  uint64_t emit_ns = 0, integrate_ns = 0, collide_ns = 0, compact_ns = 0;
+  uint64_t build_ns = 0, aos_ns = 0, live = 0;
+
+  for (uint32_t f = 0; f < frames; f++) {
+    uint64_t start = clk_now_ns();
+    refill(&system, &level);
+    emit_ns += clk_now_ns() - start;
+
+    // The same particles as one struct each
+    for (uint32_t i = 0; i < system.count; i++) {
+      aos[i].pos_x = system.pos_x[i];
+      aos[i].pos_y = system.pos_y[i];
+      aos[i].vel_x = system.vel_x[i];
+      aos[i].vel_y = system.vel_y[i];
+      aos[i].gravity = system.gravity[i];
+      aos[i].life = system.life[i];
+    }
+
+    start = clk_now_ns();
+    aos_integrate(aos, system.count, FRAME_DT);
+    aos_ns += clk_now_ns() - start;
+
+    start = clk_now_ns();
+    part_integrate(&system, FRAME_DT);
+    integrate_ns += clk_now_ns() - start;
+
+    for (uint32_t i = 0; i < system.count; i++) {
+      if (aos[i].pos_x != system.pos_x[i] || aos[i].pos_y != system.pos_y[i]) {
+        fprintf(stderr, "[ERROR]: SoA and AoS diverged at particle %u\n", i);
+        return EXIT_FAILURE;
+      }
+    }
+
+    start = clk_now_ns();
+    part_collide(&system, &level, FRAME_DT);
+    collide_ns += clk_now_ns() - start;
+
+    start = clk_now_ns();
+    part_compact(&system);
+    compact_ns += clk_now_ns() - start;
+
+    start = clk_now_ns();
+    part_build(&system);
+    build_ns += clk_now_ns() - start;
+
+    live += system.count;
+  }
+
+  double per_frame = 1.0 / frames;
+  double per_particle = 1e6 / (double)live;
+
+  printf("%u particles, %.0f live on average, %u frames\n", system.capacity,
+         (double)live * per_frame, frames);
+  printf("emit:          %8.3f ms/frame\n", clk_ns_to_ms(emit_ns) * per_frame);
+  printf("integrate SoA: %8.3f ms/frame, %.2f ns/particle\n",
+         clk_ns_to_ms(integrate_ns) * per_frame,
+         clk_ns_to_ms(integrate_ns) * per_particle);
+  printf("integrate AoS: %8.3f ms/frame, %.2f ns/particle\n",
+         clk_ns_to_ms(aos_ns) * per_frame, clk_ns_to_ms(aos_ns) * per_particle);
+  printf("collide:       %8.3f ms/frame, %.2f ns/particle\n",
+         clk_ns_to_ms(collide_ns) * per_frame,
+         clk_ns_to_ms(collide_ns) * per_particle);
+  printf("compact:       %8.3f ms/frame, %.2f ns/particle\n",
+         clk_ns_to_ms(compact_ns) * per_frame,
+         clk_ns_to_ms(compact_ns) * per_particle);
+  printf("build quads:   %8.3f ms/frame, %.2f ns/particle\n",
+         clk_ns_to_ms(build_ns) * per_frame,
+         clk_ns_to_ms(build_ns) * per_particle);
+
+  part_system_free(&system);
+  free(aos);
+  free(level.grid);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+#include "plugin/plugin.h"
+#include "plugin/chunks.h"
+#include "plugin/level.h"
+#include "plugin/light.h"
+#include "plugin/pipeline.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ACTORS 20000
+#define DEFAULT_RENDER_MS 4.0
+#define DEFAULT_FRAMES 600
+
+// The player starts walking right on this frame
+#define INPUT_FRAME 100
+
+// The screen the fake renderer draws the level to
+#define SCREEN_WIDTH 800.0f
+#define SCREEN_HEIGHT 450.0f
+
+// What a frame costs the fake renderer, and what it saw
+struct Renderer {
+  uint64_t cost_ns;
+
+  float player_x;
+};
+
+// Stands in for the draw calls: brings the level up to date and draws it,
+// as plug_update does while the next steps run, then takes cost_ns
+static void fake_render(struct Renderer *renderer, struct plug_State *state) {
+  uint64_t end = clk_now_ns() + renderer->cost_ns;
+  const struct pipe_Frame *frame = &state->pipeline.frame;
+  struct plug_Level *level = &DA_AT(state->levels, 0);
+
+  renderer->player_x = frame->player_pos.x;
+
+  level_flush_dirty(level, &state->tiles, LEVEL_FLUSH_BUDGET_CELLS);
+
+  // Baked from scratch every frame, the way chunks scrolling into view are,
+  // so the cells the steps change are read while they change
+  level_rebake(level);
+
+  Rectangle view =
+    chunk_camera_view(frame->camera, SCREEN_WIDTH, SCREEN_HEIGHT);
+  chunk_cache_draw(&level->chunks, level, &state->tiles, view);
+  light_draw(&level->light, level, view);
+
+  while (clk_now_ns() < end) {
+  }
+}
+
+static void setup(struct plug_State *state, uint32_t actors) {
+  *state = (struct plug_State){ .current_level = -1 };
+  import_level(NULL, state);
+  state->current_level = 0;
+
+  struct plug_Level *level = &DA_AT(state->levels, 0);
+  init_player(state, level->spawn);
+  state->player.camera.offset =
+    CLITERAL(Vector2){ SCREEN_WIDTH * 0.5f, SCREEN_HEIGHT * 0.5f };
+  state->player.camera.zoom = 5.0f;
+
+  // The floor the player walks on vanishes under them and comes back, so
+  // the steps change cells while the level is drawn
+  for (uint32_t x = 0; x < level->grid_width; x++) {
+    for (uint32_t y = 0; y < level->grid_height; y++) {
+      if (level->grid[y * level->grid_width + x] == CELL_TYPE_FLOOR) {
+        level_set_cell(level, x, y, CELL_TYPE_VANISH);
+        break;
+      }
+    }
+  }
+  load_level(state);
+
+  // Everyone else walks and jumps about, so the steps cost something
+  uint64_t rng = 0x853c49e6748fea9bull;
+  float level_width = (float)level->grid_width * level->cell_size;
+
+  for (uint32_t i = 1; i < actors; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+
+    Vector2 pos = { (float)(rng % (uint64_t)level_width), level->spawn.y };
+    uint32_t actor = ent_spawn(&state->actors, pos, player_hitbox());
+    state->actors.input[actor] =
+      (rng >> 32) & (INPUT_LEFT | INPUT_RIGHT | INPUT_JUMP);
+  }
+
+  tw_init(&state->timers, SIM_TIMER_CAPACITY, 0);
+  snap_init(&state->history);
+  snap_prepare(&state->history, state);
+}
+
+static void teardown(struct plug_State *state) {
+  pipe_stop(state);
+  unload_level(state);
+  snap_free(&state->history);
+  tw_free(&state->timers);
+  ent_store_free(&state->actors);
+  unload_levels(state);
+}
+
+// Runs frames the way plug_update does, one fixed step each. Returns the
+// average frame time, and the frames it took the player's first move to be
+// drawn after the input that caused it.
+static double run(bool pipelined, uint32_t actors, uint32_t frames,
+                  struct Renderer *renderer, uint32_t *latency,
+                  Vector2 *end) {
+  struct plug_State state;
+  setup(&state, actors);
+  pipe_set_enabled(&state, pipelined);
+
+  *latency = UINT32_MAX;
+  float start_x = ent_pos(&state.actors, state.player.actor).x;
+
+  uint64_t start = clk_now_ns();
+  for (uint32_t f = 0; f < frames; f++) {
+    pipe_sync(&state);
+
+    uint8_t input = f >= INPUT_FRAME ? INPUT_RIGHT : 0;
+    snap_prepare(&state.history, &state);
+    pipe_run(&state, input, 1);
+
+    fake_render(renderer, &state);
+    if (*latency == UINT32_MAX && renderer->player_x != start_x) {
+      *latency = f - INPUT_FRAME;
+    }
+  }
+  pipe_sync(&state);
+  uint64_t elapsed = clk_now_ns() - start;
+
+  *end = ent_pos(&state.actors, state.player.actor);
+  teardown(&state);
+
+  return clk_ns_to_ms(elapsed) / frames;
+}
+
+int main(int argc, char **argv) {
+  uint32_t actors = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ACTORS;
+  double render_ms = argc > 2 ? strtod(argv[2], NULL) : DEFAULT_RENDER_MS;
+  uint32_t frames = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_FRAMES;
+
+  if (actors == 0 || frames <= INPUT_FRAME) {
+    printf("usage: %s [actors] [render ms] [frames > %u]\n", argv[0],
+           INPUT_FRAME);
+    return EXIT_FAILURE;
+  }
+
+  struct Renderer renderer = { .cost_ns = (uint64_t)(render_ms * 1e6) };
+
+  uint32_t serial_latency, pipelined_latency;
+  Vector2 serial_end, pipelined_end;
+
+  double serial_ms = run(false, actors, frames, &renderer, &serial_latency,
+                         &serial_end);
+  double pipelined_ms = run(true, actors, frames, &renderer,
+                            &pipelined_latency, &pipelined_end);
+
+  if (serial_end.x != pipelined_end.x || serial_end.y != pipelined_end.y) {
+    fprintf(stderr, "[ERROR]: Pipelined steps diverged from serial ones\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%u actors, %.2f ms render, %u frames\n", actors, render_ms,
+         frames);
+  printf("serial:    %7.3f ms/frame, input drawn after %u frames\n",
+         serial_ms, serial_latency);
+  printf("pipelined: %7.3f ms/frame, input drawn after %u frames\n",
+         pipelined_ms, pipelined_latency);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+#include "plugin/plugin.h"
+#include "plugin/level.h"
+#include "plugin/pipeline.h"
+#include "plugin/snapshot.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_STEPS SNAP_MAX_FRAMES
+#define DEFAULT_RESTORES 1000
+
+// Steps stepped back one at a time at the end
+#define STEP_BACKS 600
+
+// Steps an input is held for, at most
+#define INPUT_HOLD 30
+
+static uint64_t next_random(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  return *rng;
+}
+
+// FNV-1a of the grid, to check the cells are restored too
+static uint64_t grid_hash(const struct plug_Level *level) {
+  uint64_t cells = (uint64_t)level->grid_width * level->grid_height;
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (uint64_t i = 0; i < cells; i++) {
+    hash = (hash ^ level->grid[i]) * 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+// Where the player is after a step, and what the grid is
+struct Step {
+  Vector2 pos;
+  uint64_t grid;
+};
+
+static struct Step step_of(const struct plug_State *state) {
+  return (struct Step){
+    .pos = ent_pos(&state->actors, state->player.actor),
+    .grid = grid_hash(&DA_AT(state->levels, 0)),
+  };
+}
+
+static bool check_step(const struct plug_State *state,
+                       const struct Step *steps, uint64_t step) {
+  struct Step now = step_of(state);
+  Vector2 pos = steps[step].pos;
+
+  if (now.pos.x != pos.x || now.pos.y != pos.y) {
+    fprintf(stderr, "[ERROR]: Step %llu restored to (%f, %f), not (%f, %f)\n",
+            (unsigned long long)step, now.pos.x, now.pos.y, pos.x, pos.y);
+    return false;
+  }
+
+  if (now.grid != steps[step].grid) {
+    fprintf(stderr, "[ERROR]: Step %llu restored another grid\n",
+            (unsigned long long)step);
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t steps = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_STEPS;
+  uint32_t restores = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_RESTORES;
+
+  if (steps <= STEP_BACKS) {
+    printf("usage: %s [steps > %u] [restores]\n", argv[0], STEP_BACKS);
+    return EXIT_FAILURE;
+  }
+
+  struct plug_State state = { .current_level = -1 };
+  import_level(NULL, &state);
+  state.current_level = 0;
+
+  struct plug_Level *level = &DA_AT(state.levels, 0);
+  init_player(&state, level->spawn);
+
+  // The top of every column of floor vanishes when touched, so the steps
+  // change cells
+  for (uint32_t x = 0; x < level->grid_width; x++) {
+    for (uint32_t y = 0; y < level->grid_height; y++) {
+      if (level->grid[y * level->grid_width + x] == CELL_TYPE_FLOOR) {
+        level_set_cell(level, x, y, CELL_TYPE_VANISH);
+        break;
+      }
+    }
+  }
+  load_level(&state);
+  level_flush_dirty(level, &state.tiles, UINT32_MAX);
+
+  tw_init(&state.timers, SIM_TIMER_CAPACITY, 0);
+  snap_init(&state.history);
+  snap_prepare(&state.history, &state);
+
+  // The state after every step, to check restores against
+  struct Step *pos = malloc((steps + 1) * sizeof(*pos));
+  if (pos == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x853c49e6748fea9bull;
+  uint8_t input = 0;
+
+  pos[0] = step_of(&state);
+  snap_capture(&state.history, &state, 0);
+
+  // A step a frame, the way the game runs them
+  uint64_t start = clk_now_ns();
+  for (uint32_t s = 1; s <= steps; s++) {
+    if (next_random(&rng) % INPUT_HOLD == 0) {
+      input = next_random(&rng) & (INPUT_LEFT | INPUT_RIGHT | INPUT_JUMP);
+    }
+
+    snap_prepare(&state.history, &state);
+    pipe_run(&state, input, 1);
+
+    pos[s] = step_of(&state);
+  }
+  uint64_t run_ns = clk_now_ns() - start;
+
+  struct snap_Stats stats = snap_stats(&state.history);
+
+  printf("%u frames kept of %u, %.1f s at %.0f steps/s\n", stats.frames,
+         steps, stats.frames * SIM_STEP_DT, 1.0f / SIM_STEP_DT);
+  printf("%u B raw, %.1f B/frame encoded, %llu B total, %u keyframes\n",
+         stats.frame_size, stats.bytes_per_frame,
+         (unsigned long long)stats.bytes, stats.keyframes);
+  printf("step + capture: %.3f us/step\n",
+         clk_ns_to_ms(run_ns) * 1e3 / steps);
+
+  // Restoring drops every newer frame, so restores go back in time
+  uint64_t oldest, newest;
+  if (!snap_range(&state.history, &oldest, &newest)) {
+    fprintf(stderr, "[ERROR]: No frame can be restored\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t total_ns = 0, max_ns = 0;
+  uint64_t step = newest;
+  uint32_t restored = 0;
+
+  for (; restored < restores && step > oldest + STEP_BACKS; restored++) {
+    step -= 1 + next_random(&rng) % ((newest - oldest) / (restores + 1) + 1);
+    if (step < oldest + STEP_BACKS) {
+      step = oldest + STEP_BACKS;
+    }
+
+    if (!snap_restore(&state.history, &state, step) ||
+        !check_step(&state, pos, step)) {
+      return EXIT_FAILURE;
+    }
+
+    uint64_t ns = state.history.last_restore_ns;
+    total_ns += ns;
+    max_ns = ns > max_ns ? ns : max_ns;
+  }
+
+  printf("restore:   %.3f ms avg, %.3f ms max over %u restores\n",
+         clk_ns_to_ms(total_ns) / restored, clk_ns_to_ms(max_ns), restored);
+
+  total_ns = max_ns = 0;
+  for (uint32_t i = 0; i < STEP_BACKS; i++) {
+    if (!snap_step_back(&state.history, &state) ||
+        !check_step(&state, pos, --step)) {
+      return EXIT_FAILURE;
+    }
+
+    uint64_t ns = state.history.last_restore_ns;
+    total_ns += ns;
+    max_ns = ns > max_ns ? ns : max_ns;
+  }
+
+  printf("step back: %.3f ms avg, %.3f ms max over %u steps\n",
+         clk_ns_to_ms(total_ns) / STEP_BACKS, clk_ns_to_ms(max_ns),
+         STEP_BACKS);
+
+  if (!snap_restart(&state.history, &state) || !check_step(&state, pos, 0)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("restart:   %.3f ms\n",
+         clk_ns_to_ms(state.history.last_restore_ns));
+
+  free(pos);
+  unload_level(&state);
+  snap_free(&state.history);
+  tw_free(&state.timers);
+  ent_store_free(&state.actors);
+  unload_levels(&state);
+
+  return EXIT_SUCCESS;
+}
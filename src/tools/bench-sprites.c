@@ -0,0 +1,205 @@
+#include "plugin/sprite-batch.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_SPRITES 100000
+#define DEFAULT_FRAMES 100
+
+#define TEXTURES 8
+#define LAYERS 4
+#define TOLERANCE 1e-3f
+
+struct Sprite {
+  uint32_t texture;
+  Rectangle src, dest;
+  Vector2 origin;
+  float rotation;
+  Color tint;
+  int16_t layer;
+
+  uint32_t index;
+};
+
+static uint64_t rng_next(uint64_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 7;
+  *rng ^= *rng << 17;
+
+  return *rng;
+}
+
+static float randf(uint64_t *rng) {
+  return (float)(rng_next(rng) >> 40) / (float)(1ull << 24);
+}
+
+// Layer first, then the order textures were first used in, then the order
+// sprites were added in
+static uint32_t first_use[TEXTURES];
+
+static int compare_sprites(const void *a, const void *b) {
+  const struct Sprite *sa = a, *sb = b;
+
+  if (sa->layer != sb->layer) {
+    return sa->layer < sb->layer ? -1 : 1;
+  }
+
+  if (sa->texture != sb->texture) {
+    return first_use[sa->texture] < first_use[sb->texture] ? -1 : 1;
+  }
+
+  return sa->index < sb->index ? -1 : sa->index > sb->index;
+}
+
+// The corners DrawTexturePro would emit for s
+static void reference_quad(const struct Sprite *s, Texture2D texture,
+                           Vector2 corners[4], Vector2 uvs[4]) {
+  float sn = sinf(s->rotation * DEG2RAD), cs = cosf(s->rotation * DEG2RAD);
+  float dx = -s->origin.x, dy = -s->origin.y;
+  float x = s->dest.x, y = s->dest.y, w = s->dest.width, h = s->dest.height;
+
+  corners[0] = (Vector2){ x + dx * cs - dy * sn, y + dx * sn + dy * cs };
+  corners[1] =
+    (Vector2){ x + dx * cs - (dy + h) * sn, y + dx * sn + (dy + h) * cs };
+  corners[2] = (Vector2){ x + (dx + w) * cs - (dy + h) * sn,
+                          y + (dx + w) * sn + (dy + h) * cs };
+  corners[3] =
+    (Vector2){ x + (dx + w) * cs - dy * sn, y + (dx + w) * sn + dy * cs };
+
+  float u0 = s->src.x / texture.width;
+  float u1 = (s->src.x + s->src.width) / texture.width;
+  float v0 = s->src.y / texture.height;
+  float v1 = (s->src.y + s->src.height) / texture.height;
+
+  uvs[0] = (Vector2){ u0, v0 };
+  uvs[1] = (Vector2){ u0, v1 };
+  uvs[2] = (Vector2){ u1, v1 };
+  uvs[3] = (Vector2){ u1, v0 };
+}
+
+static bool check_batch(const struct spr_Batch *batch,
+                        struct Sprite *sprites, uint32_t count,
+                        const Texture2D *textures) {
+  for (uint32_t i = 0; i < count; i++) {
+    sprites[i].index = i;
+  }
+  qsort(sprites, count, sizeof(*sprites), compare_sprites);
+
+  for (uint32_t q = 0; q < count; q++) {
+    Vector2 corners[4], uvs[4];
+    reference_quad(&sprites[q], textures[sprites[q].texture], corners, uvs);
+
+    for (uint32_t k = 0; k < 4; k++) {
+      uint32_t v = q * 4 + k;
+
+      if (fabsf(batch->x[v] - corners[k].x) > TOLERANCE ||
+          fabsf(batch->y[v] - corners[k].y) > TOLERANCE ||
+          batch->u[v] != uvs[k].x || batch->v[v] != uvs[k].y ||
+          memcmp(&batch->colors[v], &sprites[q].tint, sizeof(Color)) != 0) {
+        fprintf(stderr, "[ERROR]: quad %u corner %u differs\n", q, k);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 &&
+      (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+    printf("usage: %s [sprites] [frames]\n", argv[0]);
+    return 0;
+  }
+
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_SPRITES;
+  uint32_t frames = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FRAMES;
+
+  if (count == 0 || frames == 0) {
+    fprintf(stderr, "[ERROR]: arguments must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  // Only the ids and sizes matter without a GPU
+  Texture2D textures[TEXTURES];
+  for (uint32_t t = 0; t < TEXTURES; t++) {
+    textures[t] = (Texture2D){
+      .id = t + 1,
+      .width = 64 << (t % 3),
+      .height = 64 << (t % 2),
+    };
+    first_use[t] = UINT32_MAX;
+  }
+
+  struct Sprite *sprites = malloc(count * sizeof(*sprites));
+  if (sprites == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  uint32_t switches = 0, textures_used = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t texture = rng_next(&rng) % TEXTURES;
+
+    sprites[i] = (struct Sprite){
+      .texture = texture,
+      .src = { 16.0f * (rng_next(&rng) % 4), 16.0f * (rng_next(&rng) % 4),
+               16.0f, 16.0f },
+      .dest = { randf(&rng) * 1920.0f, randf(&rng) * 1080.0f,
+                8.0f + randf(&rng) * 24.0f, 8.0f + randf(&rng) * 24.0f },
+      .origin = { randf(&rng) * 8.0f, randf(&rng) * 8.0f },
+      .rotation = i % 4 == 0 ? randf(&rng) * 360.0f : 0.0f,
+      .tint = { (unsigned char)i, (unsigned char)(i >> 8), 255, 255 },
+      .layer = (int16_t)(rng_next(&rng) % LAYERS) - 1,
+    };
+
+    if (first_use[texture] == UINT32_MAX) {
+      first_use[texture] = textures_used++;
+    }
+
+    switches += i == 0 || sprites[i - 1].texture != texture;
+  }
+
+  struct spr_Batch batch;
+  spr_batch_init(&batch, count);
+
+  uint64_t add_ns = 0, build_ns = 0;
+
+  for (uint32_t f = 0; f < frames; f++) {
+    spr_batch_clear(&batch);
+
+    uint64_t t0 = clk_now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+      const struct Sprite *s = &sprites[i];
+      spr_batch_add(&batch, textures[s->texture], s->src, s->dest, s->origin,
+                    s->rotation, s->tint, s->layer);
+    }
+    uint64_t t1 = clk_now_ns();
+    spr_batch_build(&batch);
+    uint64_t t2 = clk_now_ns();
+
+    add_ns += t1 - t0;
+    build_ns += t2 - t1;
+  }
+
+  printf("%u sprites, %u textures, %u layers\n", count, TEXTURES, LAYERS);
+  printf("draw calls: %llu batched, %u in submission order\n",
+         (unsigned long long)batch.runs.count, switches);
+  printf("add:   %8.3f ms/frame\n", clk_ns_to_ms(add_ns) / frames);
+  printf("build: %8.3f ms/frame, %.1f ns/sprite\n",
+         clk_ns_to_ms(build_ns) / frames,
+         (double)build_ns / frames / count);
+
+  bool ok = check_batch(&batch, sprites, count, textures);
+
+  spr_batch_free(&batch);
+  free(sprites);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
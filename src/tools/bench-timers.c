@@ -0,0 +1,162 @@
+#include "plugin/timer-wheel.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_TIMERS 1000000
+#define DEFAULT_MAX_DELAY (1u << 20)
+
+// Share of the timers cancelled before any fire
+#define CANCEL_PERCENT 10
+
+// Ticks the baseline scans a list for
+#define SCAN_TICKS 256
+
+#define CANCELLED UINT64_MAX
+
+static uint64_t rng = 0x853c49e6748fea9bull;
+
+static uint64_t next_random(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+
+  return rng;
+}
+
+// The baseline: every tick looks at every pending timer, and drops the ones
+// that are due
+static uint64_t scan_tick(uint64_t *due, uint32_t *count, uint64_t tick) {
+  uint64_t fired = 0;
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < *count; i++) {
+    if (due[i] == tick) {
+      fired++;
+    } else {
+      due[kept++] = due[i];
+    }
+  }
+
+  *count = kept;
+  return fired;
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_TIMERS;
+  uint32_t max_delay =
+    argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MAX_DELAY;
+
+  if (count == 0 || max_delay == 0) {
+    printf("usage: %s [timers] [max delay in ticks]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // When every timer is due, by the id it fires with
+  uint64_t *expected = malloc(count * sizeof(*expected));
+  tw_Handle *handles = malloc(count * sizeof(*handles));
+  uint64_t *scan = malloc(count * sizeof(*scan));
+
+  if (expected == NULL || handles == NULL || scan == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    return EXIT_FAILURE;
+  }
+
+  struct tw_Wheel wheel;
+  tw_init(&wheel, count, 0);
+
+  uint64_t start = clk_now_ns();
+  for (uint32_t i = 0; i < count; i++) {
+    expected[i] = 1 + next_random() % max_delay;
+    handles[i] = tw_schedule(&wheel, expected[i],
+                             (struct tw_Event){ 0, i });
+  }
+  uint64_t schedule_ns = clk_now_ns() - start;
+
+  for (uint32_t i = 0; i < count; i++) {
+    scan[i] = expected[i];
+  }
+
+  uint32_t cancels = (uint32_t)((uint64_t)count * CANCEL_PERCENT / 100);
+  start = clk_now_ns();
+  for (uint32_t k = 0; k < cancels; k++) {
+    uint32_t i = (uint32_t)(next_random() % count);
+
+    if (tw_cancel(&wheel, handles[i])) {
+      expected[i] = CANCELLED;
+    }
+  }
+  uint64_t cancel_ns = clk_now_ns() - start;
+  uint32_t pending = wheel.count;
+
+  // The same ticks with a list, cancels left in, which only makes it
+  // cheaper
+  uint32_t scan_count = count;
+  start = clk_now_ns();
+  for (uint64_t tick = 1; tick <= SCAN_TICKS; tick++) {
+    scan_tick(scan, &scan_count, tick);
+  }
+  uint64_t scan_ns = clk_now_ns() - start;
+
+  uint64_t advance_ns = 0, max_tick_ns = 0, first_ns = 0, fired = 0;
+  uint64_t ticks = 0;
+  bool ok = true;
+
+  while (wheel.count > 0 && ok) {
+    uint64_t tick = wheel.now + 1;
+
+    start = clk_now_ns();
+    uint32_t n = tw_advance(&wheel, tick);
+    uint64_t ns = clk_now_ns() - start;
+
+    advance_ns += ns;
+    max_tick_ns = ns > max_tick_ns ? ns : max_tick_ns;
+    first_ns += ticks < SCAN_TICKS ? ns : 0;
+    ticks++;
+
+    for (uint32_t k = 0; k < n; k++) {
+      const struct tw_Fired *timer = &wheel.fired.items[k];
+      uint32_t id = timer->event.data;
+
+      if (expected[id] != tick ||
+          (k > 0 && timer->order <= wheel.fired.items[k - 1].order)) {
+        fprintf(stderr, "[ERROR]: Timer %u fired on tick %llu out of order\n",
+                id, (unsigned long long)tick);
+        ok = false;
+        break;
+      }
+
+      expected[id] = CANCELLED;
+      fired++;
+    }
+  }
+
+  if (ok && fired != pending) {
+    fprintf(stderr, "[ERROR]: %llu of %u timers fired\n",
+            (unsigned long long)fired, pending);
+    ok = false;
+  }
+
+  printf("%u timers due in up to %u ticks, %u cancelled\n", count, max_delay,
+         count - pending);
+  printf("schedule:        %8.1f ns/timer\n", (double)schedule_ns / count);
+  printf("cancel:          %8.1f ns/timer\n", (double)cancel_ns / cancels);
+  printf("wheel, first %u: %8.3f us/tick\n", SCAN_TICKS,
+         (double)first_ns * 1e-3 / SCAN_TICKS);
+  printf("list,  first %u: %8.3f us/tick\n", SCAN_TICKS,
+         (double)scan_ns * 1e-3 / SCAN_TICKS);
+  printf("wheel, all %llu:  %8.3f us/tick, %.3f us max, %.1f ns/timer\n",
+         (unsigned long long)ticks, (double)advance_ns * 1e-3 / ticks,
+         (double)max_tick_ns * 1e-3, (double)advance_ns / fired);
+  printf("every timer fired once, on its tick and in order: %s\n",
+         ok ? "yes" : "NO");
+
+  tw_free(&wheel);
+  free(expected);
+  free(handles);
+  free(scan);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
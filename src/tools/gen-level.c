@@ -0,0 +1,126 @@
+#include "plugin/plugin.h"
+#include "plugin/level.h"
+#include "plugin/level-gen.h"
+
+#include "util/clock.h"
+#include "util/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] <width>x<height>\n"
+          "\n"
+          "  -s N    seed (default: 0)\n"
+          "  -c N    cell size in pixels (default: %u)\n"
+          "  -t N    worker threads (default: number of cores)\n"
+          "  -o PATH write the level to PATH\n"
+          "  -v      generate again on one thread and check the levels match\n",
+          name, DEFAULT_LEVEL_CELL_SIZE);
+}
+
+// FNV-1a of the grid, to compare levels across runs
+static uint64_t grid_hash(const struct plug_Level *level) {
+  uint64_t cells = (uint64_t)level->grid_width * level->grid_height;
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (uint64_t i = 0; i < cells; i++) {
+    hash = (hash ^ level->grid[i]) * 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+int main(int argc, char **argv) {
+  struct gen_Options options = { .cell_size = DEFAULT_LEVEL_CELL_SIZE };
+
+  uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  const char *path = NULL;
+  bool verify = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:t:o:vh")) != -1) {
+    switch (opt) {
+    case 's':
+      options.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'c':
+      options.cell_size = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      path = optarg;
+      break;
+    case 'v':
+      verify = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (optind >= argc ||
+      sscanf(argv[optind], "%ux%u", &options.width, &options.height) != 2 ||
+      threads == 0) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  options.pool = threads > 1 ? tp_create_pool(threads) : NULL;
+
+  struct plug_Level level;
+
+  uint64_t start = clk_now_ns();
+  if (!gen_level(&level, &options)) {
+    fprintf(stderr, "[ERROR]: Levels are at least %ux%u cells\n",
+            GEN_MIN_WIDTH, GEN_MIN_HEIGHT);
+    return EXIT_FAILURE;
+  }
+  double seconds = clk_ns_to_s(clk_now_ns() - start);
+
+  uint64_t cells = (uint64_t)options.width * options.height;
+  struct gen_Limits limits = gen_limits(options.cell_size);
+
+  printf("level: %ux%u cells, seed %llu\n", options.width, options.height,
+         (unsigned long long)options.seed);
+  printf("jumps: %u up, %u down, %u across\n", limits.max_rise,
+         limits.max_drop, limits.max_gap);
+  printf("generated in %.3fs on %u threads, %.1f M cells/s\n", seconds,
+         threads, (double)cells / seconds * 1e-6);
+  printf("hash: %016llx\n", (unsigned long long)grid_hash(&level));
+
+  bool ok = true;
+
+  if (verify) {
+    struct gen_Options serial = options;
+    serial.pool = NULL;
+
+    struct plug_Level check;
+    start = clk_now_ns();
+    gen_level(&check, &serial);
+    seconds = clk_ns_to_s(clk_now_ns() - start);
+
+    ok = memcmp(level.grid, check.grid, cells * sizeof(*level.grid)) == 0;
+    printf("one thread: %.3fs, %s\n", seconds,
+           ok ? "same level" : "DIFFERENT level");
+
+    free(check.grid);
+  }
+
+  if (path != NULL) {
+    start = clk_now_ns();
+    ok &= level_write(path, &level);
+    printf("wrote %s in %.3fs\n", path, clk_ns_to_s(clk_now_ns() - start));
+  }
+
+  free(level.grid);
+  tp_free_pool(options.pool);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
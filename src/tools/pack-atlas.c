@@ -0,0 +1,92 @@
+#include "plugin/atlas-pack.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] [assets dir] [cache dir]\n"
+          "\n"
+          "  -f      decode and pack again even if the cache is up to date\n"
+          "  -l      list every sprite and its texture coordinates\n"
+          "  -s N    page size in pixels (default: %u)\n"
+          "\n"
+          "The directories default to %s and %s.\n",
+          name, PACK_PAGE_SIZE, ASSETS_DIR, ASSETS_CACHE_DIR);
+}
+
+int main(int argc, char **argv) {
+  bool force = false, list = false;
+  uint32_t page_size = PACK_PAGE_SIZE;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fls:h")) != -1) {
+    switch (opt) {
+    case 'f':
+      force = true;
+      break;
+    case 'l':
+      list = true;
+      break;
+    case 's':
+      page_size = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  const char *assets_dir = optind < argc ? argv[optind] : ASSETS_DIR;
+  const char *cache_dir = optind + 1 < argc ? argv[optind + 1]
+                                            : ASSETS_CACHE_DIR;
+
+  if (page_size == 0) {
+    fprintf(stderr, "[ERROR]: page size must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  struct pack_Atlas atlas;
+  bool repacked = true, ok;
+
+  uint64_t start = clk_now_ns();
+  if (force) {
+    ok = pack_atlas_build(assets_dir, page_size, NULL, &atlas) &&
+         pack_atlas_save(&atlas, cache_dir);
+  } else {
+    ok = pack_atlas_load(assets_dir, cache_dir, page_size, &atlas, &repacked);
+  }
+  uint64_t elapsed = clk_now_ns() - start;
+
+  if (!ok) {
+    fprintf(stderr, "[ERROR]: Failed to pack %s\n", assets_dir);
+    pack_atlas_free(&atlas);
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %llu sprites from %llu images on %llu pages of %u px\n",
+         repacked ? "packed" : "cached",
+         (unsigned long long)atlas.entries.count,
+         (unsigned long long)atlas.sources.count,
+         (unsigned long long)atlas.pages.count, page_size);
+  printf("%.3f ms\n", clk_ns_to_ms(elapsed));
+
+  if (list) {
+    for (uint32_t i = 0; i < atlas.entries.count; i++) {
+      const struct pack_Entry *entry = &atlas.entries.items[i];
+      Rectangle uv = pack_entry_uv(&atlas, entry);
+
+      printf("%-40s page %u  %4u,%4u %3ux%-3u  uv %.6f %.6f %.6f %.6f\n",
+             entry->name, entry->page, entry->x, entry->y, entry->width,
+             entry->height, uv.x, uv.y, uv.width, uv.height);
+    }
+  }
+
+  pack_atlas_free(&atlas);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include "plugin/plugin.h"
+#include "plugin/level.h"
+#include "plugin/reachability.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+#include "util/thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_DT (1.0f / 60.0f)
+
+// Longest map that is still printed to stdout without -o
+#define MAX_PRINTED_WIDTH 200
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] <level file>\n"
+          "       %s [options] -s <width>x<height>\n"
+          "\n"
+          "  -s WxH  analyse a generated test level instead of a file\n"
+          "  -t N    worker threads (default: number of cores)\n"
+          "  -f N    frames each input is held for (default: %u)\n"
+          "  -p Q    position quantum in pixels (default: %.1f)\n"
+          "  -v Q    velocity quantum (default: %.1f)\n"
+          "  -m N    maximum number of states (default: %llu)\n"
+          "  -o PATH write the reachability map to PATH\n",
+          name, name, REACH_DEFAULT_FRAMES_PER_ACTION,
+          REACH_DEFAULT_POS_QUANTUM, REACH_DEFAULT_VEL_QUANTUM,
+          (unsigned long long)REACH_DEFAULT_MAX_STATES);
+}
+
+// Flat ground with a gap every few cells, a step every so often and the
+// finish at the far right.
+static void make_test_level(struct plug_State *state, uint32_t width,
+                            uint32_t height) {
+  import_level(NULL, state);
+  struct plug_Level *level = &DA_AT(state->levels, state->levels.count - 1);
+
+  level->grid_width = width;
+  level->grid_height = height;
+  level->grid = calloc((size_t)width * height, sizeof(*level->grid));
+  level->owns_grid = true;
+  if (level->grid == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t ground = height - 3;
+  for (uint32_t x = 0; x < width; x++) {
+    bool gap = x > 4 && x % 11 == 0 && x + 2 < width;
+    uint32_t top = (x / 23) % 2 == 0 ? ground : ground - 1;
+
+    for (uint32_t y = top; y < height && !gap; y++) {
+      level->grid[y * width + x] = CELL_TYPE_FLOOR;
+    }
+
+    if (x + 1 == width) {
+      level->grid[(top - 1) * width + x] = CELL_TYPE_FINISH;
+    }
+  }
+
+  level->spawn.x = 0.0f;
+  level->spawn.y = (ground - 1.0f) * level->cell_size;
+}
+
+static void print_inputs(const struct reach_Result *result) {
+  printf("inputs (%llu steps):", (unsigned long long)result->inputs.count);
+
+  for (uint64_t i = 0; i < result->inputs.count;) {
+    uint8_t input = result->inputs.items[i];
+    uint64_t run = 1;
+    while (i + run < result->inputs.count &&
+           result->inputs.items[i + run] == input) {
+      run++;
+    }
+
+    printf(" %s%s%s%s*%llu", input == 0 ? "-" : "",
+           input & INPUT_LEFT ? "L" : "", input & INPUT_RIGHT ? "R" : "",
+           input & INPUT_JUMP ? "J" : "", (unsigned long long)run);
+    i += run;
+  }
+
+  printf("\n");
+}
+
+static void write_map(FILE *f, const struct plug_Level *level,
+                      const uint8_t *reachable) {
+  for (uint32_t y = 0; y < level->grid_height; y++) {
+    for (uint32_t x = 0; x < level->grid_width; x++) {
+      uint64_t i = (uint64_t)y * level->grid_width + x;
+
+      char c = reachable[i] ? '.' : ' ';
+      if (level->grid[i] == CELL_TYPE_FINISH) {
+        c = reachable[i] ? 'F' : 'f';
+      } else if (level->grid[i] != CELL_TYPE_NONE) {
+        c = reachable[i] ? '#' : '=';
+      }
+
+      fputc(c, f);
+    }
+
+    fputc('\n', f);
+  }
+}
+
+int main(int argc, char **argv) {
+  struct reach_Options options = {
+    .frames_per_action = REACH_DEFAULT_FRAMES_PER_ACTION,
+    .dt = SIM_DT,
+    .pos_quantum = REACH_DEFAULT_POS_QUANTUM,
+    .vel_quantum = REACH_DEFAULT_VEL_QUANTUM,
+    .max_states = REACH_DEFAULT_MAX_STATES,
+    .pool = NULL,
+  };
+
+  uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t test_width = 0, test_height = 0;
+  const char *map_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:f:p:v:m:o:h")) != -1) {
+    switch (opt) {
+    case 's':
+      if (sscanf(optarg, "%ux%u", &test_width, &test_height) != 2 ||
+          test_width < 2 || test_height < 4) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      options.frames_per_action = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      options.pos_quantum = strtof(optarg, NULL);
+      break;
+    case 'v':
+      options.vel_quantum = strtof(optarg, NULL);
+      break;
+    case 'm':
+      options.max_states = strtoull(optarg, NULL, 10);
+      break;
+    case 'o':
+      map_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if (options.frames_per_action == 0 || options.frames_per_action > 256 ||
+      options.pos_quantum <= 0.0f || options.vel_quantum <= 0.0f ||
+      options.max_states == 0 || options.max_states >= UINT32_MAX) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct plug_State state = { .current_level = -1 };
+
+  if (test_width != 0) {
+    make_test_level(&state, test_width, test_height);
+
+  } else if (optind < argc) {
+    if (!import_level(argv[optind], &state)) {
+      return EXIT_FAILURE;
+    }
+
+  } else {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const struct plug_Level *level = &DA_AT(state.levels, 0);
+
+  options.pool = threads > 1 ? tp_create_pool(threads) : NULL;
+
+  uint64_t start = clk_now_ns();
+  struct reach_Result result =
+    reach_analyse(level, level->spawn, player_hitbox(), &options);
+  double seconds = clk_ns_to_s(clk_now_ns() - start);
+
+  tp_free_pool(options.pool);
+
+  printf("level: %ux%u cells\n", level->grid_width, level->grid_height);
+  printf("finish reachable: %s%s\n", result.finish_reached ? "yes" : "no",
+         result.state_limit_hit ? " (state limit hit, search incomplete)"
+                                : "");
+  printf("states: %llu, depth: %u, time: %.3fs (%u threads)\n",
+         (unsigned long long)result.states_visited, result.depth, seconds,
+         threads);
+
+  if (result.finish_reached) {
+    print_inputs(&result);
+  }
+
+  if (map_path != NULL) {
+    FILE *f = fopen(map_path, "w");
+    if (f == NULL) {
+      fprintf(stderr, "[ERROR]: Failed to open file %s: ", map_path);
+      perror(NULL);
+    } else {
+      write_map(f, level, result.reachable);
+      fclose(f);
+    }
+
+  } else if (level->grid_width <= MAX_PRINTED_WIDTH) {
+    write_map(stdout, level, result.reachable);
+  }
+
+  bool finish_reached = result.finish_reached;
+
+  reach_free_result(&result);
+  unload_levels(&state);
+
+  return finish_reached ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+#include "plugin/plugin.h"
+#include "plugin/level.h"
+#include "plugin/pipeline.h"
+#include "plugin/replay.h"
+#include "plugin/update-player.h"
+
+#include "util/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_RUNS 10
+
+// Loads the level the way the game does, with the player at its spawn,
+// and the same history and timers
+static void setup(struct plug_State *state) {
+  *state = (struct plug_State){ .current_level = -1 };
+
+  if (!FileExists(LEVEL_FILE) || !import_level(LEVEL_FILE, state)) {
+    import_level(NULL, state);
+  }
+  state->current_level = 0;
+
+  init_player(state, DA_AT(state->levels, 0).spawn);
+
+  tw_init(&state->timers, SIM_TIMER_CAPACITY, 0);
+  snap_init(&state->history);
+  snap_prepare(&state->history, state);
+  snap_capture(&state->history, state, state->sim_step);
+}
+
+static void teardown(struct plug_State *state) {
+  snap_free(&state->history);
+  tw_free(&state->timers);
+  ent_store_free(&state->actors);
+  unload_levels(state);
+}
+
+// Steps through a session the game recorded with RECORD_KEY, without a
+// window, and times the steps. Run from the root of the repo, so the level
+// is the one the game loads. The release build trains its profile on it.
+int main(int argc, char **argv) {
+  uint32_t runs = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_RUNS;
+
+  if (argc < 2 || runs == 0) {
+    printf("usage: %s <session.replay> [runs]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  uint8_t *inputs;
+  uint32_t steps;
+  if (!replay_read(argv[1], &inputs, &steps)) {
+    return EXIT_FAILURE;
+  }
+
+  if (steps == 0) {
+    fprintf(stderr, "[ERROR]: %s has no steps\n", argv[1]);
+    free(inputs);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t best_ns = UINT64_MAX, total_ns = 0;
+  Vector2 end = { 0 };
+
+  for (uint32_t r = 0; r < runs; r++) {
+    struct plug_State state;
+    setup(&state);
+
+    uint64_t start = clk_now_ns();
+    for (uint32_t i = 0; i < steps; i++) {
+      snap_prepare(&state.history, &state);
+      pipe_run(&state, inputs[i], 1);
+    }
+    uint64_t ns = clk_now_ns() - start;
+
+    best_ns = ns < best_ns ? ns : best_ns;
+    total_ns += ns;
+
+    end = ent_pos(&state.actors, state.player.actor);
+    teardown(&state);
+  }
+
+  printf("%s: %u steps, %u runs\n", argv[1], steps, runs);
+  printf("step: %8.3f us average, %8.3f us best run\n",
+         (double)total_ns * 1e-3 / ((double)runs * steps),
+         (double)best_ns * 1e-3 / steps);
+  printf("player ends at %.3f, %.3f\n", end.x, end.y);
+
+  free(inputs);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,454 @@
+#ifndef UTIL_ALLOC_H
+#define UTIL_ALLOC_H
+
+// What the util containers allocate with. Define UTIL_MALLOC, UTIL_CALLOC,
+// UTIL_REALLOC and UTIL_FREE before including any util header to plug in
+// another allocator.
+//
+// Built with -DALLOC_TRACK (make ALLOC_TRACK=1) they go through a tracking
+// allocator instead, which counts bytes, calls and peak usage per call
+// site, and ALLOC_FORBID("what") aborts on any of them for the rest of its
+// scope:
+//
+//   void update(void) {
+//     ALLOC_FORBID("update");
+//     ...
+//   }
+//
+// Only what goes through these is seen. raylib and plain malloc are not.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef ALLOC_TRACK
+
+#define UTIL_MALLOC(size) alloc_track_malloc((size), __FILE__, __LINE__)
+#define UTIL_CALLOC(count, size) \
+  alloc_track_calloc((count), (size), __FILE__, __LINE__)
+#define UTIL_REALLOC(ptr, size) \
+  alloc_track_realloc((ptr), (size), __FILE__, __LINE__)
+#define UTIL_FREE(ptr) alloc_track_free((ptr))
+
+// Call sites tracked, the rest are counted together
+#define ALLOC_MAX_SITES 1024
+
+struct alloc_Site {
+  const char *file;
+  int line;
+
+  uint64_t allocs, frees;
+
+  // Requested over every call
+  uint64_t bytes;
+
+  // Still allocated, and the most that ever was at once
+  uint64_t live, peak;
+};
+
+struct alloc_Totals {
+  uint64_t allocs, frees;
+  uint64_t bytes;
+  uint64_t live, peak;
+};
+
+void *alloc_track_malloc(size_t size, const char *file, int line);
+void *alloc_track_calloc(size_t count, size_t size, const char *file,
+                         int line);
+void *alloc_track_realloc(void *ptr, size_t size, const char *file,
+                          int line);
+
+// Pointers the tracker did not hand out, from another plugin or plain
+// malloc, are freed without being counted.
+void alloc_track_free(void *ptr);
+
+struct alloc_Totals alloc_track_totals(void);
+
+// Copies up to max call sites to sites, most bytes first. Returns how many
+// were copied.
+uint32_t alloc_track_sites(struct alloc_Site *sites, uint32_t max);
+
+// Prints the totals and the top call sites.
+void alloc_track_report(FILE *f);
+
+struct alloc_Forbid {
+  bool armed;
+  const char *what;
+  const char *file;
+  int line;
+};
+
+struct alloc_Forbid alloc_forbid_begin(bool armed, const char *what,
+                                       const char *file, int line);
+void alloc_forbid_end(struct alloc_Forbid *forbid);
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+
+// Until the end of the scope, if armed, any tracked allocation on this
+// thread prints its call site and aborts.
+#define ALLOC_FORBID_IF(armed, what)                                   \
+  struct alloc_Forbid ALLOC_CONCAT(alloc_forbid_, __LINE__)            \
+    __attribute__((cleanup(alloc_forbid_end))) =                       \
+      alloc_forbid_begin((armed), (what), __FILE__, __LINE__)
+
+#define ALLOC_FORBID(what) ALLOC_FORBID_IF(true, what)
+
+//#define UTIL_ALLOC_IMPLEMENTATION
+#ifdef UTIL_ALLOC_IMPLEMENTATION
+
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+
+// The tracker's own memory is plain malloc
+
+struct alloc_Block {
+  void *ptr;
+  size_t size;
+  uint32_t site;
+};
+
+static pthread_mutex_t alloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Open addressing, linear probing. ptr == NULL is empty.
+static struct alloc_Block *alloc_blocks = NULL;
+static uint64_t alloc_block_count = 0;
+static uint64_t alloc_block_capacity = 0;
+
+// The last one is every call site past the others
+static struct alloc_Site alloc_sites[ALLOC_MAX_SITES + 1];
+static uint32_t alloc_site_count = 0;
+
+static struct alloc_Totals alloc_totals = { 0 };
+
+// The outermost armed ALLOC_FORBID this thread is in, if depth > 0
+static _Thread_local struct alloc_Forbid alloc_forbidden;
+static _Thread_local uint32_t alloc_forbid_depth = 0;
+
+static uint64_t alloc_hash(const void *ptr) {
+  uint64_t x = (uint64_t)(uintptr_t)ptr;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+
+  return x;
+}
+
+static uint32_t alloc_find_site(const char *file, int line) {
+  for (uint32_t i = 0; i < alloc_site_count; i++) {
+    const struct alloc_Site *site = &alloc_sites[i];
+
+    if (site->line == line &&
+        (site->file == file || strcmp(site->file, file) == 0)) {
+      return i;
+    }
+  }
+
+  if (alloc_site_count == ALLOC_MAX_SITES) {
+    alloc_sites[ALLOC_MAX_SITES].file = "(other)";
+    return ALLOC_MAX_SITES;
+  }
+
+  alloc_sites[alloc_site_count] = (struct alloc_Site){
+    .file = file,
+    .line = line,
+  };
+
+  return alloc_site_count++;
+}
+
+static void alloc_insert_block(struct alloc_Block block);
+
+static void alloc_grow_blocks(void) {
+  struct alloc_Block *old = alloc_blocks;
+  uint64_t old_capacity = alloc_block_capacity;
+
+  alloc_block_capacity = old_capacity == 0 ? 1024 : old_capacity * 2;
+  alloc_blocks = calloc(alloc_block_capacity, sizeof(*alloc_blocks));
+  assert(alloc_blocks != NULL && "Failed to allocate memory");
+  alloc_block_count = 0;
+
+  for (uint64_t i = 0; i < old_capacity; i++) {
+    if (old[i].ptr != NULL) {
+      alloc_insert_block(old[i]);
+    }
+  }
+
+  free(old);
+}
+
+static void alloc_insert_block(struct alloc_Block block) {
+  if ((alloc_block_count + 1) * 2 > alloc_block_capacity) {
+    alloc_grow_blocks();
+  }
+
+  uint64_t mask = alloc_block_capacity - 1;
+  uint64_t i = alloc_hash(block.ptr) & mask;
+
+  while (alloc_blocks[i].ptr != NULL) {
+    i = (i + 1) & mask;
+  }
+
+  alloc_blocks[i] = block;
+  alloc_block_count++;
+}
+
+// Removes the block of ptr into out. Returns false if ptr is not tracked.
+static bool alloc_remove_block(const void *ptr, struct alloc_Block *out) {
+  if (alloc_block_capacity == 0) {
+    return false;
+  }
+
+  uint64_t mask = alloc_block_capacity - 1;
+  uint64_t i = alloc_hash(ptr) & mask;
+
+  while (alloc_blocks[i].ptr != ptr) {
+    if (alloc_blocks[i].ptr == NULL) {
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+
+  *out = alloc_blocks[i];
+  alloc_blocks[i].ptr = NULL;
+  alloc_block_count--;
+
+  // Moves back whatever probed past the hole
+  for (uint64_t j = (i + 1) & mask; alloc_blocks[j].ptr != NULL;
+       j = (j + 1) & mask) {
+    uint64_t home = alloc_hash(alloc_blocks[j].ptr) & mask;
+
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      alloc_blocks[i] = alloc_blocks[j];
+      alloc_blocks[j].ptr = NULL;
+      i = j;
+    }
+  }
+
+  return true;
+}
+
+static void alloc_check_forbidden(size_t size, const char *file, int line) {
+  if (alloc_forbid_depth == 0) {
+    return;
+  }
+
+  fprintf(stderr,
+          "[ERROR]: %s:%d allocated %zu bytes inside %s, which must not "
+          "allocate (%s:%d)\n",
+          file, line, size, alloc_forbidden.what, alloc_forbidden.file,
+          alloc_forbidden.line);
+  abort();
+}
+
+// Counts ptr, of size bytes, as allocated at file:line. alloc_mutex must be
+// held.
+static void alloc_count(void *ptr, size_t size, const char *file, int line) {
+  struct alloc_Site *site = &alloc_sites[alloc_find_site(file, line)];
+
+  alloc_insert_block((struct alloc_Block){
+    .ptr = ptr,
+    .size = size,
+    .site = (uint32_t)(site - alloc_sites),
+  });
+
+  site->allocs++;
+  site->bytes += size;
+  site->live += size;
+  site->peak = site->live > site->peak ? site->live : site->peak;
+
+  alloc_totals.allocs++;
+  alloc_totals.bytes += size;
+  alloc_totals.live += size;
+  alloc_totals.peak =
+    alloc_totals.live > alloc_totals.peak ? alloc_totals.live
+                                          : alloc_totals.peak;
+}
+
+// Forgets ptr, before it is freed, so no other thread can be handed the
+// same address while it is still counted. alloc_mutex must be held.
+static void alloc_uncount(void *ptr) {
+  struct alloc_Block block;
+  if (!alloc_remove_block(ptr, &block)) {
+    return;
+  }
+
+  alloc_sites[block.site].frees++;
+  alloc_sites[block.site].live -= block.size;
+
+  alloc_totals.frees++;
+  alloc_totals.live -= block.size;
+}
+
+void *alloc_track_malloc(size_t size, const char *file, int line) {
+  return alloc_track_realloc(NULL, size, file, line);
+}
+
+void *alloc_track_calloc(size_t count, size_t size, const char *file,
+                         int line) {
+  alloc_check_forbidden(count * size, file, line);
+
+  void *ptr = calloc(count, size);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&alloc_mutex);
+  alloc_count(ptr, count * size, file, line);
+  pthread_mutex_unlock(&alloc_mutex);
+
+  return ptr;
+}
+
+void *alloc_track_realloc(void *ptr, size_t size, const char *file,
+                          int line) {
+  alloc_check_forbidden(size, file, line);
+
+  if (ptr != NULL) {
+    pthread_mutex_lock(&alloc_mutex);
+    alloc_uncount(ptr);
+    pthread_mutex_unlock(&alloc_mutex);
+  }
+
+  // On failure ptr is left as it was, but no longer counted
+  void *next = realloc(ptr, size);
+
+  if (next != NULL) {
+    pthread_mutex_lock(&alloc_mutex);
+    alloc_count(next, size, file, line);
+    pthread_mutex_unlock(&alloc_mutex);
+  }
+
+  return next;
+}
+
+void alloc_track_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&alloc_mutex);
+  alloc_uncount(ptr);
+  pthread_mutex_unlock(&alloc_mutex);
+
+  free(ptr);
+}
+
+struct alloc_Totals alloc_track_totals(void) {
+  pthread_mutex_lock(&alloc_mutex);
+  struct alloc_Totals totals = alloc_totals;
+  pthread_mutex_unlock(&alloc_mutex);
+
+  return totals;
+}
+
+static int alloc_compare_bytes(const void *a, const void *b) {
+  uint64_t x = ((const struct alloc_Site *)a)->bytes;
+  uint64_t y = ((const struct alloc_Site *)b)->bytes;
+
+  return (x < y) - (x > y);
+}
+
+uint32_t alloc_track_sites(struct alloc_Site *sites, uint32_t max) {
+  struct alloc_Site *all = malloc(sizeof(alloc_sites));
+  assert(all != NULL && "Failed to allocate memory");
+
+  pthread_mutex_lock(&alloc_mutex);
+  uint32_t count = alloc_site_count;
+  memcpy(all, alloc_sites, sizeof(alloc_sites));
+  pthread_mutex_unlock(&alloc_mutex);
+
+  if (all[ALLOC_MAX_SITES].allocs > 0) {
+    all[count++] = all[ALLOC_MAX_SITES];
+  }
+
+  qsort(all, count, sizeof(*all), alloc_compare_bytes);
+
+  count = count < max ? count : max;
+  memcpy(sites, all, count * sizeof(*sites));
+  free(all);
+
+  return count;
+}
+
+void alloc_track_report(FILE *f) {
+  struct alloc_Totals totals = alloc_track_totals();
+
+  fprintf(f,
+          "%llu allocations, %llu frees, %.2f MB requested, %.2f MB live, "
+          "%.2f MB peak\n",
+          (unsigned long long)totals.allocs, (unsigned long long)totals.frees,
+          (double)totals.bytes / (1024.0 * 1024.0),
+          (double)totals.live / (1024.0 * 1024.0),
+          (double)totals.peak / (1024.0 * 1024.0));
+
+  struct alloc_Site sites[16];
+  uint32_t count = alloc_track_sites(sites, 16);
+
+  fprintf(f, "  %10s %8s %12s %12s %12s  %s\n", "allocs", "frees", "bytes",
+          "live", "peak", "site");
+  for (uint32_t i = 0; i < count; i++) {
+    fprintf(f, "  %10llu %8llu %12llu %12llu %12llu  %s:%d\n",
+            (unsigned long long)sites[i].allocs,
+            (unsigned long long)sites[i].frees,
+            (unsigned long long)sites[i].bytes,
+            (unsigned long long)sites[i].live,
+            (unsigned long long)sites[i].peak, sites[i].file, sites[i].line);
+  }
+}
+
+struct alloc_Forbid alloc_forbid_begin(bool armed, const char *what,
+                                       const char *file, int line) {
+  struct alloc_Forbid forbid = {
+    .armed = armed,
+    .what = what,
+    .file = file,
+    .line = line,
+  };
+
+  if (armed && alloc_forbid_depth++ == 0) {
+    alloc_forbidden = forbid;
+  }
+
+  return forbid;
+}
+
+void alloc_forbid_end(struct alloc_Forbid *forbid) {
+  if (forbid->armed) {
+    alloc_forbid_depth--;
+  }
+}
+
+#endif // UTIL_ALLOC_IMPLEMENTATION
+
+#else
+
+#ifndef UTIL_MALLOC
+#define UTIL_MALLOC(size) malloc(size)
+#endif
+
+#ifndef UTIL_CALLOC
+#define UTIL_CALLOC(count, size) calloc((count), (size))
+#endif
+
+#ifndef UTIL_REALLOC
+#define UTIL_REALLOC(ptr, size) realloc((ptr), (size))
+#endif
+
+#ifndef UTIL_FREE
+#define UTIL_FREE(ptr) free(ptr)
+#endif
+
+#define ALLOC_FORBID_IF(armed, what) \
+  do {                               \
+  } while (0)
+#define ALLOC_FORBID(what) \
+  do {                     \
+  } while (0)
+
+#endif // ALLOC_TRACK
+
+#endif // UTIL_ALLOC_H
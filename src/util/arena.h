@@ -1,6 +1,8 @@
 #ifndef UTIL_ARENA_H
 #define UTIL_ARENA_H
 
+#include "alloc.h"
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -33,7 +35,7 @@ void arena_resize(struct Arena *arena, size_t size);
 struct Arena arena_create(size_t size) {
   struct Arena a = { 0 };
 
-  a.block = malloc(size);
+  a.block = UTIL_MALLOC(size);
   assert(a.block != NULL && "Failed to allocate memory");
 
   a.size = size;
@@ -57,14 +59,14 @@ void *arena_alloc(struct Arena *arena, size_t size) {
 }
 
 void arena_resize(struct Arena *arena, size_t size) {
-  arena->block = realloc(arena->block, size);
+  arena->block = UTIL_REALLOC(arena->block, size);
   assert(arena->block != NULL && "Failed to allocate memory");
 
   arena->size = size;
 }
 
 void arena_free(struct Arena *arena) {
-  free(arena->block);
+  UTIL_FREE(arena->block);
   arena->base_offset = 0;
   arena->size = 0;
 }
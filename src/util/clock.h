@@ -0,0 +1,23 @@
+#ifndef UTIL_CLOCK_H
+#define UTIL_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic time in nanoseconds. Only meaningful as a difference.
+static inline uint64_t clk_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline double clk_ns_to_ms(uint64_t ns) {
+  return (double)ns * 1e-6;
+}
+
+static inline double clk_ns_to_s(uint64_t ns) {
+  return (double)ns * 1e-9;
+}
+
+#endif // UTIL_CLOCK_H
@@ -2,6 +2,8 @@
 #ifndef UTIL_DYNAMIC_ARRAY
 #define UTIL_DYNAMIC_ARRAY
 
+#include "alloc.h"
+
 #include <assert.h>
 #include <string.h>
 
@@ -29,38 +31,50 @@
     &(arr).items[(index)];                                    \
   }))
 
-#define DA_APPEND(arr, item)                                            \
-  do {                                                                  \
-    if ((arr)->count >= (arr)->capacity) {                              \
-      (arr)->capacity = (arr)->capacity == 0                            \
-                          ? DA_INIT_CAPACITY                            \
-                          : DA_GROW_FACTOR * (arr)->capacity;           \
-      (arr)->items =                                                    \
-        realloc((arr)->items, (arr)->capacity * sizeof(*(arr)->items)); \
-      assert((arr)->items != NULL && "Failed to allocate memory");      \
-    }                                                                   \
-    (arr)->items[(arr)->count++] = (item);                              \
+#define DA_APPEND(arr, item)                                                 \
+  do {                                                                       \
+    if ((arr)->count >= (arr)->capacity) {                                   \
+      (arr)->capacity = (arr)->capacity == 0                                 \
+                          ? DA_INIT_CAPACITY                                 \
+                          : DA_GROW_FACTOR * (arr)->capacity;                \
+      (arr)->items = UTIL_REALLOC((arr)->items,                              \
+                                  (arr)->capacity * sizeof(*(arr)->items));  \
+      assert((arr)->items != NULL && "Failed to allocate memory");           \
+    }                                                                        \
+    (arr)->items[(arr)->count++] = (item);                                   \
+  } while (0)
+
+#define DA_APPEND_NO_ASSIGN(arr)                                             \
+  do {                                                                       \
+    if ((arr)->count >= (arr)->capacity) {                                   \
+      (arr)->capacity = (arr)->capacity == 0                                 \
+                          ? DA_INIT_CAPACITY                                 \
+                          : DA_GROW_FACTOR * (arr)->capacity;                \
+      (arr)->items = UTIL_REALLOC((arr)->items,                              \
+                                  (arr)->capacity * sizeof(*(arr)->items));  \
+      assert((arr)->items != NULL && "Failed to allocate memory");           \
+    }                                                                        \
+    (arr)->count++;                                                          \
   } while (0)
 
-#define DA_APPEND_NO_ASSIGN(arr)                                        \
-  do {                                                                  \
-    if ((arr)->count >= (arr)->capacity) {                              \
-      (arr)->capacity = (arr)->capacity == 0                            \
-                          ? DA_INIT_CAPACITY                            \
-                          : DA_GROW_FACTOR * (arr)->capacity;           \
-      (arr)->items =                                                    \
-        realloc((arr)->items, (arr)->capacity * sizeof(*(arr)->items)); \
-      assert((arr)->items != NULL && "Failed to allocate memory");      \
-    }                                                                   \
-    (arr)->count++;                                                     \
+// Makes room for at least n items, so appending up to that many never
+// allocates
+#define DA_RESERVE(arr, n)                                                   \
+  do {                                                                       \
+    if ((arr)->capacity < (n)) {                                             \
+      (arr)->capacity = (n);                                                 \
+      (arr)->items = UTIL_REALLOC((arr)->items,                              \
+                                  (arr)->capacity * sizeof(*(arr)->items));  \
+      assert((arr)->items != NULL && "Failed to allocate memory");           \
+    }                                                                        \
   } while (0)
 
-#define DA_FREE(arr)     \
-  do {                   \
-    free((arr)->items);  \
-    (arr)->items = NULL; \
-    (arr)->count = 0;    \
-    (arr)->capacity = 0; \
+#define DA_FREE(arr)         \
+  do {                       \
+    UTIL_FREE((arr)->items); \
+    (arr)->items = NULL;     \
+    (arr)->count = 0;        \
+    (arr)->capacity = 0;     \
   } while (0)
 
 // Does not work if the type is an array
@@ -2,6 +2,8 @@
 #ifndef UTIL_FILE_IO_H
 #define UTIL_FILE_IO_H
 
+#include "alloc.h"
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,7 +11,7 @@
 #include <limits.h>
 #include <stdint.h>
 
-// Compatible with Windows
+// Compatible with Windows. The contents are freed with UTIL_FREE.
 char *fio_read_file(const char *path);
 
 #define UTIL_FILE_IO_IMPLEMENTATION
@@ -28,7 +30,7 @@ char *fio_read_file(const char *path) {
   fstat(fileno(f), &s);
 
   uint64_t size = s.st_size;
-  char *buf = malloc(size + 1);
+  char *buf = UTIL_MALLOC(size + 1);
 
   fread(buf, 1, size, f);
   buf[size] = 0;
@@ -0,0 +1,150 @@
+#ifndef UTIL_MPSC_QUEUE_H
+#define UTIL_MPSC_QUEUE_H
+
+// A bounded queue any number of threads push messages into and one thread
+// drains, without a lock:
+//
+//   // any thread
+//   if (!mpsc_push(&queue, (struct mpsc_Message){ KIND, data })) {
+//     // full, try again later
+//   }
+//
+//   // the consumer, once a frame
+//   struct mpsc_Message batch[16];
+//   uint32_t n = mpsc_drain(&queue, batch, 16);
+//
+// Every cell carries a sequence number saying whose turn it is, so
+// producers only race for the tail, and the consumer never touches it.
+// Messages from one producer come out in the order it pushed them.
+//
+// A producer that has claimed a cell but not yet filled it holds up the
+// messages behind it until it does; the consumer sees the queue as empty
+// up to there instead of waiting.
+
+#include "alloc.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Keeps the producers' tail and the consumer's head on their own cache
+// lines
+#define MPSC_CACHE_LINE 64
+
+struct mpsc_Message {
+  uint32_t kind;
+  void *data;
+};
+
+struct mpsc_Cell {
+  // pos while free for the push at pos, pos + 1 once that push is in
+  _Atomic uint64_t sequence;
+  struct mpsc_Message message;
+};
+
+struct mpsc_Queue {
+  struct mpsc_Cell *cells;
+  uint32_t mask;
+
+  char pad_tail[MPSC_CACHE_LINE];
+  // Next push
+  _Atomic uint64_t tail;
+
+  char pad_head[MPSC_CACHE_LINE];
+  // Next message out, only the consumer touches it
+  uint64_t head;
+
+  char pad_end[MPSC_CACHE_LINE];
+};
+
+// Holds at least capacity messages, rounded up to a power of two.
+static inline void mpsc_init(struct mpsc_Queue *queue, uint32_t capacity) {
+  uint32_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  queue->cells = UTIL_MALLOC(size * sizeof(*queue->cells));
+  assert(queue->cells != NULL && "Failed to allocate memory");
+
+  queue->mask = size - 1;
+  queue->head = 0;
+  atomic_init(&queue->tail, 0);
+
+  for (uint32_t i = 0; i < size; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+    queue->cells[i].message = (struct mpsc_Message){ 0 };
+  }
+}
+
+// No thread may be pushing. Messages still in the queue are dropped as they
+// are; drain them first if they own anything.
+static inline void mpsc_free(struct mpsc_Queue *queue) {
+  UTIL_FREE(queue->cells);
+
+  queue->cells = NULL;
+  queue->mask = 0;
+}
+
+// Any thread. Returns false if the queue is full.
+static inline bool mpsc_push(struct mpsc_Queue *queue,
+                             struct mpsc_Message message) {
+  uint64_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  struct mpsc_Cell *cell;
+
+  for (;;) {
+    cell = &queue->cells[pos & queue->mask];
+
+    uint64_t sequence =
+      atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int64_t diff = (int64_t)(sequence - pos);
+
+    if (diff == 0) {
+      // The cell is free for pos, claim it unless another producer did
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Still holds the message from a lap ago
+      return false;
+    } else {
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+
+  cell->message = message;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+  return true;
+}
+
+// The consumer only. Moves up to max messages to out, oldest first, and
+// returns how many.
+static inline uint32_t mpsc_drain(struct mpsc_Queue *queue,
+                                  struct mpsc_Message *out, uint32_t max) {
+  uint32_t count = 0;
+
+  while (count < max) {
+    uint64_t pos = queue->head;
+    struct mpsc_Cell *cell = &queue->cells[pos & queue->mask];
+
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) !=
+        pos + 1) {
+      break;
+    }
+
+    out[count++] = cell->message;
+
+    // Free again for the push a lap from now
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1,
+                          memory_order_release);
+    queue->head = pos + 1;
+  }
+
+  return count;
+}
+
+#endif // UTIL_MPSC_QUEUE_H
@@ -0,0 +1,423 @@
+#ifndef UTIL_PROFILER_H
+#define UTIL_PROFILER_H
+
+// Scoped timing zones, built with -DPROFILE (make PROFILE=1) and compiled
+// out to nothing otherwise.
+//
+//   void update(void) {
+//     PROF_ZONE("update");
+//     ...
+//   } // the zone ends with the scope
+//
+// Every thread records its zones into its own ring buffer, which only it
+// writes, so recording takes no lock. Once a frame, on the main thread,
+// PROF_FRAME() folds what every thread recorded since into per zone
+// timings over the last PROF_WINDOW frames.
+
+#ifdef PROFILE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Zones kept per thread, for the trace. A power of two.
+#define PROF_RING_SIZE 4096
+
+// Frames the timings are over
+#define PROF_WINDOW 120
+
+#define PROF_MAX_ZONES 64
+#define PROF_THREAD_NAME_MAX 32
+
+struct prof_Event {
+  const char *name;
+  uint64_t begin_ns, end_ns;
+  uint32_t depth;
+};
+
+struct prof_Ring {
+  struct prof_Event events[PROF_RING_SIZE];
+
+  // Events ever recorded. Only the owning thread writes it, after the
+  // event itself.
+  _Atomic uint64_t head;
+
+  // Only the thread calling prof_frame touches it
+  uint64_t read;
+
+  // Zones the owning thread is in
+  uint32_t depth;
+
+  uint32_t id;
+  char name[PROF_THREAD_NAME_MAX];
+
+  struct prof_Ring *next;
+};
+
+struct prof_Zone {
+  struct prof_Ring *ring;
+  const char *name;
+  uint64_t begin_ns;
+};
+
+// Timings of a zone over the window, summed per frame over every thread.
+struct prof_Stats {
+  const char *name;
+
+  // The shallowest the zone was seen nested
+  uint32_t depth;
+
+  double avg_ms, p99_ms;
+  double calls;
+};
+
+struct prof_Zone prof_zone_begin(const char *name);
+void prof_zone_end(struct prof_Zone *zone);
+
+// Names the calling thread in the trace.
+void prof_thread_name(const char *name);
+
+// Folds in every zone that ended since the last call and starts the next
+// frame. Call from one thread only.
+void prof_frame(void);
+
+// Writes the timings of up to max zones to stats, in the order they first
+// began, so zones come before the ones nested in them. Returns how many
+// were written.
+uint32_t prof_stats(struct prof_Stats *stats, uint32_t max);
+
+// Writes the zones still in the rings as Chrome trace_event JSON, for
+// chrome://tracing or Perfetto. Returns false if path cannot be written.
+bool prof_write_trace(const char *path);
+
+// Frees every ring. Nothing may be in a zone, or enter one from another
+// thread, during or after.
+void prof_shutdown(void);
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+
+#define PROF_ZONE(name)                                        \
+  struct prof_Zone PROF_CONCAT(prof_zone_, __LINE__)           \
+    __attribute__((cleanup(prof_zone_end))) =                  \
+      prof_zone_begin(name)
+
+#define PROF_THREAD_NAME(name) prof_thread_name(name)
+#define PROF_FRAME() prof_frame()
+
+//#define UTIL_PROFILER_IMPLEMENTATION
+#ifdef UTIL_PROFILER_IMPLEMENTATION
+
+#include "clock.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+struct prof_ZoneWindow {
+  const char *name;
+  uint32_t depth;
+
+  // When it first began
+  uint64_t first_ns;
+
+  // Of the frame being recorded
+  uint64_t ns;
+  uint32_t calls;
+
+  // Of the last PROF_WINDOW frames, indexed by frame % PROF_WINDOW
+  uint64_t frame_ns[PROF_WINDOW];
+  uint32_t frame_calls[PROF_WINDOW];
+};
+
+static _Atomic(struct prof_Ring *) prof_rings = NULL;
+static _Atomic uint32_t prof_ring_count = 0;
+static _Thread_local struct prof_Ring *prof_ring = NULL;
+
+// When the first ring was made, what trace timestamps count from
+static _Atomic uint64_t prof_epoch_ns = 0;
+
+static struct prof_ZoneWindow prof_zones[PROF_MAX_ZONES];
+static uint32_t prof_zone_count = 0;
+static uint64_t prof_frames = 0;
+
+static struct prof_Ring *prof_thread_ring(void) {
+  if (prof_ring != NULL) {
+    return prof_ring;
+  }
+
+  struct prof_Ring *ring = calloc(1, sizeof(*ring));
+  assert(ring != NULL && "Failed to allocate memory");
+
+  ring->id = atomic_fetch_add(&prof_ring_count, 1);
+  snprintf(ring->name, sizeof(ring->name), "thread %u", ring->id);
+
+  uint64_t epoch = 0;
+  atomic_compare_exchange_strong(&prof_epoch_ns, &epoch, clk_now_ns());
+
+  ring->next = atomic_load(&prof_rings);
+  while (!atomic_compare_exchange_weak(&prof_rings, &ring->next, ring)) {
+  }
+
+  prof_ring = ring;
+  return ring;
+}
+
+struct prof_Zone prof_zone_begin(const char *name) {
+  struct prof_Ring *ring = prof_thread_ring();
+  ring->depth++;
+
+  return (struct prof_Zone){
+    .ring = ring,
+    .name = name,
+    .begin_ns = clk_now_ns(),
+  };
+}
+
+void prof_zone_end(struct prof_Zone *zone) {
+  uint64_t end = clk_now_ns();
+
+  struct prof_Ring *ring = zone->ring;
+  ring->depth--;
+
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ring->events[head & (PROF_RING_SIZE - 1)] = (struct prof_Event){
+    .name = zone->name,
+    .begin_ns = zone->begin_ns,
+    .end_ns = end,
+    .depth = ring->depth,
+  };
+
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void prof_thread_name(const char *name) {
+  struct prof_Ring *ring = prof_thread_ring();
+  snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+// Copies event index of ring to out. Returns false if the owning thread
+// has written over it, or might be.
+static bool prof_read_event(struct prof_Ring *ring, uint64_t index,
+                            struct prof_Event *out) {
+  *out = ring->events[index & (PROF_RING_SIZE - 1)];
+
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  return head - index < PROF_RING_SIZE;
+}
+
+static struct prof_ZoneWindow *prof_find_zone(
+  const struct prof_Event *event) {
+  for (uint32_t i = 0; i < prof_zone_count; i++) {
+    struct prof_ZoneWindow *zone = &prof_zones[i];
+
+    if (zone->name == event->name || strcmp(zone->name, event->name) == 0) {
+      if (event->begin_ns < zone->first_ns) {
+        zone->first_ns = event->begin_ns;
+      }
+      return zone;
+    }
+  }
+
+  if (prof_zone_count == PROF_MAX_ZONES) {
+    return NULL;
+  }
+
+  struct prof_ZoneWindow *zone = &prof_zones[prof_zone_count++];
+  *zone = (struct prof_ZoneWindow){
+    .name = event->name,
+    .depth = UINT32_MAX,
+    .first_ns = event->begin_ns,
+  };
+
+  return zone;
+}
+
+void prof_frame(void) {
+  for (struct prof_Ring *ring = atomic_load(&prof_rings); ring != NULL;
+       ring = ring->next) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    // Whatever fell out of the ring before it was read is lost
+    if (head - ring->read > PROF_RING_SIZE) {
+      ring->read = head - PROF_RING_SIZE;
+    }
+
+    for (; ring->read < head; ring->read++) {
+      struct prof_Event event;
+      if (!prof_read_event(ring, ring->read, &event)) {
+        continue;
+      }
+
+      struct prof_ZoneWindow *zone = prof_find_zone(&event);
+      if (zone == NULL) {
+        continue;
+      }
+
+      zone->ns += event.end_ns - event.begin_ns;
+      zone->calls++;
+      zone->depth = event.depth < zone->depth ? event.depth : zone->depth;
+    }
+  }
+
+  uint32_t slot = prof_frames % PROF_WINDOW;
+  for (uint32_t i = 0; i < prof_zone_count; i++) {
+    prof_zones[i].frame_ns[slot] = prof_zones[i].ns;
+    prof_zones[i].frame_calls[slot] = prof_zones[i].calls;
+    prof_zones[i].ns = 0;
+    prof_zones[i].calls = 0;
+  }
+
+  prof_frames++;
+}
+
+static int prof_compare_ns(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+uint32_t prof_stats(struct prof_Stats *stats, uint32_t max) {
+  uint32_t frames = prof_frames < PROF_WINDOW ? (uint32_t)prof_frames
+                                              : PROF_WINDOW;
+  uint32_t order[PROF_MAX_ZONES];
+  for (uint32_t i = 0; i < prof_zone_count; i++) {
+    uint32_t j = i;
+    for (; j > 0 && prof_zones[order[j - 1]].first_ns > prof_zones[i].first_ns;
+         j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  uint32_t count = prof_zone_count < max ? prof_zone_count : max;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const struct prof_ZoneWindow *zone = &prof_zones[order[i]];
+    stats[i] = (struct prof_Stats){ .name = zone->name, .depth = zone->depth };
+
+    if (frames == 0) {
+      continue;
+    }
+
+    uint64_t sorted[PROF_WINDOW];
+    uint64_t total_ns = 0, total_calls = 0;
+
+    for (uint32_t f = 0; f < frames; f++) {
+      sorted[f] = zone->frame_ns[f];
+      total_ns += zone->frame_ns[f];
+      total_calls += zone->frame_calls[f];
+    }
+    qsort(sorted, frames, sizeof(*sorted), prof_compare_ns);
+
+    // Nearest rank
+    uint32_t p99 = (frames * 99 + 99) / 100;
+
+    stats[i].avg_ms = clk_ns_to_ms(total_ns) / frames;
+    stats[i].p99_ms = clk_ns_to_ms(sorted[p99 - 1]);
+    stats[i].calls = (double)total_calls / frames;
+  }
+
+  return count;
+}
+
+// Writes s as the contents of a JSON string
+static void prof_write_string(FILE *f, const char *s) {
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', f);
+    }
+    if ((unsigned char)*s >= 0x20) {
+      fputc(*s, f);
+    }
+  }
+}
+
+bool prof_write_trace(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR]: Failed to open %s\n", path);
+    return false;
+  }
+
+  uint64_t epoch = atomic_load(&prof_epoch_ns);
+  bool first = true;
+
+  fprintf(f, "{\"traceEvents\":[\n");
+
+  for (struct prof_Ring *ring = atomic_load(&prof_rings); ring != NULL;
+       ring = ring->next) {
+    fprintf(f,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":\"",
+            first ? "" : ",\n", ring->id);
+    prof_write_string(f, ring->name);
+    fprintf(f, "\"}}");
+    first = false;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t begin = head > PROF_RING_SIZE ? head - PROF_RING_SIZE : 0;
+
+    for (uint64_t i = begin; i < head; i++) {
+      struct prof_Event event;
+      if (!prof_read_event(ring, i, &event)) {
+        continue;
+      }
+
+      fprintf(f, ",\n{\"name\":\"");
+      prof_write_string(f, event.name);
+      fprintf(f,
+              "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+              "\"dur\":%.3f}",
+              ring->id, (double)(event.begin_ns - epoch) * 1e-3,
+              (double)(event.end_ns - event.begin_ns) * 1e-3);
+    }
+  }
+
+  fprintf(f, "\n]}\n");
+
+  if (fclose(f) != 0) {
+    fprintf(stderr, "[ERROR]: Failed to write %s\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+void prof_shutdown(void) {
+  struct prof_Ring *ring = atomic_exchange(&prof_rings, NULL);
+
+  while (ring != NULL) {
+    struct prof_Ring *next = ring->next;
+    free(ring);
+    ring = next;
+  }
+
+  prof_ring = NULL;
+  atomic_store(&prof_ring_count, 0);
+  atomic_store(&prof_epoch_ns, 0);
+
+  prof_zone_count = 0;
+  prof_frames = 0;
+}
+
+#endif // UTIL_PROFILER_IMPLEMENTATION
+
+#else
+
+#define PROF_ZONE(name) \
+  do {                  \
+  } while (0)
+#define PROF_THREAD_NAME(name) \
+  do {                         \
+  } while (0)
+#define PROF_FRAME() \
+  do {               \
+  } while (0)
+
+#endif // PROFILE
+
+#endif // UTIL_PROFILER_H
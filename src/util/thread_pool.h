@@ -1,7 +1,9 @@
 #ifndef UTIL_THREAD_POOL_H
 #define UTIL_THREAD_POOL_H
 
+#include "alloc.h"
 #include "dynamic_array.h"
+#include "profiler.h"
 
 #include <pthread.h>
 #include <stdint.h>
@@ -26,9 +28,13 @@ struct tp_ThreadPool {
   pthread_t *pool;
   uint32_t count;
 
+  // Idle workers wait on job_wake until a job is queued or the pool is
+  // freed
   struct {
     DA_TYPE(struct tp_Job) job_queue;
+    bool should_exit;
     pthread_mutex_t job_mutex;
+    pthread_cond_t job_wake;
   };
 
   struct {
@@ -36,14 +42,11 @@ struct tp_ThreadPool {
     pthread_mutex_t handle_counter_mutex;
   };
 
+  // tp_wait_job waits on completed_wake until a job is done
   struct {
     DA_TYPE(struct tp_Job) completed;
     pthread_mutex_t completed_mutex;
-  };
-
-  struct {
-    bool should_exit;
-    pthread_mutex_t should_exit_mutex;
+    pthread_cond_t completed_wake;
   };
 };
 
@@ -64,70 +67,91 @@ void tp_free_pool(struct tp_ThreadPool *pool);
 
 void *tp_worker(void *p) {
   struct tp_ThreadPool *pool = p;
+  PROF_THREAD_NAME("tp_worker");
 
-  bool should_exit;
+  pthread_mutex_lock(&pool->job_mutex);
 
-  do {
-    pthread_mutex_lock(&pool->should_exit_mutex);
-    should_exit = pool->should_exit;
-    pthread_mutex_unlock(&pool->should_exit_mutex);
+  for (;;) {
+    while (!pool->should_exit && pool->job_queue.count == 0) {
+      pthread_cond_wait(&pool->job_wake, &pool->job_mutex);
+    }
 
-    if (should_exit) {
+    if (pool->should_exit) {
       break;
     }
 
-    struct tp_Job job = { 0 };
+    struct tp_Job job = DA_POP(&pool->job_queue, 0);
+    pthread_mutex_unlock(&pool->job_mutex);
+
+    {
+      PROF_ZONE("tp_job");
+      job.out = job.job(job.in);
+    }
+
+    pthread_mutex_lock(&pool->completed_mutex);
+    DA_APPEND(&pool->completed, job);
+    pthread_cond_broadcast(&pool->completed_wake);
+    pthread_mutex_unlock(&pool->completed_mutex);
 
     pthread_mutex_lock(&pool->job_mutex);
+  }
 
-    bool has_job = false;
-    if (pool->job_queue.count != 0) {
-      job = DA_POP(&pool->job_queue, 0);
-      has_job = true;
-    }
+  pthread_mutex_unlock(&pool->job_mutex);
 
-    pthread_mutex_unlock(&pool->job_mutex);
+  return NULL;
+}
 
-    if (has_job) {
-      job.out = job.job(job.in);
+// Stops and joins the first count workers of pool
+static void tp_stop_workers(struct tp_ThreadPool *pool, uint32_t count) {
+  pthread_mutex_lock(&pool->job_mutex);
+  pool->should_exit = true;
+  pthread_cond_broadcast(&pool->job_wake);
+  pthread_mutex_unlock(&pool->job_mutex);
 
-      pthread_mutex_lock(&pool->completed_mutex);
-      DA_APPEND(&pool->completed, job);
-      pthread_mutex_unlock(&pool->completed_mutex);
-    }
+  for (uint32_t i = 0; i < count; i++) {
+    errno = pthread_join(pool->pool[i], NULL);
+  }
+}
 
-  } while (1);
+static void tp_destroy_pool(struct tp_ThreadPool *pool) {
+  UTIL_FREE(pool->pool);
+  DA_FREE(&pool->job_queue);
+  DA_FREE(&pool->completed);
 
-  return NULL;
+  pthread_mutex_destroy(&pool->job_mutex);
+  pthread_cond_destroy(&pool->job_wake);
+  pthread_mutex_destroy(&pool->completed_mutex);
+  pthread_cond_destroy(&pool->completed_wake);
+  pthread_mutex_destroy(&pool->handle_counter_mutex);
+
+  UTIL_FREE(pool);
 }
 
 struct tp_ThreadPool *tp_create_pool(uint32_t num_threads) {
-  struct tp_ThreadPool *pool = calloc(1, sizeof(*pool));
+  struct tp_ThreadPool *pool = UTIL_CALLOC(1, sizeof(*pool));
   assert(pool != NULL && "Failed to allocate memory");
 
   pool->count = num_threads;
-  pool->pool = malloc(pool->count * sizeof(*pool->pool));
+  pool->pool = UTIL_MALLOC(pool->count * sizeof(*pool->pool));
   assert(pool->pool != NULL && "Failed to allocate memory");
 
+  pool->should_exit = false;
   pthread_mutex_init(&pool->job_mutex, NULL);
+  pthread_cond_init(&pool->job_wake, NULL);
+
   pthread_mutex_init(&pool->completed_mutex, NULL);
+  pthread_cond_init(&pool->completed_wake, NULL);
 
   pthread_mutex_init(&pool->handle_counter_mutex, NULL);
 
-  pool->should_exit = false;
-  pthread_mutex_init(&pool->should_exit_mutex, NULL);
-
   for (uint32_t i = 0; i < pool->count; i++) {
     errno = pthread_create(&pool->pool[i], NULL, tp_worker, pool);
     if (errno != 0) {
       fprintf(stderr, "Failed to create thread: %s\n", strerror(errno));
 
-      pthread_mutex_lock(&pool->should_exit_mutex);
-      pool->should_exit = true;
-      pthread_mutex_unlock(&pool->should_exit_mutex);
-
-      free(pool->pool);
-      free(pool);
+      // The workers already running still use the pool
+      tp_stop_workers(pool, i);
+      tp_destroy_pool(pool);
       return NULL;
     }
   }
@@ -148,15 +172,16 @@ tp_JobHandle tp_add_job(struct tp_ThreadPool *pool, tp_JobCallback job,
 
   pthread_mutex_lock(&pool->job_mutex);
   DA_APPEND(&pool->job_queue, j);
+  pthread_cond_signal(&pool->job_wake);
   pthread_mutex_unlock(&pool->job_mutex);
 
   return j.handle;
 }
 
 void *tp_wait_job(struct tp_ThreadPool *pool, tp_JobHandle handle) {
-  for (;;) {
-    pthread_mutex_lock(&pool->completed_mutex);
+  pthread_mutex_lock(&pool->completed_mutex);
 
+  for (;;) {
     for (uint64_t i = 0; i < pool->completed.count; i++) {
       struct tp_Job *j = &DA_AT(pool->completed, i);
 
@@ -170,7 +195,7 @@ void *tp_wait_job(struct tp_ThreadPool *pool, tp_JobHandle handle) {
       }
     }
 
-    pthread_mutex_unlock(&pool->completed_mutex);
+    pthread_cond_wait(&pool->completed_wake, &pool->completed_mutex);
   }
 }
 
@@ -179,24 +204,8 @@ void tp_free_pool(struct tp_ThreadPool *pool) {
     return;
   }
 
-  pthread_mutex_lock(&pool->should_exit_mutex);
-  pool->should_exit = true;
-  pthread_mutex_unlock(&pool->should_exit_mutex);
-
-  for (uint32_t i = 0; i < pool->count; i++) {
-    errno = pthread_join(pool->pool[i], NULL);
-  }
-
-  free(pool->pool);
-  DA_FREE(&pool->job_queue);
-  DA_FREE(&pool->completed);
-
-  pthread_mutex_destroy(&pool->job_mutex);
-  pthread_mutex_destroy(&pool->completed_mutex);
-  pthread_mutex_destroy(&pool->should_exit_mutex);
-  pthread_mutex_destroy(&pool->handle_counter_mutex);
-
-  free(pool);
+  tp_stop_workers(pool, pool->count);
+  tp_destroy_pool(pool);
 }
 
 #endif // UTIL_THREAD_POOL_IMPLEMENTATION
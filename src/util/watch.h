@@ -0,0 +1,152 @@
+#ifndef UTIL_WATCH_H
+#define UTIL_WATCH_H
+
+// Reports files in watched directories that were written, moved in or
+// deleted, without blocking. Directories are watched rather than files, so
+// files replaced by a rename, as linkers and editors do, are still seen.
+// Only implemented on Linux; elsewhere nothing is ever reported.
+
+#include "dynamic_array.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#define WATCH_PATH_MAX 512
+#define WATCH_BUFFER_SIZE 4096
+
+struct watch_Dir {
+  int wd;
+  char path[WATCH_PATH_MAX];
+};
+
+struct watch_Watcher {
+  int fd;
+  DA_TYPE(struct watch_Dir) dirs;
+
+  // Events read but not returned yet
+  size_t length, offset;
+  _Alignas(8) char buffer[WATCH_BUFFER_SIZE];
+};
+
+// Returns false, leaving a watcher that reports nothing, if watching is not
+// supported.
+static inline bool watch_init(struct watch_Watcher *watcher) {
+  watcher->fd = -1;
+  watcher->dirs = (typeof(watcher->dirs)){ 0 };
+  watcher->length = watcher->offset = 0;
+
+#ifdef __linux__
+  watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+  return watcher->fd >= 0;
+}
+
+static inline void watch_free(struct watch_Watcher *watcher) {
+#ifdef __linux__
+  if (watcher->fd >= 0) {
+    close(watcher->fd);
+  }
+#endif
+
+  watcher->fd = -1;
+  DA_FREE(&watcher->dirs);
+}
+
+// Watching the same directory twice is harmless.
+static inline bool watch_add_dir(struct watch_Watcher *watcher,
+                                 const char *dir) {
+#ifdef __linux__
+  if (watcher->fd < 0) {
+    return false;
+  }
+
+  int wd = inotify_add_watch(watcher->fd, dir,
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+  if (wd < 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < watcher->dirs.count; i++) {
+    if (watcher->dirs.items[i].wd == wd) {
+      return true;
+    }
+  }
+
+  struct watch_Dir entry = { .wd = wd };
+  snprintf(entry.path, sizeof(entry.path), "%s", dir);
+  DA_APPEND(&watcher->dirs, entry);
+
+  return true;
+#else
+  (void)watcher;
+  (void)dir;
+  return false;
+#endif
+}
+
+// Writes the path, <dir>/<name>, of the next changed file to path. Changes
+// to files whose path does not fit in size bytes are skipped. Returns false
+// when nothing else has changed.
+static inline bool watch_next(struct watch_Watcher *watcher, char *path,
+                              size_t size) {
+#ifdef __linux__
+  if (watcher->fd < 0) {
+    return false;
+  }
+
+  for (;;) {
+    if (watcher->offset >= watcher->length) {
+      ssize_t length =
+        read(watcher->fd, watcher->buffer, sizeof(watcher->buffer));
+      if (length <= 0) {
+        return false;
+      }
+
+      watcher->length = (size_t)length;
+      watcher->offset = 0;
+    }
+
+    const struct inotify_event *event =
+      (const struct inotify_event *)&watcher->buffer[watcher->offset];
+    watcher->offset += sizeof(*event) + event->len;
+
+    if (event->len == 0) {
+      continue;
+    }
+
+    for (size_t i = 0; i < watcher->dirs.count; i++) {
+      if (watcher->dirs.items[i].wd != event->wd) {
+        continue;
+      }
+
+      const char *dir = watcher->dirs.items[i].path;
+      int written = snprintf(path, size, "%s/%s", dir, event->name);
+      if (written >= 0 && (size_t)written < size) {
+        return true;
+      }
+
+      // A cut off path could name another file
+      fprintf(stderr, "[WARNING]: Ignoring %s/%s, the path is too long\n",
+              dir, event->name);
+      break;
+    }
+  }
+#else
+  (void)watcher;
+  (void)path;
+  (void)size;
+  return false;
+#endif
+}
+
+#endif // UTIL_WATCH_H